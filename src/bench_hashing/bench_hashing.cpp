@@ -0,0 +1,264 @@
+#include <small_utils/utils_sha1.h>
+#include <small_utils/utils_sha256.h>
+#include <small_utils/utils_bytes.h>
+
+#include <benchmark/benchmark.h>
+
+#include <chrono>
+#include <memory>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <cstdint>
+#include <cstring>
+
+// Piece hashing throughput: every SHA1 backend the CPU supports, plus
+// what GetSHA1()/GetSHA1Many() dispatch to (should match the best one)
+// and BitTorrent v2 SHA-256 merkle hashing; for piece sizes of 16 KiB..16 MiB.
+// "hot" hashes the same data again and again (from the cache, as
+// when blocks are hashed right after they're received); "cold" walks
+// over a buffer bigger than the last level cache (as recheck does).
+//
+// E.g.: bench_hashing --benchmark_filter=SHA1/ --benchmark_out=sha1.json
+
+namespace
+{
+    const std::size_t k_min_piece_size = 16 * 1024;
+    const std::size_t k_max_piece_size = 16 * 1024 * 1024;
+    // Buffers hashed at once by the multi-buffer benchmarks;
+    // lanes of the widest backend (AVX2_x8).
+    const std::size_t k_multi_count = 8;
+    // Bigger than the last level cache; fits 2 sets of the biggest
+    // multi-buffer pieces, so consecutive iterations use different memory.
+    const std::size_t k_cold_bytes = 2 * k_multi_count * k_max_piece_size;
+
+    enum class Cache
+    {
+        Hot,
+        Cold,
+    };
+
+    const char* GetBackendName(SHA1Backend backend)
+    {
+        switch (backend)
+        {
+        case SHA1Backend::Scalar:  return "Scalar";
+        case SHA1Backend::SHA_NI:  return "SHA_NI";
+        case SHA1Backend::AVX2_x8: return "AVX2_x8";
+        }
+        return "<unknown>";
+    }
+
+    const char* GetCacheName(Cache cache)
+    {
+        return ((cache == Cache::Hot) ? "hot" : "cold");
+    }
+
+    std::string GetSizeName(std::size_t size)
+    {
+        if (size >= (1024 * 1024))
+        {
+            return std::to_string(size / (1024 * 1024)) + "MiB";
+        }
+        return std::to_string(size / 1024) + "KiB";
+    }
+
+    using Clock = std::chrono::steady_clock;
+
+    // Random bytes, allocated on first use.
+    const std::uint8_t* GetData()
+    {
+        static const std::unique_ptr<std::uint8_t[]> data = []()
+        {
+            auto bytes = std::make_unique<std::uint8_t[]>(k_cold_bytes);
+            std::mt19937_64 random(42);
+            for (std::size_t i = 0; i < k_cold_bytes; i += sizeof(std::uint64_t))
+            {
+                const std::uint64_t v = random();
+                std::memcpy(&bytes[i], &v, sizeof(v));
+            }
+            return bytes;
+        }();
+        return data.get();
+    }
+
+    // `count` adjacent buffers of `size` to hash at the `iteration`.
+    // `data` is GetData().
+    void GetBuffers(const std::uint8_t* data, Cache cache
+        , std::size_t size, std::size_t count, std::uint64_t iteration
+        , std::vector<std::string_view>& buffers)
+    {
+        const std::size_t span = (size * count);
+        const std::size_t slots = (k_cold_bytes / span);
+        const std::size_t offset = ((cache == Cache::Hot) ? 0 : ((iteration % slots) * span));
+        const char* start = reinterpret_cast<const char*>(data) + offset;
+        buffers.clear();
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            buffers.emplace_back(start + (i * size), size);
+        }
+    }
+
+    // "GB" (per second) and "cycles_per_byte" counters.
+    // `start` - right before the benchmark loop.
+    void SetThroughput(benchmark::State& state, std::uint64_t bytes_per_iteration
+        , Clock::time_point start)
+    {
+        const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+        const double bytes = double(bytes_per_iteration) * double(state.iterations());
+        state.SetBytesProcessed(std::int64_t(bytes));
+        state.counters["GB"] = benchmark::Counter(bytes / 1e9, benchmark::Counter::kIsRate);
+        state.counters["cycles_per_byte"] = ((bytes > 0)
+            ? (seconds * benchmark::CPUInfo::Get().cycles_per_second / bytes)
+            : 0);
+    }
+
+    // Backend of the single buffer benchmark; none - GetSHA1() dispatch.
+    void BM_SHA1(benchmark::State& state, const SHA1Backend* backend
+        , Cache cache, std::size_t size)
+    {
+        std::vector<std::string_view> buffers;
+        const std::uint8_t* data = GetData();
+        std::uint64_t iteration = 0;
+        const Clock::time_point start = Clock::now();
+        for (auto _ : state)
+        {
+            GetBuffers(data, cache, size, 1, iteration++, buffers);
+            const SHA1Bytes digest = (backend
+                ? GetSHA1(*backend, buffers.data(), 1)
+                : GetSHA1(buffers[0]));
+            benchmark::DoNotOptimize(digest);
+        }
+        SetThroughput(state, size, start);
+    }
+
+    void BM_SHA1Many(benchmark::State& state, const SHA1Backend* backend
+        , Cache cache, std::size_t size)
+    {
+        std::vector<std::string_view> buffers;
+        SHA1Bytes digests[k_multi_count];
+        const std::uint8_t* data = GetData();
+        std::uint64_t iteration = 0;
+        const Clock::time_point start = Clock::now();
+        for (auto _ : state)
+        {
+            GetBuffers(data, cache, size, k_multi_count, iteration++, buffers);
+            if (backend)
+            {
+                GetSHA1Many(*backend, buffers.data(), digests, k_multi_count);
+            }
+            else
+            {
+                GetSHA1Many(buffers.data(), digests, k_multi_count);
+            }
+            benchmark::DoNotOptimize(digests);
+        }
+        SetThroughput(state, size * k_multi_count, start);
+    }
+
+    void BM_SHA256(benchmark::State& state, Cache cache, std::size_t size)
+    {
+        std::vector<std::string_view> buffers;
+        const std::uint8_t* data = GetData();
+        std::uint64_t iteration = 0;
+        const Clock::time_point start = Clock::now();
+        for (auto _ : state)
+        {
+            GetBuffers(data, cache, size, 1, iteration++, buffers);
+            const SHA256Bytes digest = GetSHA256(buffers[0]);
+            benchmark::DoNotOptimize(digest);
+        }
+        SetThroughput(state, size, start);
+    }
+
+    // BitTorrent v2 piece: SHA-256 of every 16 KiB block and the root.
+    void BM_Merkle(benchmark::State& state, Cache cache, std::size_t size)
+    {
+        std::vector<std::string_view> buffers;
+        std::vector<SHA256Bytes> leaves;
+        const std::uint8_t* data = GetData();
+        std::uint64_t iteration = 0;
+        const Clock::time_point start = Clock::now();
+        for (auto _ : state)
+        {
+            GetBuffers(data, cache, size, 1, iteration++, buffers);
+            leaves.clear();
+            GetMerkleLeaves(reinterpret_cast<const std::uint8_t*>(buffers[0].data())
+                , buffers[0].size(), leaves);
+            const SHA256Bytes root = GetMerkleRoot(leaves.data(), leaves.size()
+                , GetMerkleWidth(leaves.size()));
+            benchmark::DoNotOptimize(root);
+        }
+        SetThroughput(state, size, start);
+    }
+
+    void RegisterAll()
+    {
+        static const SHA1Backend k_backends[] =
+        {
+            SHA1Backend::Scalar,
+            SHA1Backend::SHA_NI,
+            SHA1Backend::AVX2_x8,
+        };
+        for (Cache cache : {Cache::Hot, Cache::Cold})
+        {
+            for (std::size_t size = k_min_piece_size; size <= k_max_piece_size; size *= 4)
+            {
+                const std::string suffix = std::string("/") + GetCacheName(cache) + "/" + GetSizeName(size);
+                for (const SHA1Backend& backend : k_backends)
+                {
+                    if (!IsSHA1BackendSupported(backend))
+                    {
+                        continue;
+                    }
+                    const std::string name = GetBackendName(backend) + suffix;
+                    if (backend != SHA1Backend::AVX2_x8)
+                    {
+                        // Multi-buffer only.
+                        benchmark::RegisterBenchmark(("SHA1/" + name).c_str()
+                            , BM_SHA1, &backend, cache, size);
+                    }
+                    benchmark::RegisterBenchmark(("SHA1Many/" + name).c_str()
+                        , BM_SHA1Many, &backend, cache, size);
+                }
+                benchmark::RegisterBenchmark(("SHA1/Dispatch" + suffix).c_str()
+                    , BM_SHA1, nullptr, cache, size);
+                benchmark::RegisterBenchmark(("SHA1Many/Dispatch" + suffix).c_str()
+                    , BM_SHA1Many, nullptr, cache, size);
+                benchmark::RegisterBenchmark(("SHA256" + suffix).c_str()
+                    , BM_SHA256, cache, size);
+                benchmark::RegisterBenchmark(("Merkle" + suffix).c_str()
+                    , BM_Merkle, cache, size);
+            }
+        }
+    }
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv))
+    {
+        return 1;
+    }
+    // In the report context, so a dispatch change shows up with the numbers.
+    std::string supported;
+    for (SHA1Backend backend : {SHA1Backend::Scalar, SHA1Backend::SHA_NI, SHA1Backend::AVX2_x8})
+    {
+        if (IsSHA1BackendSupported(backend))
+        {
+            supported += (supported.empty() ? "" : ",");
+            supported += GetBackendName(backend);
+        }
+    }
+    benchmark::AddCustomContext("sha1_backends", supported);
+    benchmark::AddCustomContext("sha1_dispatch", GetBackendName(GetSHA1Backend()));
+    benchmark::AddCustomContext("sha1_lanes", std::to_string(GetSHA1Lanes()));
+
+    RegisterAll();
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
@@ -51,9 +51,13 @@ namespace be
         MissingMultiFileProperty,
         EmptyMultiFile,
         MissingInfoProperty,
+        InvalidFileTree,
+        InvalidPiecesRoot,
+        InvalidPieceLayers,
 
         Impl_InvalidInvariant = 300, // Tracker response parsing errors.
         InvalidPeersBlobLength,
         MissingRequiredProperty,
+        InvalidScrapeInfoHash,
     };
 } // namespace be
@@ -2,9 +2,11 @@
 #include <bencoding/be_element_ref.h>
 #include <bencoding/be_errors.h>
 
+#include <map>
 #include <string>
 #include <string_view>
 #include <variant>
+#include <vector>
 
 #include <cstdint>
 #include <cstring>
@@ -24,6 +26,21 @@ namespace be
         {
             std::uint64_t length_bytes_ = 0; // 'length'.
             std::string path_utf8_; // 'path'.
+            // See "Padding files and extended file attributes":
+            // https://www.bittorrent.org/beps/bep_0047.html
+            // Set of single-letter flags ('p' - padding file), if any.
+            std::string attr_; // 'attr'.
+            // BitTorrent v2 (BEP 52): root of the merkle tree of the file
+            // 16 KiB blocks (SHA-256, 32 bytes). Empty for v1 torrents
+            // and for empty files.
+            std::vector<std::uint8_t> pieces_root_; // 'pieces root'.
+
+            // Padding file content is all zeros; it is never downloaded
+            // nor written to the disk.
+            bool is_padding() const
+            {
+                return (attr_.find('p') != std::string::npos);
+            }
         };
 
         using LengthOrFiles = std::variant<std::monostate
@@ -48,9 +65,20 @@ namespace be
 
             // String subdivided into strings of *length 20*,
             // each of which is the SHA1 hash of the piece at the corresponding index.
+            // Empty for v2-only torrents.
             std::vector<std::uint8_t> pieces_SHA1_; // 'pieces'.
 
+            // For v2-only torrents, built from the `file_tree_`: files
+            // are aligned to the pieces with padding files, as in
+            // hybrid torrents, so the v1 layout works for both.
             LengthOrFiles length_or_files_; // 'length' or 'files'.
+
+            // See "The BitTorrent Protocol Specification v2":
+            // https://www.bittorrent.org/beps/bep_0052.html
+            // 2 for v2 and hybrid torrents.
+            std::uint64_t meta_version_ = 1; // 'meta version'.
+            // Files of the 'file tree', in its order, with '/'-joined paths.
+            std::vector<File> file_tree_; // 'file tree'.
         };
 
         Info info_; // 'info'.
@@ -66,6 +94,15 @@ namespace be
       
         std::string tracker_url_utf8_; // 'announce'.
         MultitrackersList multi_trackers_; // 'announce-list'.
+
+        // BitTorrent v2: File::pieces_root_ to the hashes of the file
+        // pieces (32 bytes each; roots of the piece-sized subtrees).
+        // Files of a single piece or less have no entry.
+        std::map<std::vector<std::uint8_t>, std::vector<std::uint8_t>>
+            piece_layers_; // 'piece layers'.
+
+        bool has_v1() const { return !info_.pieces_SHA1_.empty(); }
+        bool has_v2() const { return (info_.meta_version_ == 2); }
     };
 
     struct TorrentFileInfo
@@ -73,7 +110,8 @@ namespace be
         TorrentMetainfo metainfo_;
 
         // [start; end) of 'info' in the parsed `content`.
-        // Do SHA1 to get torrent **info_hash**.
+        // Do SHA1 to get torrent **info_hash**
+        // (SHA-256 for the v2 one).
         ElementPosition info_position_;
     };
 } // namespace be
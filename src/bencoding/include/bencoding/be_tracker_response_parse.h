@@ -15,6 +15,11 @@ namespace be
     outcome::result<TrackerResponse>
         ParseTrackerCompactResponseContent(std::string_view content);
 
+    struct ScrapeResponse;
+    // https://www.bittorrent.org/beps/bep_0048.html
+    outcome::result<ScrapeResponse>
+        ParseTrackerScrapeResponseContent(std::string_view content);
+
     struct PeerAddress
     {
         // Network (big-endian) order.
@@ -39,4 +44,26 @@ namespace be
             , OnSuccess
             , OnError> data_;
     };
+
+    struct ScrapeResponse
+    {
+        struct File
+        {
+            // 20 bytes, as is.
+            std::string info_hash_;
+            std::uint64_t complete_ = 0;   // Seeders.
+            std::uint64_t downloaded_ = 0; // Completed downloads, ever.
+            std::uint64_t incomplete_ = 0; // Leechers.
+        };
+        struct OnSuccess
+        {
+            // Torrents the tracker knows about, in any order.
+            std::vector<File> files_;
+        };
+        using OnError = TrackerResponse::OnError;
+
+        std::variant<std::monostate
+            , OnSuccess
+            , OnError> data_;
+    };
 } // namespace be
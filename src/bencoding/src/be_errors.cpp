@@ -46,10 +46,14 @@ namespace
         case E::MissingMultiFileProperty      : return "MissingMultiFileProperty";
         case E::EmptyMultiFile                : return "EmptyMultiFile";
         case E::MissingInfoProperty           : return "MissingInfoProperty";
+        case E::InvalidFileTree               : return "InvalidFileTree";
+        case E::InvalidPiecesRoot             : return "InvalidPiecesRoot";
+        case E::InvalidPieceLayers            : return "InvalidPieceLayers";
 
         case E::Impl_InvalidInvariant         : return "Impl_InvalidInvariant";
         case E::InvalidPeersBlobLength        : return "InvalidPeersBlobLength";
         case E::MissingRequiredProperty       : return "MissingRequiredProperty";
+        case E::InvalidScrapeInfoHash         : return "InvalidScrapeInfoHash";
         }
         return "<unknown>";
     }
@@ -2,11 +2,19 @@
 #include <bencoding/be_element_ref_parse.h>
 #include <bencoding/be_parse_utils.h>
 
+#include <algorithm>
+#include <map>
+
 #include <cassert>
 
 namespace be
 {
     const std::size_t k_SHA1_length = 20;
+    const std::size_t k_SHA256_length = 32;
+    // BEP 52: merkle tree leaves are 16 KiB blocks.
+    const std::uint64_t k_merkle_block_size = 16 * 1024;
+    // Nesting of 'file tree' directories.
+    const int k_max_file_tree_depth = 64;
 
     struct KeyParser
     {
@@ -199,6 +207,7 @@ namespace be
             OUTCOME_TRY(DictionaryRef* data, be::ElementRefAs<DictionaryRef>(e));
             ElementRef* length = nullptr;
             ElementRef* path = nullptr;
+            ElementRef* attr = nullptr;
             for (auto& [name, element] : *data)
             {
                 if ((name == "length") && !length)
@@ -209,12 +218,23 @@ namespace be
                 {
                     path = &element;
                 }
+                else if ((name == "attr") && !attr)
+                {
+                    attr = &element;
+                }
             }
             if (!length || !path)
             {
                 return outcome::failure(ParseErrorc::MissingMultiFileProperty);
             }
-            return ParseInfo_FilesFile(*length, *path);
+            OUTCOME_TRY(TorrentMetainfo::File file, ParseInfo_FilesFile(*length, *path));
+            if (attr)
+            {
+                // Optional, BEP 47.
+                OUTCOME_TRY(const StringRef* flags, be::ElementRefAs<StringRef>(*attr));
+                file.attr_.assign(flags->data(), flags->size());
+            }
+            return outcome::success(std::move(file));
         };
 
         std::vector<TorrentMetainfo::File> files;
@@ -234,6 +254,190 @@ namespace be
         return outcome::success();
     }
 
+    static outcome::result<void> ParseInfo_MetaVersion(TorrentMetainfo& metainfo, ElementRef& version)
+    {
+        OUTCOME_TRY(IntegerRef* n, be::ElementRefAs<IntegerRef>(version));
+        OUTCOME_TRY(std::uint64_t meta_version, ParseAsUint64(*n));
+        metainfo.info_.meta_version_ = meta_version;
+        return outcome::success();
+    }
+
+    static outcome::result<TorrentMetainfo::File> ParseFileTreeFile(ElementRef& properties)
+    {
+        OUTCOME_TRY(DictionaryRef* data, be::ElementRefAs<DictionaryRef>(properties));
+        ElementRef* length = nullptr;
+        ElementRef* pieces_root = nullptr;
+        for (auto& [name, element] : *data)
+        {
+            if ((name == "length") && !length)
+            {
+                length = &element;
+            }
+            else if ((name == "pieces root") && !pieces_root)
+            {
+                pieces_root = &element;
+            }
+        }
+        if (!length)
+        {
+            return outcome::failure(ParseErrorc::MissingMultiFileProperty);
+        }
+        OUTCOME_TRY(be::IntegerRef* n, be::ElementRefAs<be::IntegerRef>(*length));
+        OUTCOME_TRY(std::uint64_t length_bytes, ParseAsUint64(*n));
+        TorrentMetainfo::File file;
+        file.length_bytes_ = length_bytes;
+        if (file.length_bytes_ == 0)
+        {
+            // Empty files have no blocks, hence no root.
+            return outcome::success(std::move(file));
+        }
+        if (!pieces_root)
+        {
+            return outcome::failure(ParseErrorc::InvalidPiecesRoot);
+        }
+        OUTCOME_TRY(const StringRef* root, be::ElementRefAs<StringRef>(*pieces_root));
+        if (root->size() != k_SHA256_length)
+        {
+            return outcome::failure(ParseErrorc::InvalidPiecesRoot);
+        }
+        file.pieces_root_.assign(AsConstData(*root), AsConstData(*root) + root->size());
+        return outcome::success(std::move(file));
+    }
+
+    // Directory: {name: node, ...}; file: {"": {properties}}.
+    static outcome::result<void> ParseFileTreeNode(std::vector<TorrentMetainfo::File>& files
+        , std::string& path, ElementRef& node, int depth)
+    {
+        OUTCOME_TRY(DictionaryRef* data, be::ElementRefAs<DictionaryRef>(node));
+        if (data->empty() || (depth > k_max_file_tree_depth))
+        {
+            return outcome::failure(ParseErrorc::InvalidFileTree);
+        }
+        for (auto& [name, element] : *data)
+        {
+            if (name.empty())
+            {
+                if (path.empty() || (data->size() != 1))
+                {
+                    // File at the root or file and directory at once.
+                    return outcome::failure(ParseErrorc::InvalidFileTree);
+                }
+                OUTCOME_TRY(TorrentMetainfo::File file, ParseFileTreeFile(element));
+                file.path_utf8_ = path;
+                files.push_back(std::move(file));
+                continue;
+            }
+            const std::size_t parent_size = path.size();
+            if (!path.empty())
+            {
+                path += '/';
+            }
+            path.append(AsConstData(name), name.size());
+            OUTCOME_TRY(ParseFileTreeNode(files, path, element, depth + 1));
+            path.resize(parent_size);
+        }
+        return outcome::success();
+    }
+
+    static outcome::result<void> ParseInfo_FileTree(TorrentMetainfo& metainfo, ElementRef& file_tree)
+    {
+        std::vector<TorrentMetainfo::File> files;
+        std::string path;
+        OUTCOME_TRY(ParseFileTreeNode(files, path, file_tree, 0));
+        files.shrink_to_fit();
+        metainfo.info_.file_tree_ = std::move(files);
+        return outcome::success();
+    }
+
+    // v2-only torrent: same layout as the hybrid one would have,
+    // every file starts at the piece boundary.
+    static void MakeV1FilesFromFileTree(TorrentMetainfo::Info& info)
+    {
+        const std::vector<TorrentMetainfo::File>& tree = info.file_tree_;
+        if ((tree.size() == 1) && (tree[0].path_utf8_ == info.suggested_name_utf8_))
+        {
+            info.length_or_files_.emplace<1>(tree[0].length_bytes_);
+            return;
+        }
+        std::vector<TorrentMetainfo::File> files;
+        files.reserve(tree.size() * 2);
+        for (std::size_t i = 0; i < tree.size(); ++i)
+        {
+            files.push_back(tree[i]);
+            const std::uint64_t tail = (tree[i].length_bytes_ % info.piece_length_bytes_);
+            if ((tail == 0) || ((i + 1) == tree.size()))
+            {
+                continue;
+            }
+            TorrentMetainfo::File padding;
+            padding.length_bytes_ = (info.piece_length_bytes_ - tail);
+            padding.path_utf8_ = ".pad/" + std::to_string(padding.length_bytes_);
+            padding.attr_ = "p";
+            files.push_back(std::move(padding));
+        }
+        info.length_or_files_.emplace<2>(std::move(files));
+    }
+
+    // Hybrid torrent: v1 files get 'pieces root' of the same v2 file.
+    static outcome::result<void> MatchV1FilesToFileTree(TorrentMetainfo::Info& info)
+    {
+        const std::vector<TorrentMetainfo::File>& tree = info.file_tree_;
+        if (const std::uint64_t* single_file = std::get_if<std::uint64_t>(&info.length_or_files_))
+        {
+            if ((tree.size() != 1) || (tree[0].length_bytes_ != *single_file))
+            {
+                return outcome::failure(ParseErrorc::InvalidFileTree);
+            }
+            return outcome::success();
+        }
+        std::map<std::string_view, const TorrentMetainfo::File*> by_path;
+        for (const TorrentMetainfo::File& file : tree)
+        {
+            by_path[file.path_utf8_] = &file;
+        }
+        auto& files = std::get<std::vector<TorrentMetainfo::File>>(info.length_or_files_);
+        for (TorrentMetainfo::File& file : files)
+        {
+            if (file.is_padding())
+            {
+                continue;
+            }
+            auto it = by_path.find(file.path_utf8_);
+            if ((it == by_path.end()) || (it->second->length_bytes_ != file.length_bytes_))
+            {
+                return outcome::failure(ParseErrorc::InvalidFileTree);
+            }
+            file.pieces_root_ = it->second->pieces_root_;
+        }
+        return outcome::success();
+    }
+
+    static outcome::result<void> ParseInfoV2(TorrentMetainfo::Info& info)
+    {
+        const std::uint64_t piece_length = info.piece_length_bytes_;
+        if ((piece_length < k_merkle_block_size)
+            || ((piece_length & (piece_length - 1)) != 0))
+        {
+            // Piece is a subtree of the merkle tree.
+            return outcome::failure(ParseErrorc::InvalidInvariant);
+        }
+        if (info.file_tree_.empty())
+        {
+            return outcome::failure(ParseErrorc::InvalidFileTree);
+        }
+        if (info.length_or_files_.index() != 0)
+        {
+            return MatchV1FilesToFileTree(info);
+        }
+        if (!info.pieces_SHA1_.empty())
+        {
+            // Hybrid without the v1 files.
+            return outcome::failure(ParseErrorc::MissingMultiFileProperty);
+        }
+        MakeV1FilesFromFileTree(info);
+        return outcome::success();
+    }
+
     static outcome::result<void> ParseInfo(TorrentMetainfo& metainfo, ElementRef& info)
     {
         OUTCOME_TRY(DictionaryRef* data, be::ElementRefAs<DictionaryRef>(info));
@@ -245,17 +449,23 @@ namespace be
             {"pieces",       &ParseInfo_Pieces,      false, nullptr},
             {"length",       &ParseInfo_Length,      false, nullptr},
             {"files",        &ParseInfo_Files,       false, nullptr},
+            {"meta version", &ParseInfo_MetaVersion, false, nullptr},
+            {"file tree",    &ParseInfo_FileTree,    false, nullptr},
         };
 
         for (auto& [name, element] : *data)
         {
             OUTCOME_TRY(InvokeParserOptionalKey(metainfo, k_parsers, name, element))
         }
+        if (metainfo.has_v2())
+        {
+            OUTCOME_TRY(ParseInfoV2(metainfo.info_));
+        }
 
         if ((metainfo.tracker_url_utf8_.size() > 0)
             && (metainfo.info_.piece_length_bytes_ > 0)
             // if exists, guarantees to be divisible by 20.
-            && (metainfo.info_.pieces_SHA1_.size() > 0)
+            && ((metainfo.info_.pieces_SHA1_.size() > 0) || metainfo.has_v2())
             // either 'length' or 'files' should be in place.
             && (metainfo.info_.length_or_files_.index() != 0))
         {
@@ -265,6 +475,25 @@ namespace be
         return outcome::failure(ParseErrorc::InvalidInvariant);
     }
 
+    static outcome::result<void> ParsePieceLayers(TorrentMetainfo& metainfo, ElementRef& piece_layers)
+    {
+        OUTCOME_TRY(DictionaryRef* data, be::ElementRefAs<DictionaryRef>(piece_layers));
+        for (auto& [root, element] : *data)
+        {
+            OUTCOME_TRY(const StringRef* hashes, be::ElementRefAs<StringRef>(element));
+            if ((root.size() != k_SHA256_length)
+                || hashes->empty()
+                || ((hashes->size() % k_SHA256_length) != 0))
+            {
+                return outcome::failure(ParseErrorc::InvalidPieceLayers);
+            }
+            std::vector<std::uint8_t> key(AsConstData(root), AsConstData(root) + root.size());
+            metainfo.piece_layers_[std::move(key)].assign(
+                AsConstData(*hashes), AsConstData(*hashes) + hashes->size());
+        }
+        return outcome::success();
+    }
+
     outcome::result<TorrentFileInfo> ParseTorrentFileContent(std::string_view content)
     {
         OUTCOME_TRY(DictionaryRef data, ParseDictionary(content));
@@ -276,6 +505,7 @@ namespace be
             {"announce",      &ParseAnnounce,     false, &announce_position},
             {"info",          &ParseInfo,         false, &info_position},
             {"announce-list", &ParseAnnounceList, false, nullptr},
+            {"piece layers",  &ParsePieceLayers,  false, nullptr},
         };
 
         TorrentMetainfo metainfo;
@@ -119,4 +119,77 @@ namespace be
         }
         return response;
     }
+
+    static outcome::result<void> ParseScrapeFile(std::string_view info_hash
+        , ElementRef& stats
+        , ScrapeResponse::File& file)
+    {
+        if (info_hash.size() != 20)
+        {
+            return outcome::failure(ParseErrorc::InvalidScrapeInfoHash);
+        }
+        OUTCOME_TRY(DictionaryRef* data, be::ElementRefAs<DictionaryRef>(stats));
+        file.info_hash_.assign(info_hash.data(), info_hash.size());
+        for (auto& [name, element] : *data)
+        {
+            std::uint64_t* value = nullptr;
+            if (name == "complete")
+            {
+                value = &file.complete_;
+            }
+            else if (name == "downloaded")
+            {
+                value = &file.downloaded_;
+            }
+            else if (name == "incomplete")
+            {
+                value = &file.incomplete_;
+            }
+            else
+            {
+                // 'name' and others, unused.
+                continue;
+            }
+            OUTCOME_TRY(IntegerRef* n, be::ElementRefAs<IntegerRef>(element));
+            OUTCOME_TRY(std::uint64_t v, ParseAsUint64(*n));
+            *value = v;
+        }
+        return outcome::success();
+    }
+
+    outcome::result<ScrapeResponse>
+        ParseTrackerScrapeResponseContent(std::string_view content)
+    {
+        OUTCOME_TRY(DictionaryRef data, ParseDictionary(content));
+
+        ScrapeResponse response;
+        for (auto& [name, element] : data)
+        {
+            if (name == "failure reason")
+            {
+                OUTCOME_TRY(StringRef* str, be::ElementRefAs<StringRef>(element));
+                ScrapeResponse::OnError error;
+                error.error_.assign(AsConstData(*str), str->size());
+                response.data_ = std::move(error);
+                return response;
+            }
+            if (name == "files")
+            {
+                OUTCOME_TRY(DictionaryRef* files, be::ElementRefAs<DictionaryRef>(element));
+                ScrapeResponse::OnSuccess success;
+                success.files_.reserve(files->size());
+                for (auto& [info_hash, stats] : *files)
+                {
+                    OUTCOME_TRY(ParseScrapeFile(info_hash, stats, success.files_.emplace_back()));
+                }
+                response.data_ = std::move(success);
+            }
+        }
+
+        if (response.data_.index() == 0)
+        {
+            return outcome::failure(ParseErrorc::MissingRequiredProperty);
+        }
+        return response;
+    }
 } // namespace be
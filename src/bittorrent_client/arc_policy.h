@@ -0,0 +1,183 @@
+#pragma once
+#include <algorithm>
+#include <list>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+#include <cstdint>
+#include <cassert>
+
+// Adaptive Replacement Cache (N. Megiddo, D. Modha) of piece indices.
+// T1 - pieces seen once recently, T2 - at least twice; B1/B2 - ghosts,
+// recently evicted from T1/T2. Hits in the ghosts adapt the target size
+// of T1 (`p_`), so both one-time scans (new peer downloads everything)
+// and popular pieces (new release) are handled.
+class ArcPolicy
+{
+public:
+    explicit ArcPolicy(std::size_t capacity)
+        : capacity_(capacity)
+    {
+        assert((capacity_ > 0) && "Budget is less than a piece; don't cache.");
+    }
+
+    enum class List { T1, T2, B1, B2 };
+
+    bool is_resident(std::uint32_t piece_index) const
+    {
+        auto it = nodes_.find(piece_index);
+        return (it != nodes_.end())
+            && ((it->second.list_ == List::T1) || (it->second.list_ == List::T2));
+    }
+
+    // Resident piece is used again. Read ahead piece, requested
+    // for the first time, is not "used twice": it stays in T1.
+    void on_hit(std::uint32_t piece_index, bool first_use)
+    {
+        assert(is_resident(piece_index));
+        Node& node = nodes_[piece_index];
+        move_to(piece_index, node, first_use ? node.list_ : List::T2);
+    }
+
+    // Makes `piece_index` resident. Pieces that are not resident
+    // anymore are added to `evicted`.
+    void insert(std::uint32_t piece_index, std::vector<std::uint32_t>& evicted)
+    {
+        assert(!is_resident(piece_index));
+        auto it = nodes_.find(piece_index);
+        if (it != nodes_.end())
+        {
+            Node& node = it->second;
+            if (node.list_ == List::B1)
+            {
+                const std::size_t delta = std::max<std::size_t>(1, b2_.size() / b1_.size());
+                p_ = std::min(capacity_, p_ + delta);
+                replace(false/*in_b2*/, evicted);
+            }
+            else
+            {
+                assert(node.list_ == List::B2);
+                const std::size_t delta = std::max<std::size_t>(1, b1_.size() / b2_.size());
+                p_ -= std::min(p_, delta);
+                replace(true/*in_b2*/, evicted);
+            }
+            move_to(piece_index, node, List::T2);
+            return;
+        }
+
+        const std::size_t l1 = (t1_.size() + b1_.size());
+        const std::size_t total = (l1 + t2_.size() + b2_.size());
+        if (l1 >= capacity_)
+        {
+            if (t1_.size() < capacity_)
+            {
+                forget(b1_.front());
+                replace(false/*in_b2*/, evicted);
+            }
+            else
+            {
+                evicted.push_back(t1_.front());
+                forget(t1_.front());
+            }
+        }
+        else if (total >= capacity_)
+        {
+            if (total >= (2 * capacity_))
+            {
+                forget(b2_.front());
+            }
+            replace(false/*in_b2*/, evicted);
+        }
+        Node& node = nodes_[piece_index];
+        node.list_ = List::T1;
+        node.it_ = t1_.insert(t1_.end(), piece_index);
+    }
+
+    // Piece data changed; forget about it completely.
+    void erase(std::uint32_t piece_index)
+    {
+        auto it = nodes_.find(piece_index);
+        if (it != nodes_.end())
+        {
+            forget(piece_index);
+        }
+    }
+
+    // std::nullopt if the piece is neither resident nor a ghost.
+    std::optional<List> find(std::uint32_t piece_index) const
+    {
+        auto it = nodes_.find(piece_index);
+        if (it == nodes_.end())
+        {
+            return std::nullopt;
+        }
+        return it->second.list_;
+    }
+
+    // Target size of T1.
+    std::size_t target_t1_size() const { return p_; }
+
+private:
+    struct Node
+    {
+        List list_ = List::T1;
+        std::list<std::uint32_t>::iterator it_;
+    };
+
+    std::list<std::uint32_t>& get_list(List list)
+    {
+        switch (list)
+        {
+        case List::T1: return t1_;
+        case List::T2: return t2_;
+        case List::B1: return b1_;
+        case List::B2: return b2_;
+        }
+        assert(false);
+        return t1_;
+    }
+
+    // Moves to MRU position of `list`.
+    void move_to(std::uint32_t piece_index, Node& node, List list)
+    {
+        get_list(node.list_).erase(node.it_);
+        std::list<std::uint32_t>& to = get_list(list);
+        node.it_ = to.insert(to.end(), piece_index);
+        node.list_ = list;
+    }
+
+    void forget(std::uint32_t piece_index)
+    {
+        auto it = nodes_.find(piece_index);
+        assert(it != nodes_.end());
+        get_list(it->second.list_).erase(it->second.it_);
+        nodes_.erase(it);
+    }
+
+    // Evicts LRU piece of T1 or T2 into its ghost list.
+    void replace(bool in_b2, std::vector<std::uint32_t>& evicted)
+    {
+        if ((t1_.size() + t2_.size()) < capacity_)
+        {
+            // Not full (some pieces were erased).
+            return;
+        }
+        const bool from_t1 = !t1_.empty()
+            && ((t1_.size() > p_) || (in_b2 && (t1_.size() == p_)) || t2_.empty());
+        const std::uint32_t victim = from_t1 ? t1_.front() : t2_.front();
+        evicted.push_back(victim);
+        move_to(victim, nodes_[victim], from_t1 ? List::B1 : List::B2);
+    }
+
+private:
+    std::size_t capacity_ = 0;
+    // Target size of T1.
+    std::size_t p_ = 0;
+    // Front is LRU.
+    std::list<std::uint32_t> t1_;
+    std::list<std::uint32_t> t2_;
+    std::list<std::uint32_t> b1_;
+    std::list<std::uint32_t> b2_;
+    std::unordered_map<std::uint32_t, Node> nodes_;
+};
@@ -20,6 +20,8 @@ namespace
         {
         case E::Ok: return "<success>";
         case E::TODO: return "<todo>";
+        case E::UnsafeFilePath: return "file path escapes download directory";
+        case E::InvalidPieceLayers: return "piece layers do not match the files pieces roots";
         }
         return "<unknown>";
     }
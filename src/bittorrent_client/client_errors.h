@@ -16,4 +16,6 @@ enum class ClientErrorc : int
 {
     Ok = 0,
     TODO,
+    UnsafeFilePath,
+    InvalidPieceLayers,
 };
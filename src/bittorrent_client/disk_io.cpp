@@ -0,0 +1,154 @@
+#include "disk_io.h"
+
+#include <utility>
+
+#include <cassert>
+
+namespace
+{
+    class SyncDiskIO final : public DiskIO
+    {
+    public:
+        explicit SyncDiskIO(asio::io_context& io_context
+            , FilesOnDisk& files
+            , PieceBufferPool& buffers)
+            : io_context_(&io_context)
+            , files_(&files)
+            , buffers_(&buffers)
+        {
+        }
+
+        void async_write_piece(std::uint32_t piece_index
+            , PieceBuffer data
+            , OnDiskWrite on_done) override
+        {
+            auto written = files_->write_piece(piece_index, data.data_, data.size_);
+            const std::error_code ec = written ? std::error_code() : written.error();
+            asio::post(*io_context_
+                , [ec, data = std::move(data), on_done = std::move(on_done)]() mutable
+            {
+                on_done(ec, std::move(data));
+            });
+        }
+
+        void async_write_pieces(std::uint32_t first_piece_index
+            , std::vector<PieceBuffer> pieces
+            , OnDiskWriteRun on_done) override
+        {
+            const std::vector<DataSlice> slices = AsDataSlices(pieces);
+            auto written = files_->write_pieces(first_piece_index, slices.data(), slices.size());
+            const std::error_code ec = written ? std::error_code() : written.error();
+            asio::post(*io_context_
+                , [ec, pieces = std::move(pieces), on_done = std::move(on_done)]() mutable
+            {
+                on_done(ec, std::move(pieces));
+            });
+        }
+
+        void async_write_block(std::uint32_t piece_index
+            , std::uint32_t offset
+            , PieceBuffer data
+            , OnDiskWrite on_done) override
+        {
+            auto written = files_->write_block(piece_index, offset, data.data_, data.size_);
+            const std::error_code ec = written ? std::error_code() : written.error();
+            asio::post(*io_context_
+                , [ec, data = std::move(data), on_done = std::move(on_done)]() mutable
+            {
+                on_done(ec, std::move(data));
+            });
+        }
+
+        void async_read(std::uint32_t piece_index
+            , std::uint32_t offset
+            , std::uint32_t size
+            , OnDiskRead on_done) override
+        {
+            PieceBuffer data = buffers_->acquire(size);
+            auto read = files_->read_piece(piece_index, offset, data.data_, size);
+            const std::error_code ec = read ? std::error_code() : read.error();
+            asio::post(*io_context_
+                , [ec, data = std::move(data), on_done = std::move(on_done)]() mutable
+            {
+                on_done(ec, std::move(data));
+            });
+        }
+
+        void async_run(DiskJobFunction job, OnDiskJob on_done) override
+        {
+            const std::error_code ec = job();
+            asio::post(*io_context_, [ec, on_done = std::move(on_done)]()
+            {
+                on_done(ec);
+            });
+        }
+
+    private:
+        asio::io_context* io_context_ = nullptr;
+        FilesOnDisk* files_ = nullptr;
+        PieceBufferPool* buffers_ = nullptr;
+    };
+
+    std::unique_ptr<DiskIO> MakeBackendDiskIO(asio::io_context& io_context
+        , FilesOnDisk& files
+        , PieceBufferPool& buffers
+        , const DiskIOOptions& options)
+    {
+        if (options.backend_ == DiskIOBackend::IoUring)
+        {
+            if (auto uring = MakeIoUringDiskIO(io_context, files, buffers, options))
+            {
+                return std::move(uring.value());
+            }
+            return MakeThreadPoolDiskIO(io_context, files, buffers, options);
+        }
+        if (options.backend_ == DiskIOBackend::ThreadPool)
+        {
+            return MakeThreadPoolDiskIO(io_context, files, buffers, options);
+        }
+        return std::make_unique<SyncDiskIO>(io_context, files, buffers);
+    }
+} // namespace
+
+void DiskIO::async_write_piece(std::uint32_t piece_index
+    , PieceBuffer data
+    , OnDiskWrite on_done)
+{
+    std::vector<PieceBuffer> pieces;
+    pieces.push_back(std::move(data));
+    async_write_pieces(piece_index, std::move(pieces)
+        , [on_done = std::move(on_done)](std::error_code ec, std::vector<PieceBuffer> pieces)
+    {
+        assert(pieces.size() == 1);
+        on_done(ec, std::move(pieces[0]));
+    });
+}
+
+std::vector<DataSlice> AsDataSlices(const std::vector<PieceBuffer>& pieces)
+{
+    std::vector<DataSlice> slices;
+    slices.reserve(pieces.size());
+    for (const PieceBuffer& piece : pieces)
+    {
+        slices.push_back(DataSlice{piece.data_, piece.size_});
+    }
+    return slices;
+}
+
+std::unique_ptr<DiskIO> MakeDiskIO(asio::io_context& io_context
+    , FilesOnDisk& files
+    , PieceBufferPool& buffers
+    , const DiskIOOptions& options)
+{
+    std::unique_ptr<DiskIO> backend = MakeBackendDiskIO(io_context, files, buffers, options);
+    // Can't hold a single piece without going over the budget.
+    if (options.read_cache_bytes_ >= files.files_list_->torrent_->get_piece_size_bytes())
+    {
+        backend = MakeReadCacheDiskIO(io_context, files, buffers, std::move(backend), options);
+    }
+    if (options.write_cache_bytes_ > 0)
+    {
+        return MakeWriteCacheDiskIO(io_context, buffers, std::move(backend), options);
+    }
+    return backend;
+}
@@ -0,0 +1,139 @@
+#pragma once
+#include "files_on_disk.h"
+#include "piece_buffer_pool.h"
+#include "utils_asio.h"
+
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <system_error>
+#include <vector>
+
+#include <cstdint>
+
+// Invoked on the io_context thread. Buffer is given back to the caller,
+// so it can be reused or dropped (returned to the pool).
+using OnDiskWrite = std::function<void (std::error_code ec, PieceBuffer buffer)>;
+using OnDiskRead  = std::function<void (std::error_code ec, PieceBuffer buffer)>;
+using OnDiskWriteRun = std::function<void (std::error_code ec, std::vector<PieceBuffer> buffers)>;
+// Blocking I/O on some file other than the torrent ones (e.g. PartFile).
+using DiskJobFunction = std::function<std::error_code ()>;
+using OnDiskJob = std::function<void (std::error_code ec)>;
+
+enum class DiskIOBackend
+{
+    // Writes on the network thread, completion is posted.
+    Sync,
+    // Portable: bounded queue of jobs served by `threads_count_` workers.
+    ThreadPool,
+    // Linux io_uring. Falls back to ThreadPool if not available.
+    IoUring,
+};
+
+struct DiskIOOptions
+{
+    DiskIOBackend backend_ = DiskIOBackend::IoUring;
+    // Max in-flight disk operations.
+    std::uint32_t queue_depth_ = 64;
+    // ThreadPool only.
+    std::uint32_t threads_count_ = 2;
+    // Completed pieces are held in memory up to this size and
+    // written in batches of adjacent pieces. 0 disables the cache.
+    std::uint64_t write_cache_bytes_ = 16 * 1024 * 1024;
+    // Oldest cached piece is written no later than that.
+    std::chrono::milliseconds write_cache_age_ = std::chrono::seconds(2);
+    // Whole pieces are read and kept in memory up to this size,
+    // so blocks requested by different peers are read once.
+    // Less than a piece (e.g. 0) disables the cache.
+    std::uint64_t read_cache_bytes_ = 32 * 1024 * 1024;
+    // Next pieces read together with the requested one.
+    std::uint32_t read_ahead_pieces_ = 1;
+};
+
+struct DiskCacheStats
+{
+    // Reads served from memory.
+    std::uint64_t read_hits_ = 0;
+    // Reads that went to the disk.
+    std::uint64_t read_misses_ = 0;
+    // Completed pieces held by the write cache, not yet sent to the disk.
+    std::uint64_t write_cached_bytes_ = 0;
+};
+
+// Asynchronous piece reads and writes. Completion handlers
+// are called on the `io_context` passed to MakeDiskIO().
+class DiskIO
+{
+public:
+    virtual ~DiskIO() = default;
+
+    // Same as async_write_pieces() with single piece.
+    virtual void async_write_piece(std::uint32_t piece_index
+        , PieceBuffer data
+        , OnDiskWrite on_done);
+
+    // Adjacent pieces [first_piece_index; first_piece_index + pieces.size()).
+    // Every file they span is written with a single vectored write.
+    virtual void async_write_pieces(std::uint32_t first_piece_index
+        , std::vector<PieceBuffer> pieces
+        , OnDiskWriteRun on_done) = 0;
+
+    // Writes `data` at `offset` of the piece, e.g. a block as soon as it
+    // is received (see FilesOnDisk::write_block()).
+    virtual void async_write_block(std::uint32_t piece_index
+        , std::uint32_t offset
+        , PieceBuffer data
+        , OnDiskWrite on_done) = 0;
+
+    // Reads [offset; offset + size) of the piece, e.g. a block to seed.
+    virtual void async_read(std::uint32_t piece_index
+        , std::uint32_t offset
+        , std::uint32_t size
+        , OnDiskRead on_done) = 0;
+
+    // Runs `job` off the network thread, next to the piece writes.
+    // Jobs may run concurrently; the caller orders dependent ones.
+    virtual void async_run(DiskJobFunction job, OnDiskJob on_done) = 0;
+
+    // Backpressure: true when disk can't keep up and
+    // no new blocks should be requested from peers.
+    virtual bool is_congested() const { return false; }
+    // Completes once is_congested() is false.
+    virtual asio::awaitable<void> wait_until_ready() { co_return; }
+    // Starts writing everything that is buffered in memory.
+    virtual void flush() {}
+    virtual DiskCacheStats cache_stats() const { return {}; }
+};
+
+std::vector<DataSlice> AsDataSlices(const std::vector<PieceBuffer>& pieces);
+
+std::unique_ptr<DiskIO> MakeDiskIO(asio::io_context& io_context
+    , FilesOnDisk& files
+    , PieceBufferPool& buffers
+    , const DiskIOOptions& options);
+
+// Write-back cache on top of `backend`, see DiskIOOptions::write_cache_bytes_.
+std::unique_ptr<DiskIO> MakeWriteCacheDiskIO(asio::io_context& io_context
+    , PieceBufferPool& buffers
+    , std::unique_ptr<DiskIO> backend
+    , const DiskIOOptions& options);
+
+// Read cache on top of `backend`, see DiskIOOptions::read_cache_bytes_.
+std::unique_ptr<DiskIO> MakeReadCacheDiskIO(asio::io_context& io_context
+    , FilesOnDisk& files
+    , PieceBufferPool& buffers
+    , std::unique_ptr<DiskIO> backend
+    , const DiskIOOptions& options);
+
+std::unique_ptr<DiskIO> MakeThreadPoolDiskIO(asio::io_context& io_context
+    , FilesOnDisk& files
+    , PieceBufferPool& buffers
+    , const DiskIOOptions& options);
+
+// Available on Linux only; fails with std::errc::not_supported elsewhere,
+// when the kernel/sandbox does not allow io_uring
+// or with StorageOptions::bypass_page_cache_.
+outcome::result<std::unique_ptr<DiskIO>> MakeIoUringDiskIO(asio::io_context& io_context
+    , FilesOnDisk& files
+    , PieceBufferPool& buffers
+    , const DiskIOOptions& options);
@@ -0,0 +1,257 @@
+#include "disk_io.h"
+#include "arc_policy.h"
+
+#include <algorithm>
+#include <map>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+
+#include <cstring>
+#include <cassert>
+
+namespace
+{
+    struct PendingRead
+    {
+        std::uint32_t offset_ = 0;
+        std::uint32_t size_ = 0;
+        OnDiskRead on_done_;
+    };
+
+    struct PieceFetch
+    {
+        std::vector<PendingRead> waiting_;
+        // Piece was written while being read; don't cache what was read.
+        bool stale_ = false;
+        // Not requested yet.
+        bool read_ahead_ = false;
+    };
+
+    // Serves block reads from whole pieces kept in memory.
+    // Shared by all peers of the torrent: first request reads
+    // the piece (and next `read_ahead_pieces_`) from the disk,
+    // concurrent requests for the same piece wait for that read.
+    class ReadCacheDiskIO final : public DiskIO
+    {
+    public:
+        explicit ReadCacheDiskIO(asio::io_context& io_context
+            , FilesOnDisk& files
+            , PieceBufferPool& buffers
+            , std::unique_ptr<DiskIO> backend
+            , const DiskIOOptions& options)
+            : io_context_(&io_context)
+            , buffers_(&buffers)
+            , backend_(std::move(backend))
+            , read_ahead_pieces_(options.read_ahead_pieces_)
+            , policy_(std::size_t(options.read_cache_bytes_
+                / files.files_list_->torrent_->get_piece_size_bytes()))
+        {
+            const be::TorrentClient& torrent = *files.files_list_->torrent_;
+            piece_size_ = torrent.get_piece_size_bytes();
+            pieces_count_ = torrent.get_pieces_count();
+            total_size_ = torrent.get_total_size_bytes();
+        }
+
+        void async_write_piece(std::uint32_t piece_index
+            , PieceBuffer data
+            , OnDiskWrite on_done) override
+        {
+            invalidate(piece_index, 1);
+            backend_->async_write_piece(piece_index, std::move(data), std::move(on_done));
+        }
+
+        void async_write_pieces(std::uint32_t first_piece_index
+            , std::vector<PieceBuffer> pieces
+            , OnDiskWriteRun on_done) override
+        {
+            invalidate(first_piece_index, std::uint32_t(pieces.size()));
+            backend_->async_write_pieces(first_piece_index, std::move(pieces), std::move(on_done));
+        }
+
+        void async_write_block(std::uint32_t piece_index
+            , std::uint32_t offset
+            , PieceBuffer data
+            , OnDiskWrite on_done) override
+        {
+            invalidate(piece_index, 1);
+            backend_->async_write_block(piece_index, offset, std::move(data), std::move(on_done));
+        }
+
+        void async_read(std::uint32_t piece_index
+            , std::uint32_t offset
+            , std::uint32_t size
+            , OnDiskRead on_done) override
+        {
+            auto cached = cached_.find(piece_index);
+            if (cached != cached_.end())
+            {
+                ++stats_.read_hits_;
+                policy_.on_hit(piece_index, (read_ahead_.erase(piece_index) > 0));
+                serve(cached->second, offset, size, std::move(on_done));
+                return;
+            }
+            auto fetch = fetching_.find(piece_index);
+            if (fetch != fetching_.end())
+            {
+                // Disk read is in progress already.
+                fetch->second.read_ahead_ = false;
+                ++stats_.read_hits_;
+                fetch->second.waiting_.push_back(PendingRead{offset, size, std::move(on_done)});
+                return;
+            }
+            ++stats_.read_misses_;
+            fetching_[piece_index].waiting_.push_back(PendingRead{offset, size, std::move(on_done)});
+            fetch_piece(piece_index);
+            for (std::uint32_t i = 1; i <= read_ahead_pieces_; ++i)
+            {
+                const std::uint32_t next_piece_index = (piece_index + i);
+                if ((next_piece_index >= pieces_count_)
+                    || cached_.count(next_piece_index)
+                    || fetching_.count(next_piece_index))
+                {
+                    break;
+                }
+                fetching_[next_piece_index].read_ahead_ = true;
+                fetch_piece(next_piece_index);
+            }
+        }
+
+        void async_run(DiskJobFunction job, OnDiskJob on_done) override
+        {
+            backend_->async_run(std::move(job), std::move(on_done));
+        }
+
+        bool is_congested() const override
+        {
+            return backend_->is_congested();
+        }
+
+        asio::awaitable<void> wait_until_ready() override
+        {
+            co_await backend_->wait_until_ready();
+        }
+
+        void flush() override
+        {
+            backend_->flush();
+        }
+
+        DiskCacheStats cache_stats() const override
+        {
+            return stats_;
+        }
+
+    private:
+        std::uint32_t get_piece_size(std::uint32_t piece_index) const
+        {
+            const std::uint64_t start = (std::uint64_t(piece_index) * piece_size_);
+            return std::uint32_t(std::min<std::uint64_t>(piece_size_, total_size_ - start));
+        }
+
+        void fetch_piece(std::uint32_t piece_index)
+        {
+            backend_->async_read(piece_index, 0, get_piece_size(piece_index)
+                , [this, piece_index](std::error_code ec, PieceBuffer data)
+            {
+                on_piece_fetched(piece_index, ec, std::move(data));
+            });
+        }
+
+        void on_piece_fetched(std::uint32_t piece_index, std::error_code ec, PieceBuffer data)
+        {
+            auto it = fetching_.find(piece_index);
+            assert(it != fetching_.end());
+            PieceFetch fetch = std::move(it->second);
+            fetching_.erase(it);
+            if (ec)
+            {
+                for (PendingRead& read : fetch.waiting_)
+                {
+                    read.on_done_(ec, PieceBuffer());
+                }
+                return;
+            }
+            if (fetch.stale_)
+            {
+                for (PendingRead& read : fetch.waiting_)
+                {
+                    backend_->async_read(piece_index, read.offset_, read.size_, std::move(read.on_done_));
+                }
+                return;
+            }
+            std::vector<std::uint32_t> evicted;
+            policy_.insert(piece_index, evicted);
+            for (std::uint32_t evicted_index : evicted)
+            {
+                cached_.erase(evicted_index);
+                read_ahead_.erase(evicted_index);
+            }
+            if (fetch.read_ahead_)
+            {
+                (void)read_ahead_.insert(piece_index);
+            }
+            PieceBuffer& cached = cached_[piece_index];
+            cached = std::move(data);
+            for (PendingRead& read : fetch.waiting_)
+            {
+                serve(cached, read.offset_, read.size_, std::move(read.on_done_));
+            }
+        }
+
+        void serve(const PieceBuffer& piece
+            , std::uint32_t offset
+            , std::uint32_t size
+            , OnDiskRead on_done)
+        {
+            assert((std::uint64_t(offset) + size) <= piece.size_);
+            PieceBuffer data = buffers_->acquire(size);
+            std::memcpy(data.data_, piece.data_ + offset, size);
+            asio::post(*io_context_
+                , [data = std::move(data), on_done = std::move(on_done)]() mutable
+            {
+                on_done(std::error_code(), std::move(data));
+            });
+        }
+
+        void invalidate(std::uint32_t first_piece_index, std::uint32_t count)
+        {
+            for (std::uint32_t i = 0; i < count; ++i)
+            {
+                const std::uint32_t piece_index = (first_piece_index + i);
+                cached_.erase(piece_index);
+                read_ahead_.erase(piece_index);
+                policy_.erase(piece_index);
+                auto fetch = fetching_.find(piece_index);
+                if (fetch != fetching_.end())
+                {
+                    fetch->second.stale_ = true;
+                }
+            }
+        }
+
+    private:
+        asio::io_context* io_context_ = nullptr;
+        PieceBufferPool* buffers_ = nullptr;
+        std::unique_ptr<DiskIO> backend_;
+        std::uint32_t read_ahead_pieces_ = 0;
+        std::uint64_t piece_size_ = 0;
+        std::uint32_t pieces_count_ = 0;
+        std::uint64_t total_size_ = 0;
+        ArcPolicy policy_;
+        std::unordered_map<std::uint32_t, PieceBuffer> cached_;
+        // Cached, but not requested yet.
+        std::unordered_set<std::uint32_t> read_ahead_;
+        std::map<std::uint32_t, PieceFetch> fetching_;
+        DiskCacheStats stats_;
+    };
+} // namespace
+
+std::unique_ptr<DiskIO> MakeReadCacheDiskIO(asio::io_context& io_context
+    , FilesOnDisk& files
+    , PieceBufferPool& buffers
+    , std::unique_ptr<DiskIO> backend
+    , const DiskIOOptions& options)
+{
+    return std::make_unique<ReadCacheDiskIO>(io_context, files, buffers, std::move(backend), options);
+}
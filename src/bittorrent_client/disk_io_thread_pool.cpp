@@ -0,0 +1,291 @@
+#include "disk_io.h"
+#include "asio_outcome_as_result.hpp"
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <utility>
+
+#include <cassert>
+
+namespace
+{
+    struct DiskJob
+    {
+        enum class Kind { Write, WriteBlock, Read, Run };
+
+        Kind kind_ = Kind::Write;
+        // For writes: first of the adjacent `pieces_`.
+        std::uint32_t piece_index_ = 0;
+        std::vector<PieceBuffer> pieces_;
+        OnDiskWriteRun on_written_;
+        // For reads and block writes: [offset_; offset_ + data_.size_) of the piece.
+        std::uint32_t offset_ = 0;
+        PieceBuffer data_;
+        // Also OnDiskWrite of the block write.
+        OnDiskRead on_read_;
+        DiskJobFunction run_;
+        OnDiskJob on_run_;
+        std::error_code ec_;
+        // Keeps io_context::run() going until completion is posted.
+        asio::executor_work_guard<asio::io_context::executor_type> work_;
+
+        explicit DiskJob(asio::io_context& io_context)
+            : work_(io_context.get_executor())
+        {
+        }
+    };
+
+    // Shared by all workers; the network thread is the only producer.
+    // Capacity is enforced by the producer (see ThreadPoolDiskIO::submit()),
+    // so push() never blocks.
+    class DiskJobsQueue
+    {
+    public:
+        void push(std::unique_ptr<DiskJob> job)
+        {
+            {
+                std::lock_guard<std::mutex> _(lock_);
+                jobs_.push_back(std::move(job));
+            }
+            has_jobs_.notify_one();
+        }
+
+        // Blocks. Returns nullptr when stopped.
+        std::unique_ptr<DiskJob> pop()
+        {
+            std::unique_lock<std::mutex> lock(lock_);
+            has_jobs_.wait(lock, [this] { return (stopped_ || !jobs_.empty()); });
+            if (jobs_.empty())
+            {
+                return nullptr;
+            }
+            std::unique_ptr<DiskJob> job = std::move(jobs_.front());
+            jobs_.pop_front();
+            return job;
+        }
+
+        // Already queued jobs are still processed.
+        void stop()
+        {
+            {
+                std::lock_guard<std::mutex> _(lock_);
+                stopped_ = true;
+            }
+            has_jobs_.notify_all();
+        }
+
+    private:
+        std::mutex lock_;
+        std::condition_variable has_jobs_;
+        std::deque<std::unique_ptr<DiskJob>> jobs_;
+        bool stopped_ = false;
+    };
+
+    class ThreadPoolDiskIO final : public DiskIO
+    {
+    public:
+        explicit ThreadPoolDiskIO(asio::io_context& io_context
+            , FilesOnDisk& files
+            , PieceBufferPool& buffers
+            , const DiskIOOptions& options)
+            : io_context_(&io_context)
+            , files_(&files)
+            , buffers_(&buffers)
+            , max_queued_(std::max<std::uint32_t>(1, options.queue_depth_))
+            , ready_(io_context)
+        {
+            ready_.expires_at(asio::steady_timer::time_point::max());
+            const std::uint32_t threads_count = std::max<std::uint32_t>(1, options.threads_count_);
+            workers_.reserve(threads_count);
+            for (std::uint32_t i = 0; i < threads_count; ++i)
+            {
+                workers_.emplace_back([this] { worker_loop(); });
+            }
+        }
+
+        ~ThreadPoolDiskIO() override
+        {
+            queue_.stop();
+            for (std::thread& worker : workers_)
+            {
+                worker.join();
+            }
+        }
+
+        void async_write_pieces(std::uint32_t first_piece_index
+            , std::vector<PieceBuffer> pieces
+            , OnDiskWriteRun on_done) override
+        {
+            auto job = std::make_unique<DiskJob>(*io_context_);
+            job->kind_ = DiskJob::Kind::Write;
+            job->piece_index_ = first_piece_index;
+            job->pieces_ = std::move(pieces);
+            job->on_written_ = std::move(on_done);
+            submit(std::move(job));
+        }
+
+        void async_write_block(std::uint32_t piece_index
+            , std::uint32_t offset
+            , PieceBuffer data
+            , OnDiskWrite on_done) override
+        {
+            auto job = std::make_unique<DiskJob>(*io_context_);
+            job->kind_ = DiskJob::Kind::WriteBlock;
+            job->piece_index_ = piece_index;
+            job->offset_ = offset;
+            job->data_ = std::move(data);
+            job->on_read_ = std::move(on_done);
+            submit(std::move(job));
+        }
+
+        void async_read(std::uint32_t piece_index
+            , std::uint32_t offset
+            , std::uint32_t size
+            , OnDiskRead on_done) override
+        {
+            auto job = std::make_unique<DiskJob>(*io_context_);
+            job->kind_ = DiskJob::Kind::Read;
+            job->piece_index_ = piece_index;
+            job->offset_ = offset;
+            job->data_ = buffers_->acquire(size);
+            job->on_read_ = std::move(on_done);
+            submit(std::move(job));
+        }
+
+        void async_run(DiskJobFunction job, OnDiskJob on_done) override
+        {
+            auto disk_job = std::make_unique<DiskJob>(*io_context_);
+            disk_job->kind_ = DiskJob::Kind::Run;
+            disk_job->run_ = std::move(job);
+            disk_job->on_run_ = std::move(on_done);
+            submit(std::move(disk_job));
+        }
+
+        bool is_congested() const override
+        {
+            return (queued_ >= max_queued_);
+        }
+
+        asio::awaitable<void> wait_until_ready() override
+        {
+            auto coro = as_result(asio::use_awaitable);
+            while (is_congested())
+            {
+                // Canceled by on_job_done().
+                (void)co_await ready_.async_wait(coro);
+            }
+        }
+
+    private:
+        // Network thread.
+        void submit(std::unique_ptr<DiskJob> job)
+        {
+            if (queued_ < max_queued_)
+            {
+                ++queued_;
+                queue_.push(std::move(job));
+                return;
+            }
+            // Peers already sent us blocks we requested before
+            // is_congested() became true; don't block the network thread.
+            overflow_.push_back(std::move(job));
+        }
+
+        // Network thread.
+        void on_job_done(std::unique_ptr<DiskJob> job)
+        {
+            assert(queued_ > 0);
+            --queued_;
+            if (!overflow_.empty())
+            {
+                ++queued_;
+                queue_.push(std::move(overflow_.front()));
+                overflow_.pop_front();
+            }
+            if (!is_congested())
+            {
+                ready_.cancel();
+            }
+            if (job->kind_ == DiskJob::Kind::Write)
+            {
+                auto on_done = std::move(job->on_written_);
+                on_done(job->ec_, std::move(job->pieces_));
+            }
+            else if (job->kind_ == DiskJob::Kind::Run)
+            {
+                auto on_done = std::move(job->on_run_);
+                on_done(job->ec_);
+            }
+            else
+            {
+                auto on_done = std::move(job->on_read_);
+                on_done(job->ec_, std::move(job->data_));
+            }
+        }
+
+        void worker_loop()
+        {
+            while (std::unique_ptr<DiskJob> job = queue_.pop())
+            {
+                const outcome::result<void> status = do_job(*job);
+                job->ec_ = status ? std::error_code() : status.error();
+                asio::post(*io_context_, [this, job = std::move(job)]() mutable
+                {
+                    on_job_done(std::move(job));
+                });
+            }
+        }
+
+        // Worker thread.
+        outcome::result<void> do_job(DiskJob& job)
+        {
+            switch (job.kind_)
+            {
+            case DiskJob::Kind::Write:
+            {
+                // pwrite() to distinct ranges of the same file is fine to do concurrently.
+                const std::vector<DataSlice> pieces = AsDataSlices(job.pieces_);
+                return files_->write_pieces(job.piece_index_, pieces.data(), pieces.size());
+            }
+            case DiskJob::Kind::WriteBlock:
+                return files_->write_block(job.piece_index_, job.offset_
+                    , job.data_.data_, job.data_.size_);
+            case DiskJob::Kind::Read:
+                return files_->read_piece(job.piece_index_, job.offset_
+                    , job.data_.data_, job.data_.size_);
+            case DiskJob::Kind::Run:
+                if (const std::error_code ec = job.run_())
+                {
+                    return outcome::failure(ec);
+                }
+                return outcome::success();
+            }
+            assert(false);
+            return outcome::success();
+        }
+
+    private:
+        asio::io_context* io_context_ = nullptr;
+        FilesOnDisk* files_ = nullptr;
+        PieceBufferPool* buffers_ = nullptr;
+        // Network thread only.
+        std::uint32_t max_queued_ = 0;
+        std::uint32_t queued_ = 0;
+        std::deque<std::unique_ptr<DiskJob>> overflow_;
+        asio::steady_timer ready_;
+        // Shared with workers.
+        DiskJobsQueue queue_;
+        std::vector<std::thread> workers_;
+    };
+} // namespace
+
+std::unique_ptr<DiskIO> MakeThreadPoolDiskIO(asio::io_context& io_context
+    , FilesOnDisk& files
+    , PieceBufferPool& buffers
+    , const DiskIOOptions& options)
+{
+    return std::make_unique<ThreadPoolDiskIO>(io_context, files, buffers, options);
+}
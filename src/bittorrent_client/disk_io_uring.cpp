@@ -0,0 +1,849 @@
+#include "disk_io.h"
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#  define BT_HAS_IO_URING() 1
+#else
+#  define BT_HAS_IO_URING() 0
+#endif
+
+#if (BT_HAS_IO_URING())
+#include <linux/io_uring.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <limits.h>
+
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <initializer_list>
+#include <vector>
+#include <utility>
+
+#include <cerrno>
+#include <cstring>
+#include <cassert>
+
+// liburing is not used to avoid one more dependency; only
+// a handful of raw syscalls are needed for our simple case.
+// See https://kernel.dk/io_uring.pdf and io_uring(7).
+namespace
+{
+    std::error_code LastError()
+    {
+        return std::error_code(errno, std::system_category());
+    }
+
+    int SysIoUringSetup(unsigned entries, io_uring_params* params)
+    {
+        return int(::syscall(__NR_io_uring_setup, entries, params));
+    }
+
+    int SysIoUringEnter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags)
+    {
+        return int(::syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, nullptr, 0));
+    }
+
+    int SysIoUringRegister(int fd, unsigned opcode, const void* arg, unsigned nr_args)
+    {
+        return int(::syscall(__NR_io_uring_register, fd, opcode, arg, nr_args));
+    }
+
+    unsigned LoadAcquire(unsigned* ptr)
+    {
+        return std::atomic_ref<unsigned>(*ptr).load(std::memory_order_acquire);
+    }
+
+    void StoreRelease(unsigned* ptr, unsigned v)
+    {
+        std::atomic_ref<unsigned>(*ptr).store(v, std::memory_order_release);
+    }
+
+    struct MappedRegion
+    {
+        void* ptr_ = MAP_FAILED;
+        std::size_t size_ = 0;
+
+        MappedRegion() noexcept = default;
+        MappedRegion(const MappedRegion&) = delete;
+        MappedRegion& operator=(const MappedRegion&) = delete;
+        ~MappedRegion() noexcept
+        {
+            if (ptr_ != MAP_FAILED)
+            {
+                (void)::munmap(ptr_, size_);
+            }
+        }
+
+        bool map(int fd, std::size_t size, off_t offset)
+        {
+            ptr_ = ::mmap(nullptr, size, PROT_READ | PROT_WRITE
+                , MAP_SHARED | MAP_POPULATE, fd, offset);
+            size_ = size;
+            return (ptr_ != MAP_FAILED);
+        }
+
+        template<typename T>
+        T* at(std::uint32_t offset) const
+        {
+            return reinterpret_cast<T*>(static_cast<std::uint8_t*>(ptr_) + offset);
+        }
+    };
+
+    // Submission and completion queues shared with the kernel.
+    // Single-threaded: we are the only producer of SQEs
+    // and the only consumer of CQEs.
+    struct Ring
+    {
+        int fd_ = -1;
+        std::uint32_t sq_entries_ = 0;
+
+        MappedRegion sq_ring_;
+        MappedRegion cq_ring_separate_;
+        MappedRegion sqes_region_;
+
+        unsigned* sq_head_ = nullptr;
+        unsigned* sq_tail_ = nullptr;
+        unsigned sq_mask_ = 0;
+        unsigned* sq_array_ = nullptr;
+        io_uring_sqe* sqes_ = nullptr;
+
+        unsigned* cq_head_ = nullptr;
+        unsigned* cq_tail_ = nullptr;
+        unsigned cq_mask_ = 0;
+        io_uring_cqe* cqes_ = nullptr;
+
+        // SQEs placed into the ring, but not yet consumed by io_uring_enter().
+        unsigned to_submit_ = 0;
+
+        Ring() = default;
+        Ring(const Ring&) = delete;
+        Ring& operator=(const Ring&) = delete;
+        ~Ring()
+        {
+            if (fd_ != -1)
+            {
+                (void)::close(fd_);
+            }
+        }
+
+        outcome::result<void> init(std::uint32_t entries)
+        {
+            io_uring_params params{};
+            fd_ = SysIoUringSetup(entries, &params);
+            if (fd_ < 0)
+            {
+                fd_ = -1;
+                return outcome::failure(LastError());
+            }
+            sq_entries_ = params.sq_entries;
+
+            const std::size_t sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+            const std::size_t cq_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+            const bool single_mmap = ((params.features & IORING_FEAT_SINGLE_MMAP) != 0);
+            if (!sq_ring_.map(fd_, single_mmap ? std::max(sq_size, cq_size) : sq_size, IORING_OFF_SQ_RING))
+            {
+                return outcome::failure(LastError());
+            }
+            const MappedRegion* cq_ring = &sq_ring_;
+            if (!single_mmap)
+            {
+                if (!cq_ring_separate_.map(fd_, cq_size, IORING_OFF_CQ_RING))
+                {
+                    return outcome::failure(LastError());
+                }
+                cq_ring = &cq_ring_separate_;
+            }
+            if (!sqes_region_.map(fd_, params.sq_entries * sizeof(io_uring_sqe), IORING_OFF_SQES))
+            {
+                return outcome::failure(LastError());
+            }
+
+            sq_head_  = sq_ring_.at<unsigned>(params.sq_off.head);
+            sq_tail_  = sq_ring_.at<unsigned>(params.sq_off.tail);
+            sq_mask_  = *sq_ring_.at<unsigned>(params.sq_off.ring_mask);
+            sq_array_ = sq_ring_.at<unsigned>(params.sq_off.array);
+            sqes_     = sqes_region_.at<io_uring_sqe>(0);
+
+            cq_head_  = cq_ring->at<unsigned>(params.cq_off.head);
+            cq_tail_  = cq_ring->at<unsigned>(params.cq_off.tail);
+            cq_mask_  = *cq_ring->at<unsigned>(params.cq_off.ring_mask);
+            cqes_     = cq_ring->at<io_uring_cqe>(params.cq_off.cqes);
+            return outcome::success();
+        }
+
+        // IORING_REGISTER_PROBE is there since 5.6, same as IORING_OP_READ/WRITE;
+        // on older kernels setup succeeds, but these ops fail with EINVAL.
+        bool supports(std::initializer_list<std::uint8_t> opcodes) const
+        {
+            const std::size_t k_max_ops = 256;
+            std::vector<std::uint8_t> storage(sizeof(io_uring_probe)
+                + k_max_ops * sizeof(io_uring_probe_op), 0);
+            io_uring_probe* probe = reinterpret_cast<io_uring_probe*>(storage.data());
+            if (SysIoUringRegister(fd_, IORING_REGISTER_PROBE, probe, unsigned(k_max_ops)) != 0)
+            {
+                return false;
+            }
+            for (std::uint8_t opcode : opcodes)
+            {
+                if ((opcode > probe->last_op)
+                    || (opcode >= probe->ops_len)
+                    || !(probe->ops[opcode].flags & IO_URING_OP_SUPPORTED))
+                {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        // nullptr when submission queue is full.
+        io_uring_sqe* next_sqe()
+        {
+            const unsigned tail = *sq_tail_;
+            if ((tail - LoadAcquire(sq_head_)) >= sq_entries_)
+            {
+                return nullptr;
+            }
+            const unsigned index = (tail & sq_mask_);
+            io_uring_sqe* sqe = &sqes_[index];
+            std::memset(sqe, 0, sizeof(*sqe));
+            sq_array_[index] = index;
+            return sqe;
+        }
+
+        void commit_sqe()
+        {
+            StoreRelease(sq_tail_, *sq_tail_ + 1);
+            ++to_submit_;
+        }
+
+        outcome::result<void> submit()
+        {
+            while (to_submit_ > 0)
+            {
+                const int submitted = SysIoUringEnter(fd_, to_submit_, 0, 0);
+                if (submitted < 0)
+                {
+                    if (errno == EINTR)
+                    {
+                        continue;
+                    }
+                    // EAGAIN/EBUSY: SQEs stay in the ring; retried on next submit().
+                    return outcome::failure(LastError());
+                }
+                to_submit_ -= unsigned(submitted);
+            }
+            return outcome::success();
+        }
+
+        // F(std::uint64_t user_data, int result)
+        template<typename F>
+        void reap(F on_cqe)
+        {
+            unsigned head = *cq_head_;
+            while (head != LoadAcquire(cq_tail_))
+            {
+                const io_uring_cqe cqe = cqes_[head & cq_mask_];
+                ++head;
+                StoreRelease(cq_head_, head);
+                on_cqe(cqe.user_data, cqe.res);
+            }
+        }
+    };
+
+    void ConsumeIovecs(std::vector<iovec>& iovecs, std::size_t bytes)
+    {
+        std::size_t consumed = 0;
+        while ((consumed < iovecs.size()) && (bytes >= iovecs[consumed].iov_len))
+        {
+            bytes -= iovecs[consumed].iov_len;
+            ++consumed;
+        }
+        iovecs.erase(iovecs.begin(), iovecs.begin() + consumed);
+        if (bytes > 0)
+        {
+            assert(!iovecs.empty());
+            iovecs[0].iov_base = static_cast<std::uint8_t*>(iovecs[0].iov_base) + bytes;
+            iovecs[0].iov_len -= bytes;
+        }
+    }
+
+    struct Operation
+    {
+        std::uint8_t opcode_ = IORING_OP_NOP;
+        FilePiece file_piece_;
+        // Leased right before submission, so only in-flight
+        // operations keep files open (see FilesOnDisk::open_file()).
+        FileLease file_;
+        std::uint8_t* data_ = nullptr;
+        // Remaining bytes for read/write.
+        std::uint32_t size_ = 0;
+        std::uint64_t offset_ = 0;
+        // Registered buffer index for *_FIXED operations.
+        int buffer_index_ = -1;
+        // Remaining slices for IORING_OP_WRITEV.
+        std::vector<iovec> iovecs_;
+        std::function<void (std::error_code)> on_done_;
+    };
+
+    // Piece(s) split into per-file fragments; finished when all are done.
+    struct PieceJob
+    {
+        // Single piece write or read.
+        PieceBuffer data_;
+        OnDiskWrite on_done_;
+        // Adjacent pieces write.
+        std::vector<PieceBuffer> pieces_;
+        OnDiskWriteRun on_written_;
+        std::uint32_t pending_ = 0;
+        std::error_code ec_;
+    };
+
+    class IoUringDiskIO final : public DiskIO
+    {
+    public:
+        explicit IoUringDiskIO(asio::io_context& io_context
+            , FilesOnDisk& files
+            , PieceBufferPool& buffers)
+            : io_context_(&io_context)
+            , files_(&files)
+            , buffers_(&buffers)
+            , ring_()
+            , eventfd_(io_context)
+            , submit_retry_(io_context)
+        {
+        }
+
+        ~IoUringDiskIO() override
+        {
+            // Kernel may still write to our buffers; wait for it.
+            while (in_flight_ > 0)
+            {
+                // Committed, but not consumed by the kernel yet, if any.
+                (void)ring_.submit();
+                const int status = SysIoUringEnter(ring_.fd_, 0, 1, IORING_ENTER_GETEVENTS);
+                if ((status < 0) && (errno != EINTR))
+                {
+                    break;
+                }
+                ring_.reap([this](std::uint64_t user_data, int)
+                {
+                    delete reinterpret_cast<Operation*>(user_data);
+                    --in_flight_;
+                });
+            }
+        }
+
+        outcome::result<void> init(const DiskIOOptions& options)
+        {
+            if (files_->options_.bypass_page_cache_)
+            {
+                // Alignment and bounce buffers are handled by PhysicalFile::write().
+                return outcome::failure(std::make_error_code(std::errc::not_supported));
+            }
+            OUTCOME_TRY(ring_.init(options.queue_depth_));
+            if (!ring_.supports({IORING_OP_READ, IORING_OP_WRITE
+                , IORING_OP_READ_FIXED, IORING_OP_WRITE_FIXED
+                , IORING_OP_WRITEV, IORING_OP_FSYNC}))
+            {
+                // MakeDiskIO() falls back to the thread pool.
+                return outcome::failure(std::make_error_code(std::errc::not_supported));
+            }
+            jobs_options_ = options;
+            jobs_options_.threads_count_ = 1;
+
+            const int efd = ::eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+            if (efd < 0)
+            {
+                return outcome::failure(LastError());
+            }
+            eventfd_.assign(efd);
+            if (SysIoUringRegister(ring_.fd_, IORING_REGISTER_EVENTFD, &efd, 1) != 0)
+            {
+                return outcome::failure(LastError());
+            }
+
+            // Pool slots are registered as fixed buffers, so the kernel
+            // does not need to pin/unpin pages on every operation.
+            // May fail because of RLIMIT_MEMLOCK; not fatal.
+            std::vector<iovec> iovecs(buffers_->buffers_count());
+            for (std::uint32_t i = 0; i < buffers_->buffers_count(); ++i)
+            {
+                iovecs[i].iov_base = buffers_->slot_data(i);
+                iovecs[i].iov_len = buffers_->buffer_size();
+            }
+            use_fixed_buffers_ = !iovecs.empty()
+                && (SysIoUringRegister(ring_.fd_, IORING_REGISTER_BUFFERS
+                    , iovecs.data(), unsigned(iovecs.size())) == 0);
+            return outcome::success();
+        }
+
+        void async_write_piece(std::uint32_t piece_index
+            , PieceBuffer data
+            , OnDiskWrite on_done) override
+        {
+            auto job = std::make_shared<PieceJob>();
+            job->data_ = std::move(data);
+            job->on_done_ = std::move(on_done);
+            // Guard: don't finish until all fragments are submitted.
+            job->pending_ = 1;
+
+            files_->files_list_->iterate_files(piece_index
+                , [&](const FilePiece& file_piece)
+            {
+                if (file_piece.bytes_count_ == 0)
+                {
+                    return;
+                }
+                ++job->pending_;
+                auto op = make_operation(IORING_OP_WRITE, IORING_OP_WRITE_FIXED
+                    , job->data_, file_piece);
+                op->on_done_ = [this, job, file_piece](std::error_code ec)
+                {
+                    on_fragment_written(job, file_piece, ec);
+                };
+                submit(std::move(op));
+            });
+            finish_fragment(job, std::error_code());
+        }
+
+        void async_write_pieces(std::uint32_t first_piece_index
+            , std::vector<PieceBuffer> pieces
+            , OnDiskWriteRun on_done) override
+        {
+            auto job = std::make_shared<PieceJob>();
+            job->pieces_ = std::move(pieces);
+            job->on_written_ = std::move(on_done);
+            job->pending_ = 1;
+
+            const std::vector<DataSlice> pieces_slices = AsDataSlices(job->pieces_);
+            files_->split_by_files(first_piece_index, pieces_slices.data(), pieces_slices.size()
+                , [&](const FilePiece& file_piece, const DataSlice* slices, std::size_t count)
+            {
+                ++job->pending_;
+                auto op = std::make_unique<Operation>();
+                op->opcode_ = IORING_OP_WRITEV;
+                op->file_piece_ = file_piece;
+                op->size_ = std::uint32_t(file_piece.bytes_count_);
+                op->offset_ = file_piece.file_offset_;
+                op->iovecs_.resize(count);
+                for (std::size_t i = 0; i < count; ++i)
+                {
+                    op->iovecs_[i].iov_base = const_cast<std::uint8_t*>(slices[i].data_);
+                    op->iovecs_[i].iov_len = slices[i].size_;
+                }
+                op->on_done_ = [this, job, file_piece](std::error_code ec)
+                {
+                    on_fragment_written(job, file_piece, ec);
+                };
+                submit(std::move(op));
+            });
+            finish_fragment(job, std::error_code());
+        }
+
+        void async_read(std::uint32_t piece_index
+            , std::uint32_t offset
+            , std::uint32_t size
+            , OnDiskRead on_done) override
+        {
+            auto job = std::make_shared<PieceJob>();
+            job->data_ = buffers_->acquire(size);
+            job->on_done_ = std::move(on_done);
+            job->pending_ = 1;
+
+            const std::uint64_t start = files_->files_list_->piece_offset(piece_index) + offset;
+            files_->files_list_->iterate_files(start, start + size
+                , [&](const FilePiece& file_piece)
+            {
+                ++job->pending_;
+                auto op = make_operation(IORING_OP_READ, IORING_OP_READ_FIXED
+                    , job->data_, file_piece);
+                op->on_done_ = [this, job](std::error_code ec)
+                {
+                    finish_fragment(job, ec);
+                };
+                submit(std::move(op));
+            }
+                , [&](std::uint64_t piece_offset, std::uint64_t bytes_count)
+            {
+                std::memset(job->data_.data_ + piece_offset, 0, std::size_t(bytes_count));
+            });
+            finish_fragment(job, std::error_code());
+        }
+
+        // Arbitrary blocking jobs can't go thru the ring;
+        // started on the first use (see PartFile and open_file()).
+        void async_run(DiskJobFunction job, OnDiskJob on_done) override
+        {
+            if (!jobs_)
+            {
+                jobs_ = MakeThreadPoolDiskIO(*io_context_, *files_, *buffers_, jobs_options_);
+            }
+            jobs_->async_run(std::move(job), std::move(on_done));
+        }
+
+        void async_write_block(std::uint32_t piece_index
+            , std::uint32_t offset
+            , PieceBuffer data
+            , OnDiskWrite on_done) override
+        {
+            auto job = std::make_shared<PieceJob>();
+            job->data_ = std::move(data);
+            job->on_done_ = std::move(on_done);
+            job->pending_ = 1;
+
+            const std::uint64_t start = files_->files_list_->piece_offset(piece_index) + offset;
+            files_->files_list_->iterate_files(start, start + job->data_.size_
+                , [&](const FilePiece& file_piece)
+            {
+                if (file_piece.bytes_count_ == 0)
+                {
+                    return;
+                }
+                ++job->pending_;
+                auto op = make_operation(IORING_OP_WRITE, IORING_OP_WRITE_FIXED
+                    , job->data_, file_piece);
+                op->on_done_ = [this, job, file_piece](std::error_code ec)
+                {
+                    on_block_written(job, file_piece, ec);
+                };
+                submit(std::move(op));
+            });
+            finish_fragment(job, std::error_code());
+        }
+
+        bool is_congested() const override
+        {
+            // Ring is full and operations wait for submission.
+            return !backlog_.empty();
+        }
+
+    private:
+        std::unique_ptr<Operation> make_operation(std::uint8_t opcode
+            , std::uint8_t opcode_fixed
+            , const PieceBuffer& data
+            , const FilePiece& file_piece)
+        {
+            auto op = std::make_unique<Operation>();
+            op->opcode_ = opcode;
+            op->file_piece_ = file_piece;
+            op->data_ = data.data_ + file_piece.piece_offset_;
+            op->size_ = std::uint32_t(file_piece.bytes_count_);
+            op->offset_ = file_piece.file_offset_;
+            if (use_fixed_buffers_ && (data.pool_ == buffers_) && (data.pool_index_ >= 0))
+            {
+                op->opcode_ = opcode_fixed;
+                op->buffer_index_ = data.pool_index_;
+            }
+            return op;
+        }
+
+        void on_fragment_written(const std::shared_ptr<PieceJob>& job
+            , const FilePiece& file_piece
+            , std::error_code ec)
+        {
+            if (ec)
+            {
+                finish_fragment(job, ec);
+                return;
+            }
+            const bool file_done = files_->mark_written(file_piece);
+            const FileSyncPolicy sync = files_->options_.sync_;
+            const bool need_sync = (sync == FileSyncPolicy::EveryWrite)
+                || (file_done && (sync == FileSyncPolicy::OnFileComplete));
+            if (!need_sync)
+            {
+                finish_fragment(job, ec);
+                return;
+            }
+            auto op = std::make_unique<Operation>();
+            op->opcode_ = IORING_OP_FSYNC;
+            op->file_piece_ = file_piece;
+            op->on_done_ = [this, job](std::error_code sync_ec)
+            {
+                finish_fragment(job, sync_ec);
+            };
+            submit(std::move(op));
+        }
+
+        // Same as on_fragment_written(), but not accounted as written.
+        void on_block_written(const std::shared_ptr<PieceJob>& job
+            , const FilePiece& file_piece
+            , std::error_code ec)
+        {
+            if (ec || (files_->options_.sync_ != FileSyncPolicy::EveryWrite))
+            {
+                finish_fragment(job, ec);
+                return;
+            }
+            auto op = std::make_unique<Operation>();
+            op->opcode_ = IORING_OP_FSYNC;
+            op->file_piece_ = file_piece;
+            op->on_done_ = [this, job](std::error_code sync_ec)
+            {
+                finish_fragment(job, sync_ec);
+            };
+            submit(std::move(op));
+        }
+
+        void finish_fragment(const std::shared_ptr<PieceJob>& job, std::error_code ec)
+        {
+            if (ec && !job->ec_)
+            {
+                job->ec_ = ec;
+            }
+            assert(job->pending_ > 0);
+            if (--job->pending_ > 0)
+            {
+                return;
+            }
+            if (job->on_written_)
+            {
+                auto on_done = std::move(job->on_written_);
+                on_done(job->ec_, std::move(job->pieces_));
+            }
+            else if (job->on_done_)
+            {
+                auto on_done = std::move(job->on_done_);
+                on_done(job->ec_, std::move(job->data_));
+            }
+        }
+
+        void submit(std::unique_ptr<Operation> op)
+        {
+            backlog_.push_back(std::move(op));
+            flush_backlog();
+        }
+
+        void flush_backlog()
+        {
+            // Keep in-flight operations under SQ size,
+            // so completion queue (2x bigger) never overflows.
+            while (!backlog_.empty() && (in_flight_ < ring_.sq_entries_))
+            {
+                io_uring_sqe* sqe = ring_.next_sqe();
+                if (!sqe)
+                {
+                    break;
+                }
+                std::unique_ptr<Operation> ready = std::move(backlog_.front());
+                backlog_.pop_front();
+                if (!ready->file_.owner_)
+                {
+                    ready->file_ = files_->lease_if_open(ready->file_piece_);
+                }
+                if (!ready->file_.owner_)
+                {
+                    // SQE is not committed; reused by the next operation.
+                    open_file(std::move(ready));
+                    continue;
+                }
+                Operation* op = ready.release();
+                prepare(*sqe, *op);
+                ring_.commit_sqe();
+                ++in_flight_;
+            }
+            if (!ring_.submit())
+            {
+                // Committed SQEs may be all there is in flight;
+                // nothing completes until they are submitted.
+                arm_submit_retry();
+            }
+            arm_completion_wait();
+        }
+
+        // open() may create directories and preallocate the file;
+        // done off the network thread, submitted once the file is open.
+        void open_file(std::unique_ptr<Operation> op)
+        {
+            auto opening = std::make_shared<std::unique_ptr<Operation>>(std::move(op));
+            async_run([this, opening]() -> std::error_code
+            {
+                Operation& pending = **opening;
+                auto file = files_->open_file(pending.file_piece_);
+                if (!file)
+                {
+                    return file.error();
+                }
+                pending.file_ = std::move(file.value());
+                return std::error_code();
+            }
+                , [this, opening](std::error_code ec)
+            {
+                std::unique_ptr<Operation> ready = std::move(*opening);
+                if (ec)
+                {
+                    ready->on_done_(ec);
+                    return;
+                }
+                backlog_.push_front(std::move(ready));
+                flush_backlog();
+            });
+        }
+
+        // Kernel is out of resources (EAGAIN/EBUSY); try again a bit later.
+        void arm_submit_retry()
+        {
+            if (retry_armed_)
+            {
+                return;
+            }
+            retry_armed_ = true;
+            submit_retry_.expires_after(std::chrono::milliseconds(1));
+            submit_retry_.async_wait([this](std::error_code ec)
+            {
+                if (ec == asio::error::operation_aborted)
+                {
+                    return;
+                }
+                retry_armed_ = false;
+                flush_backlog();
+            });
+        }
+
+        static void prepare(io_uring_sqe& sqe, const Operation& op)
+        {
+            sqe.opcode = op.opcode_;
+            sqe.fd = op.file_->file_;
+            sqe.user_data = reinterpret_cast<std::uint64_t>(&op);
+            if (op.opcode_ == IORING_OP_FSYNC)
+            {
+                sqe.fsync_flags = IORING_FSYNC_DATASYNC;
+                return;
+            }
+            sqe.off = op.offset_;
+            if (op.opcode_ == IORING_OP_WRITEV)
+            {
+                sqe.addr = reinterpret_cast<std::uint64_t>(op.iovecs_.data());
+                sqe.len = unsigned(std::min<std::size_t>(op.iovecs_.size(), IOV_MAX));
+                return;
+            }
+            sqe.addr = reinterpret_cast<std::uint64_t>(op.data_);
+            sqe.len = op.size_;
+            if (op.buffer_index_ >= 0)
+            {
+                sqe.buf_index = std::uint16_t(op.buffer_index_);
+            }
+        }
+
+        // eventfd is signaled by the kernel on every completion.
+        // Wait only while there is something in flight, otherwise
+        // io_context::run() would never return.
+        void arm_completion_wait()
+        {
+            if (waiting_ || (in_flight_ == 0))
+            {
+                return;
+            }
+            waiting_ = true;
+            eventfd_.async_wait(asio::posix::stream_descriptor::wait_read
+                , [this](std::error_code ec)
+            {
+                if (ec == asio::error::operation_aborted)
+                {
+                    return;
+                }
+                waiting_ = false;
+                std::uint64_t counter = 0;
+                (void)::read(eventfd_.native_handle(), &counter, sizeof(counter));
+                reap();
+                flush_backlog();
+            });
+        }
+
+        void reap()
+        {
+            ring_.reap([this](std::uint64_t user_data, int result)
+            {
+                --in_flight_;
+                on_complete(std::unique_ptr<Operation>(
+                    reinterpret_cast<Operation*>(user_data)), result);
+            });
+        }
+
+        void on_complete(std::unique_ptr<Operation> op, int result)
+        {
+            if ((result == -EAGAIN) || (result == -EINTR))
+            {
+                backlog_.push_back(std::move(op));
+                return;
+            }
+            if (result < 0)
+            {
+                op->on_done_(std::error_code(-result, std::system_category()));
+                return;
+            }
+            const bool is_transfer = (op->opcode_ != IORING_OP_FSYNC);
+            const std::uint32_t transferred = std::uint32_t(result);
+            if (is_transfer && (transferred < op->size_))
+            {
+                if (transferred == 0)
+                {
+                    // Read past the end of file.
+                    op->on_done_(std::make_error_code(std::errc::io_error));
+                    return;
+                }
+                // Short read/write or more than IOV_MAX slices:
+                // continue with the rest.
+                op->offset_ += transferred;
+                op->size_ -= transferred;
+                if (op->opcode_ == IORING_OP_WRITEV)
+                {
+                    ConsumeIovecs(op->iovecs_, transferred);
+                }
+                else
+                {
+                    op->data_ += transferred;
+                }
+                backlog_.push_back(std::move(op));
+                return;
+            }
+            op->on_done_(std::error_code());
+        }
+
+    private:
+        asio::io_context* io_context_ = nullptr;
+        FilesOnDisk* files_ = nullptr;
+        PieceBufferPool* buffers_ = nullptr;
+        Ring ring_;
+        asio::posix::stream_descriptor eventfd_;
+        asio::steady_timer submit_retry_;
+        std::deque<std::unique_ptr<Operation>> backlog_;
+        std::uint32_t in_flight_ = 0;
+        bool waiting_ = false;
+        bool retry_armed_ = false;
+        DiskIOOptions jobs_options_;
+        std::unique_ptr<DiskIO> jobs_;
+        bool use_fixed_buffers_ = false;
+    };
+} // namespace
+
+outcome::result<std::unique_ptr<DiskIO>> MakeIoUringDiskIO(asio::io_context& io_context
+    , FilesOnDisk& files
+    , PieceBufferPool& buffers
+    , const DiskIOOptions& options)
+{
+    auto disk = std::make_unique<IoUringDiskIO>(io_context, files, buffers);
+    OUTCOME_TRY(disk->init(options));
+    return outcome::success(std::unique_ptr<DiskIO>(std::move(disk)));
+}
+
+#else
+
+outcome::result<std::unique_ptr<DiskIO>> MakeIoUringDiskIO(asio::io_context& io_context
+    , FilesOnDisk& files
+    , PieceBufferPool& buffers
+    , const DiskIOOptions& options)
+{
+    (void)io_context;
+    (void)files;
+    (void)buffers;
+    (void)options;
+    return outcome::failure(std::make_error_code(std::errc::not_supported));
+}
+
+#endif
+
+#undef BT_HAS_IO_URING
@@ -0,0 +1,189 @@
+#include "disk_io.h"
+
+#include <map>
+#include <utility>
+
+#include <cstring>
+#include <cassert>
+
+namespace
+{
+    struct CachedPiece
+    {
+        PieceBuffer data_;
+        OnDiskWrite on_done_;
+    };
+
+    // Holds completed pieces in memory and writes them in batches:
+    // adjacent pieces are merged into a single write per file.
+    // Pieces come in random order, so bigger budget gives longer runs.
+    class WriteCacheDiskIO final : public DiskIO
+    {
+    public:
+        explicit WriteCacheDiskIO(asio::io_context& io_context
+            , PieceBufferPool& buffers
+            , std::unique_ptr<DiskIO> backend
+            , const DiskIOOptions& options)
+            : buffers_(&buffers)
+            , backend_(std::move(backend))
+            , max_bytes_(options.write_cache_bytes_)
+            , max_age_(options.write_cache_age_)
+            , age_timer_(io_context)
+        {
+        }
+
+        ~WriteCacheDiskIO() override
+        {
+            flush();
+        }
+
+        void async_write_piece(std::uint32_t piece_index
+            , PieceBuffer data
+            , OnDiskWrite on_done) override
+        {
+            if (data.size_ > max_bytes_)
+            {
+                backend_->async_write_piece(piece_index, std::move(data), std::move(on_done));
+                return;
+            }
+            const bool was_empty = pieces_.empty();
+            bytes_ += data.size_;
+            auto [_, inserted] = pieces_.emplace(piece_index
+                , CachedPiece{std::move(data), std::move(on_done)});
+            assert(inserted && "Same piece written twice"); (void)inserted;
+            if (bytes_ >= max_bytes_)
+            {
+                flush();
+            }
+            else if (was_empty)
+            {
+                arm_age_timer();
+            }
+        }
+
+        void async_write_pieces(std::uint32_t first_piece_index
+            , std::vector<PieceBuffer> pieces
+            , OnDiskWriteRun on_done) override
+        {
+            backend_->async_write_pieces(first_piece_index, std::move(pieces), std::move(on_done));
+        }
+
+        void async_write_block(std::uint32_t piece_index
+            , std::uint32_t offset
+            , PieceBuffer data
+            , OnDiskWrite on_done) override
+        {
+            // Written through; cache has complete pieces only.
+            assert(pieces_.count(piece_index) == 0);
+            backend_->async_write_block(piece_index, offset, std::move(data), std::move(on_done));
+        }
+
+        void async_read(std::uint32_t piece_index
+            , std::uint32_t offset
+            , std::uint32_t size
+            , OnDiskRead on_done) override
+        {
+            auto it = pieces_.find(piece_index);
+            if (it == pieces_.end())
+            {
+                backend_->async_read(piece_index, offset, size, std::move(on_done));
+                return;
+            }
+            // Not on the disk yet.
+            const PieceBuffer& cached = it->second.data_;
+            assert((std::uint64_t(offset) + size) <= cached.size_);
+            PieceBuffer data = buffers_->acquire(size);
+            std::memcpy(data.data_, cached.data_ + offset, size);
+            asio::post(age_timer_.get_executor()
+                , [data = std::move(data), on_done = std::move(on_done)]() mutable
+            {
+                on_done(std::error_code(), std::move(data));
+            });
+        }
+
+        void async_run(DiskJobFunction job, OnDiskJob on_done) override
+        {
+            backend_->async_run(std::move(job), std::move(on_done));
+        }
+
+        bool is_congested() const override
+        {
+            return backend_->is_congested();
+        }
+
+        asio::awaitable<void> wait_until_ready() override
+        {
+            co_await backend_->wait_until_ready();
+        }
+
+        DiskCacheStats cache_stats() const override
+        {
+            DiskCacheStats stats = backend_->cache_stats();
+            stats.write_cached_bytes_ = bytes_;
+            return stats;
+        }
+
+        void flush() override
+        {
+            age_timer_.cancel();
+            auto it = pieces_.begin();
+            while (it != pieces_.end())
+            {
+                // Collect run of adjacent pieces.
+                const std::uint32_t first_piece_index = it->first;
+                std::vector<PieceBuffer> run;
+                std::vector<OnDiskWrite> callbacks;
+                std::uint32_t next_piece_index = first_piece_index;
+                while ((it != pieces_.end()) && (it->first == next_piece_index))
+                {
+                    run.push_back(std::move(it->second.data_));
+                    callbacks.push_back(std::move(it->second.on_done_));
+                    ++next_piece_index;
+                    it = pieces_.erase(it);
+                }
+                backend_->async_write_pieces(first_piece_index, std::move(run)
+                    , [callbacks = std::move(callbacks)](std::error_code ec, std::vector<PieceBuffer> run)
+                {
+                    assert(run.size() == callbacks.size());
+                    for (std::size_t i = 0; i < run.size(); ++i)
+                    {
+                        callbacks[i](ec, std::move(run[i]));
+                    }
+                });
+            }
+            bytes_ = 0;
+            backend_->flush();
+        }
+
+    private:
+        void arm_age_timer()
+        {
+            age_timer_.expires_after(max_age_);
+            age_timer_.async_wait([this](std::error_code ec)
+            {
+                if (ec != asio::error::operation_aborted)
+                {
+                    flush();
+                }
+            });
+        }
+
+    private:
+        PieceBufferPool* buffers_ = nullptr;
+        std::unique_ptr<DiskIO> backend_;
+        std::uint64_t max_bytes_ = 0;
+        std::chrono::milliseconds max_age_;
+        // Sorted by piece index, hence by offset in the files.
+        std::map<std::uint32_t, CachedPiece> pieces_;
+        std::uint64_t bytes_ = 0;
+        asio::steady_timer age_timer_;
+    };
+} // namespace
+
+std::unique_ptr<DiskIO> MakeWriteCacheDiskIO(asio::io_context& io_context
+    , PieceBufferPool& buffers
+    , std::unique_ptr<DiskIO> backend
+    , const DiskIOOptions& options)
+{
+    return std::make_unique<WriteCacheDiskIO>(io_context, buffers, std::move(backend), options);
+}
@@ -0,0 +1,116 @@
+#pragma once
+#include "utils_outcome.h"
+
+#include <filesystem>
+#include <string>
+
+#include <cstdint>
+
+#if defined(_WIN32)
+// HANDLE, stored as integer to not pull <Windows.h> everywhere.
+using NativeFileHandle = std::intptr_t;
+#else
+using NativeFileHandle = int;
+#endif
+
+constexpr NativeFileHandle k_invalid_file_handle = NativeFileHandle(-1);
+
+enum class FileSyncPolicy
+{
+    // Let the OS decide when to flush.
+    None,
+    // fdatasync()/FlushFileBuffers() once the file is fully written.
+    OnFileComplete,
+    // fdatasync()/FlushFileBuffers() after every write.
+    EveryWrite,
+};
+
+struct StorageOptions
+{
+    // Where to place downloaded files.
+    // Multi-file torrents get additional 'name' directory.
+    std::filesystem::path root_dir_ = ".";
+    // Files are reopened on demand, see FilesOnDisk. Keep below `ulimit -n`.
+    std::uint32_t max_open_files_ = 512;
+    FileSyncPolicy sync_ = FileSyncPolicy::OnFileComplete;
+    // Reserve disk blocks up-front (fallocate()) to avoid
+    // fragmentation. Otherwise, file is only resized (likely sparse).
+    bool preallocate_ = true;
+    // Map files into memory and receive blocks directly into
+    // the mapping (see FilesOnDisk::for_each_mapped()).
+    // Implies `preallocate_`: out of space on a sparse mapped file is SIGBUS,
+    // so open fails when the file system can't preallocate (POSIX).
+    bool memory_mapped_ = false;
+    // Write around the page cache (O_DIRECT), so downloaded data does not
+    // evict anything else. If the file system does not support it, cached
+    // pages are dropped after every write (posix_fadvise(POSIX_FADV_DONTNEED)).
+    // Not used with `memory_mapped_`. POSIX only.
+    bool bypass_page_cache_ = false;
+};
+
+// File offset and memory alignment needed for O_DIRECT I/O.
+constexpr std::uint32_t k_direct_io_alignment = 4096;
+
+// Part of the data for vectored write, see PhysicalFile::write_vectored().
+struct DataSlice
+{
+    const std::uint8_t* data_ = nullptr;
+    std::uint32_t size_ = 0;
+};
+
+// Single file on disk. Same interface for all platforms,
+// see file_storage_posix.cpp and file_storage_win32.cpp.
+// Writes and reads are positional (pwrite()/pread() or OVERLAPPED
+// offset on Windows), there is no shared file pointer.
+struct PhysicalFile
+{
+    NativeFileHandle file_ = k_invalid_file_handle;
+    // Whole file, when mapped.
+    std::uint8_t* mapped_ = nullptr;
+    std::uint64_t mapped_size_ = 0;
+    // File mapping object; Windows only.
+    NativeFileHandle mapping_ = k_invalid_file_handle;
+    // StorageOptions::bypass_page_cache_: second descriptor opened with O_DIRECT
+    // for the aligned part of writes; `file_` is used for the rest.
+    NativeFileHandle direct_file_ = k_invalid_file_handle;
+    // StorageOptions::bypass_page_cache_, but no O_DIRECT support.
+    bool drop_cache_ = false;
+
+    PhysicalFile() = default;
+    PhysicalFile(const PhysicalFile&) = delete;
+    PhysicalFile& operator=(const PhysicalFile&) = delete;
+    PhysicalFile(PhysicalFile&& rhs) noexcept;
+    PhysicalFile& operator=(PhysicalFile&& rhs) noexcept;
+    ~PhysicalFile();
+
+    bool is_open() const { return (file_ != k_invalid_file_handle); }
+
+    // Opens existing or creates new file and makes sure
+    // its size is exactly `final_size`. Does not truncate existing data.
+    outcome::result<void> open(const std::filesystem::path& path
+        , std::uint64_t final_size
+        , const StorageOptions& options);
+    // close_handle() and unmap().
+    void close();
+    // Closes the file, but not the mapping: mapped memory stays valid.
+    void close_handle();
+
+    outcome::result<void> write(const void* data, std::uint64_t offset, std::uint32_t size);
+    // Writes all `slices` one after another starting from `offset`
+    // with a single call (pwritev()) where possible.
+    outcome::result<void> write_vectored(const DataSlice* slices, std::size_t count, std::uint64_t offset);
+    outcome::result<void> read(void* data, std::uint64_t offset, std::uint32_t size);
+    // Flush file data (not necessarily metadata) to the disk.
+    outcome::result<void> sync();
+
+    // Maps whole file of `size` bytes for reading and writing.
+    // Unmapped on close(). Returns existing mapping, if any.
+    outcome::result<std::uint8_t*> map(std::uint64_t size);
+    void unmap();
+    // Writes dirty pages of [offset; offset + size) back to the disk.
+    // If not `wait`, only starts the write-back (msync(MS_ASYNC)/sync_file_range()).
+    outcome::result<void> flush_mapped(std::uint64_t offset, std::uint64_t size, bool wait);
+    // Hint that [offset; offset + size) is not needed in memory anymore
+    // (madvise(MADV_DONTNEED)). Data is not lost.
+    void discard_mapped(std::uint64_t offset, std::uint64_t size);
+};
@@ -0,0 +1,467 @@
+#if !defined(_WIN32)
+#include "file_storage.h"
+#include "utils_aligned.h"
+
+#include <memory>
+#include <utility>
+#include <vector>
+#include <system_error>
+
+#include <cerrno>
+#include <cstring>
+#include <cassert>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <limits.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+static std::error_code LastError()
+{
+    return std::error_code(errno, std::system_category());
+}
+
+// `must_allocate`: no fallback to sparse resize, see StorageOptions::memory_mapped_.
+static outcome::result<void> ResizeFile(int fd, std::uint64_t final_size
+    , bool preallocate, bool must_allocate)
+{
+    const off_t size = static_cast<off_t>(final_size);
+    if (preallocate && (size > 0))
+    {
+#if defined(__linux__)
+        // Mode 0: allocate blocks, extend the size, keep existing data.
+        if (::fallocate(fd, 0, 0, size) == 0)
+        {
+            return outcome::success();
+        }
+#endif
+#if !defined(__APPLE__)
+        // posix_fallocate() may emulate allocation by writing zeros
+        // when file system has no native support.
+        const int error = ::posix_fallocate(fd, 0, size);
+        if (error == 0)
+        {
+            return outcome::success();
+        }
+        if ((error != EINVAL) && (error != EOPNOTSUPP))
+        {
+            return outcome::failure(std::error_code(error, std::system_category()));
+        }
+#endif
+        // Not supported by the file system. Fallback to resize.
+        if (must_allocate)
+        {
+            return outcome::failure(std::make_error_code(std::errc::not_supported));
+        }
+    }
+
+    struct stat info{};
+    if (::fstat(fd, &info) != 0)
+    {
+        return outcome::failure(LastError());
+    }
+    if (info.st_size == size)
+    {
+        return outcome::success();
+    }
+    if (::ftruncate(fd, size) != 0)
+    {
+        return outcome::failure(LastError());
+    }
+    return outcome::success();
+}
+
+static std::uint64_t PageSize()
+{
+    static const std::uint64_t page_size = std::uint64_t(::sysconf(_SC_PAGESIZE));
+    return page_size;
+}
+
+static int OpenFile(const std::filesystem::path& path, int extra_flags)
+{
+    int fd = -1;
+    do
+    {
+        fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC | extra_flags, 0644);
+    }
+    while ((fd == -1) && (errno == EINTR));
+    return fd;
+}
+
+static outcome::result<void> WriteAll(int fd, const void* data, std::uint64_t offset, std::uint64_t size)
+{
+    const char* current = static_cast<const char*>(data);
+    std::uint64_t remaining = size;
+    while (remaining > 0)
+    {
+        const ssize_t written = ::pwrite(fd, current, std::size_t(remaining), static_cast<off_t>(offset));
+        if (written < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return outcome::failure(LastError());
+        }
+        if (written == 0)
+        {
+            // No progress; would loop forever.
+            return outcome::failure(std::make_error_code(std::errc::io_error));
+        }
+        // Short write: disk full or signal. Try the rest.
+        current += written;
+        offset += std::uint64_t(written);
+        remaining -= std::uint64_t(written);
+    }
+    return outcome::success();
+}
+
+// Page cache keeps dirty pages no matter what; write them out first.
+static void DropCachedRange(int fd, std::uint64_t offset, std::uint64_t size)
+{
+#if defined(__linux__)
+    (void)::sync_file_range(fd, off_t(offset), off_t(size)
+        , SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+#endif
+#if defined(POSIX_FADV_DONTNEED)
+    (void)::posix_fadvise(fd, off_t(offset), off_t(size), POSIX_FADV_DONTNEED);
+#else
+    (void)fd; (void)offset; (void)size;
+#endif
+}
+
+// O_DIRECT needs file offset, size and memory to be aligned.
+// Aligned middle part goes to `direct_fd`: as is, when memory is aligned,
+// otherwise thru aligned bounce buffer. Unaligned head and tail
+// are written thru page cache (`fd`) and dropped from it: read-modify-write
+// of the whole block would race with neighbour pieces written concurrently.
+static outcome::result<void> WriteDirect(int fd, int direct_fd
+    , const std::uint8_t* data, std::uint64_t offset, std::uint32_t size)
+{
+    const std::uint64_t k_align = k_direct_io_alignment;
+    const std::uint64_t begin = offset;
+    const std::uint64_t end = (offset + size);
+    const std::uint64_t aligned_begin = ((begin + k_align - 1) / k_align) * k_align;
+    const std::uint64_t aligned_end = (end / k_align) * k_align;
+    if (aligned_begin >= aligned_end)
+    {
+        OUTCOME_TRY(WriteAll(fd, data, offset, size));
+        DropCachedRange(fd, offset, size);
+        return outcome::success();
+    }
+    if (begin < aligned_begin)
+    {
+        OUTCOME_TRY(WriteAll(fd, data, begin, aligned_begin - begin));
+        DropCachedRange(fd, begin, aligned_begin - begin);
+    }
+    if (aligned_end < end)
+    {
+        OUTCOME_TRY(WriteAll(fd, data + (aligned_end - begin), aligned_end, end - aligned_end));
+        DropCachedRange(fd, aligned_end, end - aligned_end);
+    }
+
+    const std::uint8_t* middle = data + (aligned_begin - begin);
+    const std::uint64_t middle_size = (aligned_end - aligned_begin);
+    if ((reinterpret_cast<std::uintptr_t>(middle) % k_align) == 0)
+    {
+        return WriteAll(direct_fd, middle, aligned_begin, middle_size);
+    }
+    // Piece buffers are aligned, but piece may start in the middle
+    // of the file block (multi-file torrents).
+    const std::size_t k_bounce_size = 256 * 1024;
+    thread_local std::unique_ptr<std::uint8_t[], AlignedDeleter<k_direct_io_alignment>> bounce(
+        AlignedNew(k_bounce_size, k_direct_io_alignment));
+    std::uint64_t done = 0;
+    while (done < middle_size)
+    {
+        const std::size_t chunk = std::size_t(std::min<std::uint64_t>(k_bounce_size, middle_size - done));
+        std::memcpy(bounce.get(), middle + done, chunk);
+        OUTCOME_TRY(WriteAll(direct_fd, bounce.get(), aligned_begin + done, chunk));
+        done += chunk;
+    }
+    return outcome::success();
+}
+
+PhysicalFile::PhysicalFile(PhysicalFile&& rhs) noexcept
+    : file_(std::exchange(rhs.file_, k_invalid_file_handle))
+    , mapped_(std::exchange(rhs.mapped_, nullptr))
+    , mapped_size_(std::exchange(rhs.mapped_size_, 0))
+    , mapping_(std::exchange(rhs.mapping_, k_invalid_file_handle))
+    , direct_file_(std::exchange(rhs.direct_file_, k_invalid_file_handle))
+    , drop_cache_(std::exchange(rhs.drop_cache_, false))
+{
+}
+
+PhysicalFile& PhysicalFile::operator=(PhysicalFile&& rhs) noexcept
+{
+    if (this != &rhs)
+    {
+        close();
+        file_ = std::exchange(rhs.file_, k_invalid_file_handle);
+        mapped_ = std::exchange(rhs.mapped_, nullptr);
+        mapped_size_ = std::exchange(rhs.mapped_size_, 0);
+        mapping_ = std::exchange(rhs.mapping_, k_invalid_file_handle);
+        direct_file_ = std::exchange(rhs.direct_file_, k_invalid_file_handle);
+        drop_cache_ = std::exchange(rhs.drop_cache_, false);
+    }
+    return *this;
+}
+
+PhysicalFile::~PhysicalFile()
+{
+    close();
+}
+
+void PhysicalFile::close()
+{
+    unmap();
+    close_handle();
+}
+
+void PhysicalFile::close_handle()
+{
+    if (direct_file_ != k_invalid_file_handle)
+    {
+        (void)::close(direct_file_);
+        direct_file_ = k_invalid_file_handle;
+    }
+    if (file_ != k_invalid_file_handle)
+    {
+        (void)::close(file_);
+        file_ = k_invalid_file_handle;
+    }
+    drop_cache_ = false;
+}
+
+outcome::result<void> PhysicalFile::open(const std::filesystem::path& path
+    , std::uint64_t final_size
+    , const StorageOptions& options)
+{
+    if (file_ != k_invalid_file_handle)
+    {
+        return outcome::success();
+    }
+    const int fd = OpenFile(path, 0);
+    if (fd == -1)
+    {
+        return outcome::failure(LastError());
+    }
+    file_ = fd;
+
+    auto resized = ResizeFile(fd, final_size
+        , (options.preallocate_ || options.memory_mapped_)
+        , options.memory_mapped_);
+    if (!resized)
+    {
+        close();
+        return resized;
+    }
+
+    if (options.bypass_page_cache_ && !options.memory_mapped_)
+    {
+#if defined(O_DIRECT)
+        const int direct_fd = OpenFile(path, O_DIRECT);
+        if (direct_fd != -1)
+        {
+            direct_file_ = direct_fd;
+            return outcome::success();
+        }
+        // EINVAL: file system does not support O_DIRECT (e.g., tmpfs).
+#elif defined(__APPLE__)
+        if (::fcntl(fd, F_NOCACHE, 1) == 0)
+        {
+            return outcome::success();
+        }
+#endif
+        drop_cache_ = true;
+    }
+    return outcome::success();
+}
+
+outcome::result<void> PhysicalFile::write(const void* data, std::uint64_t offset, std::uint32_t size)
+{
+    assert(file_ != k_invalid_file_handle);
+    if (direct_file_ != k_invalid_file_handle)
+    {
+        return WriteDirect(file_, direct_file_, static_cast<const std::uint8_t*>(data), offset, size);
+    }
+    OUTCOME_TRY(WriteAll(file_, data, offset, size));
+    if (drop_cache_)
+    {
+        DropCachedRange(file_, offset, size);
+    }
+    return outcome::success();
+}
+
+outcome::result<void> PhysicalFile::write_vectored(const DataSlice* slices, std::size_t count, std::uint64_t offset)
+{
+    assert(file_ != k_invalid_file_handle);
+    if ((count == 1) || (direct_file_ != k_invalid_file_handle))
+    {
+        // O_DIRECT: slices are aligned (or not) independently.
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            OUTCOME_TRY(write(slices[i].data_, offset, slices[i].size_));
+            offset += slices[i].size_;
+        }
+        return outcome::success();
+    }
+    const std::uint64_t start_offset = offset;
+    std::vector<iovec> vectors(count);
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        vectors[i].iov_base = const_cast<std::uint8_t*>(slices[i].data_);
+        vectors[i].iov_len = slices[i].size_;
+    }
+    iovec* current = vectors.data();
+    iovec* const end = (vectors.data() + vectors.size());
+    while (current != end)
+    {
+        const int iov_count = int(std::min<std::ptrdiff_t>(end - current, IOV_MAX));
+        ssize_t written = ::pwritev(file_, current, iov_count, static_cast<off_t>(offset));
+        if (written < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return outcome::failure(LastError());
+        }
+        if (written == 0)
+        {
+            // No progress; would loop forever.
+            return outcome::failure(std::make_error_code(std::errc::io_error));
+        }
+        offset += std::uint64_t(written);
+        // Skip fully written slices; adjust partially written one.
+        while ((current != end) && (std::size_t(written) >= current->iov_len))
+        {
+            written -= ssize_t(current->iov_len);
+            ++current;
+        }
+        if (current != end)
+        {
+            current->iov_base = static_cast<char*>(current->iov_base) + written;
+            current->iov_len -= std::size_t(written);
+        }
+    }
+    if (drop_cache_)
+    {
+        DropCachedRange(file_, start_offset, offset - start_offset);
+    }
+    return outcome::success();
+}
+
+outcome::result<void> PhysicalFile::read(void* data, std::uint64_t offset, std::uint32_t size)
+{
+    assert(file_ != k_invalid_file_handle);
+    char* current = static_cast<char*>(data);
+    std::uint32_t remaining = size;
+    while (remaining > 0)
+    {
+        const ssize_t read = ::pread(file_, current, remaining, static_cast<off_t>(offset));
+        if (read < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return outcome::failure(LastError());
+        }
+        if (read == 0)
+        {
+            // Reading past the end of file.
+            return outcome::failure(std::make_error_code(std::errc::io_error));
+        }
+        current += read;
+        offset += std::uint64_t(read);
+        remaining -= std::uint32_t(read);
+    }
+    return outcome::success();
+}
+
+outcome::result<void> PhysicalFile::sync()
+{
+    assert(file_ != k_invalid_file_handle);
+#if defined(__APPLE__)
+    const int status = ::fsync(file_);
+#else
+    const int status = ::fdatasync(file_);
+#endif
+    if (status != 0)
+    {
+        return outcome::failure(LastError());
+    }
+    return outcome::success();
+}
+
+outcome::result<std::uint8_t*> PhysicalFile::map(std::uint64_t size)
+{
+    assert(file_ != k_invalid_file_handle);
+    assert(size > 0);
+    if (mapped_)
+    {
+        assert(mapped_size_ == size);
+        return outcome::success(mapped_);
+    }
+    void* ptr = ::mmap(nullptr, std::size_t(size), PROT_READ | PROT_WRITE, MAP_SHARED, file_, 0);
+    if (ptr == MAP_FAILED)
+    {
+        return outcome::failure(LastError());
+    }
+    mapped_ = static_cast<std::uint8_t*>(ptr);
+    mapped_size_ = size;
+    return outcome::success(mapped_);
+}
+
+void PhysicalFile::unmap()
+{
+    if (mapped_)
+    {
+        (void)::munmap(mapped_, std::size_t(mapped_size_));
+        mapped_ = nullptr;
+        mapped_size_ = 0;
+    }
+}
+
+outcome::result<void> PhysicalFile::flush_mapped(std::uint64_t offset, std::uint64_t size, bool wait)
+{
+    assert(mapped_);
+    assert((offset + size) <= mapped_size_);
+#if defined(__linux__)
+    if (!wait)
+    {
+        // msync(MS_ASYNC) is no-op on Linux; kick the write-back explicitly.
+        if (::sync_file_range(file_, off_t(offset), off_t(size), SYNC_FILE_RANGE_WRITE) != 0)
+        {
+            return outcome::failure(LastError());
+        }
+        return outcome::success();
+    }
+#endif
+    // msync() needs page-aligned address.
+    const std::uint64_t aligned = (offset / PageSize()) * PageSize();
+    if (::msync(mapped_ + aligned, std::size_t(size + (offset - aligned))
+        , wait ? MS_SYNC : MS_ASYNC) != 0)
+    {
+        return outcome::failure(LastError());
+    }
+    return outcome::success();
+}
+
+void PhysicalFile::discard_mapped(std::uint64_t offset, std::uint64_t size)
+{
+    assert(mapped_);
+    assert((offset + size) <= mapped_size_);
+    // Only whole pages inside the range; the rest may belong to other pieces.
+    const std::uint64_t page = PageSize();
+    const std::uint64_t start = ((offset + page - 1) / page) * page;
+    const std::uint64_t end = ((offset + size) / page) * page;
+    if (start < end)
+    {
+        (void)::madvise(mapped_ + start, std::size_t(end - start), MADV_DONTNEED);
+    }
+}
+#endif
@@ -0,0 +1,234 @@
+#if defined(_WIN32)
+#include "file_storage.h"
+
+#include <utility>
+#include <system_error>
+
+#include <cassert>
+
+#include <Windows.h>
+
+static std::error_code LastError()
+{
+    return std::error_code(int(::GetLastError()), std::system_category());
+}
+
+static HANDLE AsHandle(NativeFileHandle file)
+{
+    return reinterpret_cast<HANDLE>(file);
+}
+
+static OVERLAPPED AsOverlappedOffset(std::uint64_t offset)
+{
+    // For synchronous handle OVERLAPPED is only used
+    // to pass the offset; no need for SetFilePointerEx().
+    OVERLAPPED overlapped{};
+    overlapped.Offset = DWORD(offset & 0xffff'ffffu);
+    overlapped.OffsetHigh = DWORD(offset >> 32);
+    return overlapped;
+}
+
+PhysicalFile::PhysicalFile(PhysicalFile&& rhs) noexcept
+    : file_(std::exchange(rhs.file_, k_invalid_file_handle))
+    , mapped_(std::exchange(rhs.mapped_, nullptr))
+    , mapped_size_(std::exchange(rhs.mapped_size_, 0))
+    , mapping_(std::exchange(rhs.mapping_, k_invalid_file_handle))
+    , direct_file_(std::exchange(rhs.direct_file_, k_invalid_file_handle))
+    , drop_cache_(std::exchange(rhs.drop_cache_, false))
+{
+}
+
+PhysicalFile& PhysicalFile::operator=(PhysicalFile&& rhs) noexcept
+{
+    if (this != &rhs)
+    {
+        close();
+        file_ = std::exchange(rhs.file_, k_invalid_file_handle);
+        mapped_ = std::exchange(rhs.mapped_, nullptr);
+        mapped_size_ = std::exchange(rhs.mapped_size_, 0);
+        mapping_ = std::exchange(rhs.mapping_, k_invalid_file_handle);
+        direct_file_ = std::exchange(rhs.direct_file_, k_invalid_file_handle);
+        drop_cache_ = std::exchange(rhs.drop_cache_, false);
+    }
+    return *this;
+}
+
+PhysicalFile::~PhysicalFile()
+{
+    close();
+}
+
+void PhysicalFile::close()
+{
+    unmap();
+    close_handle();
+}
+
+void PhysicalFile::close_handle()
+{
+    if (file_ != k_invalid_file_handle)
+    {
+        (void)::CloseHandle(AsHandle(file_));
+        file_ = k_invalid_file_handle;
+    }
+}
+
+outcome::result<void> PhysicalFile::open(const std::filesystem::path& path
+    , std::uint64_t final_size
+    , const StorageOptions& options)
+{
+    (void)options.preallocate_; // SetEndOfFile() always allocates on NTFS.
+    // FILE_FLAG_NO_BUFFERING needs sector-aligned writes and has no
+    // buffered fallback for unaligned parts; not supported.
+    (void)options.bypass_page_cache_;
+    if (file_ != k_invalid_file_handle)
+    {
+        return outcome::success();
+    }
+    const HANDLE file = ::CreateFileW(path.c_str()
+        , GENERIC_READ | GENERIC_WRITE
+        , FILE_SHARE_READ
+        , nullptr
+        , OPEN_ALWAYS
+        , FILE_ATTRIBUTE_NORMAL
+        , nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        return outcome::failure(LastError());
+    }
+    file_ = reinterpret_cast<NativeFileHandle>(file);
+
+    LARGE_INTEGER size{};
+    size.QuadPart = static_cast<LONGLONG>(final_size);
+    if (!::SetFilePointerEx(file, size, nullptr, FILE_BEGIN)
+        || !::SetEndOfFile(file))
+    {
+        const std::error_code ec = LastError();
+        close();
+        return outcome::failure(ec);
+    }
+    return outcome::success();
+}
+
+outcome::result<void> PhysicalFile::write(const void* data, std::uint64_t offset, std::uint32_t size)
+{
+    assert(file_ != k_invalid_file_handle);
+    OVERLAPPED overlapped = AsOverlappedOffset(offset);
+    DWORD written = 0;
+    if (!::WriteFile(AsHandle(file_), data, size, &written, &overlapped))
+    {
+        return outcome::failure(LastError());
+    }
+    assert(written == size);
+    return outcome::success();
+}
+
+outcome::result<void> PhysicalFile::write_vectored(const DataSlice* slices, std::size_t count, std::uint64_t offset)
+{
+    // WriteFileGather() needs page-aligned buffers and unbuffered I/O;
+    // sequential writes to adjacent offsets are good enough.
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        OUTCOME_TRY(write(slices[i].data_, offset, slices[i].size_));
+        offset += slices[i].size_;
+    }
+    return outcome::success();
+}
+
+outcome::result<void> PhysicalFile::read(void* data, std::uint64_t offset, std::uint32_t size)
+{
+    assert(file_ != k_invalid_file_handle);
+    OVERLAPPED overlapped = AsOverlappedOffset(offset);
+    DWORD read = 0;
+    if (!::ReadFile(AsHandle(file_), data, size, &read, &overlapped))
+    {
+        return outcome::failure(LastError());
+    }
+    if (read != size)
+    {
+        return outcome::failure(std::make_error_code(std::errc::io_error));
+    }
+    return outcome::success();
+}
+
+outcome::result<void> PhysicalFile::sync()
+{
+    assert(file_ != k_invalid_file_handle);
+    if (!::FlushFileBuffers(AsHandle(file_)))
+    {
+        return outcome::failure(LastError());
+    }
+    return outcome::success();
+}
+
+outcome::result<std::uint8_t*> PhysicalFile::map(std::uint64_t size)
+{
+    assert(file_ != k_invalid_file_handle);
+    assert(size > 0);
+    if (mapped_)
+    {
+        assert(mapped_size_ == size);
+        return outcome::success(mapped_);
+    }
+    const HANDLE mapping = ::CreateFileMappingW(AsHandle(file_)
+        , nullptr
+        , PAGE_READWRITE
+        , DWORD(size >> 32)
+        , DWORD(size & 0xffff'ffffu)
+        , nullptr);
+    if (!mapping)
+    {
+        return outcome::failure(LastError());
+    }
+    void* ptr = ::MapViewOfFile(mapping, FILE_MAP_READ | FILE_MAP_WRITE, 0, 0, SIZE_T(size));
+    if (!ptr)
+    {
+        const std::error_code ec = LastError();
+        (void)::CloseHandle(mapping);
+        return outcome::failure(ec);
+    }
+    mapping_ = reinterpret_cast<NativeFileHandle>(mapping);
+    mapped_ = static_cast<std::uint8_t*>(ptr);
+    mapped_size_ = size;
+    return outcome::success(mapped_);
+}
+
+void PhysicalFile::unmap()
+{
+    if (mapped_)
+    {
+        (void)::UnmapViewOfFile(mapped_);
+        mapped_ = nullptr;
+        mapped_size_ = 0;
+    }
+    if (mapping_ != k_invalid_file_handle)
+    {
+        (void)::CloseHandle(AsHandle(mapping_));
+        mapping_ = k_invalid_file_handle;
+    }
+}
+
+outcome::result<void> PhysicalFile::flush_mapped(std::uint64_t offset, std::uint64_t size, bool wait)
+{
+    assert(mapped_);
+    assert((offset + size) <= mapped_size_);
+    // Starts the write-back, does not wait for it.
+    if (!::FlushViewOfFile(mapped_ + offset, SIZE_T(size)))
+    {
+        return outcome::failure(LastError());
+    }
+    if (wait)
+    {
+        return sync();
+    }
+    return outcome::success();
+}
+
+void PhysicalFile::discard_mapped(std::uint64_t offset, std::uint64_t size)
+{
+    // No madvise(MADV_DONTNEED) analog for the file-backed views;
+    // OS trims the working set itself.
+    (void)offset;
+    (void)size;
+}
+#endif
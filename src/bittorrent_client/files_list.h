@@ -0,0 +1,356 @@
+#pragma once
+#include "torrent_client.h"
+
+#include <bencoding/be_torrent_file_parse.h>
+
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <limits>
+
+#include <cstdint>
+#include <cassert>
+
+struct FileOffset
+{
+    std::uint64_t start = 0;
+    std::uint64_t end = 0;
+    std::size_t file_index = 0;
+    const std::string* name = nullptr;
+    // BEP 47 padding file: implicit zeros, never read nor written.
+    bool padding = false;
+};
+
+struct FilePiece
+{
+    std::size_t file_index_;
+    const std::string* file_name_ = nullptr;
+    std::uint64_t file_offset_ = 0;
+    std::uint64_t bytes_count_ = 0;
+    std::uint64_t piece_offset_ = 0;
+    std::uint64_t file_size_ = 0;
+};
+
+// Part of the piece that belongs to a single file.
+struct PieceExtent
+{
+    std::uint64_t file_offset_ = 0;
+    std::uint32_t file_index_ = 0;
+    std::uint32_t piece_offset_ = 0;
+    std::uint32_t bytes_count_ = 0;
+};
+
+// Extents index (FilesList::piece_extents_) is not built
+// if it needs more memory than that.
+constexpr std::uint64_t k_max_extents_index_bytes = 64 * 1024 * 1024;
+
+struct FilesList
+{
+    const be::TorrentClient* torrent_;
+    std::vector<FileOffset> files_offset_;
+    // Extents of piece `i` are [piece_extents_[i]; piece_extents_[i + 1])
+    // of `extents_`, in the piece order. Both empty when the index is
+    // too big; lookups binary search `files_offset_` then.
+    std::vector<std::uint32_t> piece_extents_;
+    std::vector<PieceExtent> extents_;
+    // Total size of padding files (see FileOffset::padding).
+    std::uint64_t padding_bytes_ = 0;
+
+    static FilesList make(const be::TorrentClient& torrent
+        , std::uint64_t max_index_bytes = k_max_extents_index_bytes)
+    {
+        using LengthOrFiles = be::TorrentMetainfo::LengthOrFiles;
+        using File = be::TorrentMetainfo::File;
+        const LengthOrFiles& data = torrent.metainfo_.info_.length_or_files_;
+
+        FilesList list;
+        list.torrent_ = &torrent;
+        if (const std::uint64_t* single_file = std::get_if<std::uint64_t>(&data))
+        {
+            list.files_offset_.push_back({});
+            FileOffset& offset = list.files_offset_.back();
+            offset.file_index = 0;
+            offset.start = 0;
+            offset.end = *single_file;
+            offset.name = &torrent.metainfo_.info_.suggested_name_utf8_;
+        }
+        else if (const auto* multi_files
+            = std::get_if<std::vector<File>>(&data))
+        {
+            list.files_offset_.reserve(multi_files->size());
+            FileOffset fo;
+            fo.start = 0;
+            for (std::size_t index = 0, count = multi_files->size(); index < count; ++index)
+            {
+                const File& file = (*multi_files)[index];
+                fo.end = fo.start + file.length_bytes_;
+                fo.file_index = index;
+                fo.name = &file.path_utf8_;
+                fo.padding = file.is_padding();
+                if (fo.padding)
+                {
+                    list.padding_bytes_ += file.length_bytes_;
+                }
+                list.files_offset_.push_back(fo);
+                fo.start = fo.end;
+            }
+        }
+        else
+        {
+            assert(false && "Invalid torrent metainfo.");
+        }
+        assert(list.files_offset_.size() > 0);
+        assert(list.files_offset_.back().end == torrent.get_total_size_bytes());
+        list.build_extents_index(max_index_bytes);
+        return list;
+    }
+
+    // Every piece gets at most one extent per file boundary it crosses
+    // (and per empty file inside it).
+    void build_extents_index(std::uint64_t max_index_bytes)
+    {
+        const std::uint32_t pieces_count = torrent_->get_pieces_count();
+        const std::uint64_t max_extents = (std::uint64_t(pieces_count) + files_offset_.size());
+        const std::uint64_t index_bytes = (sizeof(std::uint32_t) * (pieces_count + 1ull))
+            + (sizeof(PieceExtent) * max_extents);
+        if ((index_bytes > max_index_bytes)
+            || (max_extents > std::numeric_limits<std::uint32_t>::max()))
+        {
+            return;
+        }
+        piece_extents_.reserve(pieces_count + 1);
+        extents_.reserve(std::size_t(max_extents));
+        for (std::uint32_t piece_index = 0; piece_index < pieces_count; ++piece_index)
+        {
+            piece_extents_.push_back(std::uint32_t(extents_.size()));
+            const std::uint64_t start = piece_offset(piece_index);
+            search_files(start, piece_end(piece_index)
+                , [&](const FilePiece& file_piece)
+            {
+                PieceExtent extent;
+                extent.file_offset_ = file_piece.file_offset_;
+                extent.file_index_ = std::uint32_t(file_piece.file_index_);
+                extent.piece_offset_ = std::uint32_t(file_piece.piece_offset_);
+                extent.bytes_count_ = std::uint32_t(file_piece.bytes_count_);
+                extents_.push_back(extent);
+            });
+        }
+        piece_extents_.push_back(std::uint32_t(extents_.size()));
+    }
+
+    bool has_extents_index() const
+    {
+        return !piece_extents_.empty();
+    }
+
+    // F(const FilePiece& file_piece)
+    // Padding files are skipped; FilePiece::piece_offset_ is still
+    // relative to `start_bytes`, so there are gaps in their place.
+    template<typename F>
+    void iterate_files(std::uint64_t start_bytes, std::uint64_t end_bytes, F f) const
+    {
+        assert(end_bytes > start_bytes);
+        if (has_extents_index())
+        {
+            const std::uint64_t piece_size = torrent_->get_piece_size_bytes();
+            const std::uint64_t piece_index = (start_bytes / piece_size);
+            if (((end_bytes - 1) / piece_size) == piece_index)
+            {
+                // Block (or whole piece) read/write: O(extents in the piece),
+                // 1 or 2 for anything but many small files.
+                const std::uint64_t start = (piece_index * piece_size);
+                iterate_extents(std::uint32_t(piece_index)
+                    , std::uint32_t(start_bytes - start)
+                    , std::uint32_t(end_bytes - start)
+                    , std::move(f));
+                return;
+            }
+        }
+        // Spans several pieces.
+        search_files(start_bytes, end_bytes, std::move(f));
+    }
+
+    // F(const FilePiece& file_piece) for [start; end) part of the piece,
+    // from the extents index.
+    template<typename F>
+    void iterate_extents(std::uint32_t piece_index, std::uint32_t start, std::uint32_t end, F f) const
+    {
+        assert(has_extents_index());
+        assert(piece_index + 1 < piece_extents_.size());
+        assert(end > start);
+        const PieceExtent* first = extents_.data() + piece_extents_[piece_index];
+        const PieceExtent* last = extents_.data() + piece_extents_[piece_index + 1];
+        // First extent that ends after `start`; empty files at `start` are skipped,
+        // same as search_files() does.
+        first = std::partition_point(first, last, [start](const PieceExtent& extent)
+        {
+            return ((extent.piece_offset_ + extent.bytes_count_) <= start);
+        });
+
+        for (const PieceExtent* extent = first; (extent != last) && (extent->piece_offset_ < end); ++extent)
+        {
+            const FileOffset& fo = files_offset_[extent->file_index_];
+            const std::uint32_t start_offset = std::max(start, extent->piece_offset_);
+            const std::uint32_t end_offset = std::min(end, extent->piece_offset_ + extent->bytes_count_);
+
+            FilePiece piece;
+            piece.file_index_ = fo.file_index;
+            piece.file_name_ = fo.name;
+            piece.file_offset_ = extent->file_offset_ + (start_offset - extent->piece_offset_);
+            piece.bytes_count_ = (end_offset - start_offset);
+            piece.piece_offset_ = (start_offset - start);
+            piece.file_size_ = (fo.end - fo.start);
+
+            f(piece);
+        }
+    }
+
+    // Same as iterate_files(), but also invokes
+    // P(std::uint64_t piece_offset, std::uint64_t bytes_count)
+    // for every padding range, in order.
+    template<typename F, typename P>
+    void iterate_files(std::uint64_t start_bytes, std::uint64_t end_bytes, F f, P on_padding) const
+    {
+        std::uint64_t position = 0;
+        iterate_files(start_bytes, end_bytes, [&](const FilePiece& file_piece)
+        {
+            if (file_piece.piece_offset_ > position)
+            {
+                on_padding(position, file_piece.piece_offset_ - position);
+            }
+            f(file_piece);
+            position = (file_piece.piece_offset_ + file_piece.bytes_count_);
+        });
+        if ((end_bytes - start_bytes) > position)
+        {
+            on_padding(position, (end_bytes - start_bytes) - position);
+        }
+    }
+
+    // [start_bytes; end_bytes) has nothing but padding files.
+    bool is_padding(std::uint64_t start_bytes, std::uint64_t end_bytes) const
+    {
+        if (padding_bytes_ == 0)
+        {
+            return false;
+        }
+        bool has_data = false;
+        iterate_files(start_bytes, end_bytes, [&](const FilePiece& file_piece)
+        {
+            has_data = has_data || (file_piece.bytes_count_ > 0);
+        });
+        return !has_data;
+    }
+
+    // F(const FilePiece& file_piece)
+    // Binary search of the files that overlap [start_bytes; end_bytes).
+    template<typename F>
+    void search_files(std::uint64_t start_bytes, std::uint64_t end_bytes, F f) const
+    {
+        assert(end_bytes > start_bytes);
+        assert(files_offset_.size() > 0);
+
+        auto end = files_offset_.end();
+        auto it_start = std::lower_bound(files_offset_.begin(), end, start_bytes
+            , [](const FileOffset& lhs, std::uint64_t rhs) { return (lhs.start < rhs); });
+        if (it_start == end)
+        {
+            // File with start >= start_bytes. Must be the last one.
+            it_start = (end - 1);
+        }
+        if (it_start->start > start_bytes)
+        {
+            // Found the file with start > start_bytes.
+            // File that has start < start_bytes is previous one.
+            --it_start;
+        }
+        // start_bytes should be in file's [start; end).
+        assert((start_bytes >= it_start->start)
+            && (start_bytes < it_start->end));
+
+        // Find the file where the end_bytes is. It starts from
+        // already found it_start file for sure.
+        auto it_end = std::lower_bound(it_start, end, end_bytes
+            , [](const FileOffset& lhs, std::uint64_t rhs)
+                { return (lhs.end < rhs); });
+        // There is always file with end >= end_bytes.
+        // Otherwise caller tries to write past the end of the file.
+        assert(it_end != end);
+        // Either the same or next file(s).
+        assert(it_end >= it_start);
+        // end_bytes should be in file's (start; end].
+        assert((end_bytes > it_end->start)
+            && (end_bytes <= it_end->end));
+
+        std::uint64_t data_offset = 0;
+        // Iterate thru all files that overlap with [start_bytes; end_bytes].
+        for (auto it = it_start; it != (it_end + 1); ++it)
+        {
+            const FileOffset& fo = *it;
+            const std::uint64_t start_offset = std::max(start_bytes, fo.start);
+            const std::uint64_t end_offset = std::min(fo.end, end_bytes);
+
+            FilePiece piece;
+            piece.file_index_ = fo.file_index;
+            piece.file_name_ = fo.name;
+            piece.file_offset_ = (start_offset - fo.start);
+            piece.bytes_count_ = (end_offset - start_offset);
+            piece.piece_offset_ = data_offset;
+            piece.file_size_ = (fo.end - fo.start);
+
+            if (!fo.padding)
+            {
+                f(piece);
+            }
+            // Consumed part of the input range.
+            data_offset += piece.bytes_count_;
+        }
+        // We should consume all the range passed.
+        assert(data_offset == (end_bytes - start_bytes));
+    }
+
+    // Whole file `file_index` (see FileOffset::file_index) as a single part.
+    FilePiece whole_file(std::size_t file_index) const
+    {
+        assert(file_index < files_offset_.size());
+        const FileOffset& fo = files_offset_[file_index];
+
+        FilePiece piece;
+        piece.file_index_ = fo.file_index;
+        piece.file_name_ = fo.name;
+        piece.file_offset_ = 0;
+        piece.bytes_count_ = (fo.end - fo.start);
+        piece.piece_offset_ = 0;
+        piece.file_size_ = (fo.end - fo.start);
+        return piece;
+    }
+
+    // Offset of the piece from the start of the torrent data.
+    std::uint64_t piece_offset(std::uint32_t piece_index) const
+    {
+        return (piece_index * std::uint64_t(torrent_->get_piece_size_bytes()));
+    }
+
+    // End of the piece (last one may be short).
+    std::uint64_t piece_end(std::uint32_t piece_index) const
+    {
+        assert(files_offset_.size() > 0);
+        const std::uint64_t total_size = files_offset_.back().end;
+        const std::uint64_t end = piece_offset(piece_index) + torrent_->get_piece_size_bytes();
+        return std::min(end, total_size);
+    }
+
+    // F(const FilePiece& file_piece)
+    template<typename F>
+    void iterate_files(std::uint32_t piece_index, F f) const
+    {
+        const std::uint64_t start = piece_offset(piece_index);
+        const std::uint64_t end = piece_end(piece_index);
+        if (has_extents_index())
+        {
+            iterate_extents(piece_index, 0, std::uint32_t(end - start), std::move(f));
+            return;
+        }
+        search_files(start, end, std::move(f));
+    }
+};
@@ -0,0 +1,388 @@
+#include "files_on_disk.h"
+#include "client_errors.h"
+
+#include <algorithm>
+#include <system_error>
+#include <utility>
+
+#include <cstring>
+#include <cassert>
+
+static std::filesystem::path FromUTF8(const std::string& str)
+{
+    return std::filesystem::path(std::u8string(str.begin(), str.end()));
+}
+
+// Paths come from .torrent file; don't let them escape `root_dir_`.
+static bool IsSafeRelativePath(const std::filesystem::path& path)
+{
+    if (path.empty()
+        || path.has_root_name()
+        || path.has_root_directory())
+    {
+        return false;
+    }
+    for (const std::filesystem::path& part : path)
+    {
+        if ((part == "..") || (part == "."))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+/*explicit*/ FileLease::FileLease(FilesOnDisk& owner, std::size_t file_index)
+    : owner_(&owner)
+    , file_index_(file_index)
+    , file_(&owner.files_[file_index])
+{
+}
+
+FileLease::FileLease(FileLease&& rhs) noexcept
+    : owner_(std::exchange(rhs.owner_, nullptr))
+    , file_index_(std::exchange(rhs.file_index_, 0))
+    , file_(std::exchange(rhs.file_, nullptr))
+{
+}
+
+FileLease& FileLease::operator=(FileLease&& rhs) noexcept
+{
+    if (this != &rhs)
+    {
+        reset();
+        owner_ = std::exchange(rhs.owner_, nullptr);
+        file_index_ = std::exchange(rhs.file_index_, 0);
+        file_ = std::exchange(rhs.file_, nullptr);
+    }
+    return *this;
+}
+
+FileLease::~FileLease()
+{
+    reset();
+}
+
+void FileLease::reset()
+{
+    if (owner_)
+    {
+        owner_->release_file(file_index_);
+        owner_ = nullptr;
+        file_ = nullptr;
+    }
+}
+
+/*explicit*/ FilesOnDisk::FilesOnDisk(const FilesList& files_list
+    , StorageOptions options /*= {}*/)
+    : files_()
+    , files_list_(&files_list)
+    , options_(std::move(options))
+{
+    const std::size_t count = files_list_->files_offset_.size();
+    files_.resize(count);
+    written_.resize(count, 0);
+    pins_.resize(count, 0);
+    unused_it_.resize(count, unused_.end());
+}
+
+outcome::result<void> FilesOnDisk::write_piece(std::uint32_t piece_index
+    , const std::uint8_t* data, std::size_t size)
+{
+    assert(data);
+    assert(size > 0);
+    const DataSlice piece{data, std::uint32_t(size)};
+    return write_pieces(piece_index, &piece, 1);
+}
+
+outcome::result<void> FilesOnDisk::write_pieces(std::uint32_t first_piece_index
+    , const DataSlice* pieces, std::size_t count)
+{
+    outcome::result<void> status = outcome::success();
+    split_by_files(first_piece_index, pieces, count
+        , [&](const FilePiece& file_piece, const DataSlice* slices, std::size_t slices_count)
+    {
+        if (status)
+        {
+            status = on_write_file_piece(file_piece, slices, slices_count);
+        }
+    });
+    return status;
+}
+
+outcome::result<void> FilesOnDisk::read_piece(std::uint32_t piece_index
+    , std::uint32_t offset, std::uint8_t* data, std::uint32_t size)
+{
+    assert(data);
+    assert(size > 0);
+    const std::uint64_t start = files_list_->piece_offset(piece_index) + offset;
+    outcome::result<void> status = outcome::success();
+    files_list_->iterate_files(start, start + size
+        , [&](const FilePiece& file_piece)
+    {
+        if (!status)
+        {
+            return;
+        }
+        auto file = open_file(file_piece);
+        if (!file)
+        {
+            status = file.as_failure();
+            return;
+        }
+        status = file.value()->read(data + file_piece.piece_offset_
+            , file_piece.file_offset_
+            , std::uint32_t(file_piece.bytes_count_));
+    }
+        , [&](std::uint64_t piece_offset, std::uint64_t bytes_count)
+    {
+        std::memset(data + piece_offset, 0, std::size_t(bytes_count));
+    });
+    return status;
+}
+
+outcome::result<void> FilesOnDisk::write_block(std::uint32_t piece_index
+    , std::uint32_t offset, const std::uint8_t* data, std::uint32_t size)
+{
+    assert(data);
+    assert(size > 0);
+    const std::uint64_t start = files_list_->piece_offset(piece_index) + offset;
+    outcome::result<void> status = outcome::success();
+    files_list_->iterate_files(start, start + size
+        , [&](const FilePiece& file_piece)
+    {
+        if (!status || (file_piece.bytes_count_ == 0))
+        {
+            return;
+        }
+        auto file = open_file(file_piece);
+        if (!file)
+        {
+            status = file.as_failure();
+            return;
+        }
+        status = file.value()->write(data + file_piece.piece_offset_
+            , file_piece.file_offset_
+            , std::uint32_t(file_piece.bytes_count_));
+        if (status && (options_.sync_ == FileSyncPolicy::EveryWrite))
+        {
+            status = file.value()->sync();
+        }
+    });
+    return status;
+}
+
+outcome::result<void> FilesOnDisk::on_blocks_piece_complete(std::uint32_t piece_index)
+{
+    outcome::result<void> status = outcome::success();
+    files_list_->iterate_files(piece_index
+        , [&](const FilePiece& file_piece)
+    {
+        if (!status)
+        {
+            return;
+        }
+        if (!mark_written(file_piece)
+            || (options_.sync_ != FileSyncPolicy::OnFileComplete))
+        {
+            return;
+        }
+        auto file = open_file(file_piece);
+        if (!file)
+        {
+            status = file.as_failure();
+            return;
+        }
+        status = file.value()->sync();
+    });
+    return status;
+}
+
+outcome::result<std::filesystem::path> FilesOnDisk::file_path(const FilePiece& piece) const
+{
+    using File = be::TorrentMetainfo::File;
+    const be::TorrentMetainfo::Info& info = files_list_->torrent_->metainfo_.info_;
+    const bool multi_file = std::holds_alternative<std::vector<File>>(info.length_or_files_);
+
+    std::filesystem::path relative;
+    if (multi_file && !info.suggested_name_utf8_.empty())
+    {
+        relative = FromUTF8(info.suggested_name_utf8_);
+    }
+    relative /= FromUTF8(*piece.file_name_);
+    if (!IsSafeRelativePath(relative))
+    {
+        return outcome::failure(ClientErrorc::UnsafeFilePath);
+    }
+    return outcome::success(options_.root_dir_ / relative);
+}
+
+outcome::result<FileLease> FilesOnDisk::open_file(const FilePiece& piece)
+{
+    assert(piece.file_index_ < files_.size());
+    const std::size_t index = piece.file_index_;
+    std::lock_guard<std::mutex> _(lock_);
+    PhysicalFile& f = files_[index];
+    if (!f.is_open())
+    {
+        OUTCOME_TRY(std::filesystem::path path, file_path(piece));
+        const std::filesystem::path directory = path.parent_path();
+        if (!directory.empty())
+        {
+            std::error_code ec;
+            (void)std::filesystem::create_directories(directory, ec);
+            if (ec)
+            {
+                return outcome::failure(ec);
+            }
+        }
+        close_unused_files();
+        OUTCOME_TRY(f.open(path, piece.file_size_, options_));
+        ++open_count_;
+    }
+    if (unused_it_[index] != unused_.end())
+    {
+        unused_.erase(unused_it_[index]);
+        unused_it_[index] = unused_.end();
+    }
+    ++pins_[index];
+    return outcome::success(FileLease(*this, index));
+}
+
+FileLease FilesOnDisk::lease_if_open(const FilePiece& piece)
+{
+    assert(piece.file_index_ < files_.size());
+    const std::size_t index = piece.file_index_;
+    std::unique_lock<std::mutex> lock(lock_, std::try_to_lock);
+    if (!lock.owns_lock() || !files_[index].is_open())
+    {
+        return FileLease();
+    }
+    if (unused_it_[index] != unused_.end())
+    {
+        unused_.erase(unused_it_[index]);
+        unused_it_[index] = unused_.end();
+    }
+    ++pins_[index];
+    return FileLease(*this, index);
+}
+
+bool FilesOnDisk::mark_written(const FilePiece& piece)
+{
+    assert(piece.file_index_ < files_.size());
+    std::lock_guard<std::mutex> _(lock_);
+    std::uint64_t& written = written_[piece.file_index_];
+    written += piece.bytes_count_;
+    assert(written <= piece.file_size_);
+    return (written == piece.file_size_);
+}
+
+void FilesOnDisk::close_unused_files()
+{
+    // If everything is leased, the limit is exceeded temporarily.
+    const std::size_t max_open = std::max<std::size_t>(1, options_.max_open_files_);
+    while ((open_count_ >= max_open) && !unused_.empty())
+    {
+        const std::size_t index = unused_.front();
+        unused_.pop_front();
+        unused_it_[index] = unused_.end();
+        // Keeps the mapping, see map_file().
+        files_[index].close_handle();
+        --open_count_;
+    }
+}
+
+void FilesOnDisk::release_file(std::size_t file_index)
+{
+    std::lock_guard<std::mutex> _(lock_);
+    assert(pins_[file_index] > 0);
+    if ((--pins_[file_index] == 0) && files_[file_index].is_open())
+    {
+        unused_it_[file_index] = unused_.insert(unused_.end(), file_index);
+    }
+}
+
+outcome::result<void> FilesOnDisk::on_write_file_piece(const FilePiece& piece
+    , const DataSlice* slices, std::size_t count)
+{
+    assert(piece.bytes_count_ > 0);
+    OUTCOME_TRY(FileLease f, open_file(piece));
+    OUTCOME_TRY(f->write_vectored(slices, count, piece.file_offset_));
+    if (options_.sync_ == FileSyncPolicy::EveryWrite)
+    {
+        OUTCOME_TRY(f->sync());
+    }
+    if (mark_written(piece)
+        && (options_.sync_ == FileSyncPolicy::OnFileComplete))
+    {
+        OUTCOME_TRY(f->sync());
+    }
+    return outcome::success();
+}
+
+outcome::result<std::uint8_t*> FilesOnDisk::map_file(const FilePiece& piece)
+{
+    OUTCOME_TRY(FileLease f, open_file(piece));
+    if (piece.file_size_ == 0)
+    {
+        return outcome::success(nullptr);
+    }
+    return f->map(piece.file_size_);
+}
+
+outcome::result<void> FilesOnDisk::on_mapped_piece_complete(std::uint32_t piece_index)
+{
+    assert(options_.memory_mapped_);
+    const bool sync_every_write = (options_.sync_ == FileSyncPolicy::EveryWrite);
+    outcome::result<void> status = outcome::success();
+    files_list_->iterate_files(piece_index
+        , [&](const FilePiece& file_piece)
+    {
+        if (!status)
+        {
+            return;
+        }
+        if (file_piece.bytes_count_ == 0)
+        {
+            (void)mark_written(file_piece);
+            return;
+        }
+        auto lease = open_file(file_piece);
+        if (!lease)
+        {
+            status = lease.as_failure();
+            return;
+        }
+        PhysicalFile& f = *lease.value().file_;
+        assert(f.mapped_);
+        status = f.flush_mapped(file_piece.file_offset_, file_piece.bytes_count_, sync_every_write);
+        if (!status)
+        {
+            return;
+        }
+        // We are done with the piece; keep resident set small.
+        f.discard_mapped(file_piece.file_offset_, file_piece.bytes_count_);
+        if (!mark_written(file_piece))
+        {
+            return;
+        }
+        if (options_.sync_ == FileSyncPolicy::OnFileComplete)
+        {
+            status = f.flush_mapped(0, f.mapped_size_, true/*wait*/);
+        }
+        // Handle itself stays in the pool for reads.
+        f.unmap();
+    });
+    return status;
+}
+
+std::uint64_t FilesOnDisk::total_written() const
+{
+    std::lock_guard<std::mutex> _(lock_);
+    std::uint64_t total = 0;
+    for (std::uint64_t written : written_)
+    {
+        total += written;
+    }
+    return total;
+}
@@ -0,0 +1,215 @@
+#pragma once
+#include "files_list.h"
+#include "file_storage.h"
+
+#include <filesystem>
+#include <list>
+#include <mutex>
+#include <vector>
+
+#include <cstdint>
+
+struct FilesOnDisk;
+
+// Open file, pinned in the FilesOnDisk handles pool:
+// it is not closed while the lease is alive. Move-only.
+struct FileLease
+{
+    FilesOnDisk* owner_ = nullptr;
+    std::size_t file_index_ = 0;
+    PhysicalFile* file_ = nullptr;
+
+    FileLease() = default;
+    explicit FileLease(FilesOnDisk& owner, std::size_t file_index);
+    FileLease(const FileLease&) = delete;
+    FileLease& operator=(const FileLease&) = delete;
+    FileLease(FileLease&& rhs) noexcept;
+    FileLease& operator=(FileLease&& rhs) noexcept;
+    ~FileLease();
+
+    PhysicalFile* operator->() const { return file_; }
+    void reset();
+};
+
+// Files of the torrent. At most `options_.max_open_files_` are open
+// at once: least recently used file without leases is closed to open
+// the next one and is reopened on demand.
+struct FilesOnDisk
+{
+    std::vector<PhysicalFile> files_;
+    const FilesList* files_list_;
+    StorageOptions options_;
+
+    explicit FilesOnDisk(const FilesList& files_list
+        , StorageOptions options = {});
+
+    outcome::result<void> write_piece(std::uint32_t piece_index
+        , const std::uint8_t* data, std::size_t size);
+    // Contiguous pieces [first_piece_index; first_piece_index + count),
+    // one vectored write per file. Thread-safe.
+    outcome::result<void> write_pieces(std::uint32_t first_piece_index
+        , const DataSlice* pieces, std::size_t count);
+    // Reads [offset; offset + size) of the piece into `data`. Thread-safe.
+    outcome::result<void> read_piece(std::uint32_t piece_index
+        , std::uint32_t offset, std::uint8_t* data, std::uint32_t size);
+    // Writes [offset; offset + size) of the piece, e.g. a single block
+    // as soon as it is received. Not accounted as written (the piece may
+    // fail the hash check and be written again) until on_blocks_piece_complete().
+    // Thread-safe.
+    outcome::result<void> write_block(std::uint32_t piece_index
+        , std::uint32_t offset, const std::uint8_t* data, std::uint32_t size);
+    // All blocks of the piece are written with write_block() and verified:
+    // accounts the piece as written and syncs completed files (see `options_.sync_`).
+    outcome::result<void> on_blocks_piece_complete(std::uint32_t piece_index);
+
+    // Full path to the file on disk, including `root_dir_` and,
+    // for multi-file torrent, its 'name' directory.
+    outcome::result<std::filesystem::path> file_path(const FilePiece& piece) const;
+
+    // Opens (creating if needed) the file `piece` belongs to.
+    // Thread-safe.
+    outcome::result<FileLease> open_file(const FilePiece& piece);
+    // Lease of the file only if it's open already, empty otherwise.
+    // Never blocks: gives up if open_file() holds the lock. Thread-safe.
+    FileLease lease_if_open(const FilePiece& piece);
+    // Accounts `piece` as written. Returns true once the whole
+    // file is written, so the caller can sync it (see `options_.sync_`).
+    // Thread-safe.
+    bool mark_written(const FilePiece& piece);
+
+    std::uint64_t total_written() const;
+
+    // StorageOptions::memory_mapped_ mode.
+    // Opens and maps the file `piece` belongs to; nullptr for empty file.
+    // Mapping outlives the lease: evicted file keeps it until complete.
+    outcome::result<std::uint8_t*> map_file(const FilePiece& piece);
+    // F(std::uint8_t* data, std::uint32_t size) for every mapped region
+    // that holds [offset; offset + size) of the piece, in order.
+    // `data` is nullptr for padding (see FileOffset::padding), which is all zeros.
+    template<typename F>
+    outcome::result<void> for_each_mapped(std::uint32_t piece_index
+        , std::uint32_t offset, std::uint32_t size, F f);
+    // Whole piece is received into the mapping and verified: starts
+    // the write-back and syncs/unmaps completed files (see `options_.sync_`).
+    outcome::result<void> on_mapped_piece_complete(std::uint32_t piece_index);
+
+    // Splits contiguous `pieces` (starting from `first_piece_index`)
+    // by the files they belong to.
+    // F(const FilePiece& file_piece, const DataSlice* slices, std::size_t count)
+    // where `slices` cover exactly `file_piece.bytes_count_` bytes.
+    // Bytes of padding files and empty files are skipped.
+    template<typename F>
+    void split_by_files(std::uint32_t first_piece_index
+        , const DataSlice* pieces, std::size_t count, F f) const;
+
+private:
+    friend struct FileLease;
+
+    outcome::result<void> on_write_file_piece(const FilePiece& piece
+        , const DataSlice* slices, std::size_t count);
+    // Under `lock_`.
+    void close_unused_files();
+    void release_file(std::size_t file_index);
+
+private:
+    mutable std::mutex lock_;
+    // Bytes written, per file. Not tied to the handle, survives reopen.
+    std::vector<std::uint64_t> written_;
+    // Active leases, per file.
+    std::vector<std::uint32_t> pins_;
+    // Open files without leases; least recently used first.
+    std::list<std::size_t> unused_;
+    // Position in `unused_` or unused_.end().
+    std::vector<std::list<std::size_t>::iterator> unused_it_;
+    std::size_t open_count_ = 0;
+};
+
+template<typename F>
+outcome::result<void> FilesOnDisk::for_each_mapped(std::uint32_t piece_index
+    , std::uint32_t offset, std::uint32_t size, F f)
+{
+    assert(options_.memory_mapped_);
+    assert(size > 0);
+    const std::uint64_t start = files_list_->piece_offset(piece_index) + offset;
+    outcome::result<void> status = outcome::success();
+    files_list_->iterate_files(start, start + size
+        , [&](const FilePiece& file_piece)
+    {
+        if (!status || (file_piece.bytes_count_ == 0))
+        {
+            return;
+        }
+        auto mapped = map_file(file_piece);
+        if (!mapped)
+        {
+            status = mapped.as_failure();
+            return;
+        }
+        f(mapped.value() + file_piece.file_offset_
+            , std::uint32_t(file_piece.bytes_count_));
+    }
+        , [&](std::uint64_t, std::uint64_t bytes_count)
+    {
+        if (status)
+        {
+            f(nullptr, std::uint32_t(bytes_count));
+        }
+    });
+    return status;
+}
+
+template<typename F>
+void FilesOnDisk::split_by_files(std::uint32_t first_piece_index
+    , const DataSlice* pieces, std::size_t count, F f) const
+{
+    assert(count > 0);
+    std::uint64_t size = 0;
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        size += pieces[i].size_;
+    }
+    const std::uint64_t start = files_list_->piece_offset(first_piece_index);
+
+    std::vector<DataSlice> slices;
+    // Current position: pieces[index] + offset; `consumed` bytes in total.
+    std::size_t index = 0;
+    std::uint32_t offset = 0;
+    std::uint64_t consumed = 0;
+    auto advance = [&](std::uint64_t remaining, bool take_slices)
+    {
+        while (remaining > 0)
+        {
+            assert(index < count);
+            const DataSlice& piece = pieces[index];
+            const std::uint32_t available = (piece.size_ - offset);
+            const std::uint32_t take = std::uint32_t(std::min<std::uint64_t>(available, remaining));
+            if (take_slices)
+            {
+                slices.push_back(DataSlice{piece.data_ + offset, take});
+            }
+            remaining -= take;
+            consumed += take;
+            offset += take;
+            if (offset == piece.size_)
+            {
+                ++index;
+                offset = 0;
+            }
+        }
+    };
+    files_list_->iterate_files(start, start + size
+        , [&](const FilePiece& file_piece)
+    {
+        if (file_piece.bytes_count_ == 0)
+        {
+            // Nothing to write; see FilesList::build_extents_index().
+            return;
+        }
+        assert(file_piece.piece_offset_ >= consumed);
+        // Padding in between.
+        advance(file_piece.piece_offset_ - consumed, false);
+        slices.clear();
+        advance(file_piece.bytes_count_, true);
+        f(file_piece, slices.data(), slices.size());
+    });
+}
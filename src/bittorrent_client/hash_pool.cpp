@@ -0,0 +1,375 @@
+#include "hash_pool.h"
+
+#include <small_utils/utils_sha1.h>
+
+#include <algorithm>
+#include <utility>
+
+#include <cstring>
+#include <cassert>
+
+namespace
+{
+    // Worker of the pool the current thread belongs to, if any.
+    thread_local const HashPool* t_pool = nullptr;
+    thread_local std::size_t t_worker_index = 0;
+} // namespace
+
+/*explicit*/ HashPool::HashPool(std::uint32_t threads_count /*= 0*/)
+{
+    if (threads_count == 0)
+    {
+        threads_count = std::max(1u, std::thread::hardware_concurrency());
+    }
+    workers_.reserve(threads_count);
+    for (std::uint32_t i = 0; i < threads_count; ++i)
+    {
+        workers_.push_back(std::make_unique<Worker>());
+    }
+    for (std::size_t i = 0; i < workers_.size(); ++i)
+    {
+        workers_[i]->thread_ = std::thread([this, i]() { run(i); });
+    }
+}
+
+HashPool::~HashPool()
+{
+    {
+        std::lock_guard<std::mutex> _(lock_);
+        stopped_ = true;
+    }
+    has_jobs_.notify_all();
+    for (auto& worker : workers_)
+    {
+        worker->thread_.join();
+    }
+    assert(queued_ == 0);
+}
+
+void HashPool::submit(Job job)
+{
+    const std::size_t index = (t_pool == this)
+        ? t_worker_index
+        : (next_worker_++ % workers_.size());
+    Worker& worker = *workers_[index];
+    {
+        std::lock_guard<std::mutex> _(worker.lock_);
+        worker.jobs_.push_back(std::move(job));
+    }
+    on_queued(1);
+}
+
+void HashPool::submit_batch(std::vector<Job> jobs)
+{
+    if (jobs.empty())
+    {
+        return;
+    }
+    const std::size_t count = jobs.size();
+    const std::size_t per_worker = (count + workers_.size() - 1) / workers_.size();
+    const std::size_t first = (next_worker_++ % workers_.size());
+    std::size_t offset = 0;
+    for (std::size_t i = 0; offset < count; ++i)
+    {
+        Worker& worker = *workers_[(first + i) % workers_.size()];
+        const std::size_t end = std::min(count, offset + per_worker);
+        std::lock_guard<std::mutex> _(worker.lock_);
+        for (; offset < end; ++offset)
+        {
+            worker.jobs_.push_back(std::move(jobs[offset]));
+        }
+    }
+    on_queued(count);
+}
+
+void HashPool::hash_batch(const std::vector<std::string_view>& data, OnHashed on_hashed)
+{
+    const std::size_t lanes = GetSHA1Lanes();
+    auto shared_on_hashed = std::make_shared<OnHashed>(std::move(on_hashed));
+    std::vector<Job> jobs;
+    jobs.reserve((data.size() + lanes - 1) / lanes);
+    for (std::size_t first = 0; first < data.size(); first += lanes)
+    {
+        const std::size_t count = std::min(lanes, data.size() - first);
+        std::vector<std::string_view> part(data.begin() + first, data.begin() + first + count);
+        jobs.push_back([part = std::move(part), first, shared_on_hashed]()
+        {
+            std::vector<SHA1Bytes> digests(part.size());
+            GetSHA1Many(part.data(), digests.data(), part.size());
+            for (std::size_t i = 0; i < part.size(); ++i)
+            {
+                (*shared_on_hashed)(first + i, digests[i]);
+            }
+        });
+    }
+    submit_batch(std::move(jobs));
+}
+
+void HashPool::on_queued(std::size_t count)
+{
+    {
+        // Under the lock, so a worker that is about to wait sees it.
+        std::lock_guard<std::mutex> _(lock_);
+        queued_ += count;
+    }
+    if (count == 1)
+    {
+        has_jobs_.notify_one();
+    }
+    else
+    {
+        has_jobs_.notify_all();
+    }
+}
+
+bool HashPool::pop(std::size_t index, Job& job)
+{
+    Worker& worker = *workers_[index];
+    std::lock_guard<std::mutex> _(worker.lock_);
+    if (worker.jobs_.empty())
+    {
+        return false;
+    }
+    // Oldest first: pieces are verified in the order they complete.
+    job = std::move(worker.jobs_.front());
+    worker.jobs_.pop_front();
+    --queued_;
+    return true;
+}
+
+bool HashPool::steal(std::size_t index, Job& job)
+{
+    for (std::size_t i = 1; i < workers_.size(); ++i)
+    {
+        Worker& victim = *workers_[(index + i) % workers_.size()];
+        std::lock_guard<std::mutex> _(victim.lock_);
+        if (victim.jobs_.empty())
+        {
+            continue;
+        }
+        // Newest: least likely to be taken by the owner soon.
+        job = std::move(victim.jobs_.back());
+        victim.jobs_.pop_back();
+        --queued_;
+        return true;
+    }
+    return false;
+}
+
+void HashPool::run(std::size_t index)
+{
+    t_pool = this;
+    t_worker_index = index;
+    while (true)
+    {
+        Job job;
+        if (pop(index, job) || steal(index, job))
+        {
+            job();
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(lock_);
+        has_jobs_.wait(lock, [this]
+        {
+            return stopped_ || (queued_ > 0);
+        });
+        if (stopped_ && (queued_ == 0))
+        {
+            return;
+        }
+    }
+}
+
+/*static*/ std::shared_ptr<PieceHasher> PieceHasher::make(HashPool& pool
+    , asio::io_context& io_context
+    , PieceHasherOptions options /*= {}*/)
+{
+    return std::make_shared<PieceHasher>(pool, io_context, std::move(options));
+}
+
+/*explicit*/ PieceHasher::PieceHasher(HashPool& pool, asio::io_context& io_context
+    , PieceHasherOptions options)
+    : pool_(&pool)
+    , io_context_(&io_context)
+    , options_(std::move(options))
+{
+    assert(!has_merkle() || (options_.merkle_width_ > 0));
+}
+
+void PieceHasher::update(const std::uint8_t* data, std::size_t size
+    , PieceBuffer owner /*= {}*/, OnHashed on_hashed /*= {}*/)
+{
+    Update update;
+    update.data_ = data;
+    update.size_ = size;
+    update.owner_ = std::move(owner);
+    update.on_hashed_ = std::move(on_hashed);
+    push(std::move(update));
+}
+
+void PieceHasher::release_after(PieceBuffer owner)
+{
+    if (!owner)
+    {
+        return;
+    }
+    update(nullptr, 0, std::move(owner));
+}
+
+void PieceHasher::expect_blocks(std::vector<SHA256Bytes> leaves)
+{
+    assert(has_merkle());
+    Update update;
+    update.expected_leaves_ = std::move(leaves);
+    push(std::move(update));
+}
+
+void PieceHasher::finalize(OnDigest on_digest)
+{
+    assert(on_digest);
+    Update update;
+    update.on_digest_ = std::move(on_digest);
+    push(std::move(update));
+}
+
+void PieceHasher::cancel()
+{
+    canceled_ = true;
+}
+
+void PieceHasher::push(Update update)
+{
+    {
+        std::lock_guard<std::mutex> _(lock_);
+        updates_.push_back(std::move(update));
+        if (running_)
+        {
+            return;
+        }
+        running_ = true;
+    }
+    pool_->submit([self = shared_from_this()]()
+    {
+        self->drain();
+    });
+}
+
+void PieceHasher::drain()
+{
+    while (true)
+    {
+        Update update;
+        {
+            std::lock_guard<std::mutex> _(lock_);
+            if (updates_.empty())
+            {
+                running_ = false;
+                return;
+            }
+            update = std::move(updates_.front());
+            updates_.pop_front();
+        }
+        const bool canceled = canceled_;
+        if (!canceled && (update.size_ > 0))
+        {
+            if (options_.sha1_)
+            {
+                hasher_.update(update.data_, update.size_);
+            }
+            hash_leaves(update.data_, update.size_);
+        }
+        if (!canceled && !update.expected_leaves_.empty())
+        {
+            expected_leaves_ = std::move(update.expected_leaves_);
+            for (std::size_t i = 0; i < leaves_.size(); ++i)
+            {
+                check_leaf(i);
+            }
+        }
+        if (!canceled && update.on_digest_)
+        {
+            PieceDigest digest;
+            if (options_.sha1_)
+            {
+                digest.sha1_ = hasher_.finalize();
+            }
+            if (has_merkle())
+            {
+                assert(merkle_offset_ == options_.merkle_size_);
+                digest.merkle_root_ = GetMerkleRoot(leaves_.data(), leaves_.size()
+                    , options_.merkle_width_);
+                leaves_.clear();
+                merkle_offset_ = 0;
+            }
+            asio::post(*io_context_, [self = shared_from_this()
+                , on_digest = std::move(update.on_digest_)
+                , digest]()
+            {
+                if (!self->canceled_)
+                {
+                    on_digest(digest);
+                }
+            });
+        }
+        if (update.owner_)
+        {
+            // Buffers are released on the network thread only.
+            asio::post(*io_context_, [self = shared_from_this()
+                , owner = std::move(update.owner_)
+                , on_hashed = std::move(update.on_hashed_)]() mutable
+            {
+                if (on_hashed && !self->canceled_)
+                {
+                    on_hashed(std::move(owner));
+                }
+            });
+        }
+    }
+}
+
+void PieceHasher::hash_leaves(const std::uint8_t* data, std::size_t size)
+{
+    // Bytes after `merkle_size_` are padding; not in the tree.
+    const std::uint32_t end = std::uint32_t(std::min<std::uint64_t>(
+        std::uint64_t(merkle_offset_) + size, options_.merkle_size_));
+    while (merkle_offset_ < end)
+    {
+        const std::uint32_t in_leaf = (merkle_offset_ % k_merkle_block_size);
+        const std::uint32_t part = std::min(k_merkle_block_size - in_leaf, end - merkle_offset_);
+        leaf_hasher_.update(data, part);
+        data += part;
+        merkle_offset_ += part;
+        if (((merkle_offset_ % k_merkle_block_size) == 0)
+            || (merkle_offset_ == options_.merkle_size_))
+        {
+            leaves_.push_back(leaf_hasher_.finalize());
+            check_leaf(leaves_.size() - 1);
+        }
+    }
+}
+
+void PieceHasher::check_leaf(std::size_t index)
+{
+    if (bad_block_reported_ || (index >= expected_leaves_.size()))
+    {
+        return;
+    }
+    if (std::memcmp(leaves_[index].data_, expected_leaves_[index].data_
+        , sizeof(leaves_[index].data_)) == 0)
+    {
+        return;
+    }
+    bad_block_reported_ = true;
+    if (!options_.on_bad_block_)
+    {
+        return;
+    }
+    asio::post(*io_context_, [self = shared_from_this()
+        , block_index = std::uint32_t(index)]()
+    {
+        if (!self->canceled_)
+        {
+            self->options_.on_bad_block_(block_index);
+        }
+    });
+}
@@ -0,0 +1,162 @@
+#pragma once
+#include "piece_buffer_pool.h"
+#include "utils_asio.h"
+
+#include <small_utils/utils_bytes.h>
+#include <small_utils/utils_sha256.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include <cstdint>
+
+// Threads for CPU-heavy work (SHA1 of pieces), so the network thread
+// never waits on it. Every worker has its own queue; idle workers
+// steal from the others, so a batch submitted at once is spread
+// over all cores.
+class HashPool
+{
+public:
+    using Job = std::function<void ()>;
+
+    // 0 - one per core.
+    explicit HashPool(std::uint32_t threads_count = 0);
+    // Finishes queued jobs.
+    ~HashPool();
+    HashPool(const HashPool&) = delete;
+    HashPool& operator=(const HashPool&) = delete;
+
+    // Any thread. From a worker, the job goes to its own queue.
+    void submit(Job job);
+    // Jobs are split between the workers queues.
+    void submit_batch(std::vector<Job> jobs);
+
+    // SHA1 of every `data[i]`; GetSHA1Lanes() of them per job, so
+    // multi-buffer hashing fills its lanes. `on_hashed(i, digest)`
+    // is invoked on a worker thread; `data` should be valid until then.
+    using OnHashed = std::function<void (std::size_t index, const SHA1Bytes& digest)>;
+    void hash_batch(const std::vector<std::string_view>& data, OnHashed on_hashed);
+
+    std::uint32_t threads_count() const { return std::uint32_t(workers_.size()); }
+
+private:
+    struct Worker
+    {
+        std::mutex lock_;
+        std::deque<Job> jobs_;
+        std::thread thread_;
+    };
+
+    void run(std::size_t index);
+    bool pop(std::size_t index, Job& job);
+    bool steal(std::size_t index, Job& job);
+    void on_queued(std::size_t count);
+
+private:
+    std::vector<std::unique_ptr<Worker>> workers_;
+    // Round-robin queue for jobs submitted outside of the pool.
+    std::atomic<std::size_t> next_worker_{0};
+    // Jobs in all queues.
+    std::atomic<std::size_t> queued_{0};
+    std::mutex lock_;
+    std::condition_variable has_jobs_;
+    bool stopped_ = false;
+};
+
+// What is computed for the piece; see PieceHashes.
+struct PieceHasherOptions
+{
+    // BitTorrent v1.
+    bool sha1_ = true;
+    // BitTorrent v2: merkle root of the first `merkle_size_` bytes of
+    // the piece (the rest is padding), over `merkle_width_` leaves;
+    // 0 - none.
+    std::uint32_t merkle_size_ = 0;
+    std::uint32_t merkle_width_ = 0;
+    // Network thread: the block hash does not match the expected one
+    // (see PieceHasher::expect_blocks()). Reported once.
+    std::function<void (std::uint32_t block_index)> on_bad_block_;
+};
+
+struct PieceDigest
+{
+    SHA1Bytes sha1_;
+    SHA256Bytes merkle_root_;
+};
+
+// Streaming SHA1 (and/or BitTorrent v2 merkle root) of a single piece
+// on the HashPool: updates run in order, one at a time, off the network thread.
+// Results and buffers are handed back on the `io_context` thread.
+class PieceHasher : public std::enable_shared_from_this<PieceHasher>
+{
+public:
+    using OnHashed = std::function<void (PieceBuffer owner)>;
+    using OnDigest = std::function<void (const PieceDigest& digest)>;
+
+    static std::shared_ptr<PieceHasher> make(HashPool& pool, asio::io_context& io_context
+        , PieceHasherOptions options = {});
+
+    // Network thread.
+    // `data` should stay valid until hashed; if it's owned by `owner`,
+    // the buffer is given back to `on_hashed` (or released) after that.
+    void update(const std::uint8_t* data, std::size_t size
+        , PieceBuffer owner = {}, OnHashed on_hashed = {});
+    // Releases `owner` once queued updates (that may point into it) are done.
+    void release_after(PieceBuffer owner);
+    // Merkle leaves of the piece, e.g. from the peer (BEP 52 hashes);
+    // every 16 KiB block is compared as soon as it's hashed.
+    void expect_blocks(std::vector<SHA256Bytes> leaves);
+    // Digest of all the updates before; hasher starts over after that.
+    void finalize(OnDigest on_digest);
+    // Network thread. Callbacks of the queued updates are not invoked
+    // anymore (their buffers are released); e.g. the piece is started over.
+    void cancel();
+
+    bool has_merkle() const { return (options_.merkle_size_ > 0); }
+
+    // Use make().
+    explicit PieceHasher(HashPool& pool, asio::io_context& io_context
+        , PieceHasherOptions options);
+
+private:
+    struct Update
+    {
+        const std::uint8_t* data_ = nullptr;
+        std::size_t size_ = 0;
+        PieceBuffer owner_;
+        OnHashed on_hashed_;
+        OnDigest on_digest_;
+        std::vector<SHA256Bytes> expected_leaves_;
+    };
+
+    void push(Update update);
+    // Worker thread.
+    void drain();
+    void hash_leaves(const std::uint8_t* data, std::size_t size);
+    void check_leaf(std::size_t index);
+
+private:
+    HashPool* pool_ = nullptr;
+    asio::io_context* io_context_ = nullptr;
+    std::mutex lock_;
+    std::deque<Update> updates_;
+    // drain() is submitted; at most one at a time.
+    bool running_ = false;
+    std::atomic<bool> canceled_{false};
+    PieceHasherOptions options_;
+    // drain() only.
+    SHA1Hasher hasher_;
+    SHA256Hasher leaf_hasher_;
+    // Bytes of the piece given to `leaf_hasher_`.
+    std::uint32_t merkle_offset_ = 0;
+    std::vector<SHA256Bytes> leaves_;
+    std::vector<SHA256Bytes> expected_leaves_;
+    bool bad_block_reported_ = false;
+};
@@ -1,6 +1,16 @@
 #include "torrent_client.h"
 #include "torrent_messages.h"
 #include "tracker_requests.h"
+#include "files_list.h"
+#include "files_on_disk.h"
+#include "disk_io.h"
+#include "piece_buffer_pool.h"
+#include "resume_file.h"
+#include "recheck.h"
+#include "part_file.h"
+#include "hash_pool.h"
+#include "piece_hashes.h"
+#include "utils_http.h"
 
 #include <bencoding/be_torrent_file_parse.h>
 #include <bencoding/be_element_ref_parse.h>
@@ -14,10 +24,17 @@
 #include <random>
 #include <algorithm>
 #include <iterator>
+#include <deque>
 #include <list>
+#include <map>
+#include <optional>
 #include <functional>
+#include <chrono>
 
 #include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <cmath>
 #include <cinttypes>
 
 #if defined(NDEBUG)
@@ -25,24 +42,61 @@
 #endif
 #include <cassert>
 
-// For writes to files.
-#include <Windows.h>
-
 // As per https://www.bittorrent.org/beps/bep_0003.html
 // All current implementations use 2^14 (16 kiB),
 // and close connections which request an amount greater than that.
 const std::uint32_t k_max_block = 16'384;
 // How much Request(s) send before reading the piece.
 const int k_max_backlog = 5;
+// Padding (BEP 47) content.
+const std::uint8_t k_zero_block[k_max_block]{};
+
+// Received after a gap, waiting for the hash (see PieceState::unhashed_).
+struct UnhashedBlock
+{
+    std::uint32_t size_ = 0;
+    // The block itself, if it's not kept in the piece data
+    // (write-through: written to the disk once hashed).
+    PieceBuffer block_;
+};
 
 struct PieceState
 {
     std::uint32_t piece_index_ = 0;
     std::uint32_t downloaded_ = 0;
     std::uint32_t requested_ = 0;
-    std::vector<std::uint8_t> data_;
+    PieceBuffer data_;
+    // Data is in the PartFile; blocks received since go there too.
+    bool spilled_ = false;
+    // `data_` is being written to the PartFile; `spilled_` once done.
+    // Blocks received meanwhile go there too, after it.
+    bool spilling_ = false;
+    // Read back from the PartFile is in flight (see PiecesToDownload::page_in()).
+    bool paging_in_ = false;
+    // Incremented when the piece is started over;
+    // PartFile completions of the previous attempt are ignored.
+    std::uint32_t attempt_ = 0;
+    // `data_` is given to the socket read (see get_block_buffers()).
+    bool receiving_ = false;
+    std::chrono::steady_clock::time_point last_receive_{};
+    // Write-through: blocks given to DiskIO, but not written yet.
+    std::uint32_t writes_pending_ = 0;
+    bool write_failed_ = false;
+    // SHA1 (or v2 merkle leaves) of [0; hashed_) of the piece, updated
+    // as blocks arrive, on the HashPool; see PiecesToDownload::get_hasher().
+    std::shared_ptr<PieceHasher> hasher_;
+    std::uint32_t hashed_ = 0;
+    // verify_piece(): set once the `digest_` is posted back.
+    bool digest_ready_ = false;
+    PieceDigest digest_{};
+    // BitTorrent v2: some block does not match the hashes from the peer.
+    bool bad_block_ = false;
+    // Blocks after the hashed prefix, by offset; hashed once the gap is filled.
+    std::map<std::uint32_t, UnhashedBlock> unhashed_;
 
     PieceState(std::uint32_t index) : piece_index_(index) {}
+
+    bool in_part_file() const { return (spilled_ || spilling_); }
 };
 
 // Stupid and simple algorithm to distribute
@@ -61,11 +115,80 @@ struct PiecesToDownload
 
     std::uint32_t next_piece_index_ = 0;
     std::uint32_t downloaded_pieces_count_ = 0;
+    // Completed or already in `pieces_`, e.g. from the resume data;
+    // skipped by the sequential pick.
+    std::vector<bool> picked_pieces_;
+    const be::TorrentClient* torrent_ = nullptr;
+    const PieceHashes* hashes_ = nullptr;
+    const FilesList* files_list_ = nullptr;
+    PieceBufferPool* buffers_ = nullptr;
+    // Canceled when buffers are released and there is room for a piece.
+    asio::steady_timer* memory_ready_ = nullptr;
+    std::uint32_t memory_waiters_ = 0;
+    // Memory-mapped mode: blocks are received directly into the files.
+    FilesOnDisk* mapped_files_ = nullptr;
+    // Block-granular write-through: blocks are written to the files
+    // as soon as they are received; `data_` holds a single block.
+    FilesOnDisk* write_through_files_ = nullptr;
+    // Canceled when some piece has no pending block writes anymore.
+    asio::steady_timer* blocks_written_ = nullptr;
+    // Pieces are hashed off the network thread.
+    HashPool* hash_pool_ = nullptr;
+    asio::io_context* io_context_ = nullptr;
+    // Canceled when some piece digest is ready.
+    asio::steady_timer* pieces_hashed_ = nullptr;
+    // Partial pieces are moved there when out of the memory budget.
+    PartFile* part_file_ = nullptr;
+    std::uint32_t spills_pending_ = 0;
+    // Canceled when some piece is spilled or paged in.
+    asio::steady_timer* part_io_done_ = nullptr;
+    DiskIO* disk_ = nullptr;
+    ResumeFile* resume_ = nullptr;
     std::function<void (PieceState&)> on_new_piece;
 
     std::uint32_t get_piece_size(std::uint32_t piece_index) const;
+    void resume(const ResumeData& resumed);
+    // Result of the recheck of the piece picked in advance.
+    void on_piece_checked(std::uint32_t piece_index, bool valid);
+    bool has_pieces_to_download();
+    void skip_picked_pieces();
     Handle pop_piece_to_download(const be::Message_Bitfield& have_pieces);
+    // New pieces are started only if their buffers fit the memory budget.
+    asio::awaitable<void> wait_for_memory();
+    void on_buffer_released();
+    // Starts moving data of the partial piece that received nothing for
+    // the longest time to the `part_file_`; its buffer is released once written.
+    bool spill_coldest_piece();
+    // Reads spilled piece back to memory, for the hash check.
+    asio::awaitable<bool> page_in(Handle piece);
+    // Writes a copy of the block; the PartFile keeps the order of the piece writes.
+    void write_to_part_file(Handle piece, std::uint32_t begin
+        , const std::uint8_t* data, std::uint32_t size);
     void push_piece_to_retry(Handle piece);
+    // Next block to request has padding files only (BEP 47):
+    // accounts it as received zeros, without the request.
+    bool skip_padding_block(Handle piece);
+    // be::PieceBlockSink for the `piece`.
+    bool get_block_buffers(Handle piece
+        , std::uint32_t begin, std::uint32_t size
+        , std::vector<asio::mutable_buffer>& buffers);
+    PieceHasher& get_hasher(PieceState& piece);
+    // Adds the block to the piece hash, now or once the blocks before it arrive.
+    // `data` is nullptr if it's in the mapping (see `mapped_files_`);
+    // it points to `block`, if given, that is kept until hashed.
+    void hash_block(Handle piece, std::uint32_t begin, std::uint32_t size
+        , const std::uint8_t* data, PieceBuffer block = {});
+    void hash_in_order(Handle piece, std::uint32_t size
+        , const std::uint8_t* data, PieceBuffer block);
+    // Hashes [begin; begin + size) from wherever the piece data is:
+    // `data_`, the mapping or, with write-through, the files.
+    bool hash_stored(PieceState& piece, std::uint32_t begin, std::uint32_t size);
+    // Hashes the rest of the piece, if any, and compares with the torrent one.
+    // Write-through: also waits until the piece blocks are on disk.
+    asio::awaitable<bool> verify_piece(Handle piece);
+    // Write-through: waits until the piece blocks are on disk, so they can be verified.
+    asio::awaitable<void> wait_for_block_writes(Handle piece);
+    void write_block(Handle piece, std::uint32_t begin, PieceBuffer block);
     void on_piece_part_receive(Handle piece, be::Message_Piece& msg_piece);
     void on_piece_downloaded(Handle piece);
 };
@@ -107,11 +230,18 @@ struct DebugObserver
     std::uint64_t received_ = 0;
     std::uint32_t received_pieces_ = 0;
     std::uint32_t peers_count_ = 0;
+    std::uint32_t checked_pieces_ = 0;
 
     void OnNewPartReceived(
         const PieceState& piece
+        , std::uint32_t piece_size
         , std::uint32_t bytes_received);
 
+    void OnPieceWritten(std::uint32_t piece_index, std::error_code ec);
+    void OnResumed(std::uint32_t pieces_count, std::uint64_t bytes);
+    void OnPieceChecked(std::uint32_t piece_index, bool valid);
+    void OnRecheckFinished();
+    void OnTrackerRoundStarted();
     void OnPeersListReceived(const std::vector<be::PeerAddress>& peers);
     void OnPeerFinished(be::PeerAddress peer, std::optional<DebugPeerAddress> debug_info, std::error_code ec);
 };
@@ -124,7 +254,7 @@ std::uint32_t PiecesToDownload::get_piece_size(std::uint32_t piece_index) const
     {
         return piece_size_;
     }
-    const std::uint64_t size = (piece_size_ * (pieces_count_ - 1));
+    const std::uint64_t size = (std::uint64_t(piece_size_) * (pieces_count_ - 1));
     assert(total_size_ > size);
     return std::uint32_t(total_size_ - size);
 }
@@ -133,8 +263,10 @@ auto PiecesToDownload::pop_piece_to_download(
     const be::Message_Bitfield& have_pieces)
         -> Handle
 {
+    skip_picked_pieces();
     if (next_piece_index_ < pieces_count_)
     {
+        picked_pieces_[next_piece_index_] = true;
         (void)pieces_.emplace_back(next_piece_index_++);
         // We don't check `have_pieces` for a reason:
         // let's the caller decide if it needs to retry or stop connection.
@@ -165,32 +297,589 @@ auto PiecesToDownload::pop_piece_to_download(
     return pieces_.end();
 }
 
+asio::awaitable<void> PiecesToDownload::wait_for_memory()
+{
+    if (mapped_files_ || !memory_ready_)
+    {
+        // Blocks are received into the files.
+        co_return;
+    }
+    auto coro = as_result(asio::use_awaitable);
+    const std::uint32_t needed = (write_through_files_ ? k_max_block : piece_size_);
+    while (!buffers_->has_room(needed))
+    {
+        if (disk_ && (disk_->cache_stats().write_cached_bytes_ > 0))
+        {
+            // Completed pieces are released once written;
+            // don't wait for the write cache age.
+            disk_->flush();
+        }
+        else if (spills_pending_ == 0)
+        {
+            // Buffer is released once written.
+            (void)spill_coldest_piece();
+        }
+        ++memory_waiters_;
+        // Canceled by on_buffer_released() or the spill completion.
+        (void)co_await memory_ready_->async_wait(coro);
+        --memory_waiters_;
+    }
+}
+
+void PiecesToDownload::on_buffer_released()
+{
+    const std::uint32_t needed = (write_through_files_ ? k_max_block : piece_size_);
+    if ((memory_waiters_ > 0) && buffers_->has_room(needed))
+    {
+        (void)memory_ready_->cancel();
+    }
+}
+
+bool PiecesToDownload::spill_coldest_piece()
+{
+    if (!part_file_)
+    {
+        return false;
+    }
+    Handle coldest = pieces_.end();
+    for (auto it = pieces_.begin(); it != pieces_.end(); ++it)
+    {
+        // Spilled (or being spilled) pieces have no `data_`.
+        if (!it->data_ || it->receiving_ || it->paging_in_)
+        {
+            continue;
+        }
+        if ((coldest == pieces_.end())
+            || (it->last_receive_ < coldest->last_receive_))
+        {
+            coldest = it;
+        }
+    }
+    if (coldest == pieces_.end())
+    {
+        return false;
+    }
+    // Blocks requested, but not received yet, are written when they arrive.
+    assert(coldest->requested_ > 0);
+    coldest->spilling_ = true;
+    ++spills_pending_;
+    // On failure, the hash check fails and the piece is downloaded again.
+    part_file_->async_write(coldest->piece_index_, 0, std::move(coldest->data_)
+        , coldest->requested_
+        , [this, piece = coldest, attempt = coldest->attempt_
+            , hasher = coldest->hasher_](std::error_code, PieceBuffer data)
+    {
+        assert(spills_pending_ > 0);
+        --spills_pending_;
+        if (hasher)
+        {
+            // Queued hash updates may point into the buffer.
+            hasher->release_after(std::move(data));
+        }
+        data.reset();
+        if (piece->attempt_ == attempt)
+        {
+            piece->spilling_ = false;
+            piece->spilled_ = true;
+        }
+        (void)part_io_done_->cancel();
+        if (memory_waiters_ > 0)
+        {
+            // Spill the next one, if still no room.
+            (void)memory_ready_->cancel();
+        }
+    });
+    return true;
+}
+
+asio::awaitable<bool> PiecesToDownload::page_in(Handle piece)
+{
+    auto coro = as_result(asio::use_awaitable);
+    while (piece->spilling_)
+    {
+        // Canceled by the spill completion.
+        (void)co_await part_io_done_->async_wait(coro);
+    }
+    if (!piece->spilled_)
+    {
+        co_return true;
+    }
+    const std::uint32_t piece_size = get_piece_size(piece->piece_index_);
+    assert(buffers_ && !piece->data_);
+    piece->paging_in_ = true;
+    // After the block writes of the piece (see PartFile).
+    part_file_->async_take(piece->piece_index_, buffers_->acquire(piece_size)
+        , [this, piece, attempt = piece->attempt_](std::error_code ec, PieceBuffer data)
+    {
+        if (piece->attempt_ == attempt)
+        {
+            piece->paging_in_ = false;
+            piece->spilled_ = false;
+            if (!ec)
+            {
+                piece->data_ = std::move(data);
+            }
+        }
+        (void)part_io_done_->cancel();
+    });
+    while (piece->paging_in_)
+    {
+        // Canceled by the completion above (or of some other piece).
+        (void)co_await part_io_done_->async_wait(coro);
+    }
+    co_return bool(piece->data_);
+}
+
+void PiecesToDownload::write_to_part_file(Handle piece, std::uint32_t begin
+    , const std::uint8_t* data, std::uint32_t size)
+{
+    assert(buffers_ && part_file_);
+    PieceBuffer block = buffers_->acquire(size);
+    std::memcpy(block.data_, data, size);
+    // On failure, the hash check fails and the piece is downloaded again.
+    part_file_->async_write(piece->piece_index_, begin, std::move(block), size
+        , [](std::error_code, PieceBuffer) {});
+}
+
+void PiecesToDownload::resume(const ResumeData& resumed)
+{
+    static_assert(k_max_block == k_resume_block_size);
+    picked_pieces_ = resumed.have_pieces_;
+    downloaded_pieces_count_ = std::uint32_t(
+        std::count(picked_pieces_.begin(), picked_pieces_.end(), true));
+    if (!mapped_files_ && !write_through_files_)
+    {
+        // Blocks of partial pieces were written in place.
+        return;
+    }
+    for (const auto& [piece_index, blocks] : resumed.partial_pieces_)
+    {
+        // Requests are sequential; continue after the received ones.
+        const auto missing = std::find(blocks.begin(), blocks.end(), false);
+        const std::uint32_t received = std::uint32_t(std::min<std::uint64_t>(
+            std::uint64_t(missing - blocks.begin()) * k_resume_block_size
+            , get_piece_size(piece_index)));
+        if ((received == 0) || (received == get_piece_size(piece_index)))
+        {
+            // Last one needs hash check anyway; download again.
+            continue;
+        }
+        PieceState& piece = pieces_.emplace_back(piece_index);
+        piece.downloaded_ = received;
+        piece.requested_ = received;
+        // So the hash continues with the blocks received next.
+        if (!hash_stored(piece, 0, received))
+        {
+            pieces_.pop_back();
+            continue;
+        }
+        picked_pieces_[piece_index] = true;
+        to_retry_.push_back(std::prev(pieces_.end()));
+    }
+}
+
+void PiecesToDownload::on_piece_checked(std::uint32_t piece_index, bool valid)
+{
+    assert(picked_pieces_[piece_index]);
+    if (valid)
+    {
+        ++downloaded_pieces_count_;
+        return;
+    }
+    picked_pieces_[piece_index] = false;
+    next_piece_index_ = std::min(next_piece_index_, piece_index);
+}
+
+bool PiecesToDownload::has_pieces_to_download()
+{
+    skip_picked_pieces();
+    return (next_piece_index_ < pieces_count_)
+        || !to_retry_.empty();
+}
+
+void PiecesToDownload::skip_picked_pieces()
+{
+    while ((next_piece_index_ < pieces_count_)
+        && picked_pieces_[next_piece_index_])
+    {
+        ++next_piece_index_;
+    }
+}
+
 void PiecesToDownload::push_piece_to_retry(Handle piece)
 {
     // Re-download all piece.
     piece->downloaded_ = 0;
     piece->requested_ = 0;
-    piece->data_.clear();
+    if (piece->hasher_)
+    {
+        // Queued hash updates may point into the buffer.
+        piece->hasher_->release_after(std::move(piece->data_));
+        piece->hasher_->cancel();
+        piece->hasher_.reset();
+    }
+    piece->data_.reset();
+    if (piece->in_part_file())
+    {
+        // Slot is reused once operations in flight are done.
+        part_file_->drop(piece->piece_index_);
+        piece->spilled_ = false;
+        piece->spilling_ = false;
+        piece->paging_in_ = false;
+    }
+    ++piece->attempt_;
+    piece->receiving_ = false;
+    // Blocks on disk are overwritten by the next download.
+    piece->write_failed_ = false;
+    piece->hashed_ = 0;
+    piece->digest_ready_ = false;
+    piece->bad_block_ = false;
+    piece->unhashed_.clear();
     to_retry_.push_back(piece);
 }
 
-void PiecesToDownload::on_piece_part_receive(Handle piece, be::Message_Piece& msg_piece)
+bool PiecesToDownload::skip_padding_block(Handle piece)
+{
+    const std::uint32_t piece_size = get_piece_size(piece->piece_index_);
+    const std::uint32_t begin = piece->requested_;
+    assert(begin < piece_size);
+    const std::uint32_t size = std::min(k_max_block, piece_size - begin);
+    const std::uint64_t start = files_list_->piece_offset(piece->piece_index_) + begin;
+    if (!files_list_->is_padding(start, start + size))
+    {
+        return false;
+    }
+    if (piece->in_part_file())
+    {
+        write_to_part_file(piece, begin, k_zero_block, size);
+    }
+    else if (!mapped_files_ && !write_through_files_)
+    {
+        // Otherwise, zeros come from FilesOnDisk if the piece is read back.
+        if (!piece->data_)
+        {
+            assert(buffers_);
+            piece->data_ = buffers_->acquire(piece_size);
+        }
+        std::memset(piece->data_.data_ + begin, 0, size);
+    }
+    piece->requested_ += size;
+    piece->downloaded_ += size;
+    hash_block(piece, begin, size, k_zero_block);
+    return true;
+}
+
+bool PiecesToDownload::get_block_buffers(Handle piece
+    , std::uint32_t begin, std::uint32_t size
+    , std::vector<asio::mutable_buffer>& buffers)
 {
     const std::uint32_t piece_size = get_piece_size(piece->piece_index_);
-    if (piece->data_.empty())
+    if ((size == 0)
+        || (begin >= piece_size)
+        || (size > (piece_size - begin)))
+    {
+        return false;
+    }
+    if (mapped_files_)
+    {
+        auto mapped = mapped_files_->for_each_mapped(piece->piece_index_, begin, size
+            , [&](std::uint8_t* data, std::uint32_t data_size)
+        {
+            if (!data)
+            {
+                // Padding sent by the peer is dropped.
+                static std::uint8_t k_discard[k_max_block];
+                data = k_discard;
+                assert(data_size <= sizeof(k_discard));
+            }
+            buffers.push_back(asio::buffer(data, data_size));
+        });
+        return bool(mapped);
+    }
+    if (piece->in_part_file())
+    {
+        // Read into the message; goes to the part file.
+        return false;
+    }
+    assert(buffers_);
+    piece->receiving_ = true;
+    if (write_through_files_)
+    {
+        // Single block; handed to the disk once received.
+        assert(!piece->data_);
+        piece->data_ = buffers_->acquire(size);
+        buffers.push_back(asio::buffer(piece->data_.data_, size));
+        return true;
+    }
+    if (!piece->data_)
     {
-        piece->data_.resize(piece_size);
+        piece->data_ = buffers_->acquire(piece_size);
     }
+    buffers.push_back(asio::buffer(piece->data_.data_ + begin, size));
+    return true;
+}
+
+PieceHasher& PiecesToDownload::get_hasher(PieceState& piece)
+{
+    if (!piece.hasher_)
+    {
+        assert(hash_pool_ && io_context_ && hashes_);
+        PieceHasherOptions options = hashes_->hasher_options(piece.piece_index_);
+        // Not invoked if the piece is started over.
+        options.on_bad_block_ = [state = &piece](std::uint32_t)
+        {
+            state->bad_block_ = true;
+        };
+        piece.hasher_ = PieceHasher::make(*hash_pool_, *io_context_, std::move(options));
+    }
+    return *piece.hasher_;
+}
+
+void PiecesToDownload::hash_block(Handle piece, std::uint32_t begin, std::uint32_t size
+    , const std::uint8_t* data, PieceBuffer block /*= {}*/)
+{
+    assert(!block || (data == block.data_));
+    if (begin != piece->hashed_)
+    {
+        // Gap; the piece data is still there when it's filled,
+        // except for the `block`.
+        assert(begin > piece->hashed_);
+        UnhashedBlock& unhashed = piece->unhashed_[begin];
+        unhashed.size_ = size;
+        if (!piece->in_part_file())
+        {
+            // Otherwise, it's in the part file.
+            unhashed.block_ = std::move(block);
+        }
+        return;
+    }
+    if (data)
+    {
+        hash_in_order(piece, size, data, std::move(block));
+    }
+    else if (!hash_stored(*piece, begin, size))
+    {
+        return;
+    }
+    while (!piece->unhashed_.empty()
+        && (piece->unhashed_.begin()->first == piece->hashed_))
+    {
+        UnhashedBlock& unhashed = piece->unhashed_.begin()->second;
+        if (unhashed.block_)
+        {
+            const std::uint8_t* block_data = unhashed.block_.data_;
+            hash_in_order(piece, unhashed.size_, block_data, std::move(unhashed.block_));
+        }
+        else if (piece->in_part_file() || !hash_stored(*piece, piece->hashed_, unhashed.size_))
+        {
+            // Not in memory; hashed on the piece completion.
+            return;
+        }
+        piece->unhashed_.erase(piece->unhashed_.begin());
+    }
+}
+
+void PiecesToDownload::hash_in_order(Handle piece, std::uint32_t size
+    , const std::uint8_t* data, PieceBuffer block)
+{
+    const std::uint32_t begin = piece->hashed_;
+    piece->hashed_ += size;
+    if (!write_through_files_ || !block)
+    {
+        get_hasher(*piece).update(data, size, std::move(block));
+        return;
+    }
+    // Written once hashed; not invoked if the piece is started over.
+    get_hasher(*piece).update(data, size, std::move(block)
+        , [this, piece, begin](PieceBuffer hashed)
+    {
+        write_block(piece, begin, std::move(hashed));
+    });
+}
+
+bool PiecesToDownload::hash_stored(PieceState& piece, std::uint32_t begin, std::uint32_t size)
+{
+    assert(begin == piece.hashed_);
+    PieceHasher& hasher = get_hasher(piece);
+    if (mapped_files_)
+    {
+        // Mapping outlives the hashing.
+        auto mapped = mapped_files_->for_each_mapped(piece.piece_index_, begin, size
+            , [&](std::uint8_t* data, std::uint32_t data_size)
+        {
+            for (std::uint32_t offset = 0; !data && (offset < data_size); offset += k_max_block)
+            {
+                // Padding is zeros.
+                hasher.update(k_zero_block, std::min(k_max_block, data_size - offset));
+            }
+            if (data)
+            {
+                hasher.update(data, data_size);
+            }
+        });
+        if (!mapped)
+        {
+            return false;
+        }
+    }
+    else if (write_through_files_)
+    {
+        // Written already; read back, block by block.
+        for (std::uint32_t offset = 0; offset < size; offset += k_max_block)
+        {
+            const std::uint32_t part = std::min(k_max_block, size - offset);
+            PieceBuffer block = buffers_->acquire(part);
+            if (!write_through_files_->read_piece(piece.piece_index_, begin + offset, block.data_, part))
+            {
+                return false;
+            }
+            const std::uint8_t* data = block.data_;
+            hasher.update(data, part, std::move(block));
+        }
+    }
+    else
+    {
+        assert(piece.data_ && !piece.spilled_);
+        hasher.update(piece.data_.data_ + begin, size);
+    }
+    piece.hashed_ += size;
+    return true;
+}
+
+asio::awaitable<bool> PiecesToDownload::verify_piece(Handle piece)
+{
+    // Blocks that came out of order while the piece was spilled, if any.
+    const std::uint32_t piece_size = get_piece_size(piece->piece_index_);
+    piece->unhashed_.clear();
+    if ((piece->hashed_ < piece_size)
+        && !hash_stored(*piece, piece->hashed_, piece_size - piece->hashed_))
+    {
+        co_return false;
+    }
+    piece->digest_ready_ = false;
+    // Not invoked if the piece is started over (e.g., the peer is gone).
+    get_hasher(*piece).finalize([this, piece](const PieceDigest& digest)
+    {
+        piece->digest_ = digest;
+        piece->digest_ready_ = true;
+        (void)pieces_hashed_->cancel();
+    });
+    auto coro = as_result(asio::use_awaitable);
+    while (!piece->digest_ready_)
+    {
+        // Canceled by the finalize() above (or of some other piece).
+        (void)co_await pieces_hashed_->async_wait(coro);
+    }
+    if (write_through_files_)
+    {
+        // All blocks are hashed, so given to the disk.
+        co_await wait_for_block_writes(piece);
+    }
+    if (piece->write_failed_)
+    {
+        co_return false;
+    }
+    co_return hashes_->is_valid(piece->piece_index_, piece->digest_);
+}
+
+void PiecesToDownload::on_piece_part_receive(Handle piece, be::Message_Piece& msg_piece)
+{
+    const std::uint32_t piece_size = get_piece_size(piece->piece_index_);
     const std::uint32_t data_size = msg_piece.size();
     assert((data_size > 0) && "Piece with zero size");
     assert(((piece->downloaded_ + data_size) <= piece_size)
         && "Downloaded more then piece has in size");
     assert((msg_piece.piece_begin_ + data_size) <= piece_size);
 
-    std::memcpy(&piece->data_[msg_piece.piece_begin_], msg_piece.data(), data_size);
+    piece->receiving_ = false;
+    piece->last_receive_ = std::chrono::steady_clock::now();
+    const std::uint32_t begin = msg_piece.piece_begin_;
+    if (write_through_files_)
+    {
+        PieceBuffer block = std::move(piece->data_);
+        if (!msg_piece.is_in_place())
+        {
+            block = buffers_->acquire(data_size);
+            std::memcpy(block.data_, msg_piece.data(), data_size);
+        }
+        // Written to the disk once hashed.
+        const std::uint8_t* data = block.data_;
+        hash_block(piece, begin, data_size, data, std::move(block));
+    }
+    else if (piece->in_part_file())
+    {
+        assert(!msg_piece.is_in_place());
+        const auto* data = static_cast<const std::uint8_t*>(msg_piece.data());
+        write_to_part_file(piece, begin, data, data_size);
+        // Message buffer is reused; hash a copy.
+        PieceBuffer block = buffers_->acquire(data_size);
+        std::memcpy(block.data_, data, data_size);
+        const std::uint8_t* block_data = block.data_;
+        hash_block(piece, begin, data_size, block_data, std::move(block));
+    }
+    else if (!msg_piece.is_in_place())
+    {
+        // Sink accepts all valid blocks.
+        assert(!mapped_files_);
+        if (!piece->data_)
+        {
+            assert(buffers_);
+            piece->data_ = buffers_->acquire(piece_size);
+        }
+        std::memcpy(piece->data_.data_ + begin, msg_piece.data(), data_size);
+        hash_block(piece, begin, data_size, piece->data_.data_ + begin);
+    }
+    else
+    {
+        hash_block(piece, begin, data_size
+            , (mapped_files_ ? nullptr : (piece->data_.data_ + begin)));
+        if (resume_ && mapped_files_ && ((data_size == k_resume_block_size)
+            || ((begin + data_size) == piece_size)))
+        {
+            // Block is in the mapped file already; no need to download it after restart.
+            // Otherwise, it's in memory only (see resume()).
+            (void)resume_->on_block_received(piece->piece_index_, begin);
+        }
+    }
     piece->downloaded_ += data_size;
 
-    debug_.OnNewPartReceived(*piece, data_size);
+    debug_.OnNewPartReceived(*piece, piece_size, data_size);
+}
+
+void PiecesToDownload::write_block(Handle piece, std::uint32_t begin, PieceBuffer block)
+{
+    assert(disk_);
+    const std::uint32_t piece_size = get_piece_size(piece->piece_index_);
+    const std::uint32_t size = block.size_;
+    ++piece->writes_pending_;
+    disk_->async_write_block(piece->piece_index_, begin, std::move(block)
+        , [this, piece, begin, size, piece_size](std::error_code ec, PieceBuffer)
+    {
+        assert(piece->writes_pending_ > 0);
+        if (ec)
+        {
+            // Hash check fails; the piece is downloaded again.
+            piece->write_failed_ = true;
+        }
+        else if (resume_ && ((size == k_resume_block_size) || ((begin + size) == piece_size)))
+        {
+            (void)resume_->on_block_received(piece->piece_index_, begin);
+        }
+        if (--piece->writes_pending_ == 0)
+        {
+            (void)blocks_written_->cancel();
+        }
+    });
+}
+
+asio::awaitable<void> PiecesToDownload::wait_for_block_writes(Handle piece)
+{
+    auto coro = as_result(asio::use_awaitable);
+    while (piece->writes_pending_ > 0)
+    {
+        // Canceled by write_block() completion.
+        (void)co_await blocks_written_->async_wait(coro);
+    }
 }
 
 void PiecesToDownload::on_piece_downloaded(Handle piece)
@@ -216,6 +905,7 @@ co_asio_result<void> TryDownloadPiecesFromPeer(
     // E.g.: https://github.com/veggiedefender/torrent-client/blob/master/p2p/p2p.go.
     while (true)
     {
+        co_await pieces.wait_for_memory();
         PiecesToDownload::Handle piece = pieces.pop_piece_to_download(peer.bitfield_);
         if (piece == pieces.pieces_.end())
         {
@@ -235,12 +925,41 @@ co_asio_result<void> TryDownloadPiecesFromPeer(
             // Connection is still used: peer may have other pieces.
             continue;
         }
+        if (peer.supports_v2())
+        {
+            if (auto range = pieces.hashes_->blocks_range(piece->piece_index_))
+            {
+                // Blocks are verified as they arrive, once the hashes come.
+                be::Message_HashRequest hash_request;
+                hash_request.range_ = *range;
+                OUTCOME_CO_TRY(co_await SendMessage(peer.socket_, hash_request));
+            }
+        }
 
         const std::uint32_t piece_size = pieces.get_piece_size(piece->piece_index_);
+        const be::PieceBlockSink sink = [&pieces, piece](std::uint32_t piece_index
+            , std::uint32_t begin, std::uint32_t size
+            , std::vector<asio::mutable_buffer>& buffers)
+        {
+            return (piece_index == piece->piece_index_)
+                && pieces.get_block_buffers(piece, begin, size, buffers);
+        };
         int backlog = 0;
         while (piece->downloaded_ < piece_size)
         {
-            if (peer.unchocked_)
+            if ((piece->requested_ < piece_size) && pieces.skip_padding_block(piece))
+            {
+                continue;
+            }
+            const bool disk_congested = (pieces.disk_ && pieces.disk_->is_congested());
+            if (disk_congested && (backlog == 0))
+            {
+                // Nothing to read from the peer; don't request
+                // more blocks until disk catches up.
+                co_await pieces.disk_->wait_until_ready();
+                continue;
+            }
+            if (peer.unchocked_ && !disk_congested)
             {
                 if ((backlog < k_max_backlog)
                     && (piece->requested_ < piece_size))
@@ -259,8 +978,9 @@ co_asio_result<void> TryDownloadPiecesFromPeer(
                 }
             }
 
-            OUTCOME_CO_TRY(be::AnyMessage msg, co_await be::ReadAnyMessage(peer.socket_));
+            OUTCOME_CO_TRY(be::AnyMessage msg, co_await be::ReadAnyMessage(peer.socket_, &sink));
 
+            std::optional<be::Message_HashReject> hash_reject;
             std::visit(overload{
                   [ ](be::Message_KeepAlive&) { }
                 , [&](be::Message_Choke&)     { peer.unchocked_ = false; }
@@ -273,17 +993,47 @@ co_asio_result<void> TryDownloadPiecesFromPeer(
                         && "Mixed order of pieces");
                     pieces.on_piece_part_receive(piece, msg_piece);
                 }
+                , [&](be::Message_Hashes& hashes)
+                {
+                    // Otherwise (e.g., hashes of the previous piece), ignored;
+                    // the piece is verified as a whole anyway.
+                    if (auto leaves = pieces.hashes_->valid_blocks(piece->piece_index_, hashes))
+                    {
+                        pieces.get_hasher(*piece).expect_blocks(std::move(*leaves));
+                    }
+                }
+                , [&](be::Message_HashRequest& request)
+                {
+                    // Nothing is uploaded.
+                    hash_reject.emplace();
+                    hash_reject->range_ = request.range_;
+                }
+                , [ ](be::Message_HashReject&) { }
                 , [](auto&) { assert(false && "Unhandled message from peer"); }
                 }, msg);
+
+            if (hash_reject)
+            {
+                OUTCOME_CO_TRY(co_await SendMessage(peer.socket_, *hash_reject));
+            }
+            if (piece->bad_block_)
+            {
+                // Bad data from the peer; `retry` starts the piece over.
+                co_return outcome::failure(ClientErrorc::TODO);
+            }
         }
         
         assert(piece->downloaded_ == piece_size);
+        if (!(co_await pieces.page_in(piece)) || !(co_await pieces.verify_piece(piece)))
+        {
+            // Hash mismatch; `retry` puts the piece back.
+            continue;
+        }
 
         const std::uint32_t piece_index = piece->piece_index_;
         retry.dismiss();
         pieces.on_piece_downloaded(piece);
 
-        // # UUU: validate and retry on hash mismatch.
         be::Message_Have have;
         have.piece_index_ = piece_index;
         OUTCOME_CO_TRY(co_await SendMessage(peer.socket_, have));
@@ -300,7 +1050,9 @@ asio::awaitable<std::error_code> DownloadFromPeer(
     , PiecesToDownload& pieces
     , be::TorrentPeer& peer)
 {
-    OUTCOME_CO_TRY_ERR(co_await peer.start(address, client.info_hash_, client.peer_id_));
+    (void)io_context;
+    OUTCOME_CO_TRY_ERR(co_await peer.start(address, client.info_hash_, client.peer_id_
+        , client.metainfo_.has_v2()));
     OUTCOME_CO_TRY_ERRV(bitfield, co_await be::ReadMessage<be::Message_Bitfield>(peer.socket_));
     peer.bitfield_ = std::move(bitfield);
     OUTCOME_CO_TRY_ERR(co_await be::SendMessage(peer.socket_, be::Message_Unchoke()));
@@ -309,7 +1061,10 @@ asio::awaitable<std::error_code> DownloadFromPeer(
     co_return ClientErrorc::Ok;
 }
 
-void DoOneTrackerRound(be::TorrentClient& client, PiecesToDownload& pieces)
+void DoOneTrackerRound(asio::io_context& io_context
+    , HTTPClient& http
+    , UDPTrackerClient& udp
+    , be::TorrentClient& client, PiecesToDownload& pieces)
 {
     Tracker::RequestInfo request;
     request.server_port = 6882;
@@ -317,325 +1072,50 @@ void DoOneTrackerRound(be::TorrentClient& client, PiecesToDownload& pieces)
     request.downloaded_pieces = pieces.downloaded_pieces_count_;
     request.uploaded_pieces = 0;
 
-    std::vector<be::PeerAddress> peers_addresses;
-    { // Get the info from the tracker first.
-        asio::io_context io_context(1);
-        asio::co_spawn(io_context
-            , [&]() -> asio::awaitable<void>
-        {
-            auto data = co_await client.request_torrent_peers(io_context, request);
-            if (data)
-            {
-                peers_addresses = std::move(data.value());
-            }
-            co_return;
-        }
-            , asio::detached);
-        io_context.run();
-    }
-
-    assert(peers_addresses.size() > 0);
-    debug_.OnPeersListReceived(peers_addresses);
-
-    std::vector<be::TorrentPeer> peers;
-    peers.reserve(peers_addresses.size());
-
-    asio::io_context io_context(1);
+    // Connections are started as soon as a tracker responds;
+    // references to the peers should stay valid.
+    std::deque<be::TorrentPeer> peers;
     asio::ip::tcp::resolver resolver(io_context);
-
-    for (auto address : peers_addresses)
+    std::size_t active_peers = 0;
+    auto on_peers = [&](std::vector<be::PeerAddress> peers_addresses)
     {
-        peers.emplace_back(io_context);
-
-        auto debug_info = ResolveToNicePeerAddress(resolver, address);
-        asio::co_spawn(io_context
-            , DownloadFromPeer(io_context, client, address, pieces, peers.back())
-            , [address, info = std::move(debug_info)](std::exception_ptr, std::error_code ec)
+        debug_.OnPeersListReceived(peers_addresses);
+        for (auto address : peers_addresses)
         {
-            debug_.OnPeerFinished(address, info, ec);
-        });
-    }
+            peers.emplace_back(io_context);
 
-    io_context.run();
-}
-
-struct FileOffset
-{
-    std::uint64_t start = 0;
-    std::uint64_t end = 0;
-    std::size_t file_index = 0;
-};
-
-struct FilePiece
-{
-    std::size_t file_index_;
-    const std::string* file_name_ = nullptr;
-    std::uint64_t file_offset_ = 0;
-    std::uint64_t bytes_count_ = 0;
-    std::uint64_t piece_offset_ = 0;
-    std::uint64_t file_size_ = 0;
-};
-
-struct FilesList
-{
-    const be::TorrentClient* torrent_;
-    std::vector<FileOffset> files_offset_;
-
-    static FilesList make(const be::TorrentClient& torrent)
-    {
-        using LengthOrFiles = be::TorrentMetainfo::LengthOrFiles;
-        using File = be::TorrentMetainfo::File;
-        const LengthOrFiles& data = torrent.metainfo_.info_.length_or_files_;
-
-        FilesList list;
-        list.torrent_ = &torrent;
-        if (const std::uint64_t* single_file = std::get_if<std::uint64_t>(&data))
-        {
-            list.files_offset_.push_back({});
-            FileOffset& offset = list.files_offset_.back();
-            offset.file_index = 0;
-            offset.start = 0;
-            offset.end = *single_file;
-        }
-        else if (const auto* multi_files
-            = std::get_if<std::vector<File>>(&data))
-        {
-            list.files_offset_.reserve(multi_files->size());
-            FileOffset fo;
-            fo.start = 0;
-            for (std::size_t index = 0, count = multi_files->size(); index < count; ++index)
+            auto debug_info = ResolveToNicePeerAddress(resolver, address);
+            ++active_peers;
+            asio::co_spawn(io_context
+                , DownloadFromPeer(io_context, client, address, pieces, peers.back())
+                , [address, info = std::move(debug_info), &active_peers](std::exception_ptr, std::error_code ec)
             {
-                const File& file = (*multi_files)[index];
-                fo.end = fo.start + file.length_bytes_;
-                fo.file_index = index;
-                list.files_offset_.push_back(fo);
-                fo.start = fo.end;
-            }
-        }
-        else
-        {
-            assert(false && "Invalid torrent metainfo.");
-        }
-        assert(list.files_offset_.size() > 0);
-        assert(list.files_offset_.back().end == torrent.get_total_size_bytes());
-        return list;
-    }
-
-    // F(const FilePiece& file_piece)
-    template<typename F>
-    void iterate_files(std::uint64_t start_bytes, std::uint64_t end_bytes, F f) const
-    {
-        assert(end_bytes > start_bytes);
-        assert(files_offset_.size() > 0);
-
-        auto end = files_offset_.end();
-        auto it_start = std::lower_bound(files_offset_.begin(), end, start_bytes
-            , [](const FileOffset& lhs, std::uint64_t rhs) { return (lhs.start < rhs); });
-        if (it_start == end)
-        {
-            // File with start >= start_bytes. Must be the last one.
-            it_start = (end - 1);
-        }
-        if (it_start->start > start_bytes)
-        {
-            // Found the file with start > start_bytes.
-            // File that has start < start_bytes is previous one.
-            --it_start;
-        }
-        // start_bytes should be in file's [start; end).
-        assert((start_bytes >= it_start->start)
-            && (start_bytes < it_start->end));
-
-        // Find the file where the end_bytes is. It starts from
-        // already found it_start file for sure.
-        auto it_end = std::lower_bound(it_start, end, end_bytes
-            , [](const FileOffset& lhs, std::uint64_t rhs)
-                { return (lhs.end < rhs); });
-        // There is always file with end >= end_bytes.
-        // Otherwise caller tries to write past the end of the file.
-        assert(it_end != end);
-        // Either the same or next file(s).
-        assert(it_end >= it_start);
-        // end_bytes should be in file's (start; end].
-        assert((end_bytes > it_end->start)
-            && (end_bytes <= it_end->end));
-
-        using File = be::TorrentMetainfo::File;
-        const auto* files = std::get_if<std::vector<File>>(
-            &torrent_->metainfo_.info_.length_or_files_);
-
-        std::uint64_t data_offset = 0;
-        // Iterate thru all files that overlap with [start_bytes; end_bytes].
-        for (auto it = it_start; it != (it_end + 1); ++it)
-        {
-            const FileOffset& fo = *it;
-            const std::string& file_name = files
-                ? (*files)[fo.file_index].path_utf8_
-                : torrent_->metainfo_.info_.suggested_name_utf8_;
-            const std::uint64_t file_size = files
-                ? (*files)[fo.file_index].length_bytes_
-                : files_offset_[0].end; // we know we have single file.
-
-            const std::uint64_t start_offset = std::max(start_bytes, fo.start);
-            const std::uint64_t end_offset = std::min(fo.end, end_bytes);
-
-            FilePiece piece;
-            piece.file_index_ = fo.file_index;
-            piece.file_name_ = &file_name;
-            piece.file_offset_ = (start_offset - fo.start);
-            piece.bytes_count_ = (end_offset - start_offset);
-            piece.piece_offset_ = data_offset;
-            piece.file_size_ = file_size;
-
-            f(piece);
-            // Consumed part of the input range.
-            data_offset += piece.bytes_count_;
-        }
-        // We should consume all the range passed.
-        assert(data_offset == (end_bytes - start_bytes));
-    }
-
-    // F(const FilePiece& file_piece)
-    template<typename F>
-    void iterate_files(std::uint32_t piece_index, F f) const
-    {
-        assert(files_offset_.size() > 0);
-        const std::uint64_t total_size = files_offset_.back().end;
-        const std::uint64_t start = piece_index * torrent_->get_piece_size_bytes();
-        std::uint64_t end = (piece_index + 1) * torrent_->get_piece_size_bytes();
-        end = std::min(end, total_size);
-        iterate_files(start, end, std::move(f));
-    }
-};
-
-struct PhysicalFile
-{
-    HANDLE file_ = INVALID_HANDLE_VALUE;
-    std::uint64_t written_ = 0;
-
-    PhysicalFile() = default;
-    PhysicalFile(const PhysicalFile&) = delete;
-    PhysicalFile& operator=(const PhysicalFile&) = delete;
-    PhysicalFile(PhysicalFile&& rhs) noexcept
-        : file_(std::exchange(rhs.file_, INVALID_HANDLE_VALUE))
-        , written_(0)
-    {
-    }
-    PhysicalFile& operator=(PhysicalFile&& rhs)
-    {
-        if (this != &rhs)
-        {
-            close();
-            file_ = std::exchange(rhs.file_, INVALID_HANDLE_VALUE);
-        }
-        return *this;
-    }
-    ~PhysicalFile()
-    {
-        close();
-    }
-    void close()
-    {
-        if (file_ != INVALID_HANDLE_VALUE)
-        {
-            (void)::CloseHandle(file_);
-            file_ = INVALID_HANDLE_VALUE;
-        }
-    }
-
-    void try_create(const std::string& name, std::uint64_t final_size)
-    {
-        if (file_ != INVALID_HANDLE_VALUE)
-        {
-            return;
-        }
-        file_ = ::CreateFileA(name.c_str()
-            , GENERIC_WRITE
-            , 0 // do not share with anyone
-            , nullptr
-            , CREATE_NEW // fail if already exists
-            , FILE_ATTRIBUTE_NORMAL
-            , nullptr);
-        assert(file_);
-        LARGE_INTEGER size{};
-        size.QuadPart = static_cast<LONGLONG>(final_size);
-        BOOL ok = ::SetFilePointerEx(file_, size, nullptr, FILE_BEGIN);
-        assert(ok);
-        ok = ::SetEndOfFile(file_);
-        assert(ok);
-    }
-
-    void write(const void* data, std::uint64_t offset, std::uint32_t size)
-    {
-        LARGE_INTEGER li{};
-        li.QuadPart = static_cast<LONGLONG>(offset);
-        BOOL ok = ::SetFilePointerEx(file_, li, nullptr, FILE_BEGIN);
-        assert(ok);
-
-        DWORD written = 0;
-        ok = ::WriteFile(file_, data, size, &written, nullptr);
-        assert(ok);
-        assert(written == size);
-        written_ += size;
-    }
-
-    void try_finalize(std::uint64_t final_size)
-    {
-        assert(written_ <= final_size);
-        if (written_ == final_size)
-        {
-            close();
+                debug_.OnPeerFinished(address, info, ec);
+                --active_peers;
+            });
         }
-    }
-};
-
-struct FilesOnDisk
-{
-    std::vector<PhysicalFile> files_;
-    const FilesList* files_list_;
-
-    FilesOnDisk(const FilesList& files_list)
-        : files_()
-        , files_list_(&files_list)
-    {
-        files_.resize(files_list_->files_offset_.size());
-    }
-
-    void write_piece(PieceState& piece)
-    {
-        assert(piece.data_.size() > 0);
-        files_list_->iterate_files(piece.piece_index_
-            , [this, &piece](const FilePiece& file_piece)
-        {
-            on_write_file_piece(file_piece, &piece.data_[0], piece.data_.size());
-        });
-        piece.data_ = {};
-    }
+    };
 
-    void on_write_file_piece(const FilePiece& piece
-        , const std::uint8_t* all_data, std::size_t data_size)
+    // Background work (e.g., Recheck) keeps io_context::run() going;
+    // run only until our own work is done.
+    io_context.restart();
+    debug_.OnTrackerRoundStarted();
+    bool announced = false;
+    asio::co_spawn(io_context
+        , [&]() -> asio::awaitable<void>
     {
-        assert(piece.file_index_ < files_.size());
-        assert(piece.piece_offset_ < data_size);
-        assert(piece.bytes_count_ > 0);
-        PhysicalFile& f = files_[piece.file_index_];
-        f.try_create(*piece.file_name_, piece.file_size_);
-        f.write(all_data + piece.piece_offset_
-            , piece.file_offset_
-            , std::uint32_t(piece.bytes_count_));
-        f.try_finalize(piece.file_size_);
+        auto ok = co_await client.request_torrent_peers(io_context, http, udp, request, on_peers);
+        assert(ok); (void)ok;
+        announced = true;
+        co_return;
     }
+        , asio::detached);
 
-    std::uint64_t total_written() const
+    while (!announced || (active_peers > 0))
     {
-        std::uint64_t total = 0;
-        for (const PhysicalFile& f : files_)
-        {
-            total += f.written_;
-        }
-        return total;
+        (void)io_context.run_one();
     }
-};
+}
 
 static std::string PrettyBytes(std::uint64_t bytes)
 {
@@ -657,7 +1137,7 @@ static std::string PrettyBytes(std::uint64_t bytes)
         count /= 1024;
     }
     char buf[256];
-    if (count - floor(count) == 0.0)
+    if (count - std::floor(count) == 0.0)
     {
         snprintf(buf, std::size(buf), "%u %s", unsigned(count), suffixes[s]);
     }
@@ -670,10 +1150,11 @@ static std::string PrettyBytes(std::uint64_t bytes)
 
 void DebugObserver::OnNewPartReceived(
     const PieceState& piece
+    , std::uint32_t piece_size
     , std::uint32_t bytes_received)
 {
     received_ += bytes_received;
-    if (piece.downloaded_ == piece.data_.size())
+    if (piece.downloaded_ == piece_size)
     {
         ++received_pieces_;
     }
@@ -688,12 +1169,55 @@ void DebugObserver::OnNewPartReceived(
         , peers_count_);
 }
 
+void DebugObserver::OnPieceWritten(std::uint32_t piece_index, std::error_code ec)
+{
+    if (ec)
+    {
+        printf("[%u] Failed to write piece: %s.\n"
+            , piece_index
+            , ec.message().c_str());
+    }
+}
+
+void DebugObserver::OnResumed(std::uint32_t pieces_count, std::uint64_t bytes)
+{
+    received_pieces_ = pieces_count;
+    received_ = bytes;
+    printf("Resumed %u pieces (%s).\n"
+        , pieces_count
+        , PrettyBytes(bytes).c_str());
+}
+
+void DebugObserver::OnPieceChecked(std::uint32_t piece_index, bool valid)
+{
+    if (valid)
+    {
+        ++received_pieces_;
+    }
+    ++checked_pieces_;
+    if (!valid)
+    {
+        printf("[%u] Recheck: missing or invalid piece.\n", piece_index);
+    }
+}
+
+void DebugObserver::OnRecheckFinished()
+{
+    printf("Recheck finished: %u pieces checked.\n", checked_pieces_);
+}
+
+void DebugObserver::OnTrackerRoundStarted()
+{
+    total_peers_ = 0;
+    peers_count_ = 0;
+}
+
 void DebugObserver::OnPeersListReceived(const std::vector<be::PeerAddress>& peers)
 {
-    total_peers_ = static_cast<std::uint32_t>(peers.size());
+    total_peers_ += static_cast<std::uint32_t>(peers.size());
     peers_count_ = total_peers_;
 
-    printf("Received %u peers.\n", total_peers_);
+    printf("Received %u peers (%u total).\n", unsigned(peers.size()), total_peers_);
 }
 
 void DebugObserver::OnPeerFinished(be::PeerAddress peer, std::optional<DebugPeerAddress> debug_info, std::error_code ec)
@@ -735,15 +1259,68 @@ void DebugObserver::OnPeerFinished(be::PeerAddress peer, std::optional<DebugPeer
 
 int main(int argc, char* argv[])
 {
-    assert(argc == 2);
+    assert(argc >= 2);
     const char* torrent_file = argv[1];
+    StorageOptions storage;
+    PieceBufferPoolOptions buffers_options;
+    bool write_through = false;
+    // Includes read and write caches (see DiskIOOptions).
+    buffers_options.budget_bytes_ = (256ull << 20);
+    for (int i = 2; i < argc; ++i)
+    {
+        if (std::strcmp(argv[i], "--mmap") == 0)
+        {
+            storage.memory_mapped_ = true;
+        }
+        else if (std::strcmp(argv[i], "--direct") == 0)
+        {
+            storage.bypass_page_cache_ = true;
+        }
+        else if ((std::strcmp(argv[i], "--memory-budget") == 0) && ((i + 1) < argc))
+        {
+            // MiB.
+            buffers_options.budget_bytes_ = (std::strtoull(argv[++i], nullptr, 10) << 20);
+        }
+        else if (std::strcmp(argv[i], "--huge-pages") == 0)
+        {
+            buffers_options.huge_pages_ = true;
+        }
+        else if (std::strcmp(argv[i], "--write-through") == 0)
+        {
+            write_through = true;
+        }
+    }
 
     std::random_device random;
     auto client = be::TorrentClient::make(torrent_file, random);
     assert(client);
     auto& client_ref = client.value();
+    auto piece_hashes = PieceHashes::make(client_ref);
+    assert(piece_hashes);
     auto files_list = FilesList::make(client_ref);
-    auto files_on_disk = FilesOnDisk(files_list);
+    auto files_on_disk = FilesOnDisk(files_list, storage);
+
+    // Disk writes complete on the same thread as network,
+    // so there is only one io_context for the whole session.
+    asio::io_context io_context(1);
+    // Enough for ~64 MiB of in-flight pieces; more goes to the heap.
+    const std::uint32_t piece_size = client_ref.get_piece_size_bytes();
+    PieceBufferPool buffers(piece_size
+        , std::max<std::uint32_t>(4, std::uint32_t((64ull << 20) / piece_size))
+        , buffers_options);
+    PartFile part_file(PartFilePath(storage, client_ref), piece_size);
+    // Before `buffers` go away, finishes hashing that may hold them.
+    HashPool hash_pool;
+    asio::steady_timer pieces_hashed(io_context);
+    pieces_hashed.expires_at(asio::steady_timer::time_point::max());
+    asio::steady_timer memory_ready(io_context);
+    memory_ready.expires_at(asio::steady_timer::time_point::max());
+    asio::steady_timer blocks_written(io_context);
+    blocks_written.expires_at(asio::steady_timer::time_point::max());
+    asio::steady_timer part_io_done(io_context);
+    part_io_done.expires_at(asio::steady_timer::time_point::max());
+    auto disk = MakeDiskIO(io_context, files_on_disk, buffers, DiskIOOptions());
+    part_file.set_disk(*disk);
 
     PiecesToDownload pieces;
     pieces.pieces_count_ = client_ref.get_pieces_count();
@@ -751,22 +1328,159 @@ int main(int argc, char* argv[])
     pieces.total_size_ = client_ref.get_total_size_bytes();
     pieces.downloaded_pieces_count_ = 0;
     pieces.next_piece_index_ = 0;
-    pieces.on_new_piece = [&files_on_disk](PieceState& piece)
+    pieces.torrent_ = &client_ref;
+    pieces.hashes_ = &piece_hashes.value();
+    pieces.files_list_ = &files_list;
+    pieces.buffers_ = &buffers;
+    pieces.memory_ready_ = &memory_ready;
+    buffers.set_on_release([&pieces] { pieces.on_buffer_released(); });
+    // Disk I/O (and its buffers) outlives `pieces`.
+    ScopeExit unsubscribe([&buffers] { buffers.set_on_release({}); });
+    pieces.mapped_files_ = (storage.memory_mapped_ ? &files_on_disk : nullptr);
+    // Nothing to spill with write-through: pieces are not kept in memory.
+    write_through &= !storage.memory_mapped_;
+    pieces.write_through_files_ = (write_through ? &files_on_disk : nullptr);
+    pieces.blocks_written_ = &blocks_written;
+    pieces.part_file_ = ((storage.memory_mapped_ || write_through) ? nullptr : &part_file);
+    pieces.part_io_done_ = &part_io_done;
+    pieces.disk_ = disk.get();
+    pieces.hash_pool_ = &hash_pool;
+    pieces.io_context_ = &io_context;
+    pieces.pieces_hashed_ = &pieces_hashed;
+
+    ResumeFile resume(ResumeFilePath(storage, client_ref), files_on_disk);
+    const ResumeData& resumed = resume.load();
+    pieces.resume_ = &resume;
+    pieces.resume(resumed);
+    std::uint64_t resumed_bytes = 0;
+    for (std::uint32_t i = 0; i < pieces.pieces_count_; ++i)
+    {
+        if (resumed.have_pieces_[i])
+        {
+            // Accounted as written for OnFileComplete sync and totals.
+            files_list.iterate_files(i, [&](const FilePiece& file_piece)
+            {
+                (void)files_on_disk.mark_written(file_piece);
+            });
+            resumed_bytes += pieces.get_piece_size(i);
+        }
+    }
+    debug_.OnResumed(pieces.downloaded_pieces_count_, resumed_bytes);
+    for (std::uint32_t i = 0; i < pieces.pieces_count_; ++i)
+    {
+        if (!pieces.picked_pieces_[i]
+            && files_list.is_padding(files_list.piece_offset(i), files_list.piece_end(i)))
+        {
+            // Padding files only (BEP 47): zeros, nothing to download.
+            pieces.picked_pieces_[i] = true;
+            ++pieces.downloaded_pieces_count_;
+        }
+    }
+
+    // Files with unknown content: verify, while downloading the rest.
+    std::vector<std::uint32_t> to_check;
+    for (std::uint32_t i = 0; i < pieces.pieces_count_; ++i)
+    {
+        if (pieces.picked_pieces_[i])
+        {
+            continue;
+        }
+        bool unverified = false;
+        files_list.iterate_files(i, [&](const FilePiece& file_piece)
+        {
+            unverified |= resumed.unverified_files_[file_piece.file_index_];
+        });
+        if (unverified)
+        {
+            pieces.picked_pieces_[i] = true;
+            to_check.push_back(i);
+        }
+    }
+    Recheck recheck(io_context, files_on_disk, hash_pool, piece_hashes.value());
+    recheck.start(std::move(to_check)
+        , [&](std::uint32_t piece_index, bool valid)
     {
-        files_on_disk.write_piece(piece);
+        pieces.on_piece_checked(piece_index, valid);
+        if (valid)
+        {
+            files_list.iterate_files(piece_index, [&](const FilePiece& file_piece)
+            {
+                (void)files_on_disk.mark_written(file_piece);
+            });
+            (void)resume.on_piece_completed(piece_index);
+        }
+        debug_.OnPieceChecked(piece_index, valid);
+    }
+        , []()
+    {
+        debug_.OnRecheckFinished();
+    });
+
+    pieces.on_new_piece = [&disk, &pieces, &files_on_disk, &resume](PieceState& piece)
+    {
+        const std::uint32_t piece_index = piece.piece_index_;
+        if (pieces.write_through_files_)
+        {
+            // Blocks are written already.
+            auto completed = files_on_disk.on_blocks_piece_complete(piece_index);
+            debug_.OnPieceWritten(piece_index, completed ? std::error_code() : completed.error());
+            assert(completed);
+            (void)resume.on_piece_completed(piece_index);
+            return;
+        }
+        if (pieces.mapped_files_)
+        {
+            // Already in place; nothing to write.
+            auto flushed = files_on_disk.on_mapped_piece_complete(piece_index);
+            debug_.OnPieceWritten(piece_index, flushed ? std::error_code() : flushed.error());
+            assert(flushed);
+            // Worst case, the piece is downloaded again after restart.
+            (void)resume.on_piece_completed(piece_index);
+            return;
+        }
+        disk->async_write_piece(piece_index, std::move(piece.data_)
+            , [piece_index, &resume](std::error_code ec, PieceBuffer)
+        {
+            debug_.OnPieceWritten(piece_index, ec);
+            assert(!ec);
+            (void)resume.on_piece_completed(piece_index);
+        });
+        if (pieces.downloaded_pieces_count_ == pieces.pieces_count_)
+        {
+            // Don't wait for the write cache timeout.
+            disk->flush();
+        }
     };
 
     debug_.total_ = pieces.total_size_;
     debug_.pieces_count_ = pieces.pieces_count_;
 
+    // Tracker connections are kept alive between the rounds.
+    HTTPClient http(io_context);
+    // Same for UDP trackers' connection ids; single socket for all.
+    UDPTrackerClient udp(io_context, random);
     while (pieces.downloaded_pieces_count_ < pieces.pieces_count_)
     {
-        DoOneTrackerRound(client_ref, pieces);
+        if (!pieces.has_pieces_to_download())
+        {
+            // Everything left is being rechecked.
+            assert(recheck.is_running());
+            io_context.restart();
+            (void)io_context.run_one();
+            continue;
+        }
+        DoOneTrackerRound(io_context, http, udp, client_ref, pieces);
     }
 
+    // Pending writes; their completions go to the journal.
+    disk->flush();
+    io_context.restart();
+    io_context.run();
+    (void)resume.compact();
+
     assert(pieces.downloaded_pieces_count_ == pieces.pieces_count_);
     assert(pieces.pieces_.empty());
     assert(pieces.to_retry_.empty());
-    assert(files_on_disk.total_written() == pieces.total_size_);
+    assert((files_on_disk.total_written() + files_list.padding_bytes_) == pieces.total_size_);
     return 0;
 }
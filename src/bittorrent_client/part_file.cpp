@@ -0,0 +1,168 @@
+#include "part_file.h"
+#include "resume_file.h"
+
+#include <system_error>
+#include <utility>
+
+#include <cassert>
+
+/*explicit*/ PartFile::PartFile(std::filesystem::path path, std::uint32_t piece_size)
+    : path_(std::move(path))
+    , piece_size_(piece_size)
+{
+}
+
+PartFile::~PartFile()
+{
+    if (file_.is_open())
+    {
+        file_.close();
+        std::error_code ec;
+        (void)std::filesystem::remove(path_, ec);
+    }
+}
+
+void PartFile::set_disk(DiskIO& disk)
+{
+    disk_ = &disk;
+}
+
+bool PartFile::has_piece(std::uint32_t piece_index) const
+{
+    return (slots_.count(piece_index) > 0);
+}
+
+std::uint32_t PartFile::take_slot(std::uint32_t piece_index)
+{
+    auto it = slots_.find(piece_index);
+    if (it != slots_.end())
+    {
+        return it->second;
+    }
+    std::uint32_t slot = std::uint32_t(states_.size());
+    if (!free_slots_.empty())
+    {
+        slot = free_slots_.back();
+        free_slots_.pop_back();
+    }
+    else
+    {
+        states_.emplace_back();
+    }
+    slots_.emplace(piece_index, slot);
+    return slot;
+}
+
+void PartFile::async_write(std::uint32_t piece_index, std::uint32_t offset
+    , PieceBuffer data, std::uint32_t size, OnDiskWrite on_done)
+{
+    assert(size <= data.size_);
+    assert((std::uint64_t(offset) + size) <= piece_size_);
+    if (!file_.is_open() && !open_error_)
+    {
+        // Leftovers of the previous run are not needed. File grows with writes.
+        StorageOptions options;
+        options.preallocate_ = false;
+        auto opened = file_.open(path_, 0, options);
+        open_error_ = (opened ? std::error_code() : opened.error());
+    }
+    const std::uint32_t slot = take_slot(piece_index);
+    Operation operation;
+    operation.offset_ = (std::uint64_t(slot) * piece_size_) + offset;
+    operation.size_ = size;
+    operation.data_ = std::move(data);
+    operation.on_done_ = std::move(on_done);
+    enqueue(slot, std::move(operation));
+}
+
+void PartFile::async_take(std::uint32_t piece_index
+    , PieceBuffer data, OnDiskRead on_done)
+{
+    assert(data.size_ <= piece_size_);
+    auto it = slots_.find(piece_index);
+    assert(it != slots_.end());
+    const std::uint32_t slot = it->second;
+    Operation operation;
+    operation.read_ = true;
+    operation.offset_ = (std::uint64_t(slot) * piece_size_);
+    operation.size_ = data.size_;
+    operation.data_ = std::move(data);
+    operation.on_done_ = std::move(on_done);
+    enqueue(slot, std::move(operation));
+    // Freed once the read is done.
+    drop(piece_index);
+}
+
+void PartFile::enqueue(std::uint32_t slot, Operation operation)
+{
+    assert(disk_);
+    std::deque<Operation>& operations = states_[slot].operations_;
+    operations.push_back(std::move(operation));
+    if (operations.size() == 1)
+    {
+        run_front(slot);
+    }
+}
+
+void PartFile::run_front(std::uint32_t slot)
+{
+    const Operation& operation = states_[slot].operations_.front();
+    // Buffer stays in the queue until the job is done.
+    disk_->async_run([this, read = operation.read_, offset = operation.offset_
+        , data = operation.data_.data_, size = operation.size_]()
+    {
+        if (open_error_)
+        {
+            return open_error_;
+        }
+        auto status = (read ? file_.read(data, offset, size) : file_.write(data, offset, size));
+        return (status ? std::error_code() : status.error());
+    }
+        , [this, slot](std::error_code ec)
+    {
+        SlotState& state = states_[slot];
+        Operation done = std::move(state.operations_.front());
+        state.operations_.pop_front();
+        if (!state.operations_.empty())
+        {
+            run_front(slot);
+        }
+        else if (state.dropped_)
+        {
+            free_slot(slot);
+        }
+        done.on_done_(ec, std::move(done.data_));
+    });
+}
+
+void PartFile::drop(std::uint32_t piece_index)
+{
+    auto it = slots_.find(piece_index);
+    if (it == slots_.end())
+    {
+        return;
+    }
+    const std::uint32_t slot = it->second;
+    slots_.erase(it);
+    if (states_[slot].operations_.empty())
+    {
+        free_slot(slot);
+    }
+    else
+    {
+        // Data written by the operations in flight is not needed.
+        states_[slot].dropped_ = true;
+    }
+}
+
+void PartFile::free_slot(std::uint32_t slot)
+{
+    states_[slot].dropped_ = false;
+    free_slots_.push_back(slot);
+}
+
+std::filesystem::path PartFilePath(const StorageOptions& options
+    , const be::TorrentClient& torrent)
+{
+    return ResumeFilePath(options, torrent).replace_extension(".parts");
+}
@@ -0,0 +1,85 @@
+#pragma once
+#include "disk_io.h"
+#include "file_storage.h"
+#include "piece_buffer_pool.h"
+#include "torrent_client.h"
+#include "utils_outcome.h"
+
+#include <deque>
+#include <filesystem>
+#include <map>
+#include <vector>
+
+#include <cstdint>
+
+// Scratch file for partial pieces that are moved out of memory
+// (see PiecesToDownload::spill_coldest_piece()). Every spilled piece
+// takes a slot of the piece size; slots of the pieces paged back are
+// reused, so the file is as big as the most pieces spilled at once.
+// Removed when closed. Called on the network thread; reads and writes
+// are done by DiskIO::async_run(), in the order they are issued
+// for the same piece.
+class PartFile
+{
+public:
+    explicit PartFile(std::filesystem::path path, std::uint32_t piece_size);
+    ~PartFile();
+    PartFile(const PartFile&) = delete;
+    PartFile& operator=(const PartFile&) = delete;
+
+    // `disk` is destroyed first, so its jobs don't outlive the file.
+    void set_disk(DiskIO& disk);
+
+    bool has_piece(std::uint32_t piece_index) const;
+    // Writes first `size` bytes of `data` at `offset` of the piece;
+    // takes a slot if needed.
+    void async_write(std::uint32_t piece_index, std::uint32_t offset
+        , PieceBuffer data, std::uint32_t size, OnDiskWrite on_done);
+    // Reads first `data.size_` bytes of the piece and frees its slot.
+    void async_take(std::uint32_t piece_index
+        , PieceBuffer data, OnDiskRead on_done);
+    // Frees the slot; piece data is not needed anymore.
+    // Reused once the piece operations in flight are done.
+    void drop(std::uint32_t piece_index);
+
+    std::size_t pieces_count() const { return slots_.size(); }
+
+private:
+    struct Operation
+    {
+        bool read_ = false;
+        std::uint64_t offset_ = 0;
+        std::uint32_t size_ = 0;
+        PieceBuffer data_;
+        OnDiskWrite on_done_;
+    };
+
+    struct SlotState
+    {
+        // Front one is in flight.
+        std::deque<Operation> operations_;
+        bool dropped_ = false;
+    };
+
+    std::uint32_t take_slot(std::uint32_t piece_index);
+    void enqueue(std::uint32_t slot, Operation operation);
+    void run_front(std::uint32_t slot);
+    void free_slot(std::uint32_t slot);
+
+private:
+    std::filesystem::path path_;
+    std::uint32_t piece_size_ = 0;
+    DiskIO* disk_ = nullptr;
+    // Opened on the network thread, written and read by the DiskIO jobs.
+    PhysicalFile file_;
+    std::error_code open_error_;
+    // Piece index -> slot.
+    std::map<std::uint32_t, std::uint32_t> slots_;
+    // By slot; deque<>, so growing does not move the queued operations.
+    std::deque<SlotState> states_;
+    std::vector<std::uint32_t> free_slots_;
+};
+
+// "<root_dir>/<info hash hex>.parts".
+std::filesystem::path PartFilePath(const StorageOptions& options
+    , const be::TorrentClient& torrent);
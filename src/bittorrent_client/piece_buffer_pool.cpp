@@ -0,0 +1,240 @@
+#include "piece_buffer_pool.h"
+
+#include <algorithm>
+#include <utility>
+
+#include <cassert>
+
+#if defined(__linux__)
+#  include <sys/mman.h>
+#endif
+
+// Free blocks kept for reuse; 4 MiB.
+static constexpr std::size_t k_max_free_blocks = 256;
+
+static std::uint64_t AlignedSize(std::uint64_t size)
+{
+    return (size + k_piece_buffer_alignment - 1)
+        / k_piece_buffer_alignment * k_piece_buffer_alignment;
+}
+
+PieceBuffer::PieceBuffer(PieceBuffer&& rhs) noexcept
+    : data_(std::exchange(rhs.data_, nullptr))
+    , size_(std::exchange(rhs.size_, 0))
+    , pool_index_(std::exchange(rhs.pool_index_, -1))
+    , pool_(std::exchange(rhs.pool_, nullptr))
+{
+}
+
+PieceBuffer& PieceBuffer::operator=(PieceBuffer&& rhs) noexcept
+{
+    if (this != &rhs)
+    {
+        reset();
+        data_ = std::exchange(rhs.data_, nullptr);
+        size_ = std::exchange(rhs.size_, 0);
+        pool_index_ = std::exchange(rhs.pool_index_, -1);
+        pool_ = std::exchange(rhs.pool_, nullptr);
+    }
+    return *this;
+}
+
+PieceBuffer::~PieceBuffer() noexcept
+{
+    reset();
+}
+
+void PieceBuffer::reset() noexcept
+{
+    if (!data_)
+    {
+        return;
+    }
+    if (pool_)
+    {
+        pool_->release(*this);
+    }
+    else
+    {
+        AlignedDelete(data_, k_piece_buffer_alignment);
+    }
+    data_ = nullptr;
+    size_ = 0;
+    pool_index_ = -1;
+    pool_ = nullptr;
+}
+
+/*explicit*/ PieceBufferPool::PieceBufferPool(std::uint32_t buffer_size
+    , std::uint32_t buffers_count
+    , const PieceBufferPoolOptions& options /*= {}*/)
+    : buffer_size_(buffer_size)
+    , buffers_count_(buffers_count)
+    , options_(options)
+    , slot_size_(AlignedSize(buffer_size))
+    , free_slots_()
+{
+    allocate_storage();
+    free_slots_.reserve(buffers_count);
+    // Reverse order, so slot 0 is used first.
+    for (std::uint32_t i = buffers_count; i > 0; --i)
+    {
+        free_slots_.push_back(i - 1);
+    }
+}
+
+PieceBufferPool::~PieceBufferPool()
+{
+    assert((used_bytes_ == 0) && "Buffers outlive the pool");
+    for (std::uint8_t* block : free_blocks_)
+    {
+        AlignedDelete(block, k_piece_buffer_alignment);
+    }
+#if defined(__linux__)
+    if (mapped_size_ > 0)
+    {
+        (void)::munmap(storage_, mapped_size_);
+        return;
+    }
+#endif
+    AlignedDelete(storage_, k_piece_buffer_alignment);
+}
+
+void PieceBufferPool::allocate_storage()
+{
+    const std::size_t size = std::size_t(slot_size_ * buffers_count_);
+#if defined(__linux__)
+    if (options_.huge_pages_ && (size > 0))
+    {
+        // 2 MiB pages of x86-64 and AArch64 (4K granule).
+        const std::size_t k_huge_page_size = 2 * 1024 * 1024;
+        const std::size_t mapped_size = (size + k_huge_page_size - 1)
+            / k_huge_page_size * k_huge_page_size;
+        void* ptr = ::mmap(nullptr, mapped_size, PROT_READ | PROT_WRITE
+            , MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (ptr == MAP_FAILED)
+        {
+            // No reserved huge pages; transparent ones, if enabled.
+            ptr = ::mmap(nullptr, mapped_size, PROT_READ | PROT_WRITE
+                , MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (ptr != MAP_FAILED)
+            {
+                (void)::madvise(ptr, mapped_size, MADV_HUGEPAGE);
+            }
+        }
+        if (ptr != MAP_FAILED)
+        {
+            storage_ = static_cast<std::uint8_t*>(ptr);
+            mapped_size_ = mapped_size;
+            return;
+        }
+    }
+#endif
+    storage_ = AlignedNew(size, k_piece_buffer_alignment);
+}
+
+static bool IsBlockSize(std::uint32_t size, std::uint64_t slot_size)
+{
+    // Small pieces: slot is not bigger than a block anyway.
+    return (size <= k_piece_buffer_block_size)
+        && (slot_size > k_piece_buffer_block_size);
+}
+
+PieceBuffer PieceBufferPool::acquire(std::uint32_t size)
+{
+    assert(size > 0);
+    PieceBuffer buffer;
+    buffer.size_ = size;
+    buffer.pool_ = this;
+    if (IsBlockSize(size, slot_size_))
+    {
+        if (free_blocks_.empty())
+        {
+            buffer.data_ = AlignedNew(k_piece_buffer_block_size, k_piece_buffer_alignment);
+        }
+        else
+        {
+            buffer.data_ = free_blocks_.back();
+            free_blocks_.pop_back();
+        }
+        buffer.pool_index_ = PieceBuffer::k_block_pool_index;
+    }
+    else if ((size <= buffer_size_) && !free_slots_.empty())
+    {
+        const std::uint32_t index = free_slots_.back();
+        free_slots_.pop_back();
+        buffer.data_ = slot_data(index);
+        buffer.pool_index_ = int(index);
+    }
+    else
+    {
+        buffer.data_ = AlignedNew(size, k_piece_buffer_alignment);
+    }
+    used_bytes_ += pinned_size(buffer);
+    return buffer;
+}
+
+std::uint64_t PieceBufferPool::pinned_size(const PieceBuffer& buffer) const
+{
+    if (buffer.pool_index_ >= 0)
+    {
+        return slot_size_;
+    }
+    if (buffer.pool_index_ == PieceBuffer::k_block_pool_index)
+    {
+        return k_piece_buffer_block_size;
+    }
+    return AlignedSize(buffer.size_);
+}
+
+bool PieceBufferPool::has_room(std::uint32_t size) const
+{
+    std::uint64_t pinned = AlignedSize(size);
+    if (IsBlockSize(size, slot_size_))
+    {
+        pinned = k_piece_buffer_block_size;
+    }
+    else if ((size <= buffer_size_) && !free_slots_.empty())
+    {
+        pinned = slot_size_;
+    }
+    return (options_.budget_bytes_ == 0)
+        || (used_bytes_ == 0)
+        || ((used_bytes_ + pinned) <= options_.budget_bytes_);
+}
+
+void PieceBufferPool::set_on_release(std::function<void ()> on_release)
+{
+    on_release_ = std::move(on_release);
+}
+
+std::uint8_t* PieceBufferPool::slot_data(std::uint32_t index) const
+{
+    assert(index < buffers_count_);
+    return (storage_ + std::size_t(index * slot_size_));
+}
+
+void PieceBufferPool::release(PieceBuffer& buffer) noexcept
+{
+    assert(buffer.pool_ == this);
+    if (buffer.pool_index_ >= 0)
+    {
+        assert(std::uint32_t(buffer.pool_index_) < buffers_count_);
+        free_slots_.push_back(std::uint32_t(buffer.pool_index_));
+    }
+    else if ((buffer.pool_index_ == PieceBuffer::k_block_pool_index)
+        && (free_blocks_.size() < k_max_free_blocks))
+    {
+        free_blocks_.push_back(buffer.data_);
+    }
+    else
+    {
+        AlignedDelete(buffer.data_, k_piece_buffer_alignment);
+    }
+    const std::uint64_t pinned = pinned_size(buffer);
+    assert(used_bytes_ >= pinned);
+    used_bytes_ -= pinned;
+    if (on_release_)
+    {
+        on_release_();
+    }
+}
@@ -0,0 +1,104 @@
+#pragma once
+#include "utils_aligned.h"
+
+#include <functional>
+#include <vector>
+
+#include <cstdint>
+
+class PieceBufferPool;
+
+// Both pool slots and heap fallback; enough for O_DIRECT
+// (see k_direct_io_alignment).
+constexpr std::size_t k_piece_buffer_alignment = 4096;
+// Requests of up to this size (single blocks) never take a piece slot.
+constexpr std::uint32_t k_piece_buffer_block_size = 16 * 1024;
+
+// Move-only memory for a single in-flight piece (or block).
+// Either one of the PieceBufferPool slots (stable address,
+// may be registered with the kernel), a recycled block-size
+// buffer or plain heap memory when pool is exhausted.
+struct PieceBuffer
+{
+    std::uint8_t* data_ = nullptr;
+    std::uint32_t size_ = 0;
+    // Slot in the `pool_`, k_block_pool_index for a block-size buffer
+    // or -1 when allocated on the heap.
+    int pool_index_ = -1;
+    static constexpr int k_block_pool_index = -2;
+    // Pool the memory is accounted in (both slot and heap).
+    PieceBufferPool* pool_ = nullptr;
+
+    PieceBuffer() noexcept = default;
+    PieceBuffer(const PieceBuffer&) = delete;
+    PieceBuffer& operator=(const PieceBuffer&) = delete;
+    PieceBuffer(PieceBuffer&& rhs) noexcept;
+    PieceBuffer& operator=(PieceBuffer&& rhs) noexcept;
+    ~PieceBuffer() noexcept;
+
+    explicit operator bool() const { return (data_ != nullptr); }
+    void reset() noexcept;
+};
+
+struct PieceBufferPoolOptions
+{
+    // Max bytes of all buffers in use (slots and heap) before
+    // has_room() says no; 0 - unlimited. acquire() still succeeds:
+    // the budget is enforced by not starting new pieces.
+    std::uint64_t budget_bytes_ = 0;
+    // Slots are allocated on huge pages (Linux only): explicit
+    // ones if reserved (vm.nr_hugepages), transparent otherwise.
+    bool huge_pages_ = false;
+};
+
+// Fixed number of same-size buffers allocated once, as a single slab,
+// and reused for all pieces. Blocks (up to k_piece_buffer_block_size)
+// come from a separate free list, so they don't pin a whole slot.
+// Not thread-safe: acquire and release on the network thread.
+class PieceBufferPool
+{
+public:
+    explicit PieceBufferPool(std::uint32_t buffer_size
+        , std::uint32_t buffers_count
+        , const PieceBufferPoolOptions& options = {});
+    ~PieceBufferPool();
+
+    PieceBufferPool(const PieceBufferPool&) = delete;
+    PieceBufferPool& operator=(const PieceBufferPool&) = delete;
+
+    // Never fails: falls back to the heap when all slots are in use.
+    PieceBuffer acquire(std::uint32_t size);
+
+    // Buffer of `size` fits into the budget. Always true when nothing
+    // is in use, so a single piece bigger than the budget still progresses.
+    bool has_room(std::uint32_t size) const;
+    // Memory actually held: whole slots, blocks and heap buffers.
+    std::uint64_t used_bytes() const { return used_bytes_; }
+    // Invoked after every release; e.g. to resume waiting for has_room().
+    void set_on_release(std::function<void ()> on_release);
+
+    std::uint32_t buffer_size() const { return buffer_size_; }
+    std::uint32_t buffers_count() const { return buffers_count_; }
+    std::uint8_t* slot_data(std::uint32_t index) const;
+
+private:
+    friend struct PieceBuffer;
+    void release(PieceBuffer& buffer) noexcept;
+    std::uint64_t pinned_size(const PieceBuffer& buffer) const;
+    void allocate_storage();
+
+private:
+    std::uint32_t buffer_size_ = 0;
+    std::uint32_t buffers_count_ = 0;
+    PieceBufferPoolOptions options_;
+    // Slots are `buffer_size_` rounded up to k_piece_buffer_alignment.
+    std::uint64_t slot_size_ = 0;
+    std::uint8_t* storage_ = nullptr;
+    // Non-zero when `storage_` is mmap-ed (huge pages).
+    std::size_t mapped_size_ = 0;
+    std::vector<std::uint32_t> free_slots_;
+    // Released block-size buffers, kept for reuse.
+    std::vector<std::uint8_t*> free_blocks_;
+    std::uint64_t used_bytes_ = 0;
+    std::function<void ()> on_release_;
+};
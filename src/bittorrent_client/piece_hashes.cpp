@@ -0,0 +1,234 @@
+#include "piece_hashes.h"
+
+#include <small_utils/utils_sha1.h>
+#include <small_utils/utils_sha256.h>
+
+#include <algorithm>
+#include <string_view>
+#include <utility>
+
+#include <cstring>
+#include <cassert>
+
+namespace
+{
+    using File = be::TorrentMetainfo::File;
+
+    bool IsSameHash(const SHA256Bytes& lhs, const SHA256Bytes& rhs)
+    {
+        return (std::memcmp(lhs.data_, rhs.data_, sizeof(lhs.data_)) == 0);
+    }
+
+    SHA256Bytes AsSHA256(const std::uint8_t* data)
+    {
+        SHA256Bytes hash;
+        std::memcpy(hash.data_, data, sizeof(hash.data_));
+        return hash;
+    }
+} // namespace
+
+/*static*/ outcome::result<PieceHashes> PieceHashes::make(const be::TorrentClient& torrent)
+{
+    PieceHashes hashes;
+    hashes.torrent_ = &torrent;
+    const be::TorrentMetainfo& metainfo = torrent.metainfo_;
+    if (!metainfo.has_v2())
+    {
+        return outcome::success(std::move(hashes));
+    }
+
+    const std::uint64_t piece_size = torrent.get_piece_size_bytes();
+    const std::uint32_t piece_width = std::uint32_t(piece_size / k_merkle_block_size);
+    // Hashes after the last piece of the file are roots of zero subtrees.
+    const SHA256Bytes layer_pad = GetMerklePadRoot(piece_width);
+    hashes.merkle_.resize(torrent.get_pieces_count());
+
+    auto add_file = [&](std::uint64_t offset, const File& file) -> outcome::result<void>
+    {
+        if ((file.length_bytes_ == 0) || file.is_padding())
+        {
+            return outcome::success();
+        }
+        if ((file.pieces_root_.size() != sizeof(SHA256Bytes))
+            || ((offset % piece_size) != 0))
+        {
+            return outcome::failure(ClientErrorc::InvalidPieceLayers);
+        }
+        const SHA256Bytes pieces_root = AsSHA256(file.pieces_root_.data());
+        const std::uint64_t pieces_count = ((file.length_bytes_ + piece_size - 1) / piece_size);
+        const std::uint32_t first_piece = std::uint32_t(offset / piece_size);
+        assert((first_piece + pieces_count) <= hashes.merkle_.size());
+
+        std::vector<SHA256Bytes> layer;
+        if (pieces_count == 1)
+        {
+            layer.push_back(pieces_root);
+        }
+        else
+        {
+            auto it = metainfo.piece_layers_.find(file.pieces_root_);
+            if ((it == metainfo.piece_layers_.end())
+                || (it->second.size() != (pieces_count * sizeof(SHA256Bytes))))
+            {
+                return outcome::failure(ClientErrorc::InvalidPieceLayers);
+            }
+            layer.reserve(std::size_t(pieces_count));
+            for (std::uint64_t i = 0; i < pieces_count; ++i)
+            {
+                layer.push_back(AsSHA256(&it->second[std::size_t(i * sizeof(SHA256Bytes))]));
+            }
+            const SHA256Bytes root = GetMerkleRoot(layer.data(), layer.size()
+                , GetMerkleWidth(layer.size()), layer_pad);
+            if (!IsSameHash(root, pieces_root))
+            {
+                return outcome::failure(ClientErrorc::InvalidPieceLayers);
+            }
+        }
+
+        for (std::uint64_t i = 0; i < pieces_count; ++i)
+        {
+            MerklePiece& piece = hashes.merkle_[std::size_t(first_piece + i)];
+            piece.pieces_root_ = pieces_root;
+            piece.index_in_file_ = std::uint32_t(i);
+            piece.data_size_ = std::uint32_t(std::min(piece_size
+                , file.length_bytes_ - (i * piece_size)));
+            // Small file is a tree of its own blocks only.
+            piece.width_ = ((pieces_count == 1)
+                ? std::uint32_t(GetMerkleWidth((piece.data_size_ + k_merkle_block_size - 1) / k_merkle_block_size))
+                : piece_width);
+            piece.root_ = layer[std::size_t(i)];
+        }
+        return outcome::success();
+    };
+
+    using LengthOrFiles = be::TorrentMetainfo::LengthOrFiles;
+    const LengthOrFiles& data = metainfo.info_.length_or_files_;
+    if (std::get_if<std::uint64_t>(&data))
+    {
+        assert(metainfo.info_.file_tree_.size() == 1);
+        OUTCOME_TRY(add_file(0, metainfo.info_.file_tree_[0]));
+    }
+    else if (const auto* multi_files = std::get_if<std::vector<File>>(&data))
+    {
+        std::uint64_t offset = 0;
+        for (const File& file : *multi_files)
+        {
+            OUTCOME_TRY(add_file(offset, file));
+            offset += file.length_bytes_;
+        }
+    }
+    for (const MerklePiece& piece : hashes.merkle_)
+    {
+        if ((piece.width_ == 0) && !metainfo.has_v1())
+        {
+            // Piece of padding files only; nothing to verify it with.
+            return outcome::failure(ClientErrorc::InvalidPieceLayers);
+        }
+    }
+    return outcome::success(std::move(hashes));
+}
+
+const MerklePiece* PieceHashes::merkle_piece(std::uint32_t piece_index) const
+{
+    if ((piece_index >= merkle_.size())
+        || (merkle_[piece_index].width_ == 0))
+    {
+        return nullptr;
+    }
+    return &merkle_[piece_index];
+}
+
+PieceHasherOptions PieceHashes::hasher_options(std::uint32_t piece_index) const
+{
+    PieceHasherOptions options;
+    options.sha1_ = has_v1();
+    if (const MerklePiece* merkle = merkle_piece(piece_index))
+    {
+        options.merkle_size_ = merkle->data_size_;
+        options.merkle_width_ = merkle->width_;
+    }
+    assert(options.sha1_ || (options.merkle_size_ > 0));
+    return options;
+}
+
+bool PieceHashes::is_valid_v1(std::uint32_t piece_index, const SHA1Bytes& sha1) const
+{
+    assert(has_v1());
+    const std::vector<std::uint8_t>& hashes = torrent_->metainfo_.info_.pieces_SHA1_;
+    assert(((piece_index + 1) * sizeof(SHA1Bytes)) <= hashes.size());
+    return (std::memcmp(sha1.data_, &hashes[piece_index * sizeof(SHA1Bytes)]
+        , sizeof(sha1.data_)) == 0);
+}
+
+bool PieceHashes::is_valid(std::uint32_t piece_index, const PieceDigest& digest) const
+{
+    if (has_v1() && !is_valid_v1(piece_index, digest.sha1_))
+    {
+        return false;
+    }
+    if (const MerklePiece* merkle = merkle_piece(piece_index))
+    {
+        return IsSameHash(digest.merkle_root_, merkle->root_);
+    }
+    return true;
+}
+
+bool PieceHashes::is_valid(std::uint32_t piece_index
+    , const std::uint8_t* data, std::uint32_t size) const
+{
+    PieceDigest digest;
+    if (has_v1())
+    {
+        digest.sha1_ = GetSHA1(std::string_view(reinterpret_cast<const char*>(data), size));
+    }
+    if (const MerklePiece* merkle = merkle_piece(piece_index))
+    {
+        assert(merkle->data_size_ <= size);
+        std::vector<SHA256Bytes> leaves;
+        GetMerkleLeaves(data, merkle->data_size_, leaves);
+        digest.merkle_root_ = GetMerkleRoot(leaves.data(), leaves.size(), merkle->width_);
+    }
+    return is_valid(piece_index, digest);
+}
+
+std::optional<be::MerkleHashesRange> PieceHashes::blocks_range(std::uint32_t piece_index) const
+{
+    const MerklePiece* merkle = merkle_piece(piece_index);
+    if (!merkle || (merkle->width_ < 2))
+    {
+        return std::nullopt;
+    }
+    // Proof is not needed: the piece root is verified already.
+    be::MerkleHashesRange range;
+    range.pieces_root_ = merkle->pieces_root_;
+    range.base_layer_ = 0;
+    range.index_ = (merkle->index_in_file_ * merkle->width_);
+    range.length_ = merkle->width_;
+    range.proof_layers_ = 0;
+    return range;
+}
+
+std::optional<std::vector<SHA256Bytes>> PieceHashes::valid_blocks(std::uint32_t piece_index
+    , const be::Message_Hashes& hashes) const
+{
+    const std::optional<be::MerkleHashesRange> expected = blocks_range(piece_index);
+    const be::MerkleHashesRange& range = hashes.range_;
+    if (!expected
+        || !IsSameHash(range.pieces_root_, expected->pieces_root_)
+        || (range.base_layer_ != expected->base_layer_)
+        || (range.index_ != expected->index_)
+        || (range.length_ != expected->length_)
+        || (hashes.hashes_.size() < range.length_))
+    {
+        return std::nullopt;
+    }
+    const MerklePiece& merkle = *merkle_piece(piece_index);
+    const SHA256Bytes root = GetMerkleRoot(hashes.hashes_.data(), merkle.width_, merkle.width_);
+    if (!IsSameHash(root, merkle.root_))
+    {
+        return std::nullopt;
+    }
+    // Leaves after the end of the file are zeros; not hashed.
+    const std::size_t blocks = ((merkle.data_size_ + k_merkle_block_size - 1) / k_merkle_block_size);
+    return std::vector<SHA256Bytes>(hashes.hashes_.begin(), hashes.hashes_.begin() + blocks);
+}
@@ -0,0 +1,64 @@
+#pragma once
+#include "torrent_client.h"
+#include "torrent_messages.h"
+#include "hash_pool.h"
+#include "utils_outcome.h"
+
+#include <small_utils/utils_bytes.h>
+
+#include <optional>
+#include <vector>
+
+#include <cstdint>
+
+// Part of the BitTorrent v2 file merkle tree that covers a piece (BEP 52).
+// Files are aligned to the pieces, so a piece never spans files.
+struct MerklePiece
+{
+    SHA256Bytes pieces_root_;
+    // Piece index within the file.
+    std::uint32_t index_in_file_ = 0;
+    // File bytes in the piece; the rest of the piece is padding.
+    std::uint32_t data_size_ = 0;
+    // Leaves (16 KiB blocks) of the piece subtree, power of two.
+    std::uint32_t width_ = 0;
+    // Root of the subtree: hash of the 'piece layers' or,
+    // for files of a single piece, the pieces root itself.
+    SHA256Bytes root_;
+};
+
+// Expected hashes of the torrent pieces: SHA1 (v1) and/or
+// the merkle roots (v2); both for hybrid torrents.
+class PieceHashes
+{
+public:
+    // Validates 'piece layers' against the files pieces roots.
+    static outcome::result<PieceHashes> make(const be::TorrentClient& torrent);
+
+    bool has_v1() const { return torrent_->metainfo_.has_v1(); }
+    bool has_v2() const { return !merkle_.empty(); }
+
+    // nullptr for v1 torrents.
+    const MerklePiece* merkle_piece(std::uint32_t piece_index) const;
+    // What PieceHasher computes so is_valid() can check the piece.
+    PieceHasherOptions hasher_options(std::uint32_t piece_index) const;
+    // SHA1 of the piece matches; v1 and hybrid torrents.
+    bool is_valid_v1(std::uint32_t piece_index, const SHA1Bytes& sha1) const;
+    // All the piece hashes of the torrent match the `digest`.
+    bool is_valid(std::uint32_t piece_index, const PieceDigest& digest) const;
+    // Same, hashes the whole piece `data`. Any thread.
+    bool is_valid(std::uint32_t piece_index, const std::uint8_t* data, std::uint32_t size) const;
+
+    // BEP 52 hash request for the piece leaves, so its blocks are verified
+    // as they arrive. None for v1 torrents and pieces of a single block.
+    std::optional<be::MerkleHashesRange> blocks_range(std::uint32_t piece_index) const;
+    // Leaves from the `hashes` response, if they are the ones of the
+    // blocks_range() and match the piece root.
+    std::optional<std::vector<SHA256Bytes>> valid_blocks(std::uint32_t piece_index
+        , const be::Message_Hashes& hashes) const;
+
+private:
+    const be::TorrentClient* torrent_ = nullptr;
+    // By the piece index; empty for v1 torrents.
+    std::vector<MerklePiece> merkle_;
+};
@@ -0,0 +1,225 @@
+#include "recheck.h"
+
+#include <small_utils/utils_bytes.h>
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <string_view>
+#include <thread>
+#include <utility>
+
+#include <cstring>
+#include <cassert>
+
+namespace
+{
+    // Adjacent pieces, read at once.
+    struct ReadChunk
+    {
+        std::unique_ptr<std::uint8_t[]> data_;
+        std::uint64_t size_ = 0;
+        // Pieces not hashed yet.
+        std::atomic<std::uint32_t> pending_{0};
+    };
+} // namespace
+
+struct Recheck::Workers
+{
+    std::mutex lock_;
+    std::condition_variable has_space_;
+    // Read, but not yet hashed.
+    std::uint64_t read_bytes_ = 0;
+    // Chunks submitted to the HashPool and not hashed yet.
+    std::uint32_t hashing_chunks_ = 0;
+    bool stopped_ = false;
+    std::thread reader_;
+    asio::executor_work_guard<asio::io_context::executor_type> work_;
+
+    explicit Workers(asio::io_context& io_context)
+        : work_(io_context.get_executor())
+    {
+    }
+};
+
+/*explicit*/ Recheck::Recheck(asio::io_context& io_context
+    , FilesOnDisk& files
+    , HashPool& hash_pool
+    , const PieceHashes& hashes
+    , const RecheckOptions& options /*= {}*/)
+    : io_context_(&io_context)
+    , files_(&files)
+    , hash_pool_(&hash_pool)
+    , hashes_(&hashes)
+    , options_(options)
+{
+}
+
+Recheck::~Recheck()
+{
+    if (!workers_)
+    {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> _(workers_->lock_);
+        workers_->stopped_ = true;
+    }
+    workers_->has_space_.notify_all();
+    workers_->reader_.join();
+    // Jobs in the pool refer to `workers_`.
+    std::unique_lock<std::mutex> lock(workers_->lock_);
+    workers_->has_space_.wait(lock, [this]
+    {
+        return (workers_->hashing_chunks_ == 0);
+    });
+}
+
+void Recheck::start(std::vector<std::uint32_t> pieces
+    , OnPieceChecked on_checked
+    , std::function<void ()> on_finished)
+{
+    assert(!workers_ && "Started twice");
+    assert(std::is_sorted(pieces.begin(), pieces.end()));
+    on_checked_ = std::move(on_checked);
+    on_finished_ = std::move(on_finished);
+    remaining_ = std::uint32_t(pieces.size());
+    if (pieces.empty())
+    {
+        asio::post(*io_context_, [this] { on_finished_(); });
+        return;
+    }
+
+    workers_ = std::make_unique<Workers>(*io_context_);
+    Workers& workers = *workers_;
+    const be::TorrentClient& torrent = *files_->files_list_->torrent_;
+    const std::uint64_t piece_size = torrent.get_piece_size_bytes();
+    const std::uint64_t total_size = torrent.get_total_size_bytes();
+    auto get_piece_size = [piece_size, total_size](std::uint32_t piece_index)
+    {
+        const std::uint64_t start = (piece_index * piece_size);
+        return std::uint32_t(std::min(piece_size, total_size - start));
+    };
+
+    auto on_result = [this](std::uint32_t piece_index, bool valid)
+    {
+        asio::post(*io_context_, [this, piece_index, valid]
+        {
+            on_checked_(piece_index, valid);
+            assert(remaining_ > 0);
+            if (--remaining_ == 0)
+            {
+                workers_->work_.reset();
+                on_finished_();
+            }
+        });
+    };
+
+    workers.reader_ = std::thread([this, &workers, pieces = std::move(pieces)
+        , get_piece_size, on_result]()
+    {
+        std::size_t index = 0;
+        while (index < pieces.size())
+        {
+            // Adjacent pieces up to `read_size_`.
+            const std::uint32_t first_piece_index = pieces[index];
+            std::size_t end = index;
+            std::uint64_t size = 0;
+            do
+            {
+                size += get_piece_size(pieces[end]);
+                ++end;
+            }
+            while ((end < pieces.size())
+                && (pieces[end] == (pieces[end - 1] + 1))
+                && ((size + get_piece_size(pieces[end])) <= options_.read_size_));
+
+            {
+                std::unique_lock<std::mutex> lock(workers.lock_);
+                workers.has_space_.wait(lock, [&]
+                {
+                    return workers.stopped_
+                        || (workers.read_bytes_ == 0)
+                        || ((workers.read_bytes_ + size) <= options_.read_ahead_bytes_);
+                });
+                if (workers.stopped_)
+                {
+                    return;
+                }
+                workers.read_bytes_ += size;
+            }
+
+            auto chunk = std::make_shared<ReadChunk>();
+            chunk->data_ = std::make_unique<std::uint8_t[]>(std::size_t(size));
+            chunk->size_ = size;
+            const bool read_ok = bool(files_->read_piece(first_piece_index
+                , 0, chunk->data_.get(), std::uint32_t(size)));
+            if (!read_ok)
+            {
+                for (; index < end; ++index)
+                {
+                    on_result(pieces[index], false);
+                }
+                std::lock_guard<std::mutex> _(workers.lock_);
+                workers.read_bytes_ -= size;
+                continue;
+            }
+
+            // Chunk pieces are hashed in parallel.
+            std::vector<std::string_view> data;
+            std::vector<std::uint32_t> chunk_pieces;
+            std::uint64_t offset = 0;
+            for (; index < end; ++index)
+            {
+                const std::uint32_t piece_size = get_piece_size(pieces[index]);
+                data.emplace_back(reinterpret_cast<const char*>(chunk->data_.get() + offset)
+                    , piece_size);
+                chunk_pieces.push_back(pieces[index]);
+                offset += piece_size;
+            }
+            chunk->pending_ = std::uint32_t(data.size());
+            {
+                std::lock_guard<std::mutex> _(workers.lock_);
+                ++workers.hashing_chunks_;
+            }
+            auto on_piece_hashed = [&workers, on_result, chunk](std::uint32_t piece_index, bool valid)
+            {
+                on_result(piece_index, valid);
+                if (--chunk->pending_ == 0)
+                {
+                    // Notified under the lock: ~Recheck() may be waiting for this one.
+                    std::lock_guard<std::mutex> _(workers.lock_);
+                    workers.read_bytes_ -= chunk->size_;
+                    --workers.hashing_chunks_;
+                    workers.has_space_.notify_all();
+                }
+            };
+            if (hashes_->has_v1())
+            {
+                // SHA1 is enough, even for hybrid torrents.
+                hash_pool_->hash_batch(data, [this, on_piece_hashed
+                    , chunk_pieces = std::move(chunk_pieces)]
+                    (std::size_t i, const SHA1Bytes& actual)
+                {
+                    const std::uint32_t piece_index = chunk_pieces[i];
+                    on_piece_hashed(piece_index, hashes_->is_valid_v1(piece_index, actual));
+                });
+                continue;
+            }
+            // v2: merkle tree of the piece blocks.
+            std::vector<HashPool::Job> jobs;
+            jobs.reserve(data.size());
+            for (std::size_t i = 0; i < data.size(); ++i)
+            {
+                jobs.push_back([this, on_piece_hashed, piece_index = chunk_pieces[i], piece = data[i]]()
+                {
+                    const auto* piece_data = reinterpret_cast<const std::uint8_t*>(piece.data());
+                    on_piece_hashed(piece_index
+                        , hashes_->is_valid(piece_index, piece_data, std::uint32_t(piece.size())));
+                });
+            }
+            hash_pool_->submit_batch(std::move(jobs));
+        }
+    });
+}
@@ -0,0 +1,63 @@
+#pragma once
+#include "files_on_disk.h"
+#include "hash_pool.h"
+#include "piece_hashes.h"
+#include "utils_asio.h"
+
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include <cstdint>
+
+struct RecheckOptions
+{
+    // Max bytes read, but not yet hashed.
+    std::uint64_t read_ahead_bytes_ = 64 * 1024 * 1024;
+    // Adjacent pieces are read with a single read of up to that size.
+    std::uint32_t read_size_ = 4 * 1024 * 1024;
+};
+
+// Invoked on the io_context thread for every piece.
+// Not `valid` also when the piece can't be read.
+using OnPieceChecked = std::function<void (std::uint32_t piece_index, bool valid)>;
+
+// Verifies data that is already on disk against the torrent hashes.
+// Files are read sequentially, in the pieces order, by a single thread
+// (so the disk sees one stream); pieces are hashed on the HashPool.
+// Keeps io_context::run() going until all pieces are checked.
+class Recheck
+{
+public:
+    explicit Recheck(asio::io_context& io_context
+        , FilesOnDisk& files
+        , HashPool& hash_pool
+        , const PieceHashes& hashes
+        , const RecheckOptions& options = {});
+    // Stops reading; already read pieces are still reported.
+    ~Recheck();
+    Recheck(const Recheck&) = delete;
+    Recheck& operator=(const Recheck&) = delete;
+
+    // `pieces` in ascending order.
+    void start(std::vector<std::uint32_t> pieces
+        , OnPieceChecked on_checked
+        , std::function<void ()> on_finished);
+
+    bool is_running() const { return (remaining_ > 0); }
+    std::uint32_t remaining() const { return remaining_; }
+
+private:
+    struct Workers;
+
+    asio::io_context* io_context_ = nullptr;
+    FilesOnDisk* files_ = nullptr;
+    HashPool* hash_pool_ = nullptr;
+    const PieceHashes* hashes_ = nullptr;
+    RecheckOptions options_;
+    // io_context thread only.
+    std::uint32_t remaining_ = 0;
+    OnPieceChecked on_checked_;
+    std::function<void ()> on_finished_;
+    std::unique_ptr<Workers> workers_;
+};
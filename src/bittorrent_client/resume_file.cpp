@@ -0,0 +1,469 @@
+#include "resume_file.h"
+#include "utils_endian.h"
+
+#include <small_utils/utils_read_file.h>
+#include <small_utils/utils_bytes.h>
+
+#include <algorithm>
+#include <system_error>
+#include <utility>
+
+#include <cerrno>
+#include <cstring>
+#include <cassert>
+
+namespace
+{
+    const char k_snapshot_magic[] = "BTRESUM1";
+    const char k_journal_magic[] = "BTJOURN1";
+    constexpr std::size_t k_magic_size = sizeof(k_snapshot_magic) - 1;
+    constexpr std::size_t k_journal_header_size = k_magic_size + sizeof(std::uint64_t);
+    // Kind, piece index, block index.
+    constexpr std::size_t k_record_size = 1 + 4 + 4;
+    // Don't rewrite small snapshots on every few pieces.
+    constexpr std::uint64_t k_min_journal_bytes = 64 * 1024;
+
+    enum RecordKind : std::uint8_t
+    {
+        PieceCompleted = 1,
+        BlockReceived = 2,
+    };
+
+    // Big-endian serialization of the snapshot.
+    struct BytesOutput
+    {
+        std::vector<std::uint8_t> data_;
+
+        void write_data(const void* ptr, std::size_t size)
+        {
+            const std::uint8_t* bytes = static_cast<const std::uint8_t*>(ptr);
+            data_.insert(data_.end(), bytes, bytes + size);
+        }
+
+        template<typename T>
+        void write(T v)
+        {
+            v = native_to_big(v);
+            write_data(&v, sizeof(v));
+        }
+
+        // As BitTorrent bitfield: high bit of the first byte is the first item.
+        void write_bits(const std::vector<bool>& bits)
+        {
+            const std::size_t offset = data_.size();
+            data_.resize(offset + (bits.size() + 7) / 8, 0);
+            for (std::size_t i = 0; i < bits.size(); ++i)
+            {
+                if (bits[i])
+                {
+                    data_[offset + i / 8] |= std::uint8_t(0x80u >> (i % 8));
+                }
+            }
+        }
+    };
+
+    template<typename T>
+    bool ReadBig(BytesReader& reader, T& v)
+    {
+        reader.read(v);
+        v = big_to_native(v);
+        return reader.valid_;
+    }
+
+    bool ReadBits(BytesReader& reader, std::vector<bool>& bits)
+    {
+        const std::size_t bytes_count = (bits.size() + 7) / 8;
+        const char* bytes = nullptr;
+        reader.consume(bytes, bytes_count);
+        if (!reader.valid_)
+        {
+            return false;
+        }
+        for (std::size_t i = 0; i < bits.size(); ++i)
+        {
+            bits[i] = ((std::uint8_t(bytes[i / 8]) & (0x80u >> (i % 8))) != 0);
+        }
+        return true;
+    }
+
+    std::FILE* OpenFile(const std::filesystem::path& path, const char* mode)
+    {
+#if (_MSC_VER)
+        std::FILE* f = nullptr;
+        const errno_t e = fopen_s(&f, path.string().c_str(), mode);
+        (void)e;
+        return f;
+#else
+        return std::fopen(path.string().c_str(), mode);
+#endif
+    }
+
+    std::error_code LastError()
+    {
+        return std::error_code(errno, std::generic_category());
+    }
+
+    FileStamp GetFileStamp(const std::filesystem::path& path)
+    {
+        std::error_code ec;
+        const std::uint64_t size = std::filesystem::file_size(path, ec);
+        if (ec)
+        {
+            return FileStamp();
+        }
+        const auto mtime = std::filesystem::last_write_time(path, ec);
+        if (ec)
+        {
+            return FileStamp();
+        }
+        FileStamp stamp;
+        stamp.size_ = std::int64_t(size);
+        stamp.mtime_ = std::int64_t(mtime.time_since_epoch().count());
+        return stamp;
+    }
+} // namespace
+
+/*explicit*/ ResumeFile::ResumeFile(std::filesystem::path path, FilesOnDisk& files)
+    : path_(std::move(path))
+    , journal_path_()
+    , files_(&files)
+    , torrent_(files.files_list_->torrent_)
+{
+    journal_path_ = path_;
+    journal_path_ += ".journal";
+}
+
+ResumeFile::~ResumeFile()
+{
+    if (journal_)
+    {
+        (void)std::fclose(journal_);
+    }
+}
+
+const ResumeData& ResumeFile::load()
+{
+    const std::uint32_t pieces_count = torrent_->get_pieces_count();
+    const std::size_t files_count = files_->files_list_->files_offset_.size();
+    data_ = ResumeData();
+    data_.have_pieces_.resize(pieces_count, false);
+    data_.files_.resize(files_count);
+    data_.unverified_files_.resize(files_count, false);
+    generation_ = 0;
+
+    const FileBuffer snapshot = ReadAllFileAsBinary(path_.string().c_str());
+    BytesReader reader = BytesReader::make(snapshot.data_, snapshot.size_);
+    ResumeData data = data_;
+    std::uint64_t generation = 0;
+    char magic[k_magic_size]{};
+    SHA1Bytes info_hash;
+    std::uint32_t stored_pieces_count = 0;
+    std::uint32_t stored_files_count = 0;
+    std::uint32_t partial_count = 0;
+    reader.read_data(magic, k_magic_size);
+    reader.read(info_hash.data_);
+    bool valid = ReadBig(reader, generation)
+        && ReadBig(reader, stored_pieces_count)
+        && ReadBig(reader, stored_files_count)
+        && (std::memcmp(magic, k_snapshot_magic, k_magic_size) == 0)
+        && (std::memcmp(info_hash.data_, torrent_->info_hash_.data_, sizeof(info_hash.data_)) == 0)
+        && (stored_pieces_count == pieces_count)
+        && (stored_files_count == files_count);
+    for (std::size_t i = 0; valid && (i < files_count); ++i)
+    {
+        std::uint64_t size = 0;
+        std::uint64_t mtime = 0;
+        valid = ReadBig(reader, size) && ReadBig(reader, mtime);
+        data.files_[i].size_ = std::int64_t(size);
+        data.files_[i].mtime_ = std::int64_t(mtime);
+    }
+    valid = valid
+        && ReadBits(reader, data.have_pieces_)
+        && ReadBig(reader, partial_count);
+    for (std::uint32_t i = 0; valid && (i < partial_count); ++i)
+    {
+        std::uint32_t piece_index = 0;
+        valid = ReadBig(reader, piece_index)
+            && (piece_index < pieces_count)
+            && !data.have_pieces_[piece_index];
+        if (valid)
+        {
+            std::vector<bool>& blocks = data.partial_pieces_[piece_index];
+            blocks.resize(blocks_count(piece_index), false);
+            valid = ReadBits(reader, blocks);
+        }
+    }
+    if (valid && reader.finalize())
+    {
+        data_ = std::move(data);
+        generation_ = generation;
+    }
+
+    std::vector<bool> touched_files(files_count, false);
+    replay_journal(touched_files);
+    drop_changed_files(touched_files);
+    // Nothing to do if it fails: journal is not written,
+    // so pieces are downloaded again after the next restart.
+    (void)compact();
+    return data_;
+}
+
+void ResumeFile::replay_journal(std::vector<bool>& touched_files)
+{
+    if (generation_ == 0)
+    {
+        // No snapshot, nothing to validate journal against.
+        return;
+    }
+    const FileBuffer journal = ReadAllFileAsBinary(journal_path_.string().c_str());
+    BytesReader reader = BytesReader::make(journal.data_, journal.size_);
+    char magic[k_magic_size]{};
+    std::uint64_t generation = 0;
+    reader.read_data(magic, k_magic_size);
+    if (!ReadBig(reader, generation)
+        || (std::memcmp(magic, k_journal_magic, k_magic_size) != 0)
+        || (generation != generation_))
+    {
+        // Crashed between snapshot rename and journal reset:
+        // records are in the snapshot already.
+        return;
+    }
+    const std::uint32_t pieces_count = torrent_->get_pieces_count();
+    // Last record may be torn; ignore it.
+    while (reader.get_remaining() >= k_record_size)
+    {
+        std::uint8_t kind = 0;
+        std::uint32_t piece_index = 0;
+        std::uint32_t block_index = 0;
+        reader.read(kind);
+        (void)ReadBig(reader, piece_index);
+        (void)ReadBig(reader, block_index);
+        if (piece_index >= pieces_count)
+        {
+            break;
+        }
+        if (kind == RecordKind::PieceCompleted)
+        {
+            data_.have_pieces_[piece_index] = true;
+            data_.partial_pieces_.erase(piece_index);
+        }
+        else if (kind == RecordKind::BlockReceived)
+        {
+            if (!data_.have_pieces_[piece_index])
+            {
+                (void)set_block(piece_index, block_index);
+            }
+        }
+        else
+        {
+            break;
+        }
+        // Written after the snapshot; modification time is expected to change.
+        files_->files_list_->iterate_files(piece_index
+            , [&](const FilePiece& file_piece)
+        {
+            touched_files[file_piece.file_index_] = true;
+        });
+    }
+}
+
+void ResumeFile::drop_changed_files(const std::vector<bool>& touched_files)
+{
+    const FilesList& files_list = *files_->files_list_;
+    for (std::size_t i = 0, count = files_list.files_offset_.size(); i < count; ++i)
+    {
+        const FilePiece file = files_list.whole_file(i);
+        if ((file.file_size_ == 0) || files_list.files_offset_[i].padding)
+        {
+            // Nothing on disk to check.
+            continue;
+        }
+        auto path = files_->file_path(file);
+        const FileStamp stamp = path ? GetFileStamp(path.value()) : FileStamp();
+        const bool same_size = (stamp.size_ == std::int64_t(file.file_size_));
+        if (!same_size || (!touched_files[i] && (stamp != data_.files_[i])))
+        {
+            drop_file_pieces(i);
+            data_.unverified_files_[i] = (stamp.size_ >= 0);
+        }
+    }
+}
+
+void ResumeFile::drop_file_pieces(std::size_t file_index)
+{
+    const FileOffset& fo = files_->files_list_->files_offset_[file_index];
+    assert(fo.end > fo.start);
+    const std::uint64_t piece_size = torrent_->get_piece_size_bytes();
+    const std::uint64_t first = (fo.start / piece_size);
+    const std::uint64_t last = ((fo.end - 1) / piece_size);
+    for (std::uint64_t piece_index = first; piece_index <= last; ++piece_index)
+    {
+        data_.have_pieces_[std::size_t(piece_index)] = false;
+        data_.partial_pieces_.erase(std::uint32_t(piece_index));
+    }
+}
+
+outcome::result<void> ResumeFile::on_piece_completed(std::uint32_t piece_index)
+{
+    assert(piece_index < data_.have_pieces_.size());
+    if (data_.have_pieces_[piece_index])
+    {
+        return outcome::success();
+    }
+    data_.have_pieces_[piece_index] = true;
+    data_.partial_pieces_.erase(piece_index);
+    return append(RecordKind::PieceCompleted, piece_index, 0);
+}
+
+outcome::result<void> ResumeFile::on_block_received(std::uint32_t piece_index, std::uint32_t begin)
+{
+    assert(piece_index < data_.have_pieces_.size());
+    const std::uint32_t block_index = (begin / k_resume_block_size);
+    if (data_.have_pieces_[piece_index]
+        || !set_block(piece_index, block_index))
+    {
+        return outcome::success();
+    }
+    return append(RecordKind::BlockReceived, piece_index, block_index);
+}
+
+bool ResumeFile::set_block(std::uint32_t piece_index, std::uint32_t block_index)
+{
+    std::vector<bool>& blocks = data_.partial_pieces_[piece_index];
+    if (blocks.empty())
+    {
+        blocks.resize(blocks_count(piece_index), false);
+    }
+    if ((block_index >= blocks.size()) || blocks[block_index])
+    {
+        return false;
+    }
+    blocks[block_index] = true;
+    return true;
+}
+
+std::uint32_t ResumeFile::blocks_count(std::uint32_t piece_index) const
+{
+    const std::uint64_t piece_size = torrent_->get_piece_size_bytes();
+    const std::uint64_t start = (piece_index * piece_size);
+    const std::uint64_t end = std::min(start + piece_size, torrent_->get_total_size_bytes());
+    assert(end > start);
+    return std::uint32_t((end - start + k_resume_block_size - 1) / k_resume_block_size);
+}
+
+outcome::result<void> ResumeFile::append(std::uint8_t kind
+    , std::uint32_t piece_index, std::uint32_t value)
+{
+    if (!journal_)
+    {
+        // Last compaction failed.
+        return outcome::failure(std::make_error_code(std::errc::bad_file_descriptor));
+    }
+    std::uint8_t record[k_record_size]{};
+    BytesWriter::make(record)
+        .write(kind)
+        .write(native_to_big(piece_index))
+        .write(native_to_big(value))
+        .finalize();
+    if ((std::fwrite(record, 1, sizeof(record), journal_) != sizeof(record))
+        || (std::fflush(journal_) != 0))
+    {
+        return outcome::failure(LastError());
+    }
+    journal_bytes_ += sizeof(record);
+    if (journal_bytes_ > std::max(snapshot_bytes_, k_min_journal_bytes))
+    {
+        return compact();
+    }
+    return outcome::success();
+}
+
+outcome::result<void> ResumeFile::compact()
+{
+    if (journal_)
+    {
+        (void)std::fclose(journal_);
+        journal_ = nullptr;
+    }
+    const FilesList& files_list = *files_->files_list_;
+    for (std::size_t i = 0, count = files_list.files_offset_.size(); i < count; ++i)
+    {
+        auto path = files_->file_path(files_list.whole_file(i));
+        data_.files_[i] = path ? GetFileStamp(path.value()) : FileStamp();
+    }
+    ++generation_;
+
+    BytesOutput out;
+    out.write_data(k_snapshot_magic, k_magic_size);
+    out.write_data(torrent_->info_hash_.data_, sizeof(torrent_->info_hash_.data_));
+    out.write(generation_);
+    out.write(std::uint32_t(data_.have_pieces_.size()));
+    out.write(std::uint32_t(data_.files_.size()));
+    for (const FileStamp& stamp : data_.files_)
+    {
+        out.write(std::uint64_t(stamp.size_));
+        out.write(std::uint64_t(stamp.mtime_));
+    }
+    out.write_bits(data_.have_pieces_);
+    out.write(std::uint32_t(data_.partial_pieces_.size()));
+    for (const auto& [piece_index, blocks] : data_.partial_pieces_)
+    {
+        out.write(piece_index);
+        out.write_bits(blocks);
+    }
+
+    // Old snapshot stays valid until the rename.
+    std::filesystem::path temp_path = path_;
+    temp_path += ".tmp";
+    {
+        std::FILE* f = OpenFile(temp_path, "wb");
+        if (!f)
+        {
+            return outcome::failure(LastError());
+        }
+        const bool written = (std::fwrite(out.data_.data(), 1, out.data_.size(), f) == out.data_.size());
+        const std::error_code ec = written ? std::error_code() : LastError();
+        if ((std::fclose(f) != 0) || !written)
+        {
+            return outcome::failure(ec ? ec : LastError());
+        }
+    }
+    std::error_code ec;
+    std::filesystem::rename(temp_path, path_, ec);
+    if (ec)
+    {
+        return outcome::failure(ec);
+    }
+    snapshot_bytes_ = out.data_.size();
+
+    journal_ = OpenFile(journal_path_, "wb");
+    if (!journal_)
+    {
+        return outcome::failure(LastError());
+    }
+    BytesOutput header;
+    header.write_data(k_journal_magic, k_magic_size);
+    header.write(generation_);
+    assert(header.data_.size() == k_journal_header_size);
+    if ((std::fwrite(header.data_.data(), 1, header.data_.size(), journal_) != header.data_.size())
+        || (std::fflush(journal_) != 0))
+    {
+        return outcome::failure(LastError());
+    }
+    journal_bytes_ = k_journal_header_size;
+    return outcome::success();
+}
+
+std::filesystem::path ResumeFilePath(const StorageOptions& options
+    , const be::TorrentClient& torrent)
+{
+    const char k_hex[] = "0123456789abcdef";
+    std::string name;
+    for (std::uint8_t byte : torrent.info_hash_.data_)
+    {
+        name += k_hex[byte >> 4];
+        name += k_hex[byte & 0xf];
+    }
+    name += ".resume";
+    return options.root_dir_ / name;
+}
@@ -0,0 +1,94 @@
+#pragma once
+#include "files_on_disk.h"
+#include "torrent_client.h"
+#include "utils_outcome.h"
+
+#include <filesystem>
+#include <map>
+#include <vector>
+
+#include <cstdio>
+#include <cstdint>
+
+// Partial pieces are accounted by blocks of this size.
+constexpr std::uint32_t k_resume_block_size = 16'384;
+
+// Used to detect files changed outside of the client.
+struct FileStamp
+{
+    // -1 when the file does not exist.
+    std::int64_t size_ = -1;
+    // std::filesystem::last_write_time() ticks.
+    std::int64_t mtime_ = 0;
+
+    bool operator==(const FileStamp&) const = default;
+};
+
+struct ResumeData
+{
+    // Verified and written pieces.
+    std::vector<bool> have_pieces_;
+    // For every file of the torrent, as of the last compaction.
+    std::vector<FileStamp> files_;
+    // Not yet completed pieces with some blocks already in the files
+    // (see StorageOptions::memory_mapped_). Bit per k_resume_block_size block.
+    std::map<std::uint32_t, std::vector<bool>> partial_pieces_;
+    // Files that exist, but resume data says nothing reliable about them
+    // (missing resume data or file changed since): pieces need a recheck.
+    std::vector<bool> unverified_files_;
+};
+
+// Resume data of the torrent: snapshot file plus append-only journal
+// ("<path>.journal") of the pieces completed since the snapshot.
+// Journal record is a single small write, so it's cheap to do it
+// for every piece; once journal outgrows the snapshot, both are
+// compacted into a new snapshot.
+// Journal is not fsync-ed: after a power loss it is as durable
+// as the data itself with FileSyncPolicy::None.
+class ResumeFile
+{
+public:
+    explicit ResumeFile(std::filesystem::path path, FilesOnDisk& files);
+    ~ResumeFile();
+    ResumeFile(const ResumeFile&) = delete;
+    ResumeFile& operator=(const ResumeFile&) = delete;
+
+    // Reads the snapshot and replays the journal. Pieces of the files
+    // that were changed since then (size or modification time) are dropped.
+    // Missing or corrupted resume data means nothing is downloaded yet.
+    // Compacts, so the new journal starts from what is actually on disk.
+    const ResumeData& load();
+
+    outcome::result<void> on_piece_completed(std::uint32_t piece_index);
+    // Block at `begin` of the piece is in the file (memory-mapped mode).
+    outcome::result<void> on_block_received(std::uint32_t piece_index, std::uint32_t begin);
+
+    // Writes new snapshot (atomically, thru rename) and starts new journal.
+    outcome::result<void> compact();
+
+    const ResumeData& data() const { return data_; }
+
+private:
+    void replay_journal(std::vector<bool>& touched_files);
+    void drop_changed_files(const std::vector<bool>& touched_files);
+    void drop_file_pieces(std::size_t file_index);
+    bool set_block(std::uint32_t piece_index, std::uint32_t block_index);
+    outcome::result<void> append(std::uint8_t kind, std::uint32_t piece_index, std::uint32_t value);
+    std::uint32_t blocks_count(std::uint32_t piece_index) const;
+
+private:
+    std::filesystem::path path_;
+    std::filesystem::path journal_path_;
+    FilesOnDisk* files_ = nullptr;
+    const be::TorrentClient* torrent_ = nullptr;
+    ResumeData data_;
+    // Snapshot and journal with different generations are not related.
+    std::uint64_t generation_ = 0;
+    std::uint64_t snapshot_bytes_ = 0;
+    std::uint64_t journal_bytes_ = 0;
+    std::FILE* journal_ = nullptr;
+};
+
+// "<root_dir>/<info hash hex>.resume".
+std::filesystem::path ResumeFilePath(const StorageOptions& options
+    , const be::TorrentClient& torrent);
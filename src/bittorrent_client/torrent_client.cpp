@@ -7,11 +7,18 @@
 #include <small_utils/utils_read_file.h>
 #include <small_utils/utils_string.h>
 #include <small_utils/utils_bytes.h>
+#include <small_utils/utils_sha256.h>
 #include <small_utils/utils_experimental.h>
 
 #include <url.hpp>
 
 #include <iostream>
+#include <algorithm>
+#include <iterator>
+#include <optional>
+#include <chrono>
+#include <limits>
+#include <map>
 
 #include <cstring>
 #include <cassert>
@@ -170,12 +177,46 @@ namespace cxxurl_detail
 
         TorrentClient client;
         client.metainfo_ = std::move(torrent.metainfo_);
-        client.info_hash_ = GetSHA1(AsStringView(buffer
+        const std::string_view info = AsStringView(buffer
             , torrent.info_position_.start_
-            , torrent.info_position_.end_));
+            , torrent.info_position_.end_);
+        client.info_hash_ = GetSHA1(info);
+        if (client.metainfo_.has_v2())
+        {
+            client.info_hash_v2_ = GetSHA256(info);
+        }
+        if (!client.metainfo_.has_v1())
+        {
+            // BEP 52: v2 info hash truncated to 20 bytes
+            // for the handshake and trackers.
+            std::memcpy(client.info_hash_.data_, client.info_hash_v2_.data_
+                , sizeof(client.info_hash_.data_));
+        }
         client.peer_id_ = GetRandomPeerId(random);
         client.random_ = &random;
 
+        // http://www.bittorrent.org/beps/bep_0012.html
+        // URLs within each tier will be processed in a randomly chosen order.
+        int last_tier = -1;
+        for (const TorrentMetainfo::Multitracker& tracker : client.metainfo_.multi_trackers_)
+        {
+            if (client.tracker_tiers_.empty()
+                || (tracker.tier_ != last_tier))
+            {
+                client.tracker_tiers_.emplace_back();
+                last_tier = tracker.tier_;
+            }
+            client.tracker_tiers_.back().push_back(tracker.url_utf8_);
+        }
+        for (std::vector<std::string>& tier : client.tracker_tiers_)
+        {
+            std::shuffle(tier.begin(), tier.end(), random);
+        }
+        if (client.tracker_tiers_.empty())
+        {
+            client.tracker_tiers_.push_back({client.metainfo_.tracker_url_utf8_});
+        }
+
         {   // Validate that total size and piece size together
             // with pieces count all do make sense together.
             const std::uint32_t pieces_count = client.get_pieces_count();
@@ -221,23 +262,22 @@ namespace cxxurl_detail
             } catch (...) {}
             return outcome::failure(ClientErrorc::TODO);
         };
-        if (metainfo_.multi_trackers_.empty())
-        {
-            OUTCOME_TRY(Tracker::Request main, build_from_one(metainfo_.tracker_url_utf8_));
-            return outcome::success(Tracker::AllTrackers(std::size_t(1), std::move(main)));
-        }
-
         Tracker::AllTrackers all_trackers;
-        all_trackers.reserve(metainfo_.multi_trackers_.size());
-        for (const auto& tracker : metainfo_.multi_trackers_)
+        all_trackers.reserve(tracker_tiers_.size());
+        bool has_any = false;
+        for (const std::vector<std::string>& urls : tracker_tiers_)
         {
-            (void)tracker.tier_; // Ignore tier for now.
-            if (auto data = build_from_one(tracker.url_utf8_))
+            Tracker::Tier& tier = all_trackers.emplace_back();
+            tier.reserve(urls.size());
+            for (const std::string& url : urls)
             {
-                all_trackers.push_back(std::move(data.value()));
+                // Keep the place, so the tier matches `tracker_tiers_`.
+                auto data = build_from_one(url);
+                has_any |= !!data;
+                tier.push_back(data ? std::move(data.value()) : Tracker::Request());
             }
         }
-        if (all_trackers.size() > 0)
+        if (has_any)
         {
             return outcome::success(std::move(all_trackers));
         }
@@ -321,13 +361,14 @@ namespace cxxurl_detail
         return outcome::failure(ClientErrorc::TODO);
     }
 
+    static bool IsLessPeer(const PeerAddress& lhs, const PeerAddress& rhs)
+    {
+        return (std::tie(lhs.ipv4_, lhs.port_) < std::tie(rhs.ipv4_, rhs.port_));
+    }
+
     static void RemoveDuplicates(std::vector<PeerAddress>& all_peers)
     {
-        std::sort(std::begin(all_peers), std::end(all_peers)
-            , [](const PeerAddress& lhs, const PeerAddress& rhs)
-        {
-            return (std::tie(lhs.ipv4_, lhs.port_) < std::tie(rhs.ipv4_, rhs.port_));
-        });
+        std::sort(std::begin(all_peers), std::end(all_peers), &IsLessPeer);
         auto it = std::unique(std::begin(all_peers), std::end(all_peers)
             , [](const PeerAddress& lhs, const PeerAddress& rhs)
         {
@@ -336,59 +377,375 @@ namespace cxxurl_detail
         (void)all_peers.erase(it, std::end(all_peers));
     }
 
-    co_asio_result<std::vector<PeerAddress>>
+    // Per tracker; the tier waits for the slowest one up to that.
+    static constexpr std::chrono::seconds k_announce_timeout{15};
+
+    co_asio_result<void>
         TorrentClient::request_torrent_peers(asio::io_context& io_context
-            , const Tracker::RequestInfo& info) const
+            , HTTPClient& http
+            , UDPTrackerClient& udp
+            , const Tracker::RequestInfo& info
+            , OnPeers on_peers)
     {
-        auto fetch_one = [this, &io_context](Tracker::Request& data)
+        auto fetch_one = [&http, &udp](Tracker::Request& data)
             -> co_asio_result<std::vector<PeerAddress>>
         {
             if (auto* http_get = std::get_if<Tracker::HTTP_GetRequest>(&data))
             {
-                OUTCOME_CO_TRY(TrackerResponse response, co_await HTTP_TrackerAnnounce(io_context, *http_get));
+                OUTCOME_CO_TRY(TrackerResponse response, co_await HTTP_TrackerAnnounce(
+                    http, *http_get, k_announce_timeout));
                 co_return TryGetOnlyPeers(std::move(response));
             }
             else if (auto* https_get = std::get_if<Tracker::HTTPS_GetRequest>(&data))
             {
-                OUTCOME_CO_TRY(TrackerResponse response, co_await HTTPS_TrackerAnnounce(io_context, *https_get));
+                OUTCOME_CO_TRY(TrackerResponse response, co_await HTTPS_TrackerAnnounce(
+                    http, *https_get, k_announce_timeout));
                 co_return TryGetOnlyPeers(std::move(response));
             }
-            else if (auto* udp = std::get_if<Tracker::UDP_Request>(&data))
+            else if (auto* udp_request = std::get_if<Tracker::UDP_Request>(&data))
             {
-                OUTCOME_CO_TRY(TrackerResponse response, co_await UDP_TrackerAnnounce(io_context, *random_, *udp));
+                OUTCOME_CO_TRY(TrackerResponse response, co_await UDP_TrackerAnnounce(
+                    udp, *udp_request, k_announce_timeout));
                 co_return TryGetOnlyPeers(std::move(response));
             }
             co_return outcome::failure(ClientErrorc::TODO);
         };
 
-        std::vector<PeerAddress> all_peers;
-        auto try_add_peers = [&all_peers](outcome::result<std::vector<PeerAddress>>&& new_peers)
+        // Sorted, see IsLessPeer().
+        std::vector<PeerAddress> known_peers;
+        auto add_peers = [&known_peers, &on_peers](std::vector<PeerAddress>&& peers)
         {
-            if (!new_peers)
+            RemoveDuplicates(peers);
+            std::vector<PeerAddress> new_peers;
+            std::set_difference(peers.begin(), peers.end()
+                , known_peers.begin(), known_peers.end()
+                , std::back_inserter(new_peers), &IsLessPeer);
+            if (new_peers.empty())
             {
                 return;
             }
-            all_peers.insert(all_peers.end()
-                , std::make_move_iterator(new_peers.value().begin())
-                , std::make_move_iterator(new_peers.value().end()));
+            std::vector<PeerAddress> all_peers;
+            all_peers.reserve(known_peers.size() + new_peers.size());
+            std::merge(known_peers.begin(), known_peers.end()
+                , new_peers.begin(), new_peers.end()
+                , std::back_inserter(all_peers), &IsLessPeer);
+            known_peers = std::move(all_peers);
+            on_peers(std::move(new_peers));
         };
-        OUTCOME_CO_TRY(Tracker::AllTrackers all_infos, build_tracker_requests(info));
-        for (Tracker::Request& data : all_infos)
+
+        OUTCOME_CO_TRY(Tracker::AllTrackers all_tiers, build_tracker_requests(info));
+        assert(all_tiers.size() == tracker_tiers_.size());
+        auto coro = as_result(asio::use_awaitable);
+        for (std::size_t tier_index = 0; tier_index < all_tiers.size(); ++tier_index)
         {
-            try_add_peers(co_await fetch_one(data));
+            Tracker::Tier& tier = all_tiers[tier_index];
+            std::size_t pending = 0;
+            // The fastest tracker that responded.
+            std::optional<std::size_t> first_ok;
+            // Canceled when all trackers of the tier are done.
+            asio::steady_timer tier_end(io_context);
+            tier_end.expires_at(asio::steady_timer::time_point::max());
+            for (std::size_t i = 0; i < tier.size(); ++i)
+            {
+                if (std::holds_alternative<std::monostate>(tier[i]))
+                {
+                    continue;
+                }
+                ++pending;
+                asio::co_spawn(io_context
+                    , [&, i]() -> asio::awaitable<void>
+                {
+                    auto peers = co_await fetch_one(tier[i]);
+                    if (peers)
+                    {
+                        if (!first_ok)
+                        {
+                            first_ok = i;
+                        }
+                        add_peers(std::move(peers.value()));
+                    }
+                    if (--pending == 0)
+                    {
+                        tier_end.cancel();
+                    }
+                }
+                    , asio::detached);
+            }
+            if (pending > 0)
+            {
+                // Not longer than k_announce_timeout.
+                (void)co_await tier_end.async_wait(coro);
+            }
+            assert(pending == 0);
+            if (first_ok)
+            {
+                // Moves to the front, the others keep their order.
+                std::vector<std::string>& urls = tracker_tiers_[tier_index];
+                std::rotate(urls.begin(), urls.begin() + *first_ok, urls.begin() + *first_ok + 1);
+                break;
+            }
         }
-        
-        RemoveDuplicates(all_peers);
 
-        if (all_peers.size() > 0)
+        if (known_peers.size() > 0)
         {
-            co_return outcome::success(std::move(all_peers));
+            co_return outcome::success();
+        }
+        co_return outcome::failure(ClientErrorc::TODO);
+    }
+
+    auto TorrentClient::get_scrape_request() const
+        -> outcome::result<Tracker::ScrapeRequest>
+    {
+        for (const std::vector<std::string>& urls : tracker_tiers_)
+        {
+            if (!urls.empty())
+            {
+                Tracker::ScrapeRequest request;
+                request.tracker_url_utf8_ = urls.front();
+                request.info_hash_ = info_hash_;
+                return outcome::success(std::move(request));
+            }
+        }
+        return outcome::failure(ClientErrorc::TODO);
+    }
+
+    // Tracker to scrape and the torrents for it.
+    struct ScrapeTarget
+    {
+        bool udp_ = false;
+        bool https_ = false;
+        std::string host_;
+        std::uint16_t port_ = 0;
+        // HTTP(S): path of the scrape URL and the URL itself
+        // for the query of the announce one (passkeys and such).
+        std::string path_;
+        std::optional<Url> url_;
+        // Indexes of the ScrapeTorrents() `requests`.
+        std::vector<std::size_t> requests_;
+        std::size_t next_batch_ = 0;
+    };
+
+    // Scrape URL (BEP 48) or "udp://host:port"; torrents with the same key
+    // are scraped together.
+    static outcome::result<std::string> MakeScrapeTarget(
+        const std::string& url_utf8, ScrapeTarget& target)
+    {
+        // Url lib uses exceptions for errors.
+        try
+        {
+            Url url(url_utf8);
+            if (url.host().empty())
+            {
+                return outcome::failure(ClientErrorc::TODO);
+            }
+            target.host_ = url.host();
+            target.udp_ = (url.scheme() == "udp");
+            target.https_ = (url.scheme() == "https");
+            if (!target.udp_ && !target.https_ && (url.scheme() != "http"))
+            {
+                return outcome::failure(ClientErrorc::TODO);
+            }
+            target.port_ = (target.https_ ? 443 : 80);
+            if (!url.port().empty())
+            {
+                std::uint64_t v = 0;
+                if (!ParseLength(url.port(), v))
+                {
+                    return outcome::failure(ClientErrorc::TODO);
+                }
+                target.port_ = static_cast<std::uint16_t>(v);
+            }
+            else if (target.udp_)
+            {
+                return outcome::failure(ClientErrorc::TODO);
+            }
+
+            std::string key = url.scheme() + "://" + target.host_ + ':' + std::to_string(target.port_);
+            if (target.udp_)
+            {
+                return outcome::success(std::move(key));
+            }
+            // "Take the tracker's announce URL. Find the last '/' in it.
+            // If the text immediately following that '/' isn't 'announce'
+            // it will be taken as a sign that that tracker doesn't support
+            // the scrape convention. If it does, substitute 'scrape' for 'announce'".
+            const std::string_view k_announce = "announce";
+            std::string path = url.path();
+            const std::size_t slash = path.rfind('/');
+            if ((slash == std::string::npos)
+                || (std::string_view(path).substr(slash + 1, k_announce.size()) != k_announce))
+            {
+                return outcome::failure(ClientErrorc::TODO);
+            }
+            path.replace(slash + 1, k_announce.size(), "scrape");
+            key += path;
+            if (!url.query().empty())
+            {
+                key += cxxurl_detail::build_query_str(url);
+            }
+            target.path_ = std::move(path);
+            target.url_ = std::move(url);
+            return outcome::success(std::move(key));
+        } catch (...) {}
+        return outcome::failure(ClientErrorc::TODO);
+    }
+
+    static std::uint32_t AsScrapeCount(std::uint64_t count)
+    {
+        return std::uint32_t(std::min<std::uint64_t>(count, std::numeric_limits<std::uint32_t>::max()));
+    }
+
+    // Info hashes per HTTP scrape; keeps the URL within the usual server limits.
+    static constexpr std::size_t k_max_http_scrape_hashes = 50;
+    // Requests in flight per tracker.
+    static constexpr std::size_t k_max_scrapes_per_tracker = 4;
+    static constexpr std::chrono::seconds k_scrape_timeout{15};
+
+    co_asio_result<std::vector<std::optional<Tracker::ScrapeInfo>>>
+        ScrapeTorrents(asio::io_context& io_context
+            , HTTPClient& http
+            , UDPTrackerClient& udp
+            , const std::vector<Tracker::ScrapeRequest>& requests)
+    {
+        std::vector<std::optional<Tracker::ScrapeInfo>> stats(requests.size());
+        // By the key of MakeScrapeTarget().
+        std::map<std::string, ScrapeTarget> targets;
+        for (std::size_t i = 0; i < requests.size(); ++i)
+        {
+            ScrapeTarget target;
+            auto key = MakeScrapeTarget(requests[i].tracker_url_utf8_, target);
+            if (!key)
+            {
+                // Can't be scraped; no stats.
+                continue;
+            }
+            auto [it, _] = targets.try_emplace(std::move(key.value()), std::move(target));
+            it->second.requests_.push_back(i);
+        }
+
+        auto scrape_udp = [&](const ScrapeTarget& target, std::size_t first, std::size_t last)
+            -> co_asio_result<void>
+        {
+            Tracker::UDP_ScrapeRequest request;
+            request.host_ = target.host_;
+            request.port_ = target.port_;
+            request.info_hashes_.reserve(last - first);
+            for (std::size_t i = first; i < last; ++i)
+            {
+                request.info_hashes_.push_back(requests[target.requests_[i]].info_hash_);
+            }
+            OUTCOME_CO_TRY(std::vector<Tracker::ScrapeInfo> files
+                , co_await UDP_TrackerScrape(udp, request, k_scrape_timeout));
+            for (std::size_t i = first; i < last; ++i)
+            {
+                stats[target.requests_[i]] = files[i - first];
+            }
+            co_return outcome::success();
+        };
+
+        auto scrape_http = [&](const ScrapeTarget& target, std::size_t first, std::size_t last)
+            -> co_asio_result<void>
+        {
+            Url url = *target.url_;
+            for (std::size_t i = first; i < last; ++i)
+            {
+                url.add_query("info_hash", AsString(requests[target.requests_[i]].info_hash_));
+            }
+            Tracker::HTTPS_GetRequest request;
+            request.host_ = target.host_;
+            request.port_ = target.port_;
+            request.get_uri_ = target.path_ + cxxurl_detail::build_query_str(url);
+            auto scrape = (target.https_
+                ? HTTPS_TrackerScrape(http, request, k_scrape_timeout)
+                : HTTP_TrackerScrape(http, request, k_scrape_timeout));
+            OUTCOME_CO_TRY(ScrapeResponse data, co_await std::move(scrape));
+            const auto* success = std::get_if<ScrapeResponse::OnSuccess>(&data.data_);
+            if (!success)
+            {
+                co_return outcome::failure(ClientErrorc::TODO);
+            }
+            // Trackers skip the torrents they don't know about.
+            for (const ScrapeResponse::File& file : success->files_)
+            {
+                for (std::size_t i = first; i < last; ++i)
+                {
+                    const std::size_t index = target.requests_[i];
+                    if (AsString(requests[index].info_hash_) == file.info_hash_)
+                    {
+                        Tracker::ScrapeInfo& info = stats[index].emplace();
+                        info.seeders_ = AsScrapeCount(file.complete_);
+                        info.completed_ = AsScrapeCount(file.downloaded_);
+                        info.leechers_ = AsScrapeCount(file.incomplete_);
+                    }
+                }
+            }
+            co_return outcome::success();
+        };
+
+        auto coro = as_result(asio::use_awaitable);
+        std::size_t pending = 0;
+        // Canceled when all the workers are done.
+        asio::steady_timer all_done(io_context);
+        all_done.expires_at(asio::steady_timer::time_point::max());
+        for (auto& entry : targets)
+        {
+            ScrapeTarget& target = entry.second;
+            const std::size_t batch_size = (target.udp_
+                ? UDPTrackerClient::k_max_scrape_hashes
+                : k_max_http_scrape_hashes);
+            const std::size_t batches = ((target.requests_.size() + batch_size - 1) / batch_size);
+            const std::size_t workers = std::min(batches, k_max_scrapes_per_tracker);
+            for (std::size_t w = 0; w < workers; ++w)
+            {
+                ++pending;
+                asio::co_spawn(io_context
+                    , [&, batch_size, batches]() -> asio::awaitable<void>
+                {
+                    while (target.next_batch_ < batches)
+                    {
+                        const std::size_t first = (target.next_batch_++ * batch_size);
+                        const std::size_t last = std::min(first + batch_size, target.requests_.size());
+                        // Failed batch leaves its torrents without stats.
+                        if (target.udp_)
+                        {
+                            (void)co_await scrape_udp(target, first, last);
+                        }
+                        else
+                        {
+                            (void)co_await scrape_http(target, first, last);
+                        }
+                    }
+                    if (--pending == 0)
+                    {
+                        all_done.cancel();
+                    }
+                }
+                    , asio::detached);
+            }
+        }
+        if (pending > 0)
+        {
+            (void)co_await all_done.async_wait(coro);
+        }
+        assert(pending == 0);
+
+        const bool has_any = std::any_of(stats.begin(), stats.end()
+            , [](const std::optional<Tracker::ScrapeInfo>& info) { return info.has_value(); });
+        if (has_any || requests.empty())
+        {
+            co_return outcome::success(std::move(stats));
         }
         co_return outcome::failure(ClientErrorc::TODO);
     }
 
     std::uint32_t TorrentClient::get_pieces_count() const
     {
+        if (!metainfo_.has_v1())
+        {
+            // v2-only: no SHA1 pieces; files are aligned to the pieces.
+            const std::uint64_t piece_size = get_piece_size_bytes();
+            return std::uint32_t((get_total_size_bytes() + piece_size - 1) / piece_size);
+        }
         return std::uint32_t(metainfo_.info_.pieces_SHA1_.size() / sizeof(SHA1Bytes));
     }
 
@@ -422,11 +779,12 @@ namespace cxxurl_detail
     co_asio_result<void> TorrentPeer::start(
         const PeerAddress& address
         , const SHA1Bytes& info_hash
-        , const PeerId& peer_id)
+        , const PeerId& peer_id
+        , bool v2 /*= false*/)
     {
         auto coro = as_result(asio::use_awaitable);
         OUTCOME_CO_TRY(co_await socket_.async_connect(AsEndpoint(address), coro));
-        const auto handshake = Message_Handshake::SerializeDefault(info_hash, peer_id);
+        const auto handshake = Message_Handshake::SerializeDefault(info_hash, peer_id, v2);
         OUTCOME_CO_TRY(co_await asio::async_write(socket_, asio::buffer(handshake.data_), coro));
         Message_Handshake::Buffer response;
         OUTCOME_CO_TRY(co_await asio::async_read(socket_, asio::buffer(response.data_), coro));
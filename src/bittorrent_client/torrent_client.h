@@ -9,6 +9,11 @@
 
 #include <small_utils/utils_bytes.h>
 
+#include <functional>
+#include <optional>
+#include <string>
+#include <vector>
+
 class Url;
 
 namespace be
@@ -18,10 +23,14 @@ namespace be
         explicit TorrentPeer(asio::io_context& io_context);
 
         // Connect & Handshake.
+        // `v2` - advertise BitTorrent v2 support (BEP 52).
         co_asio_result<void> start(
             const PeerAddress& address
             , const SHA1Bytes& info_hash
-            , const PeerId& peer_id);
+            , const PeerId& peer_id
+            , bool v2 = false);
+
+        bool supports_v2() const { return SupportsV2(extensions_); }
 
         asio::io_context* io_context_ = nullptr;
         asio::ip::tcp::socket socket_;
@@ -37,8 +46,15 @@ namespace be
     public:
         std::random_device* random_ = nullptr;
         TorrentMetainfo metainfo_;
+        // Identifies the torrent for peers, trackers and the resume data.
+        // SHA1 of the 'info'; for v2-only torrents, truncated `info_hash_v2_`.
         SHA1Bytes info_hash_;
+        // SHA-256 of the 'info'; v2 and hybrid torrents only.
+        SHA256Bytes info_hash_v2_;
         PeerId peer_id_;
+        // 'announce-list' URLs by tier (BEP 12) or just the 'announce' one.
+        // Shuffled within a tier; a tracker that responds moves to the front.
+        std::vector<std::vector<std::string>> tracker_tiers_;
 
     public:
         static outcome::result<TorrentClient> make(
@@ -49,12 +65,24 @@ namespace be
         std::uint64_t get_total_size_bytes() const;
         std::uint32_t get_piece_size_bytes() const;
 
+        // By the `tracker_tiers_`.
         outcome::result<Tracker::AllTrackers> build_tracker_requests(
             const Tracker::RequestInfo& info) const;
 
-        co_asio_result<std::vector<PeerAddress>>
+        // Peers of a tracker response, not reported before in this announce.
+        using OnPeers = std::function<void (std::vector<PeerAddress> peers)>;
+        // Announces to all trackers of a tier at once; the next tier is tried
+        // only if every tracker of the tier failed (BEP 12). Peers are given
+        // to `on_peers` as soon as the tracker responds. Fails if there are no peers.
+        co_asio_result<void>
             request_torrent_peers(asio::io_context& io_context
-                , const Tracker::RequestInfo& info) const;
+                , HTTPClient& http
+                , UDPTrackerClient& udp
+                , const Tracker::RequestInfo& info
+                , OnPeers on_peers);
+
+        // Torrent to scrape on the first tracker of the `tracker_tiers_`.
+        outcome::result<Tracker::ScrapeRequest> get_scrape_request() const;
 
     private:
         template<typename Body>
@@ -63,4 +91,14 @@ namespace be
         outcome::result<Tracker::Request> build_udp_request(
             Url& url, const Tracker::RequestInfo& request) const;
     };
+
+    // Scrapes all the `requests` (BEP 48) with as few tracker requests as
+    // possible: torrents of the same tracker go together, up to 74 per UDP
+    // packet. Stats are in the order of `requests`; std::nullopt if the tracker
+    // can't be scraped or doesn't know the torrent. Fails if there are no stats at all.
+    co_asio_result<std::vector<std::optional<Tracker::ScrapeInfo>>>
+        ScrapeTorrents(asio::io_context& io_context
+            , HTTPClient& http
+            , UDPTrackerClient& udp
+            , const std::vector<Tracker::ScrapeRequest>& requests);
 } // namespace be
@@ -2,6 +2,8 @@
 
 #include <small_utils/utils_string.h>
 
+#include <optional>
+
 #include <cstring>
 #include <cassert>
 #include <cstdint>
@@ -18,11 +20,20 @@ namespace be
         return outcome::success(AnyMessage(std::move(m)));
     }
 
+    bool SupportsV2(const ExtensionsBuffer& extensions)
+    {
+        return ((extensions.data_[7] & 0x10) != 0);
+    }
+
     /*static*/ auto Message_Handshake::SerializeDefault(
-        const SHA1Bytes& info_hash, const PeerId& client_id)
+        const SHA1Bytes& info_hash, const PeerId& client_id, bool v2 /*= false*/)
             -> Buffer
     {
-        const ExtensionsBuffer reserved; // No extensions.
+        ExtensionsBuffer reserved{}; // No extensions, except v2.
+        if (v2)
+        {
+            reserved.data_[7] |= 0x10;
+        }
 
         Buffer buffer;
         BytesWriter::make(buffer.data_)
@@ -167,17 +178,147 @@ namespace be
 
     std::uint32_t Message_Piece::size() const
     {
+        if (is_in_place())
+        {
+            return in_place_size_;
+        }
         assert(payload_.size() > data_offset_);
         return std::uint32_t(payload_.size() - data_offset_);
     }
 
     const void* Message_Piece::data() const
     {
+        assert(!is_in_place() && "Data is already in the sink buffers");
         assert(data_offset_ < payload_.size());
         return &payload_[data_offset_];
     }
 
-    co_asio_result<AnyMessage> ReadAnyMessage(asio::ip::tcp::socket& peer)
+    static BytesReader& ReadHashesRange(BytesReader& reader, MerkleHashesRange& range)
+    {
+        std::uint32_t base_layer_network = 0;
+        std::uint32_t index_network = 0;
+        std::uint32_t length_network = 0;
+        std::uint32_t proof_layers_network = 0;
+        reader
+            .read(range.pieces_root_.data_)
+            .read(base_layer_network)
+            .read(index_network)
+            .read(length_network)
+            .read(proof_layers_network);
+        range.base_layer_ = big_to_native(base_layer_network);
+        range.index_ = big_to_native(index_network);
+        range.length_ = big_to_native(length_network);
+        range.proof_layers_ = big_to_native(proof_layers_network);
+        return reader;
+    }
+
+    template<typename Message, PeerMessageId Id>
+    /*static*/ outcome::result<Message>
+        Message_HashesRangeBase<Message, Id>::ParseNetwork(std::vector<std::uint8_t> payload)
+    {
+        PeerMessageId id{};
+        Message m;
+        auto reader = BytesReader::make(&payload[0], payload.size());
+        if (ReadHashesRange(reader.read(id), m.range_).finalize())
+        {
+            return outcome::success(std::move(m));
+        }
+        return outcome::failure(ClientErrorc::TODO);
+    }
+
+    template<typename Message, PeerMessageId Id>
+    auto Message_HashesRangeBase<Message, Id>::serialize() const -> Buffer
+    {
+        Buffer buffer;
+        BytesWriter::make(buffer.data_)
+            .write(native_to_big(std::uint32_t(k_size - sizeof(std::uint32_t))))
+            .write(Id)
+            .write(range_.pieces_root_.data_)
+            .write(native_to_big(range_.base_layer_))
+            .write(native_to_big(range_.index_))
+            .write(native_to_big(range_.length_))
+            .write(native_to_big(range_.proof_layers_))
+            .finalize();
+        return buffer;
+    }
+
+    template struct Message_HashesRangeBase<Message_HashRequest, PeerMessageId::HashRequest>;
+    template struct Message_HashesRangeBase<Message_HashReject, PeerMessageId::HashReject>;
+
+    /*static*/ outcome::result<Message_Hashes>
+        Message_Hashes::ParseNetwork(std::vector<std::uint8_t> payload)
+    {
+        PeerMessageId id{};
+        Message_Hashes m;
+        auto reader = BytesReader::make(&payload[0], payload.size());
+        const std::size_t remaining = ReadHashesRange(reader.read(id), m.range_)
+            .get_remaining();
+        if ((remaining == std::size_t(-1))
+            || ((remaining % sizeof(SHA256Bytes)) != 0)
+            || ((remaining / sizeof(SHA256Bytes)) < m.range_.length_))
+        {
+            return outcome::failure(ClientErrorc::TODO);
+        }
+        m.hashes_.resize(remaining / sizeof(SHA256Bytes));
+        for (SHA256Bytes& hash : m.hashes_)
+        {
+            reader.read(hash.data_);
+        }
+        if (reader.finalize())
+        {
+            return outcome::success(std::move(m));
+        }
+        return outcome::failure(ClientErrorc::TODO);
+    }
+
+    static co_asio_result<std::optional<Message_Piece>> TryReadPieceInPlace(
+        asio::ip::tcp::socket& peer
+        , std::uint32_t length
+        , const PieceBlockSink& sink
+        , std::vector<std::uint8_t>& data)
+    {
+        auto coro = as_result(asio::use_awaitable);
+        // <id><index><begin><block>.
+        const std::size_t k_header_size = 1 + 2 * sizeof(std::uint32_t);
+        if (length <= k_header_size)
+        {
+            co_return outcome::success(std::nullopt);
+        }
+        data.resize(1);
+        OUTCOME_CO_TRY(co_await asio::async_read(peer
+            , asio::buffer(&data[0], 1), coro));
+        if (PeerMessageId(data[0]) != PeerMessageId::Piece)
+        {
+            co_return outcome::success(std::nullopt);
+        }
+        data.resize(k_header_size);
+        OUTCOME_CO_TRY(co_await asio::async_read(peer
+            , asio::buffer(&data[1], k_header_size - 1), coro));
+
+        Message_Piece m;
+        std::uint32_t piece_index_network = 0;
+        std::uint32_t begin_network = 0;
+        BytesReader::make(&data[1], k_header_size - 1)
+            .read(piece_index_network)
+            .read(begin_network);
+        m.piece_index_ = big_to_native(piece_index_network);
+        m.piece_begin_ = big_to_native(begin_network);
+        const std::uint32_t block_size = std::uint32_t(length - k_header_size);
+
+        std::vector<asio::mutable_buffer> buffers;
+        if (!sink(m.piece_index_, m.piece_begin_, block_size, buffers))
+        {
+            co_return outcome::success(std::nullopt);
+        }
+        OUTCOME_CO_TRY(co_await asio::async_read(peer, buffers, coro));
+        m.data_offset_ = k_header_size;
+        m.in_place_size_ = block_size;
+        m.payload_ = std::move(data);
+        co_return outcome::success(std::move(m));
+    }
+
+    co_asio_result<AnyMessage> ReadAnyMessage(asio::ip::tcp::socket& peer
+        , const PieceBlockSink* sink /*= nullptr*/)
     {
         auto coro = as_result(asio::use_awaitable);
         std::uint32_t length = 0;
@@ -190,9 +331,23 @@ namespace be
         }
 
         std::vector<std::uint8_t> data;
+        if (sink)
+        {
+            OUTCOME_CO_TRY(std::optional<Message_Piece> piece
+                , co_await TryReadPieceInPlace(peer, length, *sink, data));
+            if (piece)
+            {
+                co_return outcome::success(AnyMessage(std::move(*piece)));
+            }
+        }
+        // Part of the message may be already read above.
+        const std::size_t already_read = data.size();
         data.resize(length);
-        OUTCOME_CO_TRY(co_await asio::async_read(peer
-            , asio::buffer(&data[0], length), coro));
+        if (already_read < length)
+        {
+            OUTCOME_CO_TRY(co_await asio::async_read(peer
+                , asio::buffer(&data[already_read], length - already_read), coro));
+        }
         PeerMessageId message_id{};
         BytesReader::make(&data[0], length).read(message_id);
 
@@ -207,6 +362,9 @@ namespace be
         case PeerMessageId::Request:       co_return MakeMessage<Message_Request>(data);
         case PeerMessageId::Piece:         co_return MakeMessage<Message_Piece>(data);
         case PeerMessageId::Cancel:        co_return MakeMessage<Message_Cancel>(data);
+        case PeerMessageId::HashRequest:   co_return MakeMessage<Message_HashRequest>(data);
+        case PeerMessageId::Hashes:        co_return MakeMessage<Message_Hashes>(data);
+        case PeerMessageId::HashReject:    co_return MakeMessage<Message_HashReject>(data);
         default:                           co_return MakeMessage<Message_Unknown>(data);
         }
         co_return outcome::failure(ClientErrorc::TODO);
@@ -7,6 +7,8 @@
 #include <small_utils/utils_bytes.h>
 
 #include <variant>
+#include <vector>
+#include <functional>
 
 #include <cstdint>
 
@@ -24,10 +26,17 @@ namespace be
         Request       = 6,
         Piece         = 7,
         Cancel        = 8,
+        // https://www.bittorrent.org/beps/bep_0052.html
+        HashRequest   = 21,
+        Hashes        = 22,
+        HashReject    = 23,
     };
 
     using ExtensionsBuffer = Buffer<8, struct Extensions_>;
 
+    // BEP 52: the peer supports BitTorrent v2 (reserved bit 4 of the last byte).
+    bool SupportsV2(const ExtensionsBuffer& extensions);
+
     struct Message_Handshake
     {
         static constexpr char k_protocol[] = "BitTorrent protocol";
@@ -47,10 +56,11 @@ namespace be
         SHA1Bytes info_hash_;
         PeerId peer_id_;
 
-        using Buffer = Buffer<k_size, Message_Handshake>;
+        using Buffer = ::Buffer<k_size, Message_Handshake>;
 
+        // `v2` - advertise BitTorrent v2 support.
         static Buffer SerializeDefault(
-            const SHA1Bytes& info_hash, const PeerId& client_id);
+            const SHA1Bytes& info_hash, const PeerId& client_id, bool v2 = false);
 
         static outcome::result<Message_Handshake> ParseNetwork(const Buffer& buffer);
     };
@@ -108,7 +118,7 @@ namespace be
             + sizeof(std::uint32_t); // 4 bytes, index
         static_assert(k_size == 9);
 
-        using Buffer = Buffer<k_size, Message_Have>;
+        using Buffer = ::Buffer<k_size, Message_Have>;
 
         Buffer serialize() const;
     };
@@ -133,7 +143,7 @@ namespace be
             + sizeof(std::uint32_t); // 4 bytes, length
         static_assert(k_size == 17);
 
-        using Buffer = Buffer<k_size, Message_Request>;
+        using Buffer = ::Buffer<k_size, Message_Request>;
 
         std::uint32_t piece_index_ = 0;
         std::uint32_t offset_ = 0;
@@ -151,13 +161,63 @@ namespace be
         std::size_t data_offset_ = 0;
         std::uint32_t piece_index_ = 0;
         std::uint32_t piece_begin_ = 0;
+        // Non-zero when the block was read directly into the buffers
+        // given by PieceBlockSink; `payload_` has no data then.
+        std::uint32_t in_place_size_ = 0;
 
+        bool is_in_place() const { return (in_place_size_ > 0); }
         std::uint32_t size() const;
         const void* data() const;
 
         static outcome::result<Message_Piece> ParseNetwork(std::vector<std::uint8_t> payload);
     };
 
+    // Hashes of the file merkle tree layer (BEP 52): `length_` of them
+    // from `index_`, in the layer `base_layer_` (0 - 16 KiB blocks),
+    // with `proof_layers_` of the uncle hashes up to the `pieces_root_`.
+    struct MerkleHashesRange
+    {
+        SHA256Bytes pieces_root_;
+        std::uint32_t base_layer_ = 0;
+        std::uint32_t index_ = 0;
+        std::uint32_t length_ = 0;
+        std::uint32_t proof_layers_ = 0;
+
+        static constexpr std::uint32_t k_size =
+              sizeof(SHA256Bytes)         // 32 bytes, pieces root
+            + 4 * sizeof(std::uint32_t);  // 16 bytes, base layer, index, length, proof layers
+        static_assert(k_size == 48);
+    };
+
+    template<typename Message, PeerMessageId Id>
+    struct Message_HashesRangeBase : Message_Base<Message, Id>
+    {
+        static constexpr std::uint32_t k_size =
+              sizeof(std::uint32_t)        // 4 bytes, length
+            + sizeof(PeerMessageId)        // 1 byte, id
+            + MerkleHashesRange::k_size;   // 48 bytes, range
+        static_assert(k_size == 53);
+
+        using Buffer = ::Buffer<k_size, Message>;
+
+        MerkleHashesRange range_;
+
+        static outcome::result<Message> ParseNetwork(std::vector<std::uint8_t> payload);
+        Buffer serialize() const;
+    };
+
+    struct Message_HashRequest : Message_HashesRangeBase<Message_HashRequest, PeerMessageId::HashRequest> { };
+    struct Message_HashReject  : Message_HashesRangeBase<Message_HashReject,  PeerMessageId::HashReject> { };
+
+    struct Message_Hashes : Message_Base<Message_Hashes, PeerMessageId::Hashes>
+    {
+        MerkleHashesRange range_;
+        // `range_.length_` of the layer hashes, followed by the proof ones.
+        std::vector<SHA256Bytes> hashes_;
+
+        static outcome::result<Message_Hashes> ParseNetwork(std::vector<std::uint8_t> payload);
+    };
+
     using AnyMessage = std::variant<std::monostate
         , Message_Choke
         , Message_Unchoke
@@ -168,10 +228,22 @@ namespace be
         , Message_Request
         , Message_Piece
         , Message_Cancel
+        , Message_HashRequest
+        , Message_Hashes
+        , Message_HashReject
         , Message_KeepAlive
         , Message_Unknown>;
 
-    co_asio_result<AnyMessage> ReadAnyMessage(asio::ip::tcp::socket& peer);
+    // Final destination (piece buffer or mapped file) for the block of
+    // the Piece message, so it's read from the socket directly there.
+    // Returns false to read the block into Message_Piece::payload_.
+    using PieceBlockSink = std::function<bool (std::uint32_t piece_index
+        , std::uint32_t begin
+        , std::uint32_t size
+        , std::vector<asio::mutable_buffer>& buffers)>;
+
+    co_asio_result<AnyMessage> ReadAnyMessage(asio::ip::tcp::socket& peer
+        , const PieceBlockSink* sink = nullptr);
 
     template<typename Message>
     co_asio_result<Message> ReadMessage(asio::ip::tcp::socket& peer)
@@ -4,6 +4,10 @@
 #include "utils_http.h"
 #include "utils_endian.h"
 
+#include <algorithm>
+
+#include <cstring>
+
 namespace be
 {
     struct Message_UDP_Connect
@@ -18,7 +22,7 @@ namespace be
             + sizeof(std::uint64_t); // connection_id
         static_assert(k_size == 16);
 
-        using Buffer = Buffer<k_size, Message_UDP_Connect>;
+        using Buffer = ::Buffer<k_size, Message_UDP_Connect>;
 
         Buffer serialize() const
         {
@@ -32,10 +36,14 @@ namespace be
         }
 
         static outcome::result<Message_UDP_Connect>
-            ParseNetwork(const Buffer& buffer)
+            ParseNetwork(const std::uint8_t* data, std::size_t size)
         {
+            if (size < k_size)
+            {
+                return outcome::failure(ClientErrorc::TODO);
+            }
             Message_UDP_Connect m;
-            const bool ok = BytesReader::make(buffer.data_)
+            const bool ok = BytesReader::make(data, k_size)
                 .read(m.action_)
                 .read(m.transaction_id_)
                 .read(m.connection_id_)
@@ -83,7 +91,7 @@ namespace be
              + sizeof(std::uint16_t); // port
         static_assert(k_size == 98);
 
-        using Buffer = Buffer<k_size, Message_UDP_Announce>;
+        using Buffer = ::Buffer<k_size, Message_UDP_Announce>;
 
         Buffer serialize() const
         {
@@ -124,21 +132,21 @@ namespace be
              + sizeof(std::uint32_t)  // leechers
              + sizeof(std::uint32_t); // seeders
         static_assert(k_header_size == 20);
-        
-        static constexpr std::size_t k_max_peers = 128;
+
         static constexpr std::size_t k_address_size =
               sizeof(std::uint32_t)  // ipv4
             + sizeof(std::uint16_t); // port
-        static constexpr std::size_t k_size = k_header_size + (k_max_peers * k_address_size);
-
-        using Buffer = Buffer<k_size, Message_UDP_Announce_Response>;
 
+        // As many peers as fit into the datagram.
         static outcome::result<Message_UDP_Announce_Response>
-            ParseNetwork(const Buffer& buffer, std::size_t actually_read)
+            ParseNetwork(const std::uint8_t* data, std::size_t size)
         {
-            assert(actually_read >= k_header_size);
+            if (size < k_header_size)
+            {
+                return outcome::failure(ClientErrorc::TODO);
+            }
             Message_UDP_Announce_Response m;
-            const bool ok = BytesReader::make(buffer.data_, k_header_size)
+            const bool ok = BytesReader::make(data, k_header_size)
                 .read(m.action_)
                 .read(m.transaction_id_)
                 .read(m.intervals_secs_)
@@ -155,13 +163,13 @@ namespace be
             m.leechers_       = big_to_native(m.leechers_);
             m.seeders_        = big_to_native(m.seeders_);
             
-            const std::size_t peers_bytes = (actually_read - k_header_size);
+            const std::size_t peers_bytes = (size - k_header_size);
             if ((peers_bytes % k_address_size) != 0)
             {
                 return outcome::failure(ClientErrorc::TODO);
             }
             m.peers_.reserve(peers_bytes / k_address_size);
-            auto reader = BytesReader::make(buffer.data_ + k_header_size, peers_bytes);
+            auto reader = BytesReader::make(data + k_header_size, peers_bytes);
             while (reader.valid_
                 && (reader.get_remaining() > 0))
             {
@@ -177,213 +185,537 @@ namespace be
         }
     };
 
-    template<typename Buffer>
-    static co_asio_result<std::size_t> AsyncReceiveWithTimeout(
-        asio::io_context& io_context
-        , asio::ip::udp::socket& socket
-        , Buffer& buffer
-        , std::chrono::seconds timeout_from_now
-        , std::size_t read_minimum = sizeof(Buffer))
-    {
-        asio::steady_timer timeout(io_context);
-        timeout.expires_after(timeout_from_now);
-        // Make-up fake timer with much bigger wait time.
-        // Will be reset only by async receive callback
-        // notifying we are done.
-        asio::steady_timer read_end(io_context);
-        read_end.expires_after(std::chrono::hours(timeout_from_now.count()));
-        
-        auto coro = as_result(asio::use_awaitable);
-        asio::ip::udp::endpoint sender_endpoint;
-        std::error_code error;
-        bool finished = false;
-        std::size_t read_total = 0;
-        socket.async_receive_from(
-            asio::buffer(buffer.data_), sender_endpoint
-            , [&](std::error_code ec, std::size_t read)
-            {
-                const bool was_canceled = (ec == asio::error::operation_aborted);
-                if (!was_canceled)
-                {
-                    timeout.cancel();
-                }
-                error = ec;
-                read_total = read;
-                finished = true;
-                read_end.cancel();
-            });
-        auto ok = co_await timeout.async_wait(coro);
-        if (ok || (ok.error() != asio::error::operation_aborted))
+    struct Message_UDP_Scrape
+    {
+        std::uint64_t connection_id_ = 0;
+        std::uint32_t action_ = 2;
+        std::uint32_t transaction_id_ = 0;
+        std::vector<SHA1Bytes> info_hashes_;
+
+        static constexpr std::size_t k_header_size =
+               sizeof(std::uint64_t)  // connection_id
+             + sizeof(std::uint32_t)  // action
+             + sizeof(std::uint32_t); // transaction_id
+        static_assert(k_header_size == 16);
+
+        std::vector<std::uint8_t> serialize() const
         {
-            socket.cancel();
+            std::vector<std::uint8_t> buffer(k_header_size + (info_hashes_.size() * sizeof(SHA1Bytes)));
+            BytesWriter writer{buffer.data(), buffer.data() + buffer.size()};
+            writer.write(native_to_big(connection_id_))
+                .write(native_to_big(action_))
+                .write(native_to_big(transaction_id_));
+            for (const SHA1Bytes& info_hash : info_hashes_)
+            {
+                writer.write(info_hash.data_);
+            }
+            writer.finalize();
+            return buffer;
         }
-        if (!finished)
+    };
+
+    struct Message_UDP_Scrape_Response
+    {
+        std::uint32_t action_ = 2;
+        std::uint32_t transaction_id_ = 0;
+        // In the order of the request.
+        std::vector<Tracker::ScrapeInfo> files_;
+
+        static constexpr std::size_t k_header_size =
+               sizeof(std::uint32_t)  // action
+             + sizeof(std::uint32_t); // transaction_id
+        static constexpr std::size_t k_file_size =
+               sizeof(std::uint32_t)  // seeders
+             + sizeof(std::uint32_t)  // completed
+             + sizeof(std::uint32_t); // leechers
+
+        // `count` - info hashes in the request.
+        static outcome::result<Message_UDP_Scrape_Response>
+            ParseNetwork(const std::uint8_t* data, std::size_t size, std::size_t count)
         {
-            ok = co_await read_end.async_wait(coro);
-            assert(!ok && (ok.error() == asio::error::operation_aborted));
+            if (size < (k_header_size + (count * k_file_size)))
+            {
+                return outcome::failure(ClientErrorc::TODO);
+            }
+            Message_UDP_Scrape_Response m;
+            auto reader = BytesReader::make(data, k_header_size + (count * k_file_size));
+            reader.read(m.action_)
+                .read(m.transaction_id_);
+            m.action_ = big_to_native(m.action_);
+            m.transaction_id_ = big_to_native(m.transaction_id_);
+            m.files_.resize(count);
+            for (Tracker::ScrapeInfo& file : m.files_)
+            {
+                reader.read(file.seeders_)
+                    .read(file.completed_)
+                    .read(file.leechers_);
+                file.seeders_ = big_to_native(file.seeders_);
+                file.completed_ = big_to_native(file.completed_);
+                file.leechers_ = big_to_native(file.leechers_);
+            }
+            if (!reader.finalize())
+            {
+                return outcome::failure(ClientErrorc::TODO);
+            }
+            return outcome::success(std::move(m));
         }
-        if (error)
+    };
+
+    // Every request starts with connection_id (8 bytes) and action (4 bytes).
+    static constexpr std::size_t k_request_transaction_id_offset = 12;
+    // Every response starts with action (4 bytes).
+    static constexpr std::size_t k_response_transaction_id_offset = 4;
+    static constexpr std::size_t k_response_min_size = 8;
+
+    static constexpr std::uint32_t k_action_connect = 0;
+    static constexpr std::uint32_t k_action_announce = 1;
+    static constexpr std::uint32_t k_action_scrape = 2;
+
+    static std::uint32_t ReadBigUInt32(const std::uint8_t* data)
+    {
+        std::uint32_t v = 0;
+        std::memcpy(&v, data, sizeof(v));
+        return big_to_native(v);
+    }
+} // namespace be
+
+// Max UDP payload.
+static constexpr std::size_t k_max_datagram_size = 64 * 1024;
+
+UDPTrackerClient::Clock::duration UDPTrackerClient::TrackerState::rto() const
+{
+    if (srtt_ == Clock::duration::zero())
+    {
+        return k_initial_rto;
+    }
+    // RFC 6298: RTO <- SRTT + max(G, K * RTTVAR).
+    const Clock::duration rto = srtt_ + (4 * rttvar_);
+    return std::clamp<Clock::duration>(rto, k_min_rto, k_max_rto);
+}
+
+void UDPTrackerClient::TrackerState::on_rtt(Clock::duration sample)
+{
+    // Zero is reserved for "no samples".
+    sample = std::max(sample, Clock::duration(1));
+    if (srtt_ == Clock::duration::zero())
+    {
+        srtt_ = sample;
+        rttvar_ = (sample / 2);
+        return;
+    }
+    const Clock::duration delta = ((srtt_ > sample) ? (srtt_ - sample) : (sample - srtt_));
+    rttvar_ = ((3 * rttvar_) + delta) / 4;
+    srtt_ = ((7 * srtt_) + sample) / 8;
+}
+
+/*explicit*/ UDPTrackerClient::UDPTrackerClient(asio::io_context& io_context, std::random_device& random)
+    : io_context_(&io_context)
+    , random_(&random)
+    , socket_(io_context)
+    , receiving_(false)
+    , receive_buffer_(k_max_datagram_size)
+    , sender_()
+    , transactions_()
+    , trackers_()
+    , hosts_()
+{
+    static_assert(std::is_same_v<decltype(random()), std::uint32_t>
+        , "std::random_device can't generate std::uint32_t by default.");
+}
+
+UDPTrackerClient::~UDPTrackerClient()
+{
+    assert(transactions_.empty());
+    std::error_code ignore;
+    socket_.close(ignore);
+}
+
+outcome::result<void> UDPTrackerClient::open()
+{
+    if (socket_.is_open())
+    {
+        return outcome::success();
+    }
+    std::error_code ec;
+    socket_.open(asio::ip::udp::v4(), ec);
+    if (ec)
+    {
+        return outcome::failure(ec);
+    }
+    return outcome::success();
+}
+
+void UDPTrackerClient::receive()
+{
+    if (receiving_ || transactions_.empty())
+    {
+        return;
+    }
+    receiving_ = true;
+    socket_.async_receive_from(asio::buffer(receive_buffer_), sender_
+        , [this](std::error_code ec, std::size_t size)
+    {
+        on_received(ec, size);
+    });
+}
+
+void UDPTrackerClient::on_received(std::error_code ec, std::size_t size)
+{
+    receiving_ = false;
+    if (!socket_.is_open())
+    {
+        return;
+    }
+    // Errors are not fatal: ICMP "port unreachable" of some tracker
+    // shows up as an error of the next receive, for instance.
+    // Also canceled when there were no transactions; new ones may be there already.
+    if (!ec && (size >= be::k_response_min_size))
+    {
+        const std::uint32_t transaction_id = be::ReadBigUInt32(
+            receive_buffer_.data() + be::k_response_transaction_id_offset);
+        auto it = transactions_.find(transaction_id);
+        // Someone else can't answer instead of the tracker.
+        if ((it != transactions_.end())
+            && (it->second->endpoint_ == sender_))
         {
-            co_return outcome::failure(error);
+            Transaction& transaction = *it->second;
+            transaction.response_.assign(receive_buffer_.begin(), receive_buffer_.begin() + size);
+            transaction.received_ = true;
+            transaction.wake_->cancel();
+            transactions_.erase(it);
         }
-        if (read_total >= read_minimum)
+    }
+    receive();
+}
+
+co_asio_result<std::vector<std::uint8_t>>
+    UDPTrackerClient::transact(TrackerState& tracker
+        , const Endpoint& endpoint
+        , std::uint8_t* packet, std::size_t size
+        , std::uint32_t action
+        , Clock::time_point deadline)
+{
+    assert(size >= (be::k_request_transaction_id_offset + sizeof(std::uint32_t)));
+    OUTCOME_CO_TRY(open());
+
+    std::uint32_t transaction_id = (*random_)();
+    while (transactions_.count(transaction_id) > 0)
+    {
+        transaction_id = (*random_)();
+    }
+    const std::uint32_t transaction_id_network = native_to_big(transaction_id);
+    std::memcpy(packet + be::k_request_transaction_id_offset
+        , &transaction_id_network, sizeof(transaction_id_network));
+
+    asio::steady_timer wake(*io_context_);
+    Transaction transaction;
+    transaction.endpoint_ = endpoint;
+    transaction.wake_ = &wake;
+    // Also when the coroutine is destroyed.
+    struct Unregister
+    {
+        UDPTrackerClient& self_;
+        std::uint32_t transaction_id_;
+        Transaction& transaction_;
+        ~Unregister()
         {
-            co_return outcome::success(read_total);
+            auto it = self_.transactions_.find(transaction_id_);
+            if ((it != self_.transactions_.end()) && (it->second == &transaction_))
+            {
+                self_.transactions_.erase(it);
+            }
+            if (self_.transactions_.empty() && self_.receiving_)
+            {
+                // Nothing to wait for.
+                std::error_code ignore;
+                self_.socket_.cancel(ignore);
+            }
         }
-        co_return outcome::failure(ClientErrorc::TODO);
-    }
+    };
+    transactions_[transaction_id] = &transaction;
+    const Unregister unregister{*this, transaction_id, transaction};
+    receive();
 
+    auto coro = as_result(asio::use_awaitable);
     // http://www.bittorrent.org/beps/bep_0015.html
     // If a response is not received after 15 * 2 ^ n seconds,
     // the client should retransmit the request,
     // where n starts at 0 and is increased up to 8 (3840 seconds)
-    // after every retransmission. Note that it is necessary to
-    // rerequest a connection ID when it has expired.
-    // 
-    // Should be 8 = 64 hours (with standard 15 secs base).
-    // Instead, try only once.
-    unsigned k_retry_N_max = 0;
-    // Should be 15 secs.
-    unsigned k_wait_base_secs = 2;
-
-    static std::chrono::seconds RetryTimeout(unsigned n)
-    {
-        return std::chrono::seconds(k_wait_base_secs * unsigned(std::pow(2, n)));
+    // after every retransmission.
+    //
+    // The base is the RTO of the tracker instead of 15 seconds
+    // and the whole thing is limited by the `deadline`.
+    for (unsigned n = 0; ; ++n)
+    {
+        const Clock::time_point sent_at = Clock::now();
+        OUTCOME_CO_TRY(co_await socket_.async_send_to(
+            asio::buffer(packet, size), endpoint, coro));
+        if (!transaction.received_)
+        {
+            // May be canceled by on_received() sooner.
+            wake.expires_at(std::min(deadline, sent_at + (tracker.rto() * (1u << n))));
+            (void)co_await wake.async_wait(coro);
+        }
+        if (transaction.received_)
+        {
+            if (n == 0)
+            {
+                // Karn's algorithm: no samples from retransmitted requests,
+                // the reply could be for any of them.
+                tracker.on_rtt(Clock::now() - sent_at);
+            }
+            break;
+        }
+        if ((n == k_max_retransmits) || (Clock::now() >= deadline))
+        {
+            co_return outcome::failure(asio::error::timed_out);
+        }
     }
 
-    using UDPEndpoint = asio::ip::udp::resolver::results_type::value_type;
+    std::vector<std::uint8_t>& response = transaction.response_;
+    const std::uint32_t response_action = be::ReadBigUInt32(response.data());
+    if (response_action != action)
+    {
+        // Error (3) with the message, or garbage.
+        co_return outcome::failure(ClientErrorc::TODO);
+    }
+    co_return outcome::success(std::move(response));
+}
 
-    co_asio_result<std::uint64_t>
-        AsyncConnect(asio::io_context& io_context
-            , asio::ip::udp::socket& socket
-            , const UDPEndpoint& endpoint
-            , std::random_device& random)
+co_asio_result<UDPTrackerClient::Endpoint>
+    UDPTrackerClient::resolve(const std::string& host, std::uint16_t port
+        , Clock::time_point deadline)
+{
+    const std::string port_str = std::to_string(port);
+    const std::string key = (host + ':' + port_str);
+    auto it = hosts_.find(key);
+    if ((it != hosts_.end()) && (Clock::now() < it->second.expires_))
     {
-        static_assert(std::is_same_v<decltype(random()), std::uint32_t>
-            , "std::random_device can't generate std::uint32_t by default.");
+        co_return outcome::success(it->second.endpoint_);
+    }
 
-        auto coro = as_result(asio::use_awaitable);
-        for (unsigned i = 0; i <= k_retry_N_max; ++i)
+    auto coro = as_result(asio::use_awaitable);
+    asio::ip::udp::resolver resolver(*io_context_);
+    const Deadline resolve_deadline(*io_context_, deadline - Clock::now(), [&resolver]()
+    {
+        resolver.cancel();
+    });
+    // The socket is IPv4.
+    auto endpoints = co_await resolver.async_resolve(
+        asio::ip::udp::v4(), host, port_str, coro);
+    if (!endpoints)
+    {
+        if (resolve_deadline.expired())
         {
-            const auto timeout_secs = RetryTimeout(i);
-            Message_UDP_Connect msg;
-            msg.transaction_id_ = random();
-            auto connect = msg.serialize();
-            OUTCOME_CO_TRY(co_await socket.async_send_to(
-                asio::buffer(connect.data_), endpoint, coro));
-            Message_UDP_Connect::Buffer buffer;
-            auto ok = co_await AsyncReceiveWithTimeout(io_context
-                , socket, buffer, timeout_secs);
-            if (ok)
-            {
-                OUTCOME_CO_TRY(Message_UDP_Connect response, Message_UDP_Connect::ParseNetwork(buffer));
-                assert(response.action_ == 0);
-                assert(response.transaction_id_ == msg.transaction_id_);
-                assert(response.connection_id_ != 0);
-                co_return outcome::success(response.connection_id_);
-            }
-            if (!ok && (ok.error() != asio::error::operation_aborted))
-            {
-                co_return outcome::failure(ok.error());
-            }
+            co_return outcome::failure(asio::error::timed_out);
         }
-        // Retries end.
+        co_return outcome::failure(endpoints.error());
+    }
+    if (endpoints.value().empty())
+    {
         co_return outcome::failure(ClientErrorc::TODO);
     }
+    const Endpoint endpoint = endpoints.value().begin()->endpoint();
+    hosts_[key] = ResolvedHost{endpoint, Clock::now() + k_resolve_lifetime};
+    co_return outcome::success(endpoint);
+}
 
-    co_asio_result<be::TrackerResponse>
-        AsyncAnnounce(asio::io_context& io_context
-            , asio::ip::udp::socket& socket
-            , const UDPEndpoint& endpoint
-            , std::random_device& random
-            , const Tracker::UDP_Request& request
-            , std::uint64_t connection_id)
-    {
-        auto coro = as_result(asio::use_awaitable);
-
-        Message_UDP_Announce msg;
-        msg.connection_id_ = connection_id;
-        msg.transaction_id_ = random();
-        msg.info_hash_ = request.info_hash_;
-        msg.peer_id_ = request.peer_id_;
-        msg.downloaded_ = request.downloaded_pieces;
-        msg.left_ = request.pieces_left;
-        msg.uploaded_ = request.uploaded_pieces;
-        msg.key_ = random();
-        msg.port_ = request.port_;
-
-        auto announce = msg.serialize();
-        OUTCOME_CO_TRY(co_await socket.async_send_to(
-            asio::buffer(announce.data_), endpoint, coro));
-        // #QQQ: implement retry logic.
-        Message_UDP_Announce_Response::Buffer buffer;
-        auto read = co_await AsyncReceiveWithTimeout(io_context
-            , socket, buffer, RetryTimeout(0)
-            , Message_UDP_Announce_Response::k_header_size);
-        if (!read)
+co_asio_result<std::uint64_t>
+    UDPTrackerClient::connect(TrackerState& tracker, const Endpoint& endpoint
+        , Clock::time_point deadline)
+{
+    auto coro = as_result(asio::use_awaitable);
+    while (tracker.connecting_)
+    {
+        // Someone else asked for the connection id already.
+        asio::steady_timer wait(*io_context_);
+        wait.expires_at(deadline);
+        tracker.waiting_.push_back(&wait);
+        (void)co_await wait.async_wait(coro);
+        auto it = std::find(tracker.waiting_.begin(), tracker.waiting_.end(), &wait);
+        if (it != tracker.waiting_.end())
         {
-            co_return outcome::failure(ClientErrorc::TODO);
+            tracker.waiting_.erase(it);
         }
-        OUTCOME_CO_TRY(auto response, Message_UDP_Announce_Response::ParseNetwork(buffer, read.value()));
-        assert(response.action_ == 1);
-        assert(response.transaction_id_ == msg.transaction_id_);
-
-        be::TrackerResponse::OnSuccess tracker;
-        tracker.rerequest_dt_secs_ = response.intervals_secs_;
-        tracker.peers_ = std::move(response.peers_);
-        if (tracker.peers_.size() > 0)
+        if (Clock::now() >= deadline)
+        {
+            co_return outcome::failure(asio::error::timed_out);
+        }
+    }
+    if ((tracker.connection_id_ != 0)
+        && (Clock::now() < tracker.connection_id_expires_))
+    {
+        co_return outcome::success(tracker.connection_id_);
+    }
+
+    tracker.connecting_ = true;
+    be::Message_UDP_Connect msg;
+    auto packet = msg.serialize();
+    auto response = co_await transact(tracker, endpoint
+        , packet.data_, sizeof(packet.data_), be::k_action_connect, deadline);
+    tracker.connecting_ = false;
+    // They'll retry on failure.
+    for (asio::steady_timer* wait : tracker.waiting_)
+    {
+        wait->cancel();
+    }
+    OUTCOME_CO_TRY(std::vector<std::uint8_t> data, std::move(response));
+    OUTCOME_CO_TRY(be::Message_UDP_Connect connect
+        , be::Message_UDP_Connect::ParseNetwork(data.data(), data.size()));
+    if (connect.connection_id_ == 0)
+    {
+        co_return outcome::failure(ClientErrorc::TODO);
+    }
+    tracker.connection_id_ = connect.connection_id_;
+    tracker.connection_id_expires_ = (Clock::now() + k_connection_id_lifetime);
+    co_return outcome::success(tracker.connection_id_);
+}
+
+co_asio_result<std::vector<std::uint8_t>>
+    UDPTrackerClient::transact_connected(TrackerState& tracker
+        , const Endpoint& endpoint
+        , std::uint8_t* packet, std::size_t size
+        , std::uint32_t action
+        , Clock::time_point deadline)
+{
+    for (unsigned attempt = 0; ; ++attempt)
+    {
+        const bool was_cached = (tracker.connection_id_ != 0)
+            && (Clock::now() < tracker.connection_id_expires_);
+        OUTCOME_CO_TRY(std::uint64_t connection_id, co_await connect(tracker, endpoint, deadline));
+        const std::uint64_t connection_id_network = native_to_big(connection_id);
+        std::memcpy(packet, &connection_id_network, sizeof(connection_id_network));
+
+        auto data = co_await transact(tracker, endpoint, packet, size, action, deadline);
+        if (!data
+            && was_cached && (attempt == 0)
+            && (data.error() != asio::error::timed_out))
         {
-            co_return outcome::success(be::TrackerResponse{std::move(tracker)});
+            // The tracker may have forgotten the connection id sooner.
+            if (tracker.connection_id_ == connection_id)
+            {
+                tracker.connection_id_ = 0;
+            }
+            continue;
         }
+        co_return data;
+    }
+}
+
+// http://www.bittorrent.org/beps/bep_0015.html
+co_asio_result<be::TrackerResponse>
+    UDPTrackerClient::announce(const Tracker::UDP_Request& request
+        , std::chrono::seconds timeout)
+{
+    const Clock::time_point deadline = (Clock::now() + timeout);
+    OUTCOME_CO_TRY(Endpoint endpoint, co_await resolve(request.host_, request.port_, deadline));
+    // Stable, never removed.
+    TrackerState& tracker = trackers_[endpoint];
+
+    be::Message_UDP_Announce msg;
+    msg.info_hash_ = request.info_hash_;
+    msg.peer_id_ = request.peer_id_;
+    msg.downloaded_ = request.downloaded_pieces;
+    msg.left_ = request.pieces_left;
+    msg.uploaded_ = request.uploaded_pieces;
+    msg.key_ = (*random_)();
+    msg.port_ = request.server_port;
+    auto packet = msg.serialize();
+    OUTCOME_CO_TRY(std::vector<std::uint8_t> data, co_await transact_connected(tracker, endpoint
+        , packet.data_, sizeof(packet.data_), be::k_action_announce, deadline));
+
+    OUTCOME_CO_TRY(auto response, be::Message_UDP_Announce_Response::ParseNetwork(
+        data.data(), data.size()));
+    be::TrackerResponse::OnSuccess success;
+    success.rerequest_dt_secs_ = response.intervals_secs_;
+    success.peers_ = std::move(response.peers_);
+    if (success.peers_.size() > 0)
+    {
+        co_return outcome::success(be::TrackerResponse{std::move(success)});
+    }
+    co_return outcome::failure(ClientErrorc::TODO);
+}
+
+co_asio_result<std::vector<Tracker::ScrapeInfo>>
+    UDPTrackerClient::scrape(const Tracker::UDP_ScrapeRequest& request
+        , std::chrono::seconds timeout)
+{
+    if (request.info_hashes_.empty()
+        || (request.info_hashes_.size() > k_max_scrape_hashes))
+    {
         co_return outcome::failure(ClientErrorc::TODO);
     }
+    const Clock::time_point deadline = (Clock::now() + timeout);
+    OUTCOME_CO_TRY(Endpoint endpoint, co_await resolve(request.host_, request.port_, deadline));
+    TrackerState& tracker = trackers_[endpoint];
 
-    // http://www.bittorrent.org/beps/bep_0015.html
-    co_asio_result<be::TrackerResponse>
-        UDP_TrackerAnnounce(asio::io_context& io_context
-            , std::random_device& random
-            , const Tracker::UDP_Request& request)
-    {
-        auto coro = as_result(asio::use_awaitable);
-        asio::ip::udp::socket socket(io_context);
-        std::error_code ec;
-        socket.open(asio::ip::udp::v4(), ec);
-        if (ec) { co_return outcome::failure(ec); }
-
-        asio::ip::udp::resolver resolver(io_context);
-        const std::string port = std::to_string(request.port_);
-        OUTCOME_CO_TRY(auto endpoints, co_await resolver.async_resolve(request.host_, port, coro));
-        // Guarantees to be valid.
-        auto& single_endpoint = *endpoints;
-
-        OUTCOME_CO_TRY(std::uint64_t connection_id, co_await AsyncConnect(
-            io_context, socket, single_endpoint, random));
-        assert(connection_id != 0);
-        OUTCOME_CO_TRY(be::TrackerResponse response, co_await AsyncAnnounce(io_context
-            , socket
-            , single_endpoint
-            , random
-            , request
-            , connection_id));
-        co_return outcome::success(std::move(response));
+    be::Message_UDP_Scrape msg;
+    msg.info_hashes_ = request.info_hashes_;
+    std::vector<std::uint8_t> packet = msg.serialize();
+    OUTCOME_CO_TRY(std::vector<std::uint8_t> data, co_await transact_connected(tracker, endpoint
+        , packet.data(), packet.size(), be::k_action_scrape, deadline));
+
+    OUTCOME_CO_TRY(auto response, be::Message_UDP_Scrape_Response::ParseNetwork(
+        data.data(), data.size(), request.info_hashes_.size()));
+    co_return outcome::success(std::move(response.files_));
+}
+
+namespace be
+{
+    co_asio_result<TrackerResponse>
+        UDP_TrackerAnnounce(UDPTrackerClient& udp
+            , const Tracker::UDP_Request& request
+            , std::chrono::seconds timeout)
+    {
+        return udp.announce(request, timeout);
     }
 
     co_asio_result<TrackerResponse>
-        HTTP_TrackerAnnounce(asio::io_context& io_context
-            , const Tracker::HTTP_GetRequest& request)
+        HTTP_TrackerAnnounce(HTTPClient& http
+            , const Tracker::HTTP_GetRequest& request
+            , std::chrono::seconds timeout)
     {
-        OUTCOME_CO_TRY(std::string body, co_await HTTP_GET(io_context
-            , request.host_, request.get_uri_, request.port_));
+        OUTCOME_CO_TRY(std::string body, co_await http.get(
+            request.host_, request.get_uri_, request.port_, timeout));
         co_return ParseTrackerCompactResponseContent(body);
     }
 
     co_asio_result<TrackerResponse>
-        HTTPS_TrackerAnnounce(asio::io_context& io_context
-            , const Tracker::HTTPS_GetRequest& request)
+        HTTPS_TrackerAnnounce(HTTPClient& http
+            , const Tracker::HTTPS_GetRequest& request
+            , std::chrono::seconds timeout)
     {
-        OUTCOME_CO_TRY(std::string body, co_await HTTPS_GET_NoVerification(io_context
-            , request.host_, request.get_uri_, request.port_));
+        OUTCOME_CO_TRY(std::string body, co_await http.get_https_no_verification(
+            request.host_, request.get_uri_, request.port_, timeout));
         co_return ParseTrackerCompactResponseContent(body);
     }
 
+    co_asio_result<std::vector<Tracker::ScrapeInfo>>
+        UDP_TrackerScrape(UDPTrackerClient& udp
+            , const Tracker::UDP_ScrapeRequest& request
+            , std::chrono::seconds timeout)
+    {
+        return udp.scrape(request, timeout);
+    }
+
+    co_asio_result<ScrapeResponse>
+        HTTP_TrackerScrape(HTTPClient& http
+            , const Tracker::HTTP_GetRequest& request
+            , std::chrono::seconds timeout)
+    {
+        OUTCOME_CO_TRY(std::string body, co_await http.get(
+            request.host_, request.get_uri_, request.port_, timeout));
+        co_return ParseTrackerScrapeResponseContent(body);
+    }
+
+    co_asio_result<ScrapeResponse>
+        HTTPS_TrackerScrape(HTTPClient& http
+            , const Tracker::HTTPS_GetRequest& request
+            , std::chrono::seconds timeout)
+    {
+        OUTCOME_CO_TRY(std::string body, co_await http.get_https_no_verification(
+            request.host_, request.get_uri_, request.port_, timeout));
+        co_return ParseTrackerScrapeResponseContent(body);
+    }
+
 } // namespace be
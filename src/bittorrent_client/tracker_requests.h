@@ -1,6 +1,7 @@
 #pragma once
 #include "client_errors.h"
 #include "utils_asio.h"
+#include "utils_http.h"
 
 #include <bencoding/be_tracker_response_parse.h>
 
@@ -8,6 +9,10 @@
 
 #include <string>
 #include <variant>
+#include <vector>
+#include <map>
+#include <random>
+#include <chrono>
 
 #include <cstdint>
 
@@ -44,22 +49,180 @@ struct Tracker
             , HTTPS_GetRequest
             , UDP_Request>;
 
-    using AllTrackers = std::vector<Request>;
+    // Trackers of one 'announce-list' tier (BEP 12), in the order
+    // they are tried; std::monostate for the URLs we can't announce to.
+    using Tier = std::vector<Request>;
+    // Tiers in the order of preference.
+    using AllTrackers = std::vector<Tier>;
+
+    // Swarm of one torrent, as the tracker sees it (BEP 48).
+    struct ScrapeInfo
+    {
+        std::uint32_t seeders_ = 0;
+        // Completed downloads, ever.
+        std::uint32_t completed_ = 0;
+        std::uint32_t leechers_ = 0;
+    };
+
+    // One torrent to scrape on one of its trackers (announce URL).
+    struct ScrapeRequest
+    {
+        std::string tracker_url_utf8_;
+        SHA1Bytes info_hash_;
+    };
+
+    struct UDP_ScrapeRequest
+    {
+        std::string host_;
+        std::uint16_t port_ = 0;
+        // Up to UDPTrackerClient::k_max_scrape_hashes.
+        std::vector<SHA1Bytes> info_hashes_;
+    };
+};
+
+// UDP tracker protocol (BEP 15) over a single socket for the whole
+// session: replies are matched to the requests by the transaction id,
+// connection ids are reused while valid and a request is retransmitted
+// if there is no reply in time; the timeout follows the tracker RTT.
+// `io_context` thread only.
+class UDPTrackerClient
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    explicit UDPTrackerClient(asio::io_context& io_context, std::random_device& random);
+    ~UDPTrackerClient();
+    UDPTrackerClient(const UDPTrackerClient&) = delete;
+    UDPTrackerClient& operator=(const UDPTrackerClient&) = delete;
+
+    // `timeout` - for the whole announce, resolve included.
+    co_asio_result<be::TrackerResponse> announce(
+        const Tracker::UDP_Request& request
+        , std::chrono::seconds timeout);
+    // Stats in the order of `request.info_hashes_`.
+    co_asio_result<std::vector<Tracker::ScrapeInfo>> scrape(
+        const Tracker::UDP_ScrapeRequest& request
+        , std::chrono::seconds timeout);
+
+    // "A client can use a connection ID until one minute after it has received it."
+    static constexpr std::chrono::seconds k_connection_id_lifetime{60};
+    // Host name is resolved again after that.
+    static constexpr std::chrono::minutes k_resolve_lifetime{5};
+    // Retransmit timeout of the tracker without RTT samples.
+    static constexpr std::chrono::milliseconds k_initial_rto{2000};
+    static constexpr std::chrono::milliseconds k_min_rto{250};
+    // BEP 15: 15 * 2 ^ n seconds; the base is the upper bound here.
+    static constexpr std::chrono::milliseconds k_max_rto{15000};
+    // BEP 15: n is increased up to 8.
+    static constexpr unsigned k_max_retransmits = 8;
+    // BEP 15: "Up to about 74 torrents can be scraped at once."
+    static constexpr std::size_t k_max_scrape_hashes = 74;
+
+private:
+    using Endpoint = asio::ip::udp::endpoint;
+
+    struct TrackerState
+    {
+        std::uint64_t connection_id_ = 0;
+        Clock::time_point connection_id_expires_;
+        // Connect request is in flight; other requests wait for it
+        // (their timers are canceled once done) instead of sending their own.
+        bool connecting_ = false;
+        std::vector<asio::steady_timer*> waiting_;
+        // RFC 6298; no samples yet while `srtt_` is 0.
+        Clock::duration srtt_{};
+        Clock::duration rttvar_{};
+
+        Clock::duration rto() const;
+        void on_rtt(Clock::duration sample);
+    };
+
+    struct ResolvedHost
+    {
+        Endpoint endpoint_;
+        Clock::time_point expires_;
+    };
+
+    // Request in flight, waiting for the reply with its transaction id.
+    struct Transaction
+    {
+        Endpoint endpoint_;
+        asio::steady_timer* wake_ = nullptr;
+        std::vector<std::uint8_t> response_;
+        bool received_ = false;
+    };
+
+    co_asio_result<Endpoint> resolve(const std::string& host, std::uint16_t port
+        , Clock::time_point deadline);
+    co_asio_result<std::uint64_t> connect(TrackerState& tracker, const Endpoint& endpoint
+        , Clock::time_point deadline);
+    // Sends the `packet` (its transaction id is set here) till there is
+    // a reply with the `action` (or an error); returns the reply.
+    co_asio_result<std::vector<std::uint8_t>> transact(TrackerState& tracker
+        , const Endpoint& endpoint
+        , std::uint8_t* packet, std::size_t size
+        , std::uint32_t action
+        , Clock::time_point deadline);
+    // transact() with the connection id, written to the start of the `packet`;
+    // connects again once if the tracker rejects the cached id.
+    co_asio_result<std::vector<std::uint8_t>> transact_connected(TrackerState& tracker
+        , const Endpoint& endpoint
+        , std::uint8_t* packet, std::size_t size
+        , std::uint32_t action
+        , Clock::time_point deadline);
+    outcome::result<void> open();
+    void receive();
+    void on_received(std::error_code ec, std::size_t size);
+
+private:
+    asio::io_context* io_context_ = nullptr;
+    std::random_device* random_ = nullptr;
+    asio::ip::udp::socket socket_;
+    // Receive is pending; only while there are transactions,
+    // so io_context::run() can return.
+    bool receiving_ = false;
+    // Big enough for any datagram.
+    std::vector<std::uint8_t> receive_buffer_;
+    Endpoint sender_;
+    std::map<std::uint32_t, Transaction*> transactions_;
+    std::map<Endpoint, TrackerState> trackers_;
+    // By "host:port".
+    std::map<std::string, ResolvedHost> hosts_;
 };
 
 namespace be
 {
+    // `timeout` - for the whole announce, resolve included.
     co_asio_result<TrackerResponse>
-        HTTP_TrackerAnnounce(asio::io_context& io_context
-            , const Tracker::HTTP_GetRequest& request);
+        HTTP_TrackerAnnounce(HTTPClient& http
+            , const Tracker::HTTP_GetRequest& request
+            , std::chrono::seconds timeout);
 
     co_asio_result<TrackerResponse>
-        HTTPS_TrackerAnnounce(asio::io_context& io_context
-            , const Tracker::HTTPS_GetRequest& request);
+        HTTPS_TrackerAnnounce(HTTPClient& http
+            , const Tracker::HTTPS_GetRequest& request
+            , std::chrono::seconds timeout);
 
     co_asio_result<TrackerResponse>
-        UDP_TrackerAnnounce(asio::io_context& io_context
-            , std::random_device& random
-            , const Tracker::UDP_Request& request);
+        UDP_TrackerAnnounce(UDPTrackerClient& udp
+            , const Tracker::UDP_Request& request
+            , std::chrono::seconds timeout);
+
+    // https://www.bittorrent.org/beps/bep_0048.html
+    // `request.get_uri_` - scrape URL with all the 'info_hash'-es.
+    co_asio_result<ScrapeResponse>
+        HTTP_TrackerScrape(HTTPClient& http
+            , const Tracker::HTTP_GetRequest& request
+            , std::chrono::seconds timeout);
+
+    co_asio_result<ScrapeResponse>
+        HTTPS_TrackerScrape(HTTPClient& http
+            , const Tracker::HTTPS_GetRequest& request
+            , std::chrono::seconds timeout);
+
+    co_asio_result<std::vector<Tracker::ScrapeInfo>>
+        UDP_TrackerScrape(UDPTrackerClient& udp
+            , const Tracker::UDP_ScrapeRequest& request
+            , std::chrono::seconds timeout);
 } // namespace be
 
@@ -0,0 +1,25 @@
+#pragma once
+#include <new>
+
+#include <cstddef>
+#include <cstdint>
+
+// Memory for O_DIRECT I/O and registered buffers.
+inline std::uint8_t* AlignedNew(std::size_t size, std::size_t alignment)
+{
+    return new (std::align_val_t(alignment)) std::uint8_t[size];
+}
+
+inline void AlignedDelete(std::uint8_t* ptr, std::size_t alignment) noexcept
+{
+    ::operator delete[](ptr, std::align_val_t(alignment));
+}
+
+template<std::size_t Alignment>
+struct AlignedDeleter
+{
+    void operator()(std::uint8_t* ptr) const noexcept
+    {
+        AlignedDelete(ptr, Alignment);
+    }
+};
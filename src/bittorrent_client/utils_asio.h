@@ -2,5 +2,56 @@
 #include "utils_outcome.h"
 #include <asio.hpp>
 
+#include <chrono>
+#include <memory>
+#include <utility>
+
 template<typename T>
 using co_asio_result = asio::awaitable<outcome::result<T>>;
+
+// Invokes `on_expired` once `timeout` passes, unless destroyed before;
+// e.g. closes the socket so the pending operations of a coroutine fail.
+// Should live in the coroutine frame next to what `on_expired` touches.
+class Deadline
+{
+public:
+    template<typename OnExpired>
+    explicit Deadline(asio::io_context& io_context
+        , std::chrono::steady_clock::duration timeout
+        , OnExpired on_expired)
+            : timer_(io_context)
+            , state_(std::make_shared<State>())
+    {
+        timer_.expires_after(timeout);
+        timer_.async_wait([state = state_, on_expired = std::move(on_expired)]
+            (std::error_code ec) mutable
+        {
+            // Completion may be queued already when the owner is gone.
+            if (!ec && state->alive_)
+            {
+                state->expired_ = true;
+                on_expired();
+            }
+        });
+    }
+
+    ~Deadline()
+    {
+        state_->alive_ = false;
+    }
+
+    Deadline(const Deadline&) = delete;
+    Deadline& operator=(const Deadline&) = delete;
+
+    bool expired() const { return state_->expired_; }
+
+private:
+    struct State
+    {
+        bool alive_ = true;
+        bool expired_ = false;
+    };
+
+    asio::steady_timer timer_;
+    std::shared_ptr<State> state_;
+};
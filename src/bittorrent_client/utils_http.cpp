@@ -2,14 +2,21 @@
 #include "client_errors.h"
 #include "asio_outcome_as_result.hpp"
 
+#include <small_utils/utils_string.h>
+
 #include <asio/ssl.hpp>
 
 #include <string>
-#include <iostream>
+#include <string_view>
+#include <chrono>
 #include <system_error>
 #include <algorithm>
-#include <iterator>
+#include <utility>
+#include <map>
+#include <type_traits>
 
+#include <cctype>
+#include <cstring>
 #include <cstdint>
 
 namespace detail
@@ -17,16 +24,13 @@ namespace detail
     struct HTTPContext
     {
         asio::ip::tcp::socket socket_;
-        HTTPContext(asio::io_context& io_context)
+        explicit HTTPContext(asio::io_context& io_context)
             : socket_(io_context) { }
 
-        static HTTPContext make(asio::io_context& io_context)
-        {
-            return HTTPContext(io_context);
-        }
-
         co_asio_result<void> connect(
-            asio::ip::tcp::resolver::results_type& endpoints)
+            asio::ip::tcp::resolver::results_type& endpoints
+            , const std::string& /*host*/
+            , const std::string& /*server*/)
         {
             auto coro = as_result(asio::use_awaitable);
             OUTCOME_CO_TRY(co_await asio::async_connect(
@@ -38,6 +42,93 @@ namespace detail
         {
             return socket_;
         }
+
+        void close()
+        {
+            std::error_code ignore;
+            socket_.close(ignore);
+        }
+    };
+
+    // asio keeps its verify callback in the app data;
+    // ours is in the separate slots.
+    static int GetSSLContextDataIndex()
+    {
+        static const int index = SSL_CTX_get_ex_new_index(0, nullptr, nullptr, nullptr, nullptr);
+        return index;
+    }
+
+    static int GetSSLDataIndex()
+    {
+        static const int index = SSL_get_ex_new_index(0, nullptr, nullptr, nullptr, nullptr);
+        return index;
+    }
+
+    // Single SSL context for all the connections of the session
+    // and the last TLS session (ticket) of every server to resume.
+    struct TLSSessions
+    {
+        asio::ssl::context ssl_context_;
+        // By "host:port". Owned.
+        std::map<std::string, SSL_SESSION*> sessions_;
+
+        explicit TLSSessions()
+            : ssl_context_(asio::ssl::context::method::sslv23_client)
+            , sessions_()
+        {
+            SSL_CTX* ssl_ctx = ssl_context_.native_handle();
+            // Looked up by the server, not by the session id. TLS 1.3
+            // tickets arrive after the handshake, hence the callback.
+            SSL_CTX_set_session_cache_mode(ssl_ctx
+                , SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+            (void)SSL_CTX_set_ex_data(ssl_ctx, GetSSLContextDataIndex(), this);
+            SSL_CTX_sess_set_new_cb(ssl_ctx, &TLSSessions::OnNewSession);
+        }
+
+        ~TLSSessions()
+        {
+            for (auto& [_, session] : sessions_)
+            {
+                SSL_SESSION_free(session);
+            }
+        }
+
+        TLSSessions(const TLSSessions&) = delete;
+        TLSSessions& operator=(const TLSSessions&) = delete;
+
+        // Not owned.
+        SSL_SESSION* find(const std::string& server) const
+        {
+            auto it = sessions_.find(server);
+            return ((it != sessions_.end()) ? it->second : nullptr);
+        }
+
+        void forget(const std::string& server)
+        {
+            auto it = sessions_.find(server);
+            if (it != sessions_.end())
+            {
+                SSL_SESSION_free(it->second);
+                sessions_.erase(it);
+            }
+        }
+
+        // SSL data is the server ("host:port") of the connection.
+        static int OnNewSession(SSL* ssl, SSL_SESSION* session)
+        {
+            auto* self = static_cast<TLSSessions*>(SSL_CTX_get_ex_data(
+                SSL_get_SSL_CTX(ssl), GetSSLContextDataIndex()));
+            const auto* server = static_cast<const std::string*>(SSL_get_ex_data(
+                ssl, GetSSLDataIndex()));
+            if (!self || !server)
+            {
+                return 0;
+            }
+            self->forget(*server);
+            self->sessions_[*server] = session;
+            // Takes the ownership.
+            return 1;
+        }
     };
 
     // From https://www.boost.org/doc/libs/1_74_0/doc/html/boost_asio/overview/ssl.html.
@@ -46,25 +137,64 @@ namespace detail
 
     struct HTTPSContext
     {
-        asio::ssl::context ssl_context_;
+        TLSSessions* tls_ = nullptr;
         SSLStream ssl_stream_;
-        HTTPSContext(asio::io_context& io_context)
-            : ssl_context_(asio::ssl::context::method::sslv23_client)
-            , ssl_stream_(io_context, ssl_context_) { }
+        // "host:port"; see TLSSessions::OnNewSession().
+        std::string server_;
+        bool handshake_done_ = false;
+
+        explicit HTTPSContext(asio::io_context& io_context, TLSSessions& tls)
+            : tls_(&tls)
+            , ssl_stream_(io_context, tls.ssl_context_)
+            , server_()
+            , handshake_done_(false) { }
 
-        static HTTPSContext make(asio::io_context& io_context)
+        ~HTTPSContext()
         {
-            return HTTPSContext(io_context);
+            if (handshake_done_)
+            {
+                // Otherwise OpenSSL marks the session not resumable
+                // when the connection is closed without close_notify.
+                SSL* ssl = ssl_stream_.native_handle();
+                SSL_set_quiet_shutdown(ssl, 1);
+                (void)SSL_shutdown(ssl);
+            }
         }
 
+        HTTPSContext(const HTTPSContext&) = delete;
+        HTTPSContext& operator=(const HTTPSContext&) = delete;
+
         co_asio_result<void> connect(
-            asio::ip::tcp::resolver::results_type& endpoints)
+            asio::ip::tcp::resolver::results_type& endpoints
+            , const std::string& host
+            , const std::string& server)
         {
             auto coro = as_result(asio::use_awaitable);
             OUTCOME_CO_TRY(co_await asio::async_connect(
                 ssl_stream_.lowest_layer(), std::move(endpoints), coro));
-            OUTCOME_CO_TRY(co_await ssl_stream_.async_handshake(
-                asio::ssl::stream_base::handshake_type::client, coro));
+
+            server_ = server;
+            SSL* ssl = ssl_stream_.native_handle();
+            (void)SSL_set_ex_data(ssl, GetSSLDataIndex(), &server_);
+            // SNI; trackers behind CDNs need it.
+            (void)SSL_set_tlsext_host_name(ssl, host.c_str());
+            SSL_SESSION* session = tls_->find(server_);
+            if (session)
+            {
+                (void)SSL_set_session(ssl, session);
+            }
+            auto handshake = co_await ssl_stream_.async_handshake(
+                asio::ssl::stream_base::handshake_type::client, coro);
+            if (!handshake)
+            {
+                if (session)
+                {
+                    // Could be the reason.
+                    tls_->forget(server_);
+                }
+                co_return outcome::failure(handshake.error());
+            }
+            handshake_done_ = true;
             co_return outcome::success();
         }
 
@@ -72,117 +202,478 @@ namespace detail
         {
             return ssl_stream_;
         }
-    };
 
-    // From:
-    // coroutines_ts/echo_server.cpp:
-    // https://github.com/chriskohlhoff/asio/blob/master/asio/src/examples/cpp17/coroutines_ts/echo_server.cpp
-    // http/async_client.cpp:
-    // https://github.com/chriskohlhoff/asio/blob/master/asio/src/examples/cpp03/http/client/async_client.cpp
-    template<typename Context>
-    static co_asio_result<std::string>
-        HTTP_GET(asio::io_context& io_context
-            , std::string host, std::string get_uri
-            , std::uint16_t port_n)
-    {
-        auto context = Context::make(io_context);
-        auto& socket = context.get_socket();
-        asio::ip::tcp::resolver resolver(io_context);
+        void close()
+        {
+            std::error_code ignore;
+            ssl_stream_.lowest_layer().close(ignore);
+        }
+    };
+} // namespace detail
 
-        asio::streambuf request;
-        asio::streambuf response;
+namespace
+{
+    // Status line and headers are not bigger than that.
+    const std::size_t k_max_head_size = 16 * 1024;
+    // Tracker responses are small; don't allocate whatever the server says.
+    const std::uint64_t k_max_content_size = 16 * 1024 * 1024;
+    // Asked from the socket at once.
+    const std::size_t k_read_size = 16 * 1024;
 
-        const std::string port = std::to_string(port_n);
-        const std::string server = (host + ':' + port);
+    const std::string_view k_crlf = "\r\n";
+    const std::string_view k_head_end = "\r\n\r\n";
 
-        std::ostream request_stream(&request);
-        request_stream << "GET " << get_uri << " HTTP/1.0\r\n";
-        request_stream << "Host: " << server << "\r\n";
-        request_stream << "Accept: */*\r\n";
-        request_stream << "Connection: close\r\n\r\n";
+    std::string_view Trim(std::string_view str)
+    {
+        const std::size_t begin = str.find_first_not_of(" \t");
+        if (begin == std::string_view::npos)
+        {
+            return std::string_view();
+        }
+        const std::size_t end = str.find_last_not_of(" \t");
+        return str.substr(begin, end - begin + 1);
+    }
 
-        auto coro = as_result(asio::use_awaitable);
+    bool IsSameNoCase(std::string_view lhs, std::string_view rhs)
+    {
+        return (lhs.size() == rhs.size())
+            && std::equal(lhs.begin(), lhs.end(), rhs.begin()
+                , [](char l, char r)
+            {
+                return (std::tolower(static_cast<unsigned char>(l))
+                    == std::tolower(static_cast<unsigned char>(r)));
+            });
+    }
 
-        OUTCOME_CO_TRY(auto endpoints, co_await resolver.async_resolve(host, port, coro));
-        OUTCOME_CO_TRY(co_await context.connect(endpoints));
-        OUTCOME_CO_TRY(co_await asio::async_write(socket, request, coro));
-        OUTCOME_CO_TRY(co_await asio::async_read_until(socket, response, "\r\n", coro));
+    // `list` - comma-separated, e.g. 'Transfer-Encoding: gzip, chunked'.
+    bool HasToken(std::string_view list, std::string_view token)
+    {
+        while (true)
+        {
+            const std::size_t comma = list.find(',');
+            if (IsSameNoCase(Trim(list.substr(0, comma)), token))
+            {
+                return true;
+            }
+            if (comma == std::string_view::npos)
+            {
+                return false;
+            }
+            list.remove_prefix(comma + 1);
+        }
+    }
 
-        // Check that response is OK.
-        std::istream response_stream(&response);
-        std::string http_version;
-        response_stream >> http_version;
-        unsigned int status_code = 0;
-        response_stream >> status_code;
-        std::string status_message;
-        std::getline(response_stream, status_message);
-        if (!response_stream
-            || (http_version.substr(0, 5) != "HTTP/"))
+    bool ParseHex(std::string_view str, std::uint64_t& value)
+    {
+        if (str.empty() || (str.size() > 15))
         {
-            co_return outcome::failure(ClientErrorc::TODO);
+            return false;
         }
-        if (status_code != 200)
+        value = 0;
+        for (char c : str)
         {
-            co_return outcome::failure(ClientErrorc::TODO);
+            unsigned digit = 0;
+            if ((c >= '0') && (c <= '9'))      { digit = unsigned(c - '0'); }
+            else if ((c >= 'a') && (c <= 'f')) { digit = unsigned(c - 'a' + 10); }
+            else if ((c >= 'A') && (c <= 'F')) { digit = unsigned(c - 'A' + 10); }
+            else { return false; }
+            value = ((value << 4) | digit);
         }
+        return true;
+    }
 
-        OUTCOME_CO_TRY(co_await asio::async_read_until(socket, response, "\r\n\r\n", coro));
+    // Splits the first line off the `text`.
+    std::string_view NextLine(std::string_view& text)
+    {
+        const std::size_t end = text.find(k_crlf);
+        const std::string_view line = text.substr(0, end);
+        text = ((end == std::string_view::npos)
+            ? std::string_view()
+            : text.substr(end + k_crlf.size()));
+        return line;
+    }
 
-        std::istream headers_stream(&response);
-        std::string header;
-        while (std::getline(headers_stream, header)
-            && (header != "\r"))
+    bool IsEndOfStream(const std::error_code& ec)
+    {
+        // TLS servers do not always shutdown gracefully.
+        return (ec == asio::error::eof)
+            || (ec == asio::ssl::error::stream_truncated);
+    }
+} // namespace
+
+outcome::result<HTTPResponseHead> ParseHTTPResponseHead(std::string_view head)
+{
+    // HTTP/1.1 200 OK
+    const std::string_view status_line = NextLine(head);
+    const std::size_t version_end = status_line.find(' ');
+    const std::string_view version = status_line.substr(0, version_end);
+    if ((version_end == std::string_view::npos)
+        || (version.substr(0, 5) != "HTTP/"))
+    {
+        return outcome::failure(ClientErrorc::TODO);
+    }
+    const std::string_view code = status_line.substr(version_end + 1, 3);
+    std::uint64_t status_code = 0;
+    if ((code.size() != 3)
+        || !ParseLength(code, status_code))
+    {
+        return outcome::failure(ClientErrorc::TODO);
+    }
+
+    HTTPResponseHead response;
+    response.status_code_ = unsigned(status_code);
+    response.keep_alive_ = (version != "HTTP/1.0");
+    response.no_content_ = ((status_code / 100) == 1)
+        || (status_code == 204)
+        || (status_code == 304);
+
+    while (!head.empty())
+    {
+        const std::string_view line = NextLine(head);
+        const std::size_t colon = line.find(':');
+        if (colon == std::string_view::npos)
+        {
+            return outcome::failure(ClientErrorc::TODO);
+        }
+        const std::string_view name = line.substr(0, colon);
+        const std::string_view value = Trim(line.substr(colon + 1));
+        if (IsSameNoCase(name, "Content-Length"))
+        {
+            std::uint64_t length = 0;
+            if (!ParseLength(value, length)
+                || (response.content_length_ && (*response.content_length_ != length)))
+            {
+                return outcome::failure(ClientErrorc::TODO);
+            }
+            response.content_length_ = length;
+        }
+        else if (IsSameNoCase(name, "Transfer-Encoding"))
+        {
+            // Takes precedence over 'Content-Length'.
+            response.chunked_ = HasToken(value, "chunked");
+        }
+        else if (IsSameNoCase(name, "Connection"))
         {
-            // Ignore any header.
+            if (HasToken(value, "close"))
+            {
+                response.keep_alive_ = false;
+            }
+            else if (HasToken(value, "keep-alive"))
+            {
+                response.keep_alive_ = true;
+            }
         }
+    }
+    return outcome::success(response);
+}
 
-        std::string content;
-        auto add_content = [&content](asio::streambuf& incoming)
+outcome::result<bool> HTTPChunkedDecoder::decode(std::string& data)
+{
+    while (true)
+    {
+        // chunk-size [; chunk-ext] CRLF chunk-data CRLF
+        std::string_view rest = std::string_view(data).substr(read_);
+        const std::size_t line_end = rest.find(k_crlf);
+        if (line_end == std::string_view::npos)
+        {
+            return ((rest.size() > k_max_head_size)
+                ? outcome::result<bool>(outcome::failure(ClientErrorc::TODO))
+                : outcome::result<bool>(outcome::success(false)));
+        }
+        const std::string_view size_line = rest.substr(0, line_end);
+        std::uint64_t chunk_size = 0;
+        if (!ParseHex(Trim(size_line.substr(0, size_line.find(';'))), chunk_size))
+        {
+            return outcome::failure(ClientErrorc::TODO);
+        }
+        const std::size_t data_start = (line_end + k_crlf.size());
+        if (chunk_size == 0)
         {
-            content.reserve(content.size() + incoming.size());
-            std::istream ss(&incoming);
-            std::copy(std::istreambuf_iterator<char>(ss), {}
-                , std::back_inserter(content));
-        };
-        // Write whatever content we already have to output.
-        add_content(response);
+            // Last chunk; trailers (ignored) till the empty line.
+            const std::string_view trailers = rest.substr(data_start);
+            std::size_t trailers_size = 0;
+            if (trailers.substr(0, k_crlf.size()) == k_crlf)
+            {
+                trailers_size = k_crlf.size();
+            }
+            else
+            {
+                const std::size_t end = trailers.find(k_head_end);
+                if (end == std::string_view::npos)
+                {
+                    return ((trailers.size() > k_max_head_size)
+                        ? outcome::result<bool>(outcome::failure(ClientErrorc::TODO))
+                        : outcome::result<bool>(outcome::success(false)));
+                }
+                trailers_size = (end + k_head_end.size());
+            }
+            read_ += (data_start + trailers_size);
+            return outcome::success(true);
+        }
+        if ((size_ + chunk_size) > k_max_content_size)
+        {
+            return outcome::failure(ClientErrorc::TODO);
+        }
+        const std::size_t chunk_end = (data_start + std::size_t(chunk_size));
+        if (rest.size() < (chunk_end + k_crlf.size()))
+        {
+            return outcome::success(false);
+        }
+        if (rest.substr(chunk_end, k_crlf.size()) != k_crlf)
+        {
+            return outcome::failure(ClientErrorc::TODO);
+        }
+        std::memmove(&data[size_], &data[read_ + data_start], std::size_t(chunk_size));
+        size_ += std::size_t(chunk_size);
+        read_ += (chunk_end + k_crlf.size());
+    }
+}
 
+namespace detail
+{
+    struct HTTPResponse
+    {
+        HTTPResponseHead head_;
+        std::string content_;
+        // Nothing else was sent after the content; can be kept alive.
+        bool reusable_ = false;
+    };
+
+    // Appends whatever is available (up to k_read_size) to the `data`.
+    template<typename Socket>
+    static co_asio_result<std::size_t> ReadMore(Socket& socket, std::string& data)
+    {
+        const std::size_t size = data.size();
+        data.resize(size + k_read_size);
+        auto read = co_await socket.async_read_some(
+            asio::buffer(&data[size], k_read_size), as_result(asio::use_awaitable));
+        data.resize(size + (read ? read.value() : 0));
+        co_return read;
+    }
+
+    // Content is read to the same buffer as the head,
+    // right after what is there already; chunks are decoded in place.
+    template<typename Context>
+    static co_asio_result<HTTPResponse> HTTP_Request(Context& context
+        , const std::string& request)
+    {
+        auto& socket = context.get_socket();
+        auto coro = as_result(asio::use_awaitable);
+        OUTCOME_CO_TRY(co_await asio::async_write(socket, asio::buffer(request), coro));
+
+        std::string data;
+        std::size_t head_end = std::string::npos;
         while (true)
         {
-            auto result = co_await asio::async_read(socket, response,
-                asio::transfer_at_least(1), coro);
-            if (result)
+            // End of head may be split between reads.
+            const std::size_t from = ((data.size() > k_head_end.size())
+                ? (data.size() - k_head_end.size())
+                : 0);
+            OUTCOME_CO_TRY(co_await ReadMore(socket, data));
+            head_end = data.find(k_head_end, from);
+            if (head_end != std::string::npos)
+            {
+                break;
+            }
+            if (data.size() > k_max_head_size)
+            {
+                co_return outcome::failure(ClientErrorc::TODO);
+            }
+        }
+
+        HTTPResponse response;
+        OUTCOME_CO_TRY(response.head_, ParseHTTPResponseHead(
+            std::string_view(data).substr(0, head_end)));
+        const HTTPResponseHead& head = response.head_;
+        data.erase(0, head_end + k_head_end.size());
+
+        bool has_extra = false;
+        if (head.no_content_)
+        {
+            has_extra = !data.empty();
+            data.clear();
+        }
+        else if (head.chunked_)
+        {
+            HTTPChunkedDecoder decoder;
+            while (true)
+            {
+                OUTCOME_CO_TRY(const bool done, decoder.decode(data));
+                if (done)
+                {
+                    break;
+                }
+                OUTCOME_CO_TRY(co_await ReadMore(socket, data));
+            }
+            has_extra = (decoder.read_ != data.size());
+            data.resize(decoder.size_);
+        }
+        else if (head.content_length_)
+        {
+            const std::uint64_t length = *head.content_length_;
+            if (length > k_max_content_size)
             {
-                add_content(response);
-                continue;
+                co_return outcome::failure(ClientErrorc::TODO);
             }
-            if (result.error() != asio::error::eof)
+            const std::size_t have = data.size();
+            if (have < length)
+            {
+                data.resize(std::size_t(length));
+                OUTCOME_CO_TRY(co_await asio::async_read(socket
+                    , asio::buffer(&data[have], std::size_t(length) - have), coro));
+            }
+            has_extra = (have > length);
+            data.resize(std::size_t(length));
+        }
+        else
+        {
+            // Till the server closes the connection.
+            while (true)
             {
-                co_return outcome::failure(result.error());
+                auto read = co_await ReadMore(socket, data);
+                if (read)
+                {
+                    if (data.size() > k_max_content_size)
+                    {
+                        co_return outcome::failure(ClientErrorc::TODO);
+                    }
+                    continue;
+                }
+                if (!IsEndOfStream(read.error()))
+                {
+                    co_return outcome::failure(read.error());
+                }
+                break;
             }
-            break;
+            response.head_.keep_alive_ = false;
         }
 
-        co_return outcome::success(std::move(content));
+        response.reusable_ = (head.keep_alive_ && !has_extra);
+        response.content_ = std::move(data);
+        co_return outcome::success(std::move(response));
     }
 } // namespace detail
 
-co_asio_result<std::string>
-    HTTP_GET(asio::io_context& io_context
-        , std::string host, std::string get_uri
-        , std::uint16_t port_n /*= 80*/)
+/*explicit*/ HTTPClient::HTTPClient(asio::io_context& io_context)
+    : io_context_(&io_context)
+    , tls_(std::make_unique<detail::TLSSessions>())
+    , http_()
+    , https_()
+{
+}
+
+HTTPClient::~HTTPClient() = default;
+
+template<typename Context>
+co_asio_result<std::string> HTTPClient::do_get(IdlePool<Context>& pool
+    , std::string host, std::string get_uri
+    , std::uint16_t port_n
+    , std::chrono::seconds timeout)
+{
+    const std::string port = std::to_string(port_n);
+    const std::string server = (host + ':' + port);
+
+    std::string request;
+    request.reserve(get_uri.size() + server.size() + 96);
+    request += "GET ";
+    request += get_uri;
+    request += " HTTP/1.1\r\n";
+    request += "Host: ";
+    request += server;
+    request += "\r\n";
+    request += "Accept: */*\r\n";
+    request += "Connection: keep-alive\r\n\r\n";
+
+    std::unique_ptr<Context> context;
+    if (auto it = pool.find(server); it != pool.end())
+    {
+        const auto now = std::chrono::steady_clock::now();
+        std::vector<Idle<Context>>& idle = it->second;
+        while (!idle.empty() && !context)
+        {
+            Idle<Context> last = std::move(idle.back());
+            idle.pop_back();
+            if ((now - last.since_) < k_max_idle_time)
+            {
+                context = std::move(last.context_);
+            }
+        }
+        if (idle.empty())
+        {
+            pool.erase(it);
+        }
+    }
+
+    asio::ip::tcp::resolver resolver(*io_context_);
+    // Fails whatever is awaited at the moment.
+    const Deadline deadline(*io_context_, timeout, [&context, &resolver]()
+    {
+        resolver.cancel();
+        if (context)
+        {
+            context->close();
+        }
+    });
+    auto get = [&]() -> co_asio_result<detail::HTTPResponse>
+    {
+        if (context)
+        {
+            // The server could close the idle connection already;
+            // try with the new one then.
+            auto response = co_await detail::HTTP_Request(*context, request);
+            if (response || deadline.expired())
+            {
+                co_return response;
+            }
+            context.reset();
+        }
+        auto coro = as_result(asio::use_awaitable);
+        if constexpr (std::is_same_v<Context, detail::HTTPSContext>)
+        {
+            context = std::make_unique<Context>(*io_context_, *tls_);
+        }
+        else
+        {
+            context = std::make_unique<Context>(*io_context_);
+        }
+        OUTCOME_CO_TRY(auto endpoints, co_await resolver.async_resolve(host, port, coro));
+        OUTCOME_CO_TRY(co_await context->connect(endpoints, host, server));
+        co_return co_await detail::HTTP_Request(*context, request);
+    };
+    auto response = co_await get();
+    if (deadline.expired())
+    {
+        co_return outcome::failure(asio::error::timed_out);
+    }
+    if (!response)
+    {
+        co_return outcome::failure(response.error());
+    }
+    if (response.value().reusable_)
+    {
+        std::vector<Idle<Context>>& idle = pool[server];
+        if (idle.size() < k_max_idle_per_host)
+        {
+            idle.push_back({std::move(context), std::chrono::steady_clock::now()});
+        }
+    }
+    if (response.value().head_.status_code_ != 200)
+    {
+        co_return outcome::failure(ClientErrorc::TODO);
+    }
+    co_return outcome::success(std::move(response.value().content_));
+}
+
+co_asio_result<std::string> HTTPClient::get(std::string host, std::string get_uri
+    , std::uint16_t port_n /*= 80*/
+    , std::chrono::seconds timeout /*= k_http_timeout*/)
 {
-    OUTCOME_CO_TRY(std::string data, co_await ::detail::HTTP_GET<detail::HTTPContext>(
-        io_context, std::move(host), std::move(get_uri), port_n));
-    co_return outcome::success(std::move(data));
+    co_return co_await do_get(http_, std::move(host), std::move(get_uri), port_n, timeout);
 }
 
-co_asio_result<std::string>
-    HTTPS_GET_NoVerification(asio::io_context& io_context
-        , std::string host, std::string get_uri
-        , std::uint16_t port_n /*= 443*/)
+co_asio_result<std::string> HTTPClient::get_https_no_verification(std::string host, std::string get_uri
+    , std::uint16_t port_n /*= 443*/
+    , std::chrono::seconds timeout /*= k_http_timeout*/)
 {
-    OUTCOME_CO_TRY(std::string data, co_await ::detail::HTTP_GET<detail::HTTPSContext>(
-        io_context, std::move(host), std::move(get_uri), port_n));
-    co_return outcome::success(std::move(data));
+    co_return co_await do_get(https_, std::move(host), std::move(get_uri), port_n, timeout);
 }
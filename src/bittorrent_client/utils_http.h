@@ -3,15 +3,103 @@
 #include "utils_asio.h"
 
 #include <string>
+#include <string_view>
+#include <vector>
+#include <map>
+#include <memory>
+#include <optional>
+#include <chrono>
 
 #include <cstdint>
 
-co_asio_result<std::string>
-    HTTP_GET(asio::io_context& io_context
-        , std::string host, std::string get_uri
-        , std::uint16_t port_n = 80);
+// Whole request, from resolve to the last byte of the content.
+inline constexpr std::chrono::seconds k_http_timeout{30};
+
+namespace detail
+{
+    struct HTTPContext;
+    struct HTTPSContext;
+    struct TLSSessions;
+} // namespace detail
+
+// Status line and headers of the HTTP/1.x response.
+struct HTTPResponseHead
+{
+    unsigned status_code_ = 0;
+    // Connection can be used for the next request.
+    bool keep_alive_ = false;
+    // 'Transfer-Encoding: chunked'.
+    bool chunked_ = false;
+    // 'Content-Length', if any.
+    std::optional<std::uint64_t> content_length_;
+    // No content, whatever the headers say (1xx, 204, 304).
+    bool no_content_ = false;
+};
+
+// `head` - everything before the empty line ("\r\n\r\n").
+outcome::result<HTTPResponseHead> ParseHTTPResponseHead(std::string_view head);
+
+// Decodes 'Transfer-Encoding: chunked' content in place, as it arrives:
+// decoded bytes are moved to the front of the same buffer.
+struct HTTPChunkedDecoder
+{
+    // Decodes whatever is complete in `data`; true once the last chunk
+    // (and trailers) are done. Decoded content is `data[0, size_)`.
+    outcome::result<bool> decode(std::string& data);
+
+    // Decoded content size.
+    std::size_t size_ = 0;
+    // Start of not decoded yet data.
+    std::size_t read_ = 0;
+};
 
-co_asio_result<std::string>
-    HTTPS_GET_NoVerification(asio::io_context& io_context
+// HTTP/1.1 GET; connections are kept alive and reused
+// by the next request to the same host and port.
+// HTTPS connections share the SSL context and resume
+// the last TLS session of the server.
+// `io_context` thread only.
+class HTTPClient
+{
+public:
+    explicit HTTPClient(asio::io_context& io_context);
+    ~HTTPClient();
+    HTTPClient(const HTTPClient&) = delete;
+    HTTPClient& operator=(const HTTPClient&) = delete;
+
+    // Content of the 200 OK response.
+    co_asio_result<std::string> get(std::string host, std::string get_uri
+        , std::uint16_t port_n = 80
+        , std::chrono::seconds timeout = k_http_timeout);
+    co_asio_result<std::string> get_https_no_verification(std::string host, std::string get_uri
+        , std::uint16_t port_n = 443
+        , std::chrono::seconds timeout = k_http_timeout);
+
+    // Idle connections kept per host.
+    static constexpr std::size_t k_max_idle_per_host = 4;
+    // Servers close idle connections on their own; don't bother with older ones.
+    static constexpr std::chrono::seconds k_max_idle_time{60};
+
+private:
+    template<typename Context>
+    struct Idle
+    {
+        std::unique_ptr<Context> context_;
+        std::chrono::steady_clock::time_point since_;
+    };
+    // By "host:port".
+    template<typename Context>
+    using IdlePool = std::map<std::string, std::vector<Idle<Context>>>;
+
+    template<typename Context>
+    co_asio_result<std::string> do_get(IdlePool<Context>& pool
         , std::string host, std::string get_uri
-        , std::uint16_t port_n = 443);
+        , std::uint16_t port_n
+        , std::chrono::seconds timeout);
+
+private:
+    asio::io_context* io_context_ = nullptr;
+    // Outlives the connections.
+    std::unique_ptr<detail::TLSSessions> tls_;
+    IdlePool<detail::HTTPContext> http_;
+    IdlePool<detail::HTTPSContext> https_;
+};
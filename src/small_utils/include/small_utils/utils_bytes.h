@@ -1,9 +1,11 @@
 #pragma once
+#include <memory>
 #include <random>
 #include <string_view> // std::span is not available in MinGW yet.
 #include <type_traits>
 
 #include <cstdint>
+#include <cstring>
 #include <cassert>
 
 template<std::size_t N, typename>
@@ -14,8 +16,31 @@ struct Buffer
 
 struct SHA1Bytes : Buffer<20, SHA1Bytes> { };
 struct PeerId    : Buffer<20, PeerId> { };
+// See utils_sha256.h.
+struct SHA256Bytes : Buffer<32, SHA256Bytes> { };
 
+// See utils_sha1.h for the implementations.
 SHA1Bytes GetSHA1(std::string_view data);
+// SHA1 of all `parts` concatenated.
+SHA1Bytes GetSHA1(const std::string_view* parts, std::size_t count);
+
+// Streaming SHA1: same as GetSHA1() of all update()-s concatenated.
+class SHA1Hasher
+{
+public:
+    SHA1Hasher();
+    ~SHA1Hasher();
+    SHA1Hasher(SHA1Hasher&&) noexcept;
+    SHA1Hasher& operator=(SHA1Hasher&&) noexcept;
+
+    void update(const void* data, std::size_t size);
+    // Hasher is reset afterwards.
+    SHA1Bytes finalize();
+
+private:
+    struct Impl;
+    std::unique_ptr<Impl> impl_;
+};
 PeerId GetRandomPeerId(std::random_device& random);
 
 struct BytesWriter
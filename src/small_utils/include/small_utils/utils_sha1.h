@@ -0,0 +1,33 @@
+#pragma once
+#include <small_utils/utils_bytes.h>
+
+#include <string_view>
+
+#include <cstddef>
+
+// SHA1 implementations. GetSHA1() and SHA1Hasher (see utils_bytes.h)
+// use the fastest one the CPU supports, detected once at runtime.
+enum class SHA1Backend
+{
+    // Portable (TinySHA1); always supported.
+    Scalar,
+    // x86 SHA extensions; single buffer.
+    SHA_NI,
+    // AVX2, 8 independent buffers at once; GetSHA1Many() only.
+    AVX2_x8,
+};
+
+bool IsSHA1BackendSupported(SHA1Backend backend);
+// Backend of GetSHA1() and SHA1Hasher: SHA_NI or Scalar.
+SHA1Backend GetSHA1Backend();
+// How many buffers GetSHA1Many() hashes at once with the best backend
+// for this CPU; 1 if there is no gain from batching.
+std::size_t GetSHA1Lanes();
+
+// `results[i]` is GetSHA1(`data[i]`).
+void GetSHA1Many(const std::string_view* data, SHA1Bytes* results, std::size_t count);
+
+// Same as above, with the given (supported) `backend`. For tests/benchmarks.
+SHA1Bytes GetSHA1(SHA1Backend backend, const std::string_view* parts, std::size_t count);
+void GetSHA1Many(SHA1Backend backend
+    , const std::string_view* data, SHA1Bytes* results, std::size_t count);
@@ -0,0 +1,52 @@
+#pragma once
+#include <small_utils/utils_bytes.h>
+
+#include <string_view>
+#include <vector>
+
+#include <cstddef>
+#include <cstdint>
+
+// SHA-256, for BitTorrent v2 (BEP 52). Uses x86 SHA extensions
+// when the CPU has them (same as SHA1Backend::SHA_NI).
+SHA256Bytes GetSHA256(std::string_view data);
+// SHA-256 of all `parts` concatenated.
+SHA256Bytes GetSHA256(const std::string_view* parts, std::size_t count);
+
+// Streaming SHA-256: same as GetSHA256() of all update()-s concatenated.
+class SHA256Hasher
+{
+public:
+    SHA256Hasher();
+
+    void update(const void* data, std::size_t size);
+    // Hasher is reset afterwards.
+    SHA256Bytes finalize();
+
+private:
+    void reset();
+
+private:
+    std::uint32_t state_[8]{};
+    std::uint8_t block_[64]{};
+    std::size_t block_size_ = 0;
+    std::uint64_t total_size_ = 0;
+};
+
+// BEP 52 merkle trees: leaves are SHA-256 of 16 KiB blocks
+// (the last one of the file may be shorter); the tree is padded
+// to a power of two leaves with zeros.
+const std::uint32_t k_merkle_block_size = 16 * 1024;
+
+// Leaves of the tree over `count` of them: next power of two.
+std::size_t GetMerkleWidth(std::size_t count);
+// Root of the tree of `width` leaves: `leaves` followed by
+// (width - count) of `pad`.
+SHA256Bytes GetMerkleRoot(const SHA256Bytes* leaves, std::size_t count
+    , std::size_t width, const SHA256Bytes& pad = {});
+// Root of the tree of `width` zero leaves; the pad of the upper layers
+// (e.g., of the 'piece layers' hashes).
+SHA256Bytes GetMerklePadRoot(std::size_t width);
+// Leaves of the `data`: SHA-256 of every 16 KiB block, appended to `leaves`.
+void GetMerkleLeaves(const std::uint8_t* data, std::size_t size
+    , std::vector<SHA256Bytes>& leaves);
@@ -1,22 +1,7 @@
 #include <small_utils/utils_bytes.h>
 
-#include <TinySHA1.hpp>
-
 #include <cstring>
 
-SHA1Bytes GetSHA1(std::string_view data)
-{
-    SHA1Bytes bytes{};
-    if (data.empty())
-    {
-        return bytes;
-    }
-    sha1::SHA1 sha1;
-    sha1.processBytes(data.data(), data.size())
-        .getDigestBytes(bytes.data_);
-    return bytes;
-}
-
 PeerId GetRandomPeerId(std::random_device& random)
 {
     PeerId peer;
@@ -1,5 +1,7 @@
 #include <small_utils/utils_read_file.h>
 
+#include <utility>
+
 FileBuffer::FileBuffer(FileBuffer&& rhs) noexcept
     : data_(std::exchange(rhs.data_, nullptr))
     , size_(std::exchange(rhs.size_, 0))
@@ -0,0 +1,586 @@
+#include <small_utils/utils_sha1.h>
+
+#include <TinySHA1.hpp>
+
+#include <algorithm>
+#include <utility>
+
+#include <cstring>
+#include <cassert>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#  define SHA1_X86 1
+#  include <immintrin.h>
+#  if defined(_MSC_VER)
+#    include <intrin.h>
+#  else
+#    include <cpuid.h>
+#  endif
+#else
+#  define SHA1_X86 0
+#endif
+
+#if SHA1_X86 && !(defined(_MSC_VER) && !defined(__clang__))
+// Kernels are compiled for the instructions they use;
+// they run only if the CPU has them.
+#  define SHA1_TARGET(features) __attribute__((target(features)))
+#else
+#  define SHA1_TARGET(features)
+#endif
+
+namespace
+{
+    const std::uint32_t k_initial_state[5] =
+        {0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0};
+    const std::size_t k_block_size = 64;
+
+    std::uint32_t ReadBig32(const std::uint8_t* data)
+    {
+        return (std::uint32_t(data[0]) << 24)
+            | (std::uint32_t(data[1]) << 16)
+            | (std::uint32_t(data[2]) << 8)
+            | std::uint32_t(data[3]);
+    }
+
+    void WriteBig32(std::uint8_t* data, std::uint32_t v)
+    {
+        data[0] = std::uint8_t(v >> 24);
+        data[1] = std::uint8_t(v >> 16);
+        data[2] = std::uint8_t(v >> 8);
+        data[3] = std::uint8_t(v);
+    }
+
+    // Message padding: the rest of the data (< 64 bytes), 0x80, zeros
+    // and the length in bits. Returns the number of blocks (1 or 2) in `tail`.
+    std::size_t MakeTail(const std::uint8_t* rest, std::size_t rest_size
+        , std::uint64_t total_size, std::uint8_t (&tail)[2 * k_block_size])
+    {
+        assert(rest_size < k_block_size);
+        std::memset(tail, 0, sizeof(tail));
+        if (rest_size > 0)
+        {
+            std::memcpy(tail, rest, rest_size);
+        }
+        tail[rest_size] = 0x80;
+        const std::size_t blocks = ((rest_size + 1 + 8) <= k_block_size) ? 1 : 2;
+        const std::uint64_t bits = (total_size * 8);
+        std::uint8_t* length = tail + (blocks * k_block_size) - 8;
+        WriteBig32(length, std::uint32_t(bits >> 32));
+        WriteBig32(length + 4, std::uint32_t(bits));
+        return blocks;
+    }
+
+    // Processes `count` 64-byte blocks.
+    using CompressBlocks = void (*)(std::uint32_t (&state)[5]
+        , const std::uint8_t* blocks, std::size_t count);
+
+    // Streaming on top of the block function, for backends
+    // other than Scalar.
+    struct SHA1Stream
+    {
+        CompressBlocks compress_ = nullptr;
+        std::uint32_t state_[5]{};
+        std::uint8_t block_[k_block_size]{};
+        std::size_t block_size_ = 0;
+        std::uint64_t total_size_ = 0;
+
+        explicit SHA1Stream(CompressBlocks compress)
+            : compress_(compress)
+        {
+            reset();
+        }
+
+        void reset()
+        {
+            std::memcpy(state_, k_initial_state, sizeof(state_));
+            block_size_ = 0;
+            total_size_ = 0;
+        }
+
+        void update(const std::uint8_t* data, std::size_t size)
+        {
+            total_size_ += size;
+            if (block_size_ > 0)
+            {
+                const std::size_t take = std::min(size, k_block_size - block_size_);
+                std::memcpy(block_ + block_size_, data, take);
+                block_size_ += take;
+                data += take;
+                size -= take;
+                if (block_size_ < k_block_size)
+                {
+                    return;
+                }
+                compress_(state_, block_, 1);
+                block_size_ = 0;
+            }
+            const std::size_t blocks = (size / k_block_size);
+            if (blocks > 0)
+            {
+                compress_(state_, data, blocks);
+                data += (blocks * k_block_size);
+                size -= (blocks * k_block_size);
+            }
+            if (size > 0)
+            {
+                std::memcpy(block_, data, size);
+                block_size_ = size;
+            }
+        }
+
+        SHA1Bytes finalize()
+        {
+            std::uint8_t tail[2 * k_block_size];
+            const std::size_t blocks = MakeTail(block_, block_size_, total_size_, tail);
+            compress_(state_, tail, blocks);
+            SHA1Bytes bytes{};
+            for (int i = 0; i < 5; ++i)
+            {
+                WriteBig32(bytes.data_ + (i * 4), state_[i]);
+            }
+            reset();
+            return bytes;
+        }
+    };
+
+#if SHA1_X86
+    void CpuId(std::uint32_t leaf, std::uint32_t subleaf, std::uint32_t (&regs)[4])
+    {
+#if defined(_MSC_VER)
+        int data[4]{};
+        __cpuidex(data, int(leaf), int(subleaf));
+        for (int i = 0; i < 4; ++i)
+        {
+            regs[i] = std::uint32_t(data[i]);
+        }
+#else
+        regs[0] = regs[1] = regs[2] = regs[3] = 0;
+        (void)__get_cpuid_count(leaf, subleaf, &regs[0], &regs[1], &regs[2], &regs[3]);
+#endif
+    }
+
+    // OS saves YMM registers on context switch.
+    bool HasOSAVXSupport()
+    {
+        std::uint32_t regs[4]{};
+        CpuId(1, 0, regs);
+        const bool osxsave = (regs[2] & (1u << 27)) != 0;
+        const bool avx = (regs[2] & (1u << 28)) != 0;
+        if (!osxsave || !avx)
+        {
+            return false;
+        }
+#if defined(_MSC_VER)
+        const std::uint64_t xcr0 = _xgetbv(0);
+#else
+        std::uint32_t eax = 0;
+        std::uint32_t edx = 0;
+        __asm__ volatile ("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+        const std::uint64_t xcr0 = (std::uint64_t(edx) << 32) | eax;
+#endif
+        return ((xcr0 & 0x6) == 0x6);
+    }
+
+    struct CpuFeatures
+    {
+        bool sha_ni_ = false;
+        bool avx2_ = false;
+
+        static CpuFeatures detect()
+        {
+            CpuFeatures features;
+            std::uint32_t regs[4]{};
+            CpuId(0, 0, regs);
+            const std::uint32_t max_leaf = regs[0];
+            if (max_leaf < 7)
+            {
+                return features;
+            }
+            std::uint32_t leaf1[4]{};
+            CpuId(1, 0, leaf1);
+            const bool ssse3 = (leaf1[2] & (1u << 9)) != 0;
+            const bool sse41 = (leaf1[2] & (1u << 19)) != 0;
+            CpuId(7, 0, regs);
+            features.sha_ni_ = ssse3 && sse41 && ((regs[1] & (1u << 29)) != 0);
+            features.avx2_ = ((regs[1] & (1u << 5)) != 0) && HasOSAVXSupport();
+            return features;
+        }
+    };
+
+    // 4 rounds (group `G` of 20) with SHA extensions; message schedule
+    // for the next groups is computed in between.
+    template<int G>
+    SHA1_TARGET("sha,sse4.1,ssse3")
+    inline void SHA_NI_Rounds(__m128i& abcd, __m128i (&e)[2], __m128i (&msg)[4])
+    {
+        __m128i& e_current = e[G % 2];
+        if constexpr (G == 0)
+        {
+            e_current = _mm_add_epi32(e_current, msg[0]);
+        }
+        else
+        {
+            e_current = _mm_sha1nexte_epu32(e_current, msg[G % 4]);
+        }
+        e[(G + 1) % 2] = abcd;
+        if constexpr ((G >= 3) && (G <= 18))
+        {
+            msg[(G + 1) % 4] = _mm_sha1msg2_epu32(msg[(G + 1) % 4], msg[G % 4]);
+        }
+        abcd = _mm_sha1rnds4_epu32(abcd, e_current, G / 5);
+        if constexpr ((G >= 1) && (G <= 16))
+        {
+            msg[(G + 3) % 4] = _mm_sha1msg1_epu32(msg[(G + 3) % 4], msg[G % 4]);
+        }
+        if constexpr ((G >= 2) && (G <= 17))
+        {
+            msg[(G + 2) % 4] = _mm_xor_si128(msg[(G + 2) % 4], msg[G % 4]);
+        }
+    }
+
+    template<int... G>
+    SHA1_TARGET("sha,sse4.1,ssse3")
+    inline void SHA_NI_AllRounds(__m128i& abcd, __m128i (&e)[2], __m128i (&msg)[4]
+        , std::integer_sequence<int, G...>)
+    {
+        (SHA_NI_Rounds<G>(abcd, e, msg), ...);
+    }
+
+    SHA1_TARGET("sha,sse4.1,ssse3")
+    void Compress_SHA_NI(std::uint32_t (&state)[5], const std::uint8_t* blocks, std::size_t count)
+    {
+        // Big-endian words.
+        const __m128i k_shuffle = _mm_set_epi64x(0x0001020304050607ll, 0x08090a0b0c0d0e0fll);
+        __m128i abcd = _mm_loadu_si128(reinterpret_cast<const __m128i*>(state));
+        abcd = _mm_shuffle_epi32(abcd, 0x1B);
+        __m128i e_initial = _mm_set_epi32(int(state[4]), 0, 0, 0);
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            const std::uint8_t* block = blocks + (i * k_block_size);
+            const __m128i abcd_saved = abcd;
+            const __m128i e_saved = e_initial;
+            __m128i msg[4];
+            for (int j = 0; j < 4; ++j)
+            {
+                msg[j] = _mm_shuffle_epi8(_mm_loadu_si128(
+                    reinterpret_cast<const __m128i*>(block + (j * 16))), k_shuffle);
+            }
+            __m128i e[2] = {e_initial, _mm_setzero_si128()};
+            SHA_NI_AllRounds(abcd, e, msg, std::make_integer_sequence<int, 20>());
+            // Last group is odd; e[0] holds `abcd` before it.
+            e_initial = _mm_sha1nexte_epu32(e[0], e_saved);
+            abcd = _mm_add_epi32(abcd, abcd_saved);
+        }
+        abcd = _mm_shuffle_epi32(abcd, 0x1B);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(state), abcd);
+        state[4] = std::uint32_t(_mm_extract_epi32(e_initial, 3));
+    }
+
+    const std::size_t k_avx2_lanes = 8;
+
+    SHA1_TARGET("avx2")
+    inline __m256i RotateLeft(__m256i v, int bits)
+    {
+        return _mm256_or_si256(_mm256_slli_epi32(v, bits), _mm256_srli_epi32(v, 32 - bits));
+    }
+
+    // One block for each of 8 lanes; only lanes with all bits of `active` set are updated.
+    SHA1_TARGET("avx2")
+    void Compress_AVX2_x8(__m256i (&state)[5]
+        , const std::uint8_t* const (&blocks)[k_avx2_lanes], __m256i active)
+    {
+        __m256i w[16];
+        for (int t = 0; t < 16; ++t)
+        {
+            const int offset = (t * 4);
+            w[t] = _mm256_set_epi32(
+                  int(ReadBig32(blocks[7] + offset)), int(ReadBig32(blocks[6] + offset))
+                , int(ReadBig32(blocks[5] + offset)), int(ReadBig32(blocks[4] + offset))
+                , int(ReadBig32(blocks[3] + offset)), int(ReadBig32(blocks[2] + offset))
+                , int(ReadBig32(blocks[1] + offset)), int(ReadBig32(blocks[0] + offset)));
+        }
+        __m256i a = state[0];
+        __m256i b = state[1];
+        __m256i c = state[2];
+        __m256i d = state[3];
+        __m256i e = state[4];
+        for (int t = 0; t < 80; ++t)
+        {
+            if (t >= 16)
+            {
+                const __m256i x = _mm256_xor_si256(
+                    _mm256_xor_si256(w[(t - 3) % 16], w[(t - 8) % 16])
+                    , _mm256_xor_si256(w[(t - 14) % 16], w[t % 16]));
+                w[t % 16] = RotateLeft(x, 1);
+            }
+            __m256i f;
+            std::uint32_t k = 0;
+            if (t < 20)
+            {
+                f = _mm256_xor_si256(d, _mm256_and_si256(b, _mm256_xor_si256(c, d)));
+                k = 0x5A827999;
+            }
+            else if (t < 40)
+            {
+                f = _mm256_xor_si256(b, _mm256_xor_si256(c, d));
+                k = 0x6ED9EBA1;
+            }
+            else if (t < 60)
+            {
+                f = _mm256_or_si256(_mm256_and_si256(b, c), _mm256_and_si256(d, _mm256_or_si256(b, c)));
+                k = 0x8F1BBCDC;
+            }
+            else
+            {
+                f = _mm256_xor_si256(b, _mm256_xor_si256(c, d));
+                k = 0xCA62C1D6;
+            }
+            __m256i temp = _mm256_add_epi32(RotateLeft(a, 5), f);
+            temp = _mm256_add_epi32(temp, _mm256_add_epi32(e, w[t % 16]));
+            temp = _mm256_add_epi32(temp, _mm256_set1_epi32(int(k)));
+            e = d;
+            d = c;
+            c = RotateLeft(b, 30);
+            b = a;
+            a = temp;
+        }
+        const __m256i updated[5] = {a, b, c, d, e};
+        for (int i = 0; i < 5; ++i)
+        {
+            state[i] = _mm256_blendv_epi8(state[i]
+                , _mm256_add_epi32(state[i], updated[i]), active);
+        }
+    }
+
+    // Up to 8 buffers of any sizes; shorter ones idle while the rest finish.
+    SHA1_TARGET("avx2")
+    void GetSHA1_AVX2_x8(const std::string_view* data, SHA1Bytes* results, std::size_t count)
+    {
+        assert((count > 0) && (count <= k_avx2_lanes));
+        static const std::uint8_t k_idle_block[k_block_size]{};
+        std::uint8_t tails[k_avx2_lanes][2 * k_block_size];
+        std::size_t full_blocks[k_avx2_lanes]{};
+        std::size_t total_blocks[k_avx2_lanes]{};
+        std::size_t max_blocks = 0;
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            const std::size_t size = data[i].size();
+            const auto* bytes = reinterpret_cast<const std::uint8_t*>(data[i].data());
+            full_blocks[i] = (size / k_block_size);
+            total_blocks[i] = full_blocks[i] + MakeTail(bytes + (full_blocks[i] * k_block_size)
+                , (size % k_block_size), size, tails[i]);
+            max_blocks = std::max(max_blocks, total_blocks[i]);
+        }
+
+        __m256i state[5];
+        for (int i = 0; i < 5; ++i)
+        {
+            state[i] = _mm256_set1_epi32(int(k_initial_state[i]));
+        }
+        for (std::size_t block = 0; block < max_blocks; ++block)
+        {
+            const std::uint8_t* blocks[k_avx2_lanes];
+            alignas(32) std::int32_t active[k_avx2_lanes]{};
+            for (std::size_t i = 0; i < k_avx2_lanes; ++i)
+            {
+                blocks[i] = k_idle_block;
+                if ((i >= count) || (block >= total_blocks[i]))
+                {
+                    continue;
+                }
+                active[i] = -1;
+                blocks[i] = (block < full_blocks[i])
+                    ? reinterpret_cast<const std::uint8_t*>(data[i].data()) + (block * k_block_size)
+                    : tails[i] + ((block - full_blocks[i]) * k_block_size);
+            }
+            Compress_AVX2_x8(state, blocks
+                , _mm256_load_si256(reinterpret_cast<const __m256i*>(active)));
+        }
+
+        alignas(32) std::uint32_t words[5][k_avx2_lanes];
+        for (int i = 0; i < 5; ++i)
+        {
+            _mm256_store_si256(reinterpret_cast<__m256i*>(words[i]), state[i]);
+        }
+        for (std::size_t lane = 0; lane < count; ++lane)
+        {
+            for (int i = 0; i < 5; ++i)
+            {
+                WriteBig32(results[lane].data_ + (i * 4), words[i][lane]);
+            }
+        }
+    }
+
+    const CpuFeatures& GetCpuFeatures()
+    {
+        static const CpuFeatures features = CpuFeatures::detect();
+        return features;
+    }
+#endif // SHA1_X86
+
+    CompressBlocks GetCompressBlocks(SHA1Backend backend)
+    {
+#if SHA1_X86
+        if (backend == SHA1Backend::SHA_NI)
+        {
+            return &Compress_SHA_NI;
+        }
+#endif
+        (void)backend;
+        return nullptr;
+    }
+} // namespace
+
+bool IsSHA1BackendSupported(SHA1Backend backend)
+{
+    switch (backend)
+    {
+    case SHA1Backend::Scalar: return true;
+#if SHA1_X86
+    case SHA1Backend::SHA_NI: return GetCpuFeatures().sha_ni_;
+    case SHA1Backend::AVX2_x8: return GetCpuFeatures().avx2_;
+#endif
+    default: return false;
+    }
+}
+
+SHA1Backend GetSHA1Backend()
+{
+    static const SHA1Backend backend = IsSHA1BackendSupported(SHA1Backend::SHA_NI)
+        ? SHA1Backend::SHA_NI
+        : SHA1Backend::Scalar;
+    return backend;
+}
+
+std::size_t GetSHA1Lanes()
+{
+    // SHA extensions on a single buffer are faster than
+    // 8 lanes of AVX2; batch only without them.
+    if ((GetSHA1Backend() == SHA1Backend::Scalar)
+        && IsSHA1BackendSupported(SHA1Backend::AVX2_x8))
+    {
+        return 8;
+    }
+    return 1;
+}
+
+SHA1Bytes GetSHA1(SHA1Backend backend, const std::string_view* parts, std::size_t count)
+{
+    assert(IsSHA1BackendSupported(backend));
+    if (CompressBlocks compress = GetCompressBlocks(backend))
+    {
+        SHA1Stream stream(compress);
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            stream.update(reinterpret_cast<const std::uint8_t*>(parts[i].data()), parts[i].size());
+        }
+        return stream.finalize();
+    }
+    // Scalar; also for AVX2_x8, which has no gain on a single buffer.
+    SHA1Bytes bytes{};
+    sha1::SHA1 sha1;
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        sha1.processBytes(parts[i].data(), parts[i].size());
+    }
+    sha1.getDigestBytes(bytes.data_);
+    return bytes;
+}
+
+void GetSHA1Many(SHA1Backend backend
+    , const std::string_view* data, SHA1Bytes* results, std::size_t count)
+{
+    assert(IsSHA1BackendSupported(backend));
+#if SHA1_X86
+    if (backend == SHA1Backend::AVX2_x8)
+    {
+        for (std::size_t i = 0; i < count; i += k_avx2_lanes)
+        {
+            GetSHA1_AVX2_x8(data + i, results + i, std::min(k_avx2_lanes, count - i));
+        }
+    }
+    else
+#endif
+    {
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            results[i] = GetSHA1(backend, &data[i], 1);
+        }
+    }
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        if (data[i].empty())
+        {
+            // Same as GetSHA1(std::string_view).
+            results[i] = SHA1Bytes();
+        }
+    }
+}
+
+void GetSHA1Many(const std::string_view* data, SHA1Bytes* results, std::size_t count)
+{
+    const SHA1Backend backend = (GetSHA1Lanes() > 1)
+        ? SHA1Backend::AVX2_x8
+        : GetSHA1Backend();
+    GetSHA1Many(backend, data, results, count);
+}
+
+SHA1Bytes GetSHA1(std::string_view data)
+{
+    if (data.empty())
+    {
+        return SHA1Bytes();
+    }
+    return GetSHA1(GetSHA1Backend(), &data, 1);
+}
+
+SHA1Bytes GetSHA1(const std::string_view* parts, std::size_t count)
+{
+    return GetSHA1(GetSHA1Backend(), parts, count);
+}
+
+struct SHA1Hasher::Impl
+{
+    // Either one.
+    sha1::SHA1 scalar_;
+    SHA1Stream stream_;
+
+    Impl()
+        : scalar_()
+        , stream_(GetCompressBlocks(GetSHA1Backend()))
+    {
+    }
+};
+
+SHA1Hasher::SHA1Hasher()
+    : impl_(std::make_unique<Impl>())
+{
+}
+
+SHA1Hasher::~SHA1Hasher() = default;
+SHA1Hasher::SHA1Hasher(SHA1Hasher&&) noexcept = default;
+SHA1Hasher& SHA1Hasher::operator=(SHA1Hasher&&) noexcept = default;
+
+void SHA1Hasher::update(const void* data, std::size_t size)
+{
+    assert(impl_);
+    if (impl_->stream_.compress_)
+    {
+        impl_->stream_.update(static_cast<const std::uint8_t*>(data), size);
+        return;
+    }
+    impl_->scalar_.processBytes(data, size);
+}
+
+SHA1Bytes SHA1Hasher::finalize()
+{
+    assert(impl_);
+    if (impl_->stream_.compress_)
+    {
+        return impl_->stream_.finalize();
+    }
+    SHA1Bytes bytes{};
+    impl_->scalar_.getDigestBytes(bytes.data_);
+    impl_->scalar_.reset();
+    return bytes;
+}
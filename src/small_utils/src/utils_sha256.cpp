@@ -0,0 +1,339 @@
+#include <small_utils/utils_sha256.h>
+#include <small_utils/utils_sha1.h>
+
+#include <algorithm>
+
+#include <cstring>
+#include <cassert>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#  define SHA256_X86 1
+#  include <immintrin.h>
+#else
+#  define SHA256_X86 0
+#endif
+
+#if SHA256_X86 && !(defined(_MSC_VER) && !defined(__clang__))
+#  define SHA256_TARGET(features) __attribute__((target(features)))
+#else
+#  define SHA256_TARGET(features)
+#endif
+
+namespace
+{
+    const std::uint32_t k_initial_state[8] =
+    {
+        0x6A09E667, 0xBB67AE85, 0x3C6EF372, 0xA54FF53A,
+        0x510E527F, 0x9B05688C, 0x1F83D9AB, 0x5BE0CD19,
+    };
+
+    alignas(16) const std::uint32_t k_round_constants[64] =
+    {
+        0x428A2F98, 0x71374491, 0xB5C0FBCF, 0xE9B5DBA5, 0x3956C25B, 0x59F111F1, 0x923F82A4, 0xAB1C5ED5,
+        0xD807AA98, 0x12835B01, 0x243185BE, 0x550C7DC3, 0x72BE5D74, 0x80DEB1FE, 0x9BDC06A7, 0xC19BF174,
+        0xE49B69C1, 0xEFBE4786, 0x0FC19DC6, 0x240CA1CC, 0x2DE92C6F, 0x4A7484AA, 0x5CB0A9DC, 0x76F988DA,
+        0x983E5152, 0xA831C66D, 0xB00327C8, 0xBF597FC7, 0xC6E00BF3, 0xD5A79147, 0x06CA6351, 0x14292967,
+        0x27B70A85, 0x2E1B2138, 0x4D2C6DFC, 0x53380D13, 0x650A7354, 0x766A0ABB, 0x81C2C92E, 0x92722C85,
+        0xA2BFE8A1, 0xA81A664B, 0xC24B8B70, 0xC76C51A3, 0xD192E819, 0xD6990624, 0xF40E3585, 0x106AA070,
+        0x19A4C116, 0x1E376C08, 0x2748774C, 0x34B0BCB5, 0x391C0CB3, 0x4ED8AA4A, 0x5B9CCA4F, 0x682E6FF3,
+        0x748F82EE, 0x78A5636F, 0x84C87814, 0x8CC70208, 0x90BEFFFA, 0xA4506CEB, 0xBEF9A3F7, 0xC67178F2,
+    };
+
+    const std::size_t k_block_size = 64;
+
+    std::uint32_t ReadBig32(const std::uint8_t* data)
+    {
+        return (std::uint32_t(data[0]) << 24)
+            | (std::uint32_t(data[1]) << 16)
+            | (std::uint32_t(data[2]) << 8)
+            | std::uint32_t(data[3]);
+    }
+
+    void WriteBig32(std::uint8_t* data, std::uint32_t v)
+    {
+        data[0] = std::uint8_t(v >> 24);
+        data[1] = std::uint8_t(v >> 16);
+        data[2] = std::uint8_t(v >> 8);
+        data[3] = std::uint8_t(v);
+    }
+
+    std::uint32_t RotateRight(std::uint32_t v, int bits)
+    {
+        return ((v >> bits) | (v << (32 - bits)));
+    }
+
+    void Compress_Scalar(std::uint32_t (&state)[8], const std::uint8_t* blocks, std::size_t count)
+    {
+        for (; count > 0; --count, blocks += k_block_size)
+        {
+            std::uint32_t w[64];
+            for (int i = 0; i < 16; ++i)
+            {
+                w[i] = ReadBig32(blocks + (i * 4));
+            }
+            for (int i = 16; i < 64; ++i)
+            {
+                const std::uint32_t s0 = RotateRight(w[i - 15], 7)
+                    ^ RotateRight(w[i - 15], 18) ^ (w[i - 15] >> 3);
+                const std::uint32_t s1 = RotateRight(w[i - 2], 17)
+                    ^ RotateRight(w[i - 2], 19) ^ (w[i - 2] >> 10);
+                w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+            }
+            std::uint32_t v[8];
+            std::memcpy(v, state, sizeof(v));
+            for (int i = 0; i < 64; ++i)
+            {
+                const std::uint32_t s1 = RotateRight(v[4], 6) ^ RotateRight(v[4], 11) ^ RotateRight(v[4], 25);
+                const std::uint32_t ch = (v[4] & v[5]) ^ (~v[4] & v[6]);
+                const std::uint32_t t1 = v[7] + s1 + ch + k_round_constants[i] + w[i];
+                const std::uint32_t s0 = RotateRight(v[0], 2) ^ RotateRight(v[0], 13) ^ RotateRight(v[0], 22);
+                const std::uint32_t maj = (v[0] & v[1]) ^ (v[0] & v[2]) ^ (v[1] & v[2]);
+                const std::uint32_t t2 = s0 + maj;
+                v[7] = v[6];
+                v[6] = v[5];
+                v[5] = v[4];
+                v[4] = v[3] + t1;
+                v[3] = v[2];
+                v[2] = v[1];
+                v[1] = v[0];
+                v[0] = t1 + t2;
+            }
+            for (int i = 0; i < 8; ++i)
+            {
+                state[i] += v[i];
+            }
+        }
+    }
+
+#if SHA256_X86
+    // Four rounds `i` (of 16) with the message schedule, as in
+    // Intel's "SHA Extensions" reference code.
+    SHA256_TARGET("sha,sse4.1,ssse3")
+    inline void SHA_NI_Rounds(int i, __m128i& state0, __m128i& state1, __m128i (&msg)[4])
+    {
+        __m128i k = _mm_load_si128(reinterpret_cast<const __m128i*>(k_round_constants + (i * 4)));
+        __m128i m = _mm_add_epi32(msg[i % 4], k);
+        state1 = _mm_sha256rnds2_epu32(state1, state0, m);
+        if ((i >= 3) && (i <= 14))
+        {
+            const __m128i tmp = _mm_alignr_epi8(msg[i % 4], msg[(i + 3) % 4], 4);
+            __m128i& next = msg[(i + 1) % 4];
+            next = _mm_add_epi32(next, tmp);
+            next = _mm_sha256msg2_epu32(next, msg[i % 4]);
+        }
+        m = _mm_shuffle_epi32(m, 0x0E);
+        state0 = _mm_sha256rnds2_epu32(state0, state1, m);
+        if ((i >= 1) && (i <= 12))
+        {
+            __m128i& prev = msg[(i + 3) % 4];
+            prev = _mm_sha256msg1_epu32(prev, msg[i % 4]);
+        }
+    }
+
+    SHA256_TARGET("sha,sse4.1,ssse3")
+    void Compress_SHA_NI(std::uint32_t (&state)[8], const std::uint8_t* blocks, std::size_t count)
+    {
+        const __m128i byte_swap = _mm_set_epi64x(0x0C0D0E0F08090A0BULL, 0x0405060700010203ULL);
+        // ABEF and CDGH, as sha256rnds2 wants.
+        __m128i tmp = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&state[0]));
+        __m128i state1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&state[4]));
+        tmp = _mm_shuffle_epi32(tmp, 0xB1);
+        state1 = _mm_shuffle_epi32(state1, 0x1B);
+        __m128i state0 = _mm_alignr_epi8(tmp, state1, 8);
+        state1 = _mm_blend_epi16(state1, tmp, 0xF0);
+
+        for (; count > 0; --count, blocks += k_block_size)
+        {
+            const __m128i abef = state0;
+            const __m128i cdgh = state1;
+            __m128i msg[4];
+            for (int i = 0; i < 4; ++i)
+            {
+                msg[i] = _mm_shuffle_epi8(_mm_loadu_si128(
+                    reinterpret_cast<const __m128i*>(blocks + (i * 16))), byte_swap);
+            }
+            for (int i = 0; i < 16; ++i)
+            {
+                SHA_NI_Rounds(i, state0, state1, msg);
+            }
+            state0 = _mm_add_epi32(state0, abef);
+            state1 = _mm_add_epi32(state1, cdgh);
+        }
+
+        tmp = _mm_shuffle_epi32(state0, 0x1B);
+        state1 = _mm_shuffle_epi32(state1, 0xB1);
+        state0 = _mm_blend_epi16(tmp, state1, 0xF0);
+        state1 = _mm_alignr_epi8(state1, tmp, 8);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(&state[0]), state0);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(&state[4]), state1);
+    }
+#endif
+
+    using CompressBlocks = void (*)(std::uint32_t (&state)[8]
+        , const std::uint8_t* blocks, std::size_t count);
+
+    CompressBlocks GetCompressBlocks()
+    {
+#if SHA256_X86
+        // SHA extensions have both SHA1 and SHA-256 instructions.
+        static const CompressBlocks compress = IsSHA1BackendSupported(SHA1Backend::SHA_NI)
+            ? &Compress_SHA_NI
+            : &Compress_Scalar;
+        return compress;
+#else
+        return &Compress_Scalar;
+#endif
+    }
+} // namespace
+
+SHA256Hasher::SHA256Hasher()
+{
+    reset();
+}
+
+void SHA256Hasher::reset()
+{
+    std::memcpy(state_, k_initial_state, sizeof(state_));
+    block_size_ = 0;
+    total_size_ = 0;
+}
+
+void SHA256Hasher::update(const void* data_ptr, std::size_t size)
+{
+    const CompressBlocks compress = GetCompressBlocks();
+    const std::uint8_t* data = static_cast<const std::uint8_t*>(data_ptr);
+    total_size_ += size;
+    if (block_size_ > 0)
+    {
+        const std::size_t take = std::min(size, k_block_size - block_size_);
+        std::memcpy(block_ + block_size_, data, take);
+        block_size_ += take;
+        data += take;
+        size -= take;
+        if (block_size_ < k_block_size)
+        {
+            return;
+        }
+        compress(state_, block_, 1);
+        block_size_ = 0;
+    }
+    const std::size_t blocks = (size / k_block_size);
+    if (blocks > 0)
+    {
+        compress(state_, data, blocks);
+        data += (blocks * k_block_size);
+        size -= (blocks * k_block_size);
+    }
+    if (size > 0)
+    {
+        std::memcpy(block_, data, size);
+        block_size_ = size;
+    }
+}
+
+SHA256Bytes SHA256Hasher::finalize()
+{
+    // Same padding as SHA1: 0x80, zeros and the length in bits.
+    std::uint8_t tail[2 * k_block_size]{};
+    if (block_size_ > 0)
+    {
+        std::memcpy(tail, block_, block_size_);
+    }
+    tail[block_size_] = 0x80;
+    const std::size_t blocks = ((block_size_ + 1 + 8) <= k_block_size) ? 1 : 2;
+    const std::uint64_t bits = (total_size_ * 8);
+    std::uint8_t* length = tail + (blocks * k_block_size) - 8;
+    WriteBig32(length, std::uint32_t(bits >> 32));
+    WriteBig32(length + 4, std::uint32_t(bits));
+    GetCompressBlocks()(state_, tail, blocks);
+
+    SHA256Bytes bytes{};
+    for (int i = 0; i < 8; ++i)
+    {
+        WriteBig32(bytes.data_ + (i * 4), state_[i]);
+    }
+    reset();
+    return bytes;
+}
+
+SHA256Bytes GetSHA256(std::string_view data)
+{
+    return GetSHA256(&data, 1);
+}
+
+SHA256Bytes GetSHA256(const std::string_view* parts, std::size_t count)
+{
+    SHA256Hasher hasher;
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        hasher.update(parts[i].data(), parts[i].size());
+    }
+    return hasher.finalize();
+}
+
+std::size_t GetMerkleWidth(std::size_t count)
+{
+    std::size_t width = 1;
+    while (width < count)
+    {
+        width *= 2;
+    }
+    return width;
+}
+
+static SHA256Bytes HashPair(const SHA256Bytes& left, const SHA256Bytes& right)
+{
+    SHA256Hasher hasher;
+    hasher.update(left.data_, sizeof(left.data_));
+    hasher.update(right.data_, sizeof(right.data_));
+    return hasher.finalize();
+}
+
+SHA256Bytes GetMerkleRoot(const SHA256Bytes* leaves, std::size_t count
+    , std::size_t width, const SHA256Bytes& pad /*= {}*/)
+{
+    assert(count <= width);
+    assert(GetMerkleWidth(width) == width);
+    if (count == 0)
+    {
+        return GetMerkleRoot(&pad, 1, width, pad);
+    }
+    std::vector<SHA256Bytes> layer(leaves, leaves + count);
+    SHA256Bytes layer_pad = pad;
+    for (; width > 1; width /= 2)
+    {
+        // Only the nodes that have real leaves under them; the rest are pads.
+        const std::size_t next_count = ((layer.size() + 1) / 2);
+        for (std::size_t i = 0; i < next_count; ++i)
+        {
+            const std::size_t right = (2 * i + 1);
+            layer[i] = HashPair(layer[2 * i]
+                , ((right < layer.size()) ? layer[right] : layer_pad));
+        }
+        layer.resize(next_count);
+        layer_pad = HashPair(layer_pad, layer_pad);
+    }
+    return layer[0];
+}
+
+SHA256Bytes GetMerklePadRoot(std::size_t width)
+{
+    assert(GetMerkleWidth(width) == width);
+    SHA256Bytes root{};
+    for (; width > 1; width /= 2)
+    {
+        root = HashPair(root, root);
+    }
+    return root;
+}
+
+void GetMerkleLeaves(const std::uint8_t* data, std::size_t size
+    , std::vector<SHA256Bytes>& leaves)
+{
+    for (std::size_t offset = 0; offset < size; offset += k_merkle_block_size)
+    {
+        const std::size_t block = std::min<std::size_t>(k_merkle_block_size, size - offset);
+        leaves.push_back(GetSHA256(std::string_view(
+            reinterpret_cast<const char*>(data + offset), block)));
+    }
+}
@@ -49,3 +49,115 @@ TEST(Torrent, NormalMultiFileTorrent)
     ASSERT_EQ("32f6dbf1412d24a370c12cc90d289affb4806284"
         , GetSHA1(buffer, result.value().info_position_));
 }
+
+TEST(Torrent, PaddingFilesAttr)
+{
+    const std::string content =
+        "d8:announce13:http://a/annp"
+        "4:infod"
+            "5:filesl"
+                "d6:lengthi5e4:pathl1:aee"
+                "d4:attr1:p6:lengthi11e4:pathl4:.pad2:11ee"
+                "d4:attr2:xh6:lengthi3e4:pathl1:bee"
+            "e"
+            "4:name1:t"
+            "12:piece lengthi16e"
+            "6:pieces20:" + std::string(20, 'h') +
+        "ee";
+    auto result = ParseTorrentFileContent(content);
+    ASSERT_TRUE(result);
+
+    using File = TorrentMetainfo::File;
+    const auto& files = std::get<std::vector<File>>(
+        result.value().metainfo_.info_.length_or_files_);
+    ASSERT_EQ(3u, files.size());
+    ASSERT_FALSE(files[0].is_padding());
+    ASSERT_TRUE(files[1].is_padding());
+    ASSERT_EQ(11u, files[1].length_bytes_);
+    ASSERT_EQ("xh", files[2].attr_);
+    ASSERT_FALSE(files[2].is_padding());
+}
+
+TEST(Torrent, V2FileTreeAndPieceLayers)
+{
+    const std::string root(32, 'r');
+    const std::string content =
+        "d8:announce12:http://a/ann"
+        "4:infod"
+            "9:file treed"
+                "1:ad0:d6:lengthi20000e11:pieces root32:" + root + "ee"
+                "3:dird1:bd0:d6:lengthi0eeee"
+            "e"
+            "12:meta versioni2e"
+            "4:name1:t"
+            "12:piece lengthi16384e"
+        "e"
+        "12:piece layersd32:" + root + "64:" + std::string(64, 'l') + "e"
+        "e";
+    auto result = ParseTorrentFileContent(content);
+    ASSERT_TRUE(result);
+    const TorrentMetainfo& metainfo = result.value().metainfo_;
+    ASSERT_TRUE(metainfo.has_v2());
+    ASSERT_FALSE(metainfo.has_v1());
+
+    using File = TorrentMetainfo::File;
+    const std::vector<File>& tree = metainfo.info_.file_tree_;
+    ASSERT_EQ(2u, tree.size());
+    ASSERT_EQ("a", tree[0].path_utf8_);
+    ASSERT_EQ(32u, tree[0].pieces_root_.size());
+    ASSERT_EQ("dir/b", tree[1].path_utf8_);
+    ASSERT_TRUE(tree[1].pieces_root_.empty());
+
+    // v1 layout: files start at the piece boundaries.
+    const auto& files = std::get<std::vector<File>>(metainfo.info_.length_or_files_);
+    ASSERT_EQ(3u, files.size());
+    ASSERT_EQ(tree[0].pieces_root_, files[0].pieces_root_);
+    ASSERT_TRUE(files[1].is_padding());
+    ASSERT_EQ(2 * 16384u - 20000u, files[1].length_bytes_);
+    ASSERT_EQ("dir/b", files[2].path_utf8_);
+
+    ASSERT_EQ(1u, metainfo.piece_layers_.size());
+    ASSERT_EQ(64u, metainfo.piece_layers_.begin()->second.size());
+}
+
+TEST(Torrent, V2HybridMatchesFiles)
+{
+    const std::string root(32, 'r');
+    auto make = [&](const char* v1_length)
+    {
+        return "d8:announce12:http://a/ann"
+            "4:infod"
+                "9:file treed1:td0:d6:lengthi5e11:pieces root32:" + root + "eee"
+                "6:length" + v1_length +
+                "12:meta versioni2e"
+                "4:name1:t"
+                "12:piece lengthi16384e"
+                "6:pieces20:" + std::string(20, 'h') +
+            "ee";
+    };
+    auto hybrid = ParseTorrentFileContent(make("i5e"));
+    ASSERT_TRUE(hybrid);
+    ASSERT_TRUE(hybrid.value().metainfo_.has_v1());
+    ASSERT_TRUE(hybrid.value().metainfo_.has_v2());
+    ASSERT_EQ(5u, std::get<std::uint64_t>(hybrid.value().metainfo_.info_.length_or_files_));
+
+    // v1 and v2 files differ.
+    auto mismatch = ParseTorrentFileContent(make("i6e"));
+    ASSERT_FALSE(mismatch);
+    ASSERT_EQ(ParseErrorc::InvalidFileTree, mismatch.error());
+}
+
+TEST(Torrent, V2InvalidPiecesRoot)
+{
+    const std::string content =
+        "d8:announce12:http://a/ann"
+        "4:infod"
+            "9:file treed1:td0:d6:lengthi5e11:pieces root3:abceee"
+            "12:meta versioni2e"
+            "4:name1:t"
+            "12:piece lengthi16384e"
+        "ee";
+    auto result = ParseTorrentFileContent(content);
+    ASSERT_FALSE(result);
+    ASSERT_EQ(ParseErrorc::InvalidPiecesRoot, result.error());
+}
@@ -0,0 +1,49 @@
+#include <bencoding/be_tracker_response_parse.h>
+
+#include <gtest/gtest.h>
+
+using namespace be;
+
+TEST(Tracker, ScrapeResponse)
+{
+    const std::string hash_a(20, 'a');
+    const std::string hash_b(20, 'b');
+    const std::string content =
+        "d5:filesd"
+            "20:" + hash_a + "d8:completei5e10:downloadedi50e10:incompletei10ee"
+            "20:" + hash_b + "d8:completei0e10:downloadedi1e10:incompletei2e4:name1:xe"
+        "ee";
+    auto result = ParseTrackerScrapeResponseContent(content);
+    ASSERT_TRUE(result);
+
+    const auto& files = std::get<ScrapeResponse::OnSuccess>(result.value().data_).files_;
+    ASSERT_EQ(2u, files.size());
+    ASSERT_EQ(hash_a, files[0].info_hash_);
+    ASSERT_EQ(5u, files[0].complete_);
+    ASSERT_EQ(50u, files[0].downloaded_);
+    ASSERT_EQ(10u, files[0].incomplete_);
+    ASSERT_EQ(hash_b, files[1].info_hash_);
+    ASSERT_EQ(0u, files[1].complete_);
+    ASSERT_EQ(1u, files[1].downloaded_);
+    ASSERT_EQ(2u, files[1].incomplete_);
+}
+
+TEST(Tracker, ScrapeResponseNoFiles)
+{
+    auto result = ParseTrackerScrapeResponseContent("d5:filesdee");
+    ASSERT_TRUE(result);
+    ASSERT_TRUE(std::get<ScrapeResponse::OnSuccess>(result.value().data_).files_.empty());
+}
+
+TEST(Tracker, ScrapeResponseFailure)
+{
+    auto result = ParseTrackerScrapeResponseContent("d14:failure reason4:nopee");
+    ASSERT_TRUE(result);
+    ASSERT_EQ("nope", std::get<ScrapeResponse::OnError>(result.value().data_).error_);
+}
+
+TEST(Tracker, ScrapeResponseInvalid)
+{
+    ASSERT_FALSE(ParseTrackerScrapeResponseContent("d5:filesd3:abcdeee"));
+    ASSERT_FALSE(ParseTrackerScrapeResponseContent("d8:intervali5ee"));
+}
@@ -0,0 +1,221 @@
+#include "arc_policy.h"
+#include "disk_io.h"
+#include "files_list.h"
+#include "files_on_disk.h"
+#include "piece_buffer_pool.h"
+#include "test_torrent.h"
+
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <optional>
+#include <vector>
+
+#include <cstring>
+
+using List = ArcPolicy::List;
+
+TEST(ArcPolicy, SecondHitPromotesToT2)
+{
+    ArcPolicy arc(2);
+    std::vector<std::uint32_t> evicted;
+    arc.insert(1, evicted);
+    ASSERT_EQ(arc.find(1), List::T1);
+    arc.on_hit(1, false/*first_use*/);
+    ASSERT_EQ(arc.find(1), List::T2);
+    ASSERT_TRUE(evicted.empty());
+}
+
+TEST(ArcPolicy, ReadAheadFirstUseStaysInT1)
+{
+    ArcPolicy arc(2);
+    std::vector<std::uint32_t> evicted;
+    arc.insert(1, evicted);
+    arc.on_hit(1, true/*first_use*/);
+    ASSERT_EQ(arc.find(1), List::T1);
+    // Second use is a real one.
+    arc.on_hit(1, false/*first_use*/);
+    ASSERT_EQ(arc.find(1), List::T2);
+}
+
+TEST(ArcPolicy, ScanDoesNotEvictFrequentPieces)
+{
+    ArcPolicy arc(2);
+    std::vector<std::uint32_t> evicted;
+    arc.insert(1, evicted);
+    arc.on_hit(1, false/*first_use*/);
+    for (std::uint32_t piece_index = 10; piece_index < 20; ++piece_index)
+    {
+        arc.insert(piece_index, evicted);
+    }
+    ASSERT_TRUE(arc.is_resident(1));
+    ASSERT_EQ(arc.find(1), List::T2);
+}
+
+TEST(ArcPolicy, GhostHitsAdaptTarget)
+{
+    ArcPolicy arc(2);
+    std::vector<std::uint32_t> evicted;
+    arc.insert(1, evicted);
+    arc.on_hit(1, false/*first_use*/);
+    arc.insert(2, evicted);
+    // Full: LRU of T1 goes to the B1 ghosts.
+    arc.insert(3, evicted);
+    ASSERT_EQ(evicted, std::vector<std::uint32_t>({2}));
+    ASSERT_EQ(arc.find(2), List::B1);
+    ASSERT_FALSE(arc.is_resident(2));
+    ASSERT_EQ(arc.target_t1_size(), 0u);
+
+    // B1 hit: T1 should have been bigger.
+    evicted.clear();
+    arc.insert(2, evicted);
+    ASSERT_EQ(arc.target_t1_size(), 1u);
+    ASSERT_EQ(arc.find(2), List::T2);
+    ASSERT_EQ(evicted, std::vector<std::uint32_t>({1}));
+    ASSERT_EQ(arc.find(1), List::B2);
+    ASSERT_EQ(arc.find(3), List::T1);
+
+    // B2 hit: T2 should have been bigger.
+    evicted.clear();
+    arc.insert(1, evicted);
+    ASSERT_EQ(arc.target_t1_size(), 0u);
+    ASSERT_EQ(arc.find(1), List::T2);
+    ASSERT_EQ(evicted, std::vector<std::uint32_t>({3}));
+    ASSERT_EQ(arc.find(3), List::B1);
+}
+
+TEST(ArcPolicy, EraseForgetsResidentAndGhost)
+{
+    ArcPolicy arc(1);
+    std::vector<std::uint32_t> evicted;
+    arc.insert(1, evicted);
+    arc.on_hit(1, false/*first_use*/);
+    arc.insert(2, evicted);
+    ASSERT_EQ(arc.find(1), List::B2);
+    ASSERT_EQ(arc.find(2), List::T1);
+
+    arc.erase(1);
+    arc.erase(2);
+    ASSERT_EQ(arc.find(1), std::nullopt);
+    ASSERT_EQ(arc.find(2), std::nullopt);
+    // Written piece is not a ghost: inserted as new.
+    arc.insert(1, evicted);
+    ASSERT_EQ(arc.find(1), List::T1);
+}
+
+namespace
+{
+    // Reads are completed by the test; writes complete immediately.
+    class ManualDiskIO final : public DiskIO
+    {
+    public:
+        struct Read
+        {
+            std::uint32_t piece_index_ = 0;
+            std::uint32_t offset_ = 0;
+            std::uint32_t size_ = 0;
+            OnDiskRead on_done_;
+        };
+
+        explicit ManualDiskIO(PieceBufferPool& buffers)
+            : buffers_(&buffers)
+        {
+        }
+
+        void async_write_pieces(std::uint32_t, std::vector<PieceBuffer> pieces
+            , OnDiskWriteRun on_done) override
+        {
+            on_done(std::error_code(), std::move(pieces));
+        }
+
+        void async_write_block(std::uint32_t, std::uint32_t, PieceBuffer data
+            , OnDiskWrite on_done) override
+        {
+            on_done(std::error_code(), std::move(data));
+        }
+
+        void async_read(std::uint32_t piece_index, std::uint32_t offset, std::uint32_t size
+            , OnDiskRead on_done) override
+        {
+            reads_->push_back(Read{piece_index, offset, size, std::move(on_done)});
+        }
+
+        void async_run(DiskJobFunction job, OnDiskJob on_done) override
+        {
+            on_done(job());
+        }
+
+        // Completes the oldest read with bytes equal to `fill`.
+        void complete_read(std::uint8_t fill)
+        {
+            Read read = std::move(reads_->front());
+            reads_->erase(reads_->begin());
+            PieceBuffer data = buffers_->acquire(read.size_);
+            std::memset(data.data_, fill, read.size_);
+            read.on_done_(std::error_code(), std::move(data));
+        }
+
+        PieceBufferPool* buffers_ = nullptr;
+        // Outlives the DiskIO owned by the cache.
+        std::shared_ptr<std::vector<Read>> reads_ = std::make_shared<std::vector<Read>>();
+    };
+} // namespace
+
+TEST(ReadCacheDiskIO, WriteDuringFetchIsNotCached)
+{
+    const std::uint32_t k_piece_size = 32 * 1024;
+    const be::TorrentClient torrent = MakeTestTorrent(k_piece_size, 3 * k_piece_size);
+    const FilesList files_list = FilesList::make(torrent);
+    FilesOnDisk files(files_list);
+    PieceBufferPool buffers(k_piece_size, 4);
+    asio::io_context io_context(1);
+
+    auto backend = std::make_unique<ManualDiskIO>(buffers);
+    ManualDiskIO& manual = *backend;
+    const auto reads = manual.reads_;
+    DiskIOOptions options;
+    options.read_cache_bytes_ = 2 * k_piece_size;
+    options.read_ahead_pieces_ = 0;
+    auto disk = MakeReadCacheDiskIO(io_context, files, buffers, std::move(backend), options);
+
+    std::vector<std::uint8_t> received;
+    auto on_read = [&](std::error_code ec, PieceBuffer data)
+    {
+        ASSERT_FALSE(ec);
+        received.assign(data.data_, data.data_ + data.size_);
+    };
+    disk->async_read(0, 100, 16, on_read);
+    ASSERT_EQ(reads->size(), 1u);
+    // Whole piece is fetched.
+    ASSERT_EQ((*reads)[0].offset_, 0u);
+    ASSERT_EQ((*reads)[0].size_, k_piece_size);
+
+    // Piece changes while it's being read.
+    disk->async_write_piece(0, buffers.acquire(k_piece_size), [](std::error_code, PieceBuffer) {});
+    manual.complete_read(0xAA);
+    // What was read may be old; the block is read again, as requested.
+    ASSERT_EQ(reads->size(), 1u);
+    ASSERT_EQ((*reads)[0].piece_index_, 0u);
+    ASSERT_EQ((*reads)[0].offset_, 100u);
+    ASSERT_EQ((*reads)[0].size_, 16u);
+    ASSERT_TRUE(received.empty());
+    manual.complete_read(0xBB);
+    (void)io_context.poll();
+    ASSERT_EQ(received, std::vector<std::uint8_t>(16, 0xBB));
+
+    // Nothing was cached: next read goes to the disk again.
+    received.clear();
+    disk->async_read(0, 0, 16, on_read);
+    ASSERT_EQ(reads->size(), 1u);
+    manual.complete_read(0xCC);
+    (void)io_context.poll();
+    ASSERT_EQ(received, std::vector<std::uint8_t>(16, 0xCC));
+    ASSERT_EQ(disk->cache_stats().read_misses_, 2u);
+    ASSERT_EQ(disk->cache_stats().read_hits_, 0u);
+
+    // Cached now.
+    disk->async_read(0, 16, 16, on_read);
+    ASSERT_TRUE(reads->empty());
+    (void)io_context.poll();
+    ASSERT_EQ(disk->cache_stats().read_hits_, 1u);
+}
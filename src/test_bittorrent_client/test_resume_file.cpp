@@ -0,0 +1,243 @@
+#include "resume_file.h"
+#include "files_list.h"
+#include "files_on_disk.h"
+#include "test_torrent.h"
+
+#include <gtest/gtest.h>
+
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <cstdint>
+
+namespace
+{
+    // 3 pieces, 2 blocks each.
+    const std::uint32_t k_piece_size = 2 * k_resume_block_size;
+    const std::uint64_t k_total_size = 3 * k_piece_size;
+
+    std::vector<std::uint8_t> ReadBytes(const std::filesystem::path& path)
+    {
+        std::ifstream in(path, std::ios::binary);
+        return std::vector<std::uint8_t>(std::istreambuf_iterator<char>(in)
+            , std::istreambuf_iterator<char>());
+    }
+
+    void WriteBytes(const std::filesystem::path& path, const std::vector<std::uint8_t>& bytes)
+    {
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        out.write(reinterpret_cast<const char*>(bytes.data()), std::streamsize(bytes.size()));
+    }
+
+    void AppendBig(std::vector<std::uint8_t>& bytes, std::uint64_t v, std::size_t size)
+    {
+        for (std::size_t i = size; i > 0; --i)
+        {
+            bytes.push_back(std::uint8_t(v >> ((i - 1) * 8)));
+        }
+    }
+
+    // "BTRESUM1", info hash, generation.
+    std::uint64_t ReadGeneration(const std::filesystem::path& snapshot_path)
+    {
+        const std::vector<std::uint8_t> bytes = ReadBytes(snapshot_path);
+        std::uint64_t generation = 0;
+        for (std::size_t i = 8 + 20; (i < 8 + 20 + 8) && (i < bytes.size()); ++i)
+        {
+            generation = ((generation << 8) | bytes[i]);
+        }
+        return generation;
+    }
+
+    struct JournalRecord
+    {
+        std::uint8_t kind_ = 0;
+        std::uint32_t piece_index_ = 0;
+        std::uint32_t block_index_ = 0;
+    };
+    const std::uint8_t k_piece_completed = 1;
+    const std::uint8_t k_block_received = 2;
+
+    std::vector<std::uint8_t> MakeJournal(std::uint64_t generation
+        , const std::vector<JournalRecord>& records)
+    {
+        const std::string magic = "BTJOURN1";
+        std::vector<std::uint8_t> bytes(magic.begin(), magic.end());
+        AppendBig(bytes, generation, 8);
+        for (const JournalRecord& record : records)
+        {
+            bytes.push_back(record.kind_);
+            AppendBig(bytes, record.piece_index_, 4);
+            AppendBig(bytes, record.block_index_, 4);
+        }
+        return bytes;
+    }
+
+    class ResumeFileTest : public ::testing::Test
+    {
+    protected:
+        void SetUp() override
+        {
+            const ::testing::TestInfo* test = ::testing::UnitTest::GetInstance()->current_test_info();
+            root_ = std::filesystem::temp_directory_path()
+                / (std::string("test_resume_file_") + test->name());
+            std::filesystem::remove_all(root_);
+            std::filesystem::create_directories(root_);
+            std::ofstream data(root_ / "data.bin", std::ios::binary);
+            data.seekp(std::streamoff(k_total_size - 1));
+            data.put('\0');
+
+            StorageOptions options;
+            options.root_dir_ = root_;
+            files_ = std::make_unique<FilesOnDisk>(files_list_, options);
+            path_ = ResumeFilePath(options, torrent_);
+            journal_path_ = path_;
+            journal_path_ += ".journal";
+        }
+
+        void TearDown() override
+        {
+            files_.reset();
+            std::error_code ec;
+            std::filesystem::remove_all(root_, ec);
+        }
+
+        // As after the restart of the client.
+        ResumeData reload()
+        {
+            ResumeFile resume(path_, *files_);
+            return resume.load();
+        }
+
+        const be::TorrentClient torrent_ = MakeTestTorrent(k_piece_size, k_total_size);
+        const FilesList files_list_ = FilesList::make(torrent_);
+        std::unique_ptr<FilesOnDisk> files_;
+        std::filesystem::path root_;
+        std::filesystem::path path_;
+        std::filesystem::path journal_path_;
+    };
+} // namespace
+
+TEST_F(ResumeFileTest, NothingWithoutResumeData)
+{
+    const ResumeData data = reload();
+    ASSERT_EQ(data.have_pieces_, std::vector<bool>(3, false));
+    ASSERT_TRUE(data.partial_pieces_.empty());
+    // File exists, but nothing is known about it.
+    ASSERT_EQ(data.unverified_files_, std::vector<bool>({true}));
+}
+
+TEST_F(ResumeFileTest, SnapshotRoundTrip)
+{
+    {
+        ResumeFile resume(path_, *files_);
+        (void)resume.load();
+        ASSERT_TRUE(resume.on_piece_completed(0));
+        ASSERT_TRUE(resume.on_block_received(2, k_resume_block_size));
+        ASSERT_TRUE(resume.compact());
+    }
+    const ResumeData data = reload();
+    ASSERT_EQ(data.have_pieces_, std::vector<bool>({true, false, false}));
+    ASSERT_EQ(data.partial_pieces_.size(), 1u);
+    ASSERT_EQ(data.partial_pieces_.at(2), std::vector<bool>({false, true}));
+    ASSERT_EQ(data.unverified_files_, std::vector<bool>({false}));
+}
+
+TEST_F(ResumeFileTest, JournalRoundTrip)
+{
+    {
+        ResumeFile resume(path_, *files_);
+        (void)resume.load();
+        ASSERT_TRUE(resume.on_block_received(1, 0));
+        ASSERT_TRUE(resume.on_piece_completed(2));
+        ASSERT_TRUE(resume.on_block_received(0, k_resume_block_size));
+    }
+    // Recorded in the journal only.
+    ASSERT_EQ(std::filesystem::file_size(journal_path_), 16u + 3 * 9u);
+    const ResumeData data = reload();
+    ASSERT_EQ(data.have_pieces_, std::vector<bool>({false, false, true}));
+    ASSERT_EQ(data.partial_pieces_.size(), 2u);
+    ASSERT_EQ(data.partial_pieces_.at(0), std::vector<bool>({false, true}));
+    ASSERT_EQ(data.partial_pieces_.at(1), std::vector<bool>({true, false}));
+    // Load compacts: everything is in the snapshot, journal is empty.
+    ASSERT_EQ(std::filesystem::file_size(journal_path_), 16u);
+    ASSERT_EQ(reload().have_pieces_, data.have_pieces_);
+}
+
+TEST_F(ResumeFileTest, TornLastRecordIgnored)
+{
+    {
+        ResumeFile resume(path_, *files_);
+        (void)resume.load();
+        ASSERT_TRUE(resume.on_piece_completed(0));
+        ASSERT_TRUE(resume.on_piece_completed(1));
+    }
+    std::vector<std::uint8_t> journal = ReadBytes(journal_path_);
+    ASSERT_EQ(journal.size(), 16u + 2 * 9u);
+    // Crash in the middle of the second record.
+    journal.resize(journal.size() - 4);
+    WriteBytes(journal_path_, journal);
+
+    const ResumeData data = reload();
+    ASSERT_EQ(data.have_pieces_, std::vector<bool>({true, false, false}));
+}
+
+TEST_F(ResumeFileTest, JournalOfOtherGenerationIgnored)
+{
+    {
+        ResumeFile resume(path_, *files_);
+        (void)resume.load();
+        ASSERT_TRUE(resume.on_piece_completed(0));
+        ASSERT_TRUE(resume.compact());
+    }
+    const std::uint64_t generation = ReadGeneration(path_);
+    ASSERT_GT(generation, 1u);
+
+    // Crash between snapshot rename and journal reset:
+    // journal of the previous generation stays.
+    WriteBytes(journal_path_, MakeJournal(generation - 1
+        , {{k_piece_completed, 2, 0}}));
+    ResumeData data = reload();
+    ASSERT_EQ(data.have_pieces_, std::vector<bool>({true, false, false}));
+
+    // Same records with the right generation are replayed.
+    WriteBytes(journal_path_, MakeJournal(ReadGeneration(path_)
+        , {{k_piece_completed, 2, 0}}));
+    data = reload();
+    ASSERT_EQ(data.have_pieces_, std::vector<bool>({true, false, true}));
+}
+
+TEST_F(ResumeFileTest, SameRecordTwice)
+{
+    {
+        ResumeFile resume(path_, *files_);
+        (void)resume.load();
+        ASSERT_TRUE(resume.on_piece_completed(0));
+        ASSERT_TRUE(resume.on_piece_completed(0));
+        ASSERT_TRUE(resume.on_block_received(1, 0));
+        ASSERT_TRUE(resume.on_block_received(1, 100));
+        // Piece is there already.
+        ASSERT_TRUE(resume.on_block_received(0, 0));
+    }
+    // Not journaled again.
+    ASSERT_EQ(std::filesystem::file_size(journal_path_), 16u + 2 * 9u);
+    ResumeData data = reload();
+    ASSERT_EQ(data.have_pieces_, std::vector<bool>({true, false, false}));
+    ASSERT_EQ(data.partial_pieces_.at(1), std::vector<bool>({true, false}));
+
+    // Replay is idempotent too.
+    WriteBytes(journal_path_, MakeJournal(ReadGeneration(path_)
+        , {{k_block_received, 2, 1}
+        , {k_block_received, 2, 1}
+        , {k_piece_completed, 1, 0}
+        , {k_piece_completed, 1, 0}
+        , {k_block_received, 1, 1}}));
+    data = reload();
+    ASSERT_EQ(data.have_pieces_, std::vector<bool>({true, true, false}));
+    ASSERT_EQ(data.partial_pieces_.size(), 1u);
+    ASSERT_EQ(data.partial_pieces_.at(2), std::vector<bool>({false, true}));
+}
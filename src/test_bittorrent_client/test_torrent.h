@@ -0,0 +1,25 @@
+#pragma once
+#include "torrent_client.h"
+
+#include <string>
+
+#include <cstdint>
+
+// Single-file torrent with the given layout; piece hashes are zeros.
+inline be::TorrentClient MakeTestTorrent(std::uint32_t piece_size
+    , std::uint64_t total_size
+    , std::string name = "data.bin")
+{
+    be::TorrentClient torrent;
+    be::TorrentMetainfo::Info& info = torrent.metainfo_.info_;
+    info.suggested_name_utf8_ = std::move(name);
+    info.piece_length_bytes_ = piece_size;
+    info.length_or_files_ = total_size;
+    const std::uint64_t pieces_count = (total_size + piece_size - 1) / piece_size;
+    info.pieces_SHA1_.resize(std::size_t(pieces_count * sizeof(SHA1Bytes)), 0);
+    for (std::size_t i = 0; i < sizeof(torrent.info_hash_.data_); ++i)
+    {
+        torrent.info_hash_.data_[i] = std::uint8_t(i);
+    }
+    return torrent;
+}
@@ -0,0 +1,174 @@
+#include "utils_http.h"
+
+#include <gtest/gtest.h>
+
+#include <string>
+#include <vector>
+
+namespace
+{
+    struct Decoded
+    {
+        bool ok_ = false;
+        bool done_ = false;
+        std::string content_;
+        // Not consumed by the decoder, e.g. the next response.
+        std::string extra_;
+    };
+
+    // Appends `reads` one by one, as they would arrive from the socket.
+    Decoded DecodeChunked(const std::vector<std::string>& reads)
+    {
+        Decoded decoded;
+        HTTPChunkedDecoder decoder;
+        std::string data;
+        for (const std::string& read : reads)
+        {
+            EXPECT_FALSE(decoded.done_);
+            data += read;
+            auto done = decoder.decode(data);
+            if (!done)
+            {
+                return decoded;
+            }
+            decoded.done_ = done.value();
+        }
+        decoded.ok_ = true;
+        decoded.content_ = data.substr(0, decoder.size_);
+        decoded.extra_ = data.substr(decoder.read_);
+        return decoded;
+    }
+} // namespace
+
+TEST(HTTPChunkedDecoder, WholeBody)
+{
+    const Decoded decoded = DecodeChunked({"5\r\nhello\r\n6\r\n world\r\n0\r\n\r\n"});
+    ASSERT_TRUE(decoded.ok_);
+    ASSERT_TRUE(decoded.done_);
+    ASSERT_EQ(decoded.content_, "hello world");
+    ASSERT_EQ(decoded.extra_, "");
+}
+
+TEST(HTTPChunkedDecoder, ChunkSplitAcrossReads)
+{
+    const Decoded decoded = DecodeChunked({"a\r\n01234", "56789\r\n0\r\n\r\n"});
+    ASSERT_TRUE(decoded.ok_);
+    ASSERT_TRUE(decoded.done_);
+    ASSERT_EQ(decoded.content_, "0123456789");
+}
+
+TEST(HTTPChunkedDecoder, CRLFSplitAcrossReads)
+{
+    const Decoded decoded = DecodeChunked({"5\r", "\nhello\r", "\n0\r\n\r", "\n"});
+    ASSERT_TRUE(decoded.ok_);
+    ASSERT_TRUE(decoded.done_);
+    ASSERT_EQ(decoded.content_, "hello");
+    ASSERT_EQ(decoded.extra_, "");
+}
+
+TEST(HTTPChunkedDecoder, NotDoneUntilLastChunk)
+{
+    const Decoded decoded = DecodeChunked({"5\r\nhello\r\n", "0\r\n"});
+    ASSERT_TRUE(decoded.ok_);
+    ASSERT_FALSE(decoded.done_);
+}
+
+TEST(HTTPChunkedDecoder, ChunkExtensionsIgnored)
+{
+    const Decoded decoded = DecodeChunked({"5;name=value\r\nhello\r\n0;last\r\n\r\n"});
+    ASSERT_TRUE(decoded.ok_);
+    ASSERT_TRUE(decoded.done_);
+    ASSERT_EQ(decoded.content_, "hello");
+}
+
+TEST(HTTPChunkedDecoder, TrailersSkipped)
+{
+    const Decoded decoded = DecodeChunked({"5\r\nhello\r\n0\r\nExpires: never\r\n"
+        , "X-Checksum: 1\r\n\r\nHTTP/1.1"});
+    ASSERT_TRUE(decoded.ok_);
+    ASSERT_TRUE(decoded.done_);
+    ASSERT_EQ(decoded.content_, "hello");
+    // Next response on the same connection.
+    ASSERT_EQ(decoded.extra_, "HTTP/1.1");
+}
+
+TEST(HTTPChunkedDecoder, BadChunkTerminator)
+{
+    ASSERT_FALSE(DecodeChunked({"5\r\nhelloXX0\r\n\r\n"}).ok_);
+    ASSERT_FALSE(DecodeChunked({"5\r\nhello\n0\r\n\r\n"}).ok_);
+}
+
+TEST(HTTPChunkedDecoder, BadChunkSize)
+{
+    ASSERT_FALSE(DecodeChunked({"x\r\nhello\r\n0\r\n\r\n"}).ok_);
+    ASSERT_FALSE(DecodeChunked({"\r\nhello\r\n0\r\n\r\n"}).ok_);
+}
+
+TEST(ParseHTTPResponseHead, ContentLength)
+{
+    auto head = ParseHTTPResponseHead("HTTP/1.1 200 OK\r\nContent-Length: 42");
+    ASSERT_TRUE(head);
+    ASSERT_EQ(head.value().status_code_, 200u);
+    ASSERT_TRUE(head.value().keep_alive_);
+    ASSERT_FALSE(head.value().chunked_);
+    ASSERT_FALSE(head.value().no_content_);
+    ASSERT_EQ(head.value().content_length_, 42u);
+}
+
+TEST(ParseHTTPResponseHead, SameContentLengthTwice)
+{
+    auto head = ParseHTTPResponseHead("HTTP/1.1 200 OK\r\n"
+        "Content-Length: 42\r\n"
+        "content-length: 42");
+    ASSERT_TRUE(head);
+    ASSERT_EQ(head.value().content_length_, 42u);
+}
+
+TEST(ParseHTTPResponseHead, ConflictingContentLength)
+{
+    ASSERT_FALSE(ParseHTTPResponseHead("HTTP/1.1 200 OK\r\n"
+        "Content-Length: 42\r\n"
+        "Content-Length: 43"));
+}
+
+TEST(ParseHTTPResponseHead, Chunked)
+{
+    auto head = ParseHTTPResponseHead("HTTP/1.1 200 OK\r\nTransfer-Encoding: gzip, Chunked");
+    ASSERT_TRUE(head);
+    ASSERT_TRUE(head.value().chunked_);
+}
+
+TEST(ParseHTTPResponseHead, ConnectionClose)
+{
+    auto head = ParseHTTPResponseHead("HTTP/1.1 200 OK\r\nConnection: close");
+    ASSERT_TRUE(head);
+    ASSERT_FALSE(head.value().keep_alive_);
+}
+
+TEST(ParseHTTPResponseHead, HTTP10)
+{
+    auto head = ParseHTTPResponseHead("HTTP/1.0 200 OK");
+    ASSERT_TRUE(head);
+    ASSERT_FALSE(head.value().keep_alive_);
+
+    head = ParseHTTPResponseHead("HTTP/1.0 200 OK\r\nConnection: Keep-Alive");
+    ASSERT_TRUE(head);
+    ASSERT_TRUE(head.value().keep_alive_);
+}
+
+TEST(ParseHTTPResponseHead, NoContent)
+{
+    auto head = ParseHTTPResponseHead("HTTP/1.1 304 Not Modified\r\nContent-Length: 42");
+    ASSERT_TRUE(head);
+    ASSERT_TRUE(head.value().no_content_);
+    head = ParseHTTPResponseHead("HTTP/1.1 204 No Content");
+    ASSERT_TRUE(head);
+    ASSERT_TRUE(head.value().no_content_);
+}
+
+TEST(ParseHTTPResponseHead, Malformed)
+{
+    ASSERT_FALSE(ParseHTTPResponseHead("ICY 200 OK"));
+    ASSERT_FALSE(ParseHTTPResponseHead("HTTP/1.1 2x0 OK"));
+    ASSERT_FALSE(ParseHTTPResponseHead("HTTP/1.1 200 OK\r\nno colon"));
+}
@@ -1,9 +1,203 @@
 #include <small_utils/utils_read_file.h>
+#include <small_utils/utils_sha1.h>
+#include <small_utils/utils_sha256.h>
 #include <small_utils/utils_string.h>
 
 #include <gtest/gtest.h>
 
+#include <random>
+#include <string>
+#include <vector>
+
+#include <cstdio>
+
 TEST(SmallUtils, Dummy)
 {
     ASSERT_TRUE(true);
 }
+
+template<std::size_t N, typename Tag>
+static std::string ToHex(const Buffer<N, Tag>& bytes)
+{
+    std::string hex;
+    for (std::uint8_t b : bytes.data_)
+    {
+        char tmp[3]{};
+        (void)snprintf(tmp, sizeof(tmp), "%02x", b);
+        hex += tmp;
+    }
+    return hex;
+}
+
+static std::vector<SHA1Backend> GetSupportedSHA1Backends()
+{
+    std::vector<SHA1Backend> backends;
+    for (SHA1Backend backend : {SHA1Backend::Scalar, SHA1Backend::SHA_NI, SHA1Backend::AVX2_x8})
+    {
+        if (IsSHA1BackendSupported(backend))
+        {
+            backends.push_back(backend);
+        }
+    }
+    return backends;
+}
+
+static std::string GetRandomData(std::mt19937& random, std::size_t size)
+{
+    std::string data(size, '\0');
+    for (char& c : data)
+    {
+        c = char(random());
+    }
+    return data;
+}
+
+TEST(SmallUtils, SHA1KnownValues)
+{
+    const std::string million(1'000'000, 'a');
+    const std::string_view abc = "abc";
+    const std::string_view two_blocks = "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq";
+    for (SHA1Backend backend : GetSupportedSHA1Backends())
+    {
+        const std::string_view views[] = {abc, two_blocks, million};
+        SHA1Bytes results[3];
+        GetSHA1Many(backend, views, results, 3);
+        ASSERT_EQ("a9993e364706816aba3e25717850c26c9cd0d89d", ToHex(results[0]));
+        ASSERT_EQ("84983e441c3bd26ebaae4aa1f95129e5e54670f1", ToHex(results[1]));
+        ASSERT_EQ("34aa973cd4c4daa4f61eeb2bdbad27316534016f", ToHex(results[2]));
+    }
+    ASSERT_EQ("a9993e364706816aba3e25717850c26c9cd0d89d", ToHex(GetSHA1(abc)));
+}
+
+TEST(SmallUtils, SHA1BackendsMatchScalar)
+{
+    std::mt19937 random(42);
+    std::vector<std::string> buffers;
+    // All tail sizes around the block boundary and a few pieces.
+    for (std::size_t size = 0; size < 200; ++size)
+    {
+        buffers.push_back(GetRandomData(random, size));
+    }
+    for (std::size_t size : {1000, 16384, 16385, 262144})
+    {
+        buffers.push_back(GetRandomData(random, size));
+    }
+    std::vector<std::string_view> views(buffers.begin(), buffers.end());
+    std::vector<SHA1Bytes> expected(views.size());
+    for (std::size_t i = 0; i < views.size(); ++i)
+    {
+        expected[i] = GetSHA1(SHA1Backend::Scalar, &views[i], 1);
+    }
+
+    for (SHA1Backend backend : GetSupportedSHA1Backends())
+    {
+        for (std::size_t i = 1; i < views.size(); ++i)
+        {
+            ASSERT_EQ(ToHex(expected[i]), ToHex(GetSHA1(backend, &views[i], 1)));
+        }
+        // Any count, mixed sizes.
+        for (std::size_t count : {1, 3, 8, 13})
+        {
+            std::vector<SHA1Bytes> actual(count);
+            const std::size_t first = (views.size() - count);
+            GetSHA1Many(backend, &views[first], actual.data(), count);
+            for (std::size_t i = 0; i < count; ++i)
+            {
+                ASSERT_EQ(ToHex(expected[first + i]), ToHex(actual[i]));
+            }
+        }
+    }
+
+    std::vector<SHA1Bytes> actual(views.size());
+    GetSHA1Many(views.data(), actual.data(), views.size());
+    for (std::size_t i = 1; i < views.size(); ++i)
+    {
+        ASSERT_EQ(ToHex(expected[i]), ToHex(actual[i]));
+    }
+    // Compatible with GetSHA1(std::string_view).
+    ASSERT_EQ(ToHex(SHA1Bytes()), ToHex(actual[0]));
+}
+
+TEST(SmallUtils, SHA1HasherChunks)
+{
+    std::mt19937 random(7);
+    const std::string data = GetRandomData(random, 100'000);
+    const SHA1Bytes expected = GetSHA1(std::string_view(data));
+    SHA1Hasher hasher;
+    for (int round = 0; round < 2; ++round)
+    {
+        std::size_t offset = 0;
+        while (offset < data.size())
+        {
+            const std::size_t size = std::min<std::size_t>(random() % 300, data.size() - offset);
+            hasher.update(data.data() + offset, size);
+            offset += size;
+        }
+        // Hasher is reusable after finalize().
+        ASSERT_EQ(ToHex(expected), ToHex(hasher.finalize()));
+    }
+}
+
+TEST(SmallUtils, SHA256KnownValues)
+{
+    ASSERT_EQ("e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855"
+        , ToHex(GetSHA256("")));
+    ASSERT_EQ("ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad"
+        , ToHex(GetSHA256("abc")));
+    ASSERT_EQ("248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1"
+        , ToHex(GetSHA256("abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq")));
+    ASSERT_EQ("cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0"
+        , ToHex(GetSHA256(std::string(1'000'000, 'a'))));
+}
+
+TEST(SmallUtils, SHA256HasherChunks)
+{
+    std::mt19937 random(7);
+    const std::string data = GetRandomData(random, 100'000);
+    const SHA256Bytes expected = GetSHA256(data);
+    for (std::size_t chunk : {1, 3, 63, 64, 65, 1000, 16384})
+    {
+        SHA256Hasher hasher;
+        for (std::size_t offset = 0; offset < data.size(); offset += chunk)
+        {
+            const std::size_t size = std::min(chunk, data.size() - offset);
+            hasher.update(data.data() + offset, size);
+        }
+        ASSERT_EQ(ToHex(expected), ToHex(hasher.finalize())) << chunk;
+    }
+}
+
+static SHA256Bytes HashPairForTest(const SHA256Bytes& left, const SHA256Bytes& right)
+{
+    const std::string_view parts[] =
+    {
+        {reinterpret_cast<const char*>(left.data_), sizeof(left.data_)},
+        {reinterpret_cast<const char*>(right.data_), sizeof(right.data_)},
+    };
+    return GetSHA256(parts, 2);
+}
+
+TEST(SmallUtils, MerkleRoot)
+{
+    std::mt19937 random(11);
+    const std::string data = GetRandomData(random, 2 * k_merkle_block_size + 100);
+    std::vector<SHA256Bytes> leaves;
+    GetMerkleLeaves(reinterpret_cast<const std::uint8_t*>(data.data()), data.size(), leaves);
+    ASSERT_EQ(3u, leaves.size());
+    ASSERT_EQ(ToHex(GetSHA256(std::string_view(data).substr(2 * k_merkle_block_size)))
+        , ToHex(leaves[2]));
+    ASSERT_EQ(4u, GetMerkleWidth(3));
+    ASSERT_EQ(1u, GetMerkleWidth(1));
+
+    const SHA256Bytes zero{};
+    const SHA256Bytes expected = HashPairForTest(
+          HashPairForTest(leaves[0], leaves[1])
+        , HashPairForTest(leaves[2], zero));
+    ASSERT_EQ(ToHex(expected), ToHex(GetMerkleRoot(leaves.data(), 3, 4)));
+    ASSERT_EQ(ToHex(leaves[0]), ToHex(GetMerkleRoot(leaves.data(), 1, 1)));
+
+    // Upper layers are padded with roots of zero subtrees.
+    const SHA256Bytes pad = GetMerklePadRoot(2);
+    ASSERT_EQ(ToHex(HashPairForTest(zero, zero)), ToHex(pad));
+    ASSERT_EQ(ToHex(HashPairForTest(leaves[0], pad)), ToHex(GetMerkleRoot(leaves.data(), 1, 2, pad)));
+}
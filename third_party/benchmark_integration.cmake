@@ -0,0 +1,4 @@
+add_library(benchmark_Integrated INTERFACE)
+find_package(benchmark CONFIG REQUIRED)
+target_link_libraries(benchmark_Integrated INTERFACE
+    benchmark::benchmark)
@@ -5,6 +5,8 @@ find_package(OpenSSL REQUIRED)
 target_link_libraries(OpenSSL_Integrated INTERFACE OpenSSL::SSL)
 target_link_libraries(OpenSSL_Integrated INTERFACE OpenSSL::Crypto)
 
-target_compile_options(OpenSSL_Integrated INTERFACE
-	/wd4996
-	)
+if (MSVC)
+	target_compile_options(OpenSSL_Integrated INTERFACE
+		/wd4996
+		)
+endif()